@@ -3,6 +3,7 @@ import os
 import tempfile
 
 from memray import AllocatorType
+from memray import FileDestination
 from memray import FileReader
 
 try:
@@ -158,6 +159,31 @@ class HighWatermarkBenchmarks:
         )
 
 
+class TemporaryAllocationsBenchmarks:
+    params = [1, 10, 100, 1000, 10000]
+    param_names = ["threshold"]
+
+    def setup(self, threshold):
+        self.tempfile = tempfile.NamedTemporaryFile()
+        os.unlink(self.tempfile.name)
+        allocators = [MemoryAllocator() for _ in range(1000)]
+
+        with Tracker(self.tempfile.name):
+            for _ in range(20):
+                for allocator in allocators:
+                    allocator.valloc(1234)
+                # Oldest first, so matching them has to look far back.
+                for allocator in allocators:
+                    allocator.free()
+
+    def time_temporary_allocations(self, threshold):
+        list(
+            FileReader(self.tempfile.name).get_temporary_allocation_records(
+                threshold=threshold
+            )
+        )
+
+
 class MacroBenchmarksBase:
     def __init_subclass__(cls) -> None:
         for name in dir(cls):
@@ -165,35 +191,35 @@ class MacroBenchmarksBase:
                 bench_name = name[len("bench_") :]
                 setattr(cls, f"time_{bench_name}", getattr(cls, name))
 
-    def bench_async_tree_cpu(self):
+    def bench_async_tree_cpu(self, *params):
         with self.tracker:
             async_tree_base.run_benchmark("none")
 
-    def bench_async_tree_io(self):
+    def bench_async_tree_io(self, *params):
         with self.tracker:
             async_tree_base.run_benchmark("io")
 
-    def bench_async_tree_memoization(self):
+    def bench_async_tree_memoization(self, *params):
         with self.tracker:
             async_tree_base.run_benchmark("memoization")
 
-    def bench_async_tree_cpu_io_mixed(self):
+    def bench_async_tree_cpu_io_mixed(self, *params):
         with self.tracker:
             async_tree_base.run_benchmark("cpu_io_mixed")
 
-    def bench_fannkuch(self):
+    def bench_fannkuch(self, *params):
         with self.tracker:
             fannkuch_base.run_benchmark()
 
-    def bench_mdp(self):
+    def bench_mdp(self, *params):
         with self.tracker:
             mdp_base.run_benchmark()
 
-    def bench_pprint_format(self):
+    def bench_pprint_format(self, *params):
         with self.tracker:
             pprint_format_base.run_benchmark()
 
-    def bench_raytrace(self):
+    def bench_raytrace(self, *params):
         with self.tracker:
             raytrace_base.run_benchmark()
 
@@ -226,48 +252,65 @@ class MacroBenchmarksPythonAll(MacroBenchmarksBase):
         self.tracker = Tracker(*self.tracker_args, **self.tracker_kwargs)
 
 
+class MacroBenchmarksFileSinks(MacroBenchmarksBase):
+    params = ["mmap", "io_uring", "pwrite"]
+    param_names = ["io_backend"]
+
+    def setup(self, io_backend):
+        self.tempfile = tempfile.NamedTemporaryFile()
+        os.unlink(self.tempfile.name)
+        destination = FileDestination(
+            self.tempfile.name, compress_on_exit=False, io_backend=io_backend
+        )
+        self.tracker = Tracker(destination=destination)
+
+
 class FileSizeBenchmarks:
-    def setup(self):
+    params = ["mmap", "io_uring", "pwrite"]
+    param_names = ["io_backend"]
+
+    def setup(self, io_backend):
         self.tempfile = tempfile.NamedTemporaryFile()
         os.unlink(self.tempfile.name)
-        self.tracker = Tracker(self.tempfile.name)
+        destination = FileDestination(self.tempfile.name, io_backend=io_backend)
+        self.tracker = Tracker(destination=destination)
 
-    def track_async_tree_cpu(self):
+    def track_async_tree_cpu(self, io_backend):
         with self.tracker:
             async_tree_base.run_benchmark("none")
         return os.stat(self.tempfile.name).st_size
 
-    def track_async_tree_io(self):
+    def track_async_tree_io(self, io_backend):
         with self.tracker:
             async_tree_base.run_benchmark("io")
         return os.stat(self.tempfile.name).st_size
 
-    def track_async_tree_memoization(self):
+    def track_async_tree_memoization(self, io_backend):
         with self.tracker:
             async_tree_base.run_benchmark("memoization")
         return os.stat(self.tempfile.name).st_size
 
-    def track_async_tree_cpu_io_mixed(self):
+    def track_async_tree_cpu_io_mixed(self, io_backend):
         with self.tracker:
             async_tree_base.run_benchmark("cpu_io_mixed")
         return os.stat(self.tempfile.name).st_size
 
-    def track_fannkuch(self):
+    def track_fannkuch(self, io_backend):
         with self.tracker:
             fannkuch_base.run_benchmark()
         return os.stat(self.tempfile.name).st_size
 
-    def track_mdp(self):
+    def track_mdp(self, io_backend):
         with self.tracker:
             mdp_base.run_benchmark()
         return os.stat(self.tempfile.name).st_size
 
-    def track_pprint_format(self):
+    def track_pprint_format(self, io_backend):
         with self.tracker:
             pprint_format_base.run_benchmark()
         return os.stat(self.tempfile.name).st_size
 
-    def track_raytrace(self):
+    def track_raytrace(self, io_backend):
         with self.tracker:
             raytrace_base.run_benchmark()
         return os.stat(self.tempfile.name).st_size
@@ -213,15 +213,15 @@ if MEMRAY_FAST_TLS:
 BINARY_FORMATS = {"darwin": "macho", "linux": "elf"}
 BINARY_FORMAT = BINARY_FORMATS.get(sys.platform, "elf")
 
-library_flags = {"libraries": ["lz4"]}
+library_flags = {"libraries": ["lz4", "zstd"]}
 if IS_LINUX:
     library_flags["libraries"].append("unwind")
 
 try:
     if IS_LINUX:
-        library_flags = pkgconfig.parse("liblz4 libunwind")
+        library_flags = pkgconfig.parse("liblz4 libzstd libunwind")
     else:
-        library_flags = pkgconfig.parse("liblz4")
+        library_flags = pkgconfig.parse("liblz4 libzstd")
 except EnvironmentError as e:
     print("pkg-config not found.", e)
     print("Falling back to static flags.")
@@ -234,6 +234,7 @@ MEMRAY_EXTENSION = Extension(
     sources=[
         "src/memray/_memray.pyx",
         "src/memray/_memray/compat.cpp",
+        "src/memray/_memray/compression.cpp",
         "src/memray/_memray/hooks.cpp",
         "src/memray/_memray/tracking_api.cpp",
         f"src/memray/_memray/{BINARY_FORMAT}_shenanigans.cpp",
@@ -246,6 +247,9 @@ MEMRAY_EXTENSION = Extension(
         "src/memray/_memray/record_writer.cpp",
         "src/memray/_memray/snapshot.cpp",
         "src/memray/_memray/socket_reader_thread.cpp",
+        "src/memray/_memray/live_broker.cpp",
+        "src/memray/_memray/pipelined_reader.cpp",
+        "src/memray/_memray/flamegraph_builder.cpp",
         "src/memray/_memray/native_resolver.cpp",
     ],
     language="c++",
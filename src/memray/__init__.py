@@ -3,9 +3,14 @@ from ._memray import AllocationRecord
 from ._memray import AllocatorType
 from ._memray import Destination
 from ._memray import FileDestination
+from ._memray import FileFollower
 from ._memray import FileFormat
 from ._memray import FileReader
+from ._memray import LiveBroker
 from ._memray import MemorySnapshot
+from ._memray import ProcessGroupReader
+from ._memray import SharedMemoryDestination
+from ._memray import SharedMemoryReader
 from ._memray import SocketDestination
 from ._memray import SocketReader
 from ._memray import Tracker
@@ -24,10 +29,15 @@ __all__ = [
     "start_thread_trace",
     "Tracker",
     "FileReader",
+    "FileFollower",
     "SocketReader",
+    "SharedMemoryReader",
+    "ProcessGroupReader",
+    "LiveBroker",
     "Destination",
     "FileDestination",
     "SocketDestination",
+    "SharedMemoryDestination",
     "Metadata",
     "__version__",
     "set_log_level",
@@ -2,6 +2,43 @@ import pathlib
 import typing
 from dataclasses import dataclass
 
+IO_BACKENDS = ("mmap", "io_uring", "pwrite")
+
+BACKPRESSURE_POLICIES = ("block", "drop", "aggregate")
+
+LIVE_TRANSPORTS = ("socket", "shm")
+
+COMPRESSION_LEVELS = {
+    "lz4": range(0, 13),
+    "zstd": range(1, 23),
+}
+
+
+def parse_compression(spec: str) -> typing.Tuple[str, int]:
+    """Split a ``codec[:level]`` compression spec into its codec and level.
+
+    A level of 0 means that the codec's default level should be used.
+    """
+    codec, _, level_str = spec.partition(":")
+    if codec not in COMPRESSION_LEVELS:
+        choices = ", ".join(sorted(COMPRESSION_LEVELS))
+        raise ValueError(
+            f"Unknown compression codec {codec!r} (expected one of: {choices})"
+        )
+    if not level_str:
+        return codec, 0
+    try:
+        level = int(level_str)
+    except ValueError:
+        raise ValueError(f"Invalid compression level {level_str!r}") from None
+    levels = COMPRESSION_LEVELS[codec]
+    if level not in levels:
+        raise ValueError(
+            f"Compression level for {codec} must be between"
+            f" {levels.start} and {levels.stop - 1}"
+        )
+    return codec, level
+
 
 @dataclass(frozen=True)
 class Destination:
@@ -17,11 +54,38 @@ class FileDestination(Destination):
         overwrite: By default, if a file already exists at that path an
             exception will be raised. If you provide ``overwrite=True``, then
             the existing file will be overwritten instead.
+        compress_on_exit: Whether to compress the output file once tracking
+            completes.
+        compression: The codec used to compress the output file, optionally
+            followed by a compression level, like ``"lz4"`` or ``"zstd:19"``.
+            LZ4 is the fastest, while zstd produces considerably smaller files.
+        compression_dictionary: The path to a dictionary trained with
+            ``zstd --train`` to improve the zstd compression ratio. The
+            dictionary is embedded in the compressed file.
+        io_backend: How records are written to the output file. ``"mmap"``
+            (the default) writes them through a memory mapping of the file.
+            ``"io_uring"`` buffers them in memory and writes them with
+            asynchronous io_uring requests. ``"pwrite"`` buffers them in memory
+            and writes them from a background thread, and is also used when
+            io_uring is not available.
     """
 
     path: typing.Union[pathlib.Path, str]
     overwrite: bool = False
     compress_on_exit: bool = True
+    compression: str = "lz4"
+    compression_dictionary: typing.Optional[typing.Union[pathlib.Path, str]] = None
+    io_backend: str = "mmap"
+
+    def __post_init__(self) -> None:
+        if self.io_backend not in IO_BACKENDS:
+            choices = ", ".join(IO_BACKENDS)
+            raise ValueError(
+                f"Unknown I/O backend {self.io_backend!r} (expected one of: {choices})"
+            )
+        codec, _ = parse_compression(self.compression)
+        if self.compression_dictionary is not None and codec != "zstd":
+            raise ValueError("A compression dictionary can only be used with zstd")
 
 
 @dataclass(frozen=True)
@@ -45,7 +109,64 @@ class SocketDestination(Destination):
             :ref:`Native Tracking`, because the client on the remote machine
             won't have access to the shared libraries used by the tracked
             process.
+        backpressure: What to do when the client can't keep up with the
+            tracked process and the buffer of records waiting to be sent fills
+            up. ``"block"`` (the default) makes the tracked process wait for
+            the client. ``"drop"`` drops allocation records, and tells the
+            client how many were dropped. ``"aggregate"`` summarizes
+            allocation records made from the same location into a single
+            record, and subtracts them from their location again once they're
+            freed.
+        buffer_size: The size in bytes of the buffer of records waiting to be
+            sent to the client.
+        children_port: The port a `ProcessGroupReader` listens on for
+            processes forked by the tracked process. If it's set and the
+            `Tracker` is created with ``follow_fork=True``, each forked process
+            connects to it and sends its own records to the reader.
     """
 
     server_port: int
     address: str = "127.0.0.1"
+    backpressure: str = "block"
+    buffer_size: int = 16 * 1024 * 1024
+    children_port: typing.Optional[int] = None
+
+    def __post_init__(self) -> None:
+        if self.backpressure not in BACKPRESSURE_POLICIES:
+            choices = ", ".join(BACKPRESSURE_POLICIES)
+            raise ValueError(
+                f"Unknown backpressure policy {self.backpressure!r}"
+                f" (expected one of: {choices})"
+            )
+        if self.buffer_size <= 0:
+            raise ValueError("The buffer size must be a positive number of bytes")
+        if self.children_port is not None and not 2**16 > self.children_port > 0:
+            raise ValueError(f"Invalid children port: {self.children_port}")
+
+
+@dataclass(frozen=True)
+class SharedMemoryDestination(Destination):
+    """Specify a shared memory ring to write captured allocations into.
+
+    This is a faster alternative to `SocketDestination` for a reader running
+    on the same Linux host as the tracked process. The ring is created by a
+    `SharedMemoryReader`, and the path to pass here is its ``path``
+    attribute. Both processes must be run by the same user.
+
+    Args:
+        path: The path to the ring created by the reader.
+        backpressure: What to do when the reader can't keep up with the
+            tracked process and the ring fills up. This accepts the same
+            policies as `SocketDestination`.
+    """
+
+    path: str
+    backpressure: str = "block"
+
+    def __post_init__(self) -> None:
+        if self.backpressure not in BACKPRESSURE_POLICIES:
+            choices = ", ".join(BACKPRESSURE_POLICIES)
+            raise ValueError(
+                f"Unknown backpressure policy {self.backpressure!r}"
+                f" (expected one of: {choices})"
+            )
@@ -3,6 +3,8 @@ from pathlib import Path
 from types import FrameType
 from types import TracebackType
 from typing import Any
+from typing import Callable
+from typing import Dict
 from typing import Iterable
 from typing import Iterator
 from typing import List
@@ -10,16 +12,20 @@ from typing import NamedTuple
 from typing import Optional
 from typing import Tuple
 from typing import Type
+from typing import TypeVar
 from typing import Union
 from typing import overload
 
 from memray._destination import FileDestination as FileDestination
+from memray._destination import SharedMemoryDestination as SharedMemoryDestination
 from memray._destination import SocketDestination as SocketDestination
 from memray._metadata import Metadata
 from memray._stats import Stats
 
 from . import Destination
 
+_Reporter = TypeVar("_Reporter")
+
 PythonStackElement = Tuple[str, str, int]
 NativeStackElement = Tuple[str, str, int]
 MemorySnapshot = NamedTuple(
@@ -106,6 +112,12 @@ class TemporalAllocationRecord:
     def __hash__(self) -> Any: ...
     intervals: List[Interval]
 
+def stack_traces(
+    allocations: Iterable[Union[AllocationRecord, TemporalAllocationRecord]],
+    *,
+    native_traces: bool = ...,
+) -> List[List[Union[PythonStackElement, NativeStackElement]]]: ...
+
 class AllocatorType(enum.IntEnum):
     MALLOC: int
     FREE: int
@@ -138,6 +150,8 @@ class FileReader:
         *,
         report_progress: bool = False,
         max_memory_records: int = 10000,
+        collect_statistics: bool = False,
+        use_index: bool = False,
     ) -> None: ...
     def get_allocation_records(self) -> Iterable[AllocationRecord]: ...
     def get_temporal_allocation_records(
@@ -159,6 +173,15 @@ class FileReader:
         self, merge_threads: bool = ..., threshold: int = ...
     ) -> Iterable[AllocationRecord]: ...
     def get_memory_snapshots(self) -> Iterable[MemorySnapshot]: ...
+    def get_statistics(self, *, num_largest: int = ...) -> Stats: ...
+    def create_reporters(
+        self,
+        reporter_factories: Iterable[Callable[..., _Reporter]],
+        *,
+        show_memory_leaks: bool = ...,
+        merge_threads: bool = ...,
+        inverted: bool = ...,
+    ) -> List[_Reporter]: ...
     def __enter__(self) -> Any: ...
     def __exit__(
         self,
@@ -176,6 +199,17 @@ def compute_statistics(
     report_progress: bool = False,
     num_largest: int = 5,
 ) -> Stats: ...
+def build_flame_graph_data(
+    allocations: Iterable[Any],
+    *,
+    native_traces: bool,
+    temporal: bool,
+    inverted: bool,
+    max_stacks: int,
+    describe_frame: Callable[[PythonStackElement], Any],
+    prune_fraction: float = 0.0,
+) -> Dict[str, Any]: ...
+def encode_compact_column(values: Iterable[int]) -> str: ...
 def dump_all_records(file_name: Union[str, Path]) -> None: ...
 
 class SocketReader:
@@ -190,6 +224,12 @@ class SocketReader:
     def get_current_snapshot(
         self, *, merge_threads: bool
     ) -> Iterator[AllocationRecord]: ...
+    def get_current_snapshot_by_location(
+        self, *, memory_ratio: float = ...
+    ) -> Tuple[
+        List[AllocationRecord],
+        List[Tuple[str, str, int, int, int, Tuple[int, ...]]],
+    ]: ...
     @property
     def command_line(self) -> Optional[str]: ...
     @property
@@ -198,6 +238,53 @@ class SocketReader:
     def pid(self) -> Optional[int]: ...
     @property
     def has_native_traces(self) -> bool: ...
+    @property
+    def dropped_allocations(self) -> int: ...
+
+class SharedMemoryReader(SocketReader):
+    def __init__(self, buffer_size: int = ...) -> None: ...
+    def __enter__(self) -> "SharedMemoryReader": ...
+    @property
+    def path(self) -> str: ...
+
+class FileFollower(SocketReader):
+    def __init__(self, file_name: Union[Path, str]) -> None: ...
+    def __enter__(self) -> "FileFollower": ...
+    def get_current_statistics(self, *, num_largest: int = ...) -> Optional[Stats]: ...
+
+class ProcessGroupReader:
+    def __init__(self, reader: SocketReader) -> None: ...
+    def __enter__(self) -> "ProcessGroupReader": ...
+    def __exit__(
+        self,
+        exc_type: Optional[Type[BaseException]],
+        exc_value: Optional[BaseException],
+        exc_traceback: Optional[TracebackType],
+    ) -> Any: ...
+    @property
+    def children_port(self) -> int: ...
+    @property
+    def readers(self) -> List[SocketReader]: ...
+    @property
+    def is_active(self) -> bool: ...
+
+class LiveBroker:
+    def __init__(
+        self, reader: SocketReader, port: int = ..., host: str = ...
+    ) -> None: ...
+    def __enter__(self) -> "LiveBroker": ...
+    def __exit__(
+        self,
+        exc_type: Optional[Type[BaseException]],
+        exc_value: Optional[BaseException],
+        exc_traceback: Optional[TracebackType],
+    ) -> Any: ...
+    @property
+    def port(self) -> Optional[int]: ...
+    @property
+    def is_active(self) -> bool: ...
+    @property
+    def client_count(self) -> int: ...
 
 class Tracker:
     @property
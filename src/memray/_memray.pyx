@@ -2,10 +2,13 @@ import collections
 import contextlib
 import os
 import pathlib
+import select
+import socket
 import sys
 
 cimport cython
 
+import tempfile
 import threading
 from datetime import datetime
 
@@ -17,22 +20,39 @@ from posix.time cimport CLOCK_MONOTONIC
 from posix.time cimport clock_gettime
 from posix.time cimport timespec
 
-from _memray.algorithm cimport count
+from _memray.flamegraph_builder cimport FlameGraphBuilder
+from _memray.flamegraph_builder cimport FlameGraphNodes
+from _memray.flamegraph_builder cimport encodeCompactColumn
 from _memray.hooks cimport Allocator
 from _memray.hooks cimport isDeallocator
+from _memray.live_broker cimport LiveBroker as NativeLiveBroker
 from _memray.logging cimport setLogThreshold
 from _memray.native_resolver cimport unwindHere
+from _memray.pipelined_reader cimport PipelinedRecordReader
+from _memray.pipelined_reader cimport RecordBatch
 from _memray.record_reader cimport RecordReader
 from _memray.record_reader cimport RecordResult
+from _memray.record_reader cimport StackFrame
 from _memray.record_writer cimport RecordWriter
+from _memray.record_writer cimport createLiveAggregatingRecordWriter
 from _memray.record_writer cimport createRecordWriter
 from _memray.records cimport AggregatedAllocation
 from _memray.records cimport Allocation as _Allocation
 from _memray.records cimport FileFormat as _FileFormat
+from _memray.records cimport HeaderRecord
+from _memray.records cimport IndexedCapture
+from _memray.records cimport MAGIC
 from _memray.records cimport MemoryRecord
 from _memray.records cimport MemorySnapshot as _MemorySnapshot
+from _memray.records cimport thread_id_t
+from _memray.sink cimport AsyncFileSink
+from _memray.sink cimport AsyncFileSinkBackend
+from _memray.sink cimport BackpressurePolicy
+from _memray.sink cimport CompressionCodec
+from _memray.sink cimport CompressionOptions
 from _memray.sink cimport FileSink
 from _memray.sink cimport NullSink
+from _memray.sink cimport SharedMemorySink
 from _memray.sink cimport Sink
 from _memray.sink cimport SocketSink
 from _memray.snapshot cimport NO_THREAD_INFO
@@ -41,22 +61,27 @@ from _memray.snapshot cimport AggregatedCaptureReaggregator
 from _memray.snapshot cimport AllocationLifetime
 from _memray.snapshot cimport AllocationLifetimeAggregator
 from _memray.snapshot cimport AllocationStatsAggregator
-from _memray.snapshot cimport HighWatermark
 from _memray.snapshot cimport HighWaterMarkAggregator
-from _memray.snapshot cimport HighWatermarkFinder
 from _memray.snapshot cimport HighWaterMarkLocationKey
+from _memray.snapshot cimport IncrementalSnapshotAggregator
+from _memray.snapshot cimport IncrementalSnapshotAggregatorChanges
 from _memray.snapshot cimport Py_GetSnapshotAllocationRecords
 from _memray.snapshot cimport Py_ListFromSnapshotAllocationRecords
 from _memray.snapshot cimport SnapshotAllocationAggregator
 from _memray.snapshot cimport TemporaryAllocationsAggregator
 from _memray.socket_reader_thread cimport BackgroundSocketReader
+from _memray.socket_reader_thread cimport Statistics
 from _memray.source cimport FileSource
+from _memray.source cimport SharedMemorySource
 from _memray.source cimport SocketSource
+from _memray.source cimport Source
 from _memray.tracking_api cimport Tracker as NativeTracker
 from _memray.tracking_api cimport install_trace_function
 from cpython cimport PyErr_CheckSignals
 from libc.math cimport ceil
+from libc.stdint cimport int64_t
 from libc.stdint cimport uint64_t
+from libc.stdint cimport uintptr_t
 from libcpp cimport bool
 from libcpp.limits cimport numeric_limits
 from libcpp.memory cimport make_shared
@@ -66,11 +91,14 @@ from libcpp.memory cimport unique_ptr
 from libcpp.string cimport string as cppstring
 from libcpp.unordered_map cimport unordered_map
 from libcpp.utility cimport move
+from libcpp.utility cimport pair
 from libcpp.vector cimport vector
 
 from ._destination import Destination
 from ._destination import FileDestination
+from ._destination import SharedMemoryDestination
 from ._destination import SocketDestination
+from ._destination import parse_compression
 from ._metadata import Metadata
 from ._stats import Stats
 
@@ -175,77 +203,18 @@ cdef hybrid_stack_trace(
     generation,
     max_stacks=None,
 ):
-    # This function merges a Python stack and a native stack into
-    # a "hybrid" stack. It substitutes _PyFrame_EvalFrameDefault calls in
-    # the native stack with the corresponding frame in the Python stack.
-    # This sounds easy, but there are several tricky aspects:
-    # 1. For the thread that called Tracker.__enter__, we want to hide
-    #    frames (both Python and C) above the one that made that call.
-    #    For other threads we want to keep all frames.
-    # 2. If _PyFrame_EvalFrameDefault allocates memory before calling our
-    #    profile function, we'll have too few Python frames to pair up
-    #    every _PyFrame_EvalFrameDefault call. This happens in 3.11.
-    # 3. Since Python 3.11, one _PyFrame_EvalFrameDefault call can evaluate
-    #    many Python frames. If a frame's is_entry_frame flag is unset, it
-    #    uses the same _PyFrame_EvalFrameDefault call as its caller.
-    # 4. If the interpreter was stripped, we may not be able to recognize
-    #    every (or even any) _PyFrame_EvalFrameDefault call, so we may
-    #    have extra Python frames left after pairing.
-    cdef vector[unsigned char] is_entry_frame
-    native_stack = native_stack_trace(reader, allocator, native_stack_id, generation)
-    python_stack = reader.Py_GetStackFrameAndEntryInfo(python_stack_id, &is_entry_frame)
-
-    cdef ssize_t num_non_entry_frames = count(
-        is_entry_frame.begin(), is_entry_frame.end(), 0
-    )
-
-    # Entry frames replace native frames; non-entry frames are inserted.
-    hybrid_stack = [None] * (len(native_stack) + num_non_entry_frames)
-
-    # Both stacks are from most recent to least, but we must pair things up
-    # least recent to most to handle cases where _PyFrame_EvalFrameDefault
-    # allocated memory before calling the profile function.
-    native_stack.reverse()
-    cdef ssize_t pidx = len(python_stack) - 1
-    cdef ssize_t hidx = len(hybrid_stack) - 1
-
-    cdef ssize_t to_skip = 0
-    if tid == reader.getMainThreadTid():
-        to_skip = reader.getSkippedFramesOnMainThread()
-    cdef ssize_t first_kept_frame = pidx - to_skip
-
-    for native_frame in native_stack:
-        symbol = native_frame[0]
-        if pidx >= 0 and "_PyEval_EvalFrameDefault" in symbol:
-            while True:
-                # If we're not keeping all frames and we've reached the
-                # first one we want to keep, remove frames above it.
-                if to_skip != 0 and pidx == first_kept_frame:
-                    del hybrid_stack[hidx + 1:]
-
-                assert hidx >= 0
-                hybrid_stack[hidx] = python_stack[pidx]
-                hidx -= 1
-                pidx -= 1
-
-                # Stop when we either run out of Python frames or reach the
-                # entry frame being evaluated by the next eval loop.
-                if pidx < 0 or is_entry_frame[pidx]:
-                    break
-        else:
-            assert hidx >= 0
-            hybrid_stack[hidx] = native_frame
-            hidx -= 1
-
-    if pidx >= 0:
-        # We ran out of native frames without using up all of our Python
-        # frames. We've seen this happen on stripped interpreters on Alpine
-        # Linux in CI. Presumably this indicates that unwinding failed to
-        # symbolify some of the calls to _PyEval_EvalFrameDefault.
-        return python_stack
-    assert hidx == -1
+    if allocator in (AllocatorType.FREE, AllocatorType.MUNMAP):
+        raise NotImplementedError("Stack traces for deallocations aren't captured.")
 
-    return hybrid_stack[:max_stacks]
+    assert reader != NULL, "Cannot get stack trace without reader."
+    cdef bool is_main_thread = tid == reader.getMainThreadTid()
+    if max_stacks is None:
+        return reader.Py_GetHybridStackFrame(
+            python_stack_id, native_stack_id, generation, is_main_thread
+        )
+    return reader.Py_GetHybridStackFrame(
+        python_stack_id, native_stack_id, generation, is_main_thread, max_stacks
+    )
 
 
 @cython.freelist(1024)
@@ -499,6 +468,64 @@ cdef create_temporal_allocation_record(
     return alloc
 
 
+cdef RecordReader* _record_reader(record):
+    if type(record) is AllocationRecord:
+        return (<AllocationRecord>record)._reader.get()
+    if type(record) is TemporalAllocationRecord:
+        return (<TemporalAllocationRecord>record)._reader.get()
+    return NULL
+
+
+cdef dict _record_stack_trace_cache(record):
+    if type(record) is AllocationRecord:
+        return (<AllocationRecord>record)._stack_trace_cache
+    return (<TemporalAllocationRecord>record)._stack_trace_cache
+
+
+def stack_traces(allocations, *, bool native_traces=False):
+    """Return the stack trace of each of the allocation records.
+
+    This gives the same stacks as calling each record's stack_trace() or
+    hybrid_stack_trace() method, but the Python stacks of the records read by
+    the same reader are all materialized in one call.
+    """
+    cdef list records = list(allocations)
+    cdef list stacks = [None] * len(records)
+    cdef dict positions_by_reader = {}
+    cdef RecordReader* reader
+    cdef vector[unsigned int] indexes
+    cdef ssize_t to_skip
+
+    for i, record in enumerate(records):
+        if native_traces:
+            stacks[i] = record.hybrid_stack_trace()
+            continue
+        reader = _record_reader(record)
+        if (
+            reader == NULL
+            or ("python", None) in _record_stack_trace_cache(record)
+            or record.allocator in (AllocatorType.FREE, AllocatorType.MUNMAP)
+        ):
+            stacks[i] = record.stack_trace()
+            continue
+        positions_by_reader.setdefault(<uintptr_t>reader, []).append(i)
+
+    for address, positions in positions_by_reader.items():
+        reader = <RecordReader*><uintptr_t>address
+        indexes.clear()
+        for i in positions:
+            indexes.push_back(records[i].stack_id)
+        main_tid = reader.getMainThreadTid()
+        to_skip = reader.getSkippedFramesOnMainThread()
+        for i, stack in zip(positions, reader.Py_GetStackFrames(indexes)):
+            record = records[i]
+            if record.tid == main_tid:
+                del stack[max(len(stack) - to_skip, 0):]
+            _record_stack_trace_cache(record)[("python", None)] = stack
+            stacks[i] = stack
+    return stacks
+
+
 cdef class TemporalAllocationGenerator:
     cdef vector[AllocationLifetime] lifetimes
     cdef shared_ptr[RecordReader] reader
@@ -593,9 +620,9 @@ cdef class Tracker:
             captured allocations into. This is the only argument that can be
             passed positionally. If not provided, the *destination* keyword
             argument must be provided.
-        destination (FileDestination or SocketDestination): The destination to
-            write captured allocations to. If provided, the *file_name*
-            argument must not be provided.
+        destination (FileDestination, SocketDestination or SharedMemoryDestination):
+            The destination to write captured allocations to. If provided, the
+            *file_name* argument must not be provided.
         native_traces (bool): Whether or not to capture native stack frames, in
             addition to Python stack frames (see :ref:`Native Tracking`).
             Defaults to False.
@@ -628,6 +655,8 @@ cdef class Tracker:
     cdef unique_ptr[Sink] _make_writer(self, destination) except*:
         # Creating a Sink can raise Python exceptions (if is interrupted by signal
         # handlers). If this happens, this method will propagate the appropriate exception.
+        cdef CompressionOptions compression
+        cdef BackpressurePolicy policy
         if isinstance(destination, FileDestination):
             is_dev_null = False
             with contextlib.suppress(OSError):
@@ -636,14 +665,50 @@ cdef class Tracker:
 
             if is_dev_null:
                 return unique_ptr[Sink](new NullSink())
+
+            compression.codec = CompressionCodec.NONE
+            if destination.compress_on_exit:
+                codec, compression.level = parse_compression(destination.compression)
+                if codec == "zstd":
+                    compression.codec = CompressionCodec.ZSTD
+                else:
+                    compression.codec = CompressionCodec.LZ4
+                if destination.compression_dictionary is not None:
+                    compression.dictionary_path = os.fsencode(
+                        destination.compression_dictionary
+                    )
+            if destination.io_backend == "io_uring":
+                return unique_ptr[Sink](new AsyncFileSink(os.fsencode(destination.path),
+                                                          destination.overwrite,
+                                                          compression,
+                                                          AsyncFileSinkBackend.IO_URING))
+            if destination.io_backend == "pwrite":
+                return unique_ptr[Sink](new AsyncFileSink(os.fsencode(destination.path),
+                                                          destination.overwrite,
+                                                          compression,
+                                                          AsyncFileSinkBackend.PWRITE))
             return unique_ptr[Sink](new FileSink(os.fsencode(destination.path),
                                                  destination.overwrite,
-                                                 destination.compress_on_exit))
+                                                 compression))
 
-        elif isinstance(destination, SocketDestination):
-            return unique_ptr[Sink](new SocketSink(destination.address, destination.server_port))
+        elif isinstance(destination, (SocketDestination, SharedMemoryDestination)):
+            if destination.backpressure == "drop":
+                policy = BackpressurePolicy.DROP
+            elif destination.backpressure == "aggregate":
+                policy = BackpressurePolicy.AGGREGATE
+            else:
+                policy = BackpressurePolicy.BLOCK
+            if isinstance(destination, SharedMemoryDestination):
+                return unique_ptr[Sink](new SharedMemorySink(os.fsencode(destination.path), policy))
+            return unique_ptr[Sink](new SocketSink(destination.address,
+                                                   destination.server_port,
+                                                   policy,
+                                                   destination.buffer_size,
+                                                   destination.children_port or 0))
         else:
-            raise TypeError("destination must be a SocketDestination or FileDestination")
+            raise TypeError(
+                "destination must be a FileDestination, SocketDestination or SharedMemoryDestination"
+            )
 
     def __cinit__(self, object file_name=None, *, object destination=None,
                   bool native_traces=False, unsigned int memory_interval_ms = 10,
@@ -662,11 +727,24 @@ cdef class Tracker:
             destination = FileDestination(path=file_name)
 
         if not isinstance(destination, FileDestination):
-            if follow_fork:
-                raise RuntimeError("follow_fork requires an output file")
+            if follow_fork and getattr(destination, "children_port", None) is None:
+                raise RuntimeError(
+                    "follow_fork requires an output file or a SocketDestination"
+                    " with a children_port"
+                )
 
-            if file_format != FileFormat.ALL_ALLOCATIONS:
-                raise RuntimeError("AGGREGATED_ALLOCATIONS requires an output file")
+            if file_format == FileFormat.AGGREGATED_ALLOCATIONS:
+                # Live clients get per-location deltas instead of a summary
+                # written when tracking ends.
+                self._writer = move(
+                    createLiveAggregatingRecordWriter(
+                        move(self._make_writer(destination)),
+                        command_line,
+                        native_traces,
+                        trace_python_allocators,
+                    )
+                )
+                return
 
         self._writer = move(
             createRecordWriter(
@@ -833,10 +911,16 @@ cdef class ProgressIndicator:
         return False
 
     cdef update(self, size_t n_processed):
+        cdef size_t previous = self._cumulative_num_processed
         self._cumulative_num_processed += n_processed
         if not self._report_progress:
             return
-        if self._cumulative_num_processed % self._update_interval == 0:
+        # Records may be counted a batch at a time, so check whether this
+        # update crossed a multiple of the interval rather than landed on one.
+        if (
+            previous // self._update_interval
+            != self._cumulative_num_processed // self._update_interval
+        ):
             if self._time_for_refresh():
                 assert(self._context_manager is not None)
                 self._context_manager.update(
@@ -849,17 +933,46 @@ cdef class ProgressIndicator:
         return self._cumulative_num_processed
 
 
+cdef extern from "snapshot.h":
+    """
+    std::vector<memray::tracking_api::AggregatedAllocation>
+    collectAllocations(const memray::api::HighWaterMarkAggregator& aggregator)
+    {
+        std::vector<memray::tracking_api::AggregatedAllocation> ret;
+        aggregator.visitAllocations([&](const memray::tracking_api::AggregatedAllocation& agg) {
+            if (agg.n_allocations_in_high_water_mark || agg.n_allocations_leaked) {
+                ret.push_back(agg);
+            }
+            return true;
+        });
+        return ret;
+    }
+    """
+    vector[AggregatedAllocation] collectAllocations(HighWaterMarkAggregator) except+
+
+
 cdef class FileReader:
     cdef cppstring _path
 
     cdef object _file
+    cdef shared_ptr[RecordReader] _reader
     cdef vector[_MemorySnapshot] _memory_snapshots
-    cdef HighWatermark _high_watermark
+    cdef vector[AggregatedAllocation] _aggregated_allocations
+    cdef unique_ptr[AllocationStatsAggregator] _stats_aggregator
+    cdef size_t _peak_memory
     cdef object _header
     cdef bool _report_progress
     cdef size_t _memory_snapshot_stride
 
-    def __cinit__(self, object file_name, *, bool report_progress=False, int max_memory_records=10000):
+    def __cinit__(
+        self,
+        object file_name,
+        *,
+        bool report_progress=False,
+        int max_memory_records=10000,
+        bool collect_statistics=False,
+        bool use_index=False,
+    ):
         try:
             self._file = open(file_name)
         except OSError as exc:
@@ -871,12 +984,13 @@ cdef class FileReader:
             self._path = str(file_name)
         self._report_progress = report_progress
 
-        # Initial pass to populate _header, _high_watermark, and _memory_snapshots.
-        cdef shared_ptr[RecordReader] reader_sp = make_shared[RecordReader](
-            unique_ptr[FileSource](new FileSource(self._path)),
-            False
+        # A single pass populates _header, _memory_snapshots, and the
+        # contribution of each location to both the high water mark and the
+        # leaks, so that neither of those needs to read the file again.
+        self._reader = make_shared[RecordReader](
+            unique_ptr[FileSource](new FileSource(self._path))
         )
-        cdef RecordReader* reader = reader_sp.get()
+        cdef RecordReader* reader = self._reader.get()
 
         self._header = reader.getHeader()
         stats = self._header["stats"]
@@ -889,47 +1003,214 @@ cdef class FileReader:
             n_memory_snapshots_approx = max_memory_records
         self._memory_snapshots.reserve(n_memory_snapshots_approx)
 
+        if collect_statistics:
+            if self._header["file_format"] == FileFormat.AGGREGATED_ALLOCATIONS:
+                raise NotImplementedError(
+                    "Can't compute statistics using a pre-aggregated capture file."
+                )
+            self._stats_aggregator.reset(new AllocationStatsAggregator())
+        cdef AllocationStatsAggregator* stats_aggregator = self._stats_aggregator.get()
+
+        # What the pass below computes can be saved in an index beside the
+        # capture, and read back from it by later readers, as long as the
+        # capture hasn't changed since. Only reading and aggregating the
+        # records is saved: native frames are kept unresolved, so resolving
+        # their symbols still happens each time. Statistics aren't saved, and
+        # captures that are already pre-aggregated have nothing to gain from
+        # an index.
+        cdef IndexedCapture indexed_capture
+        index_path = None
+        if (
+            use_index
+            and not collect_statistics
+            and self._header["file_format"] == FileFormat.ALL_ALLOCATIONS
+        ):
+            capture_stat = os.fstat(self._file.fileno())
+            indexed_capture.size = capture_stat.st_size
+            indexed_capture.mtime_ns = capture_stat.st_mtime_ns
+            index_path = os.fsencode(file_name) + b".idx"
+
         cdef object total = stats['n_allocations'] or None
-        cdef HighWatermarkFinder finder
+        cdef HighWaterMarkAggregator aggregator
+        cdef AggregatedAllocation aggregated_allocation
+        cdef _Allocation allocation
 
         cdef ProgressIndicator progress_indicator = ProgressIndicator(
-            "Calculating high watermark",
+            "Processing allocation records",
             total=total,
             report_progress=self._report_progress
         )
         self._memory_snapshot_stride = 0
+        self._peak_memory = 0
         cdef MemoryRecord memory_record
-        with progress_indicator:
-            while True:
-                PyErr_CheckSignals()
-                ret = reader.nextRecord()
-                if ret == RecordResult.RecordResultAllocationRecord:
-                    finder.processAllocation(reader.getLatestAllocation())
-                    progress_indicator.update(1)
-                elif ret == RecordResult.RecordResultAggregatedAllocationRecord:
-                    finder.processAllocation(
-                        reader.getLatestAggregatedAllocation().contributionToHighWaterMark()
-                    )
-                    progress_indicator.update(1)
-                elif ret == RecordResult.RecordResultMemoryRecord:
-                    memory_record = reader.getLatestMemoryRecord()
-                    self._memory_snapshots.push_back(
-                        _MemorySnapshot(
-                            memory_record.ms_since_epoch,
-                            memory_record.rss,
-                            finder.getCurrentWatermark(),
-                        )
-                    )
-                elif ret == RecordResult.RecordResultMemorySnapshot:
-                    self._memory_snapshots.push_back(reader.getLatestMemorySnapshot())
-                else:
-                    break
+        # Records are decoded on another thread while the ones decoded before
+        # them are aggregated here, one batch at a time and in order.
+        cdef unique_ptr[PipelinedRecordReader] pipeline
+        cdef RecordBatch batch
+        cdef RecordResult ret
+        cdef bool more
+        cdef size_t allocation_idx, aggregated_idx, memory_record_idx, snapshot_idx
+        if index_path is None or not self._read_index(index_path, indexed_capture):
+            pipeline.reset(new PipelinedRecordReader(self._reader))
+            with progress_indicator:
+                more = True
+                while more:
+                    PyErr_CheckSignals()
+                    with nogil:
+                        more = pipeline.get().nextBatch(&batch)
+                    if not more:
+                        break
+                    allocation_idx = aggregated_idx = 0
+                    memory_record_idx = snapshot_idx = 0
+                    for ret in batch.results:
+                        if ret == RecordResult.RecordResultAllocationRecord:
+                            allocation = batch.allocations[allocation_idx]
+                            allocation_idx += 1
+                            aggregator.addAllocation(allocation)
+                            if stats_aggregator != NULL:
+                                stats_aggregator.addAllocation(
+                                    allocation, reader.getLatestPythonFrameId(allocation)
+                                )
+                        elif ret == RecordResult.RecordResultAggregatedAllocationRecord:
+                            aggregated_allocation = batch.aggregated_allocations[aggregated_idx]
+                            aggregated_idx += 1
+                            self._aggregated_allocations.push_back(aggregated_allocation)
+                            self._peak_memory += aggregated_allocation.bytes_in_high_water_mark
+                        elif ret == RecordResult.RecordResultMemoryRecord:
+                            memory_record = batch.memory_records[memory_record_idx]
+                            memory_record_idx += 1
+                            self._memory_snapshots.push_back(
+                                _MemorySnapshot(
+                                    memory_record.ms_since_epoch,
+                                    memory_record.rss,
+                                    aggregator.getCurrentHeapSize(),
+                                )
+                            )
+                        elif ret == RecordResult.RecordResultMemorySnapshot:
+                            self._memory_snapshots.push_back(batch.memory_snapshots[snapshot_idx])
+                            snapshot_idx += 1
+                        else:
+                            more = False
+                            break
+                    progress_indicator.update(allocation_idx + aggregated_idx)
+            pipeline.reset()
+
+            if self._header["file_format"] == FileFormat.ALL_ALLOCATIONS:
+                self._aggregated_allocations = collectAllocations(aggregator)
+                self._peak_memory = aggregator.getPeakHeapSize()
+            stats["n_allocations"] = progress_indicator.num_processed
+            if index_path is not None:
+                self._write_index(index_path, indexed_capture)
 
         if len(self._memory_snapshots) > max_memory_records:
             self._memory_snapshot_stride = int(ceil(<double>len(self._memory_snapshots) / max_memory_records))
             self._memory_snapshots = self._memory_snapshots[::self._memory_snapshot_stride]
-        self._high_watermark = finder.getHighWatermark()
-        stats["n_allocations"] = progress_indicator.num_processed
+
+    cdef bool _read_index(self, bytes index_path, IndexedCapture capture) except *:
+        """Read what an earlier pass over the capture saved in its index.
+
+        Returns False, leaving this reader untouched, if there is no index or
+        it was built from a capture with a different size or modification time.
+        """
+        cdef shared_ptr[RecordReader] reader_sp
+        try:
+            reader_sp = make_shared[RecordReader](
+                unique_ptr[FileSource](new FileSource(index_path))
+            )
+        except OSError:
+            return False
+        cdef RecordReader* reader = reader_sp.get()
+        if reader.getHeader().file_format != _FileFormat.AGGREGATED_ALLOCATIONS:
+            return False
+
+        # The capture that the index describes is recorded before anything else.
+        ret = reader.nextRecord()
+        cdef IndexedCapture indexed_capture = reader.getIndexedCapture()
+        if indexed_capture.size != capture.size or indexed_capture.mtime_ns != capture.mtime_ns:
+            return False
+
+        cdef vector[_MemorySnapshot] memory_snapshots
+        cdef vector[AggregatedAllocation] aggregated_allocations
+        cdef AggregatedAllocation aggregated_allocation
+        cdef size_t peak_memory = 0
+        while ret != RecordResult.RecordResultEndOfFile:
+            PyErr_CheckSignals()
+            if ret == RecordResult.RecordResultAggregatedAllocationRecord:
+                aggregated_allocation = reader.getLatestAggregatedAllocation()
+                aggregated_allocations.push_back(aggregated_allocation)
+                peak_memory += aggregated_allocation.bytes_in_high_water_mark
+            elif ret == RecordResult.RecordResultMemorySnapshot:
+                memory_snapshots.push_back(reader.getLatestMemorySnapshot())
+            else:
+                return False
+            ret = reader.nextRecord()
+
+        self._reader = reader_sp
+        self._memory_snapshots.swap(memory_snapshots)
+        self._aggregated_allocations.swap(aggregated_allocations)
+        self._peak_memory = peak_memory
+        self._header["stats"]["n_allocations"] = reader.getHeader().stats.n_allocations
+        return True
+
+    cdef void _write_index(self, bytes index_path, IndexedCapture capture) except *:
+        """Save what the first pass computed in an index beside the capture.
+
+        The index is only ever an optimization, so it's fine if it can't be
+        written, for instance because the capture is in a read-only directory,
+        or because a file that isn't a memray index already has its name.
+        """
+        cdef bytes magic = MAGIC
+        try:
+            with open(index_path, "rb") as existing:
+                if existing.read(len(magic)) != magic:
+                    return
+        except FileNotFoundError:
+            pass
+        except OSError:
+            return
+
+        cdef HeaderRecord header = self._reader.get().getHeader()
+        header.stats.n_allocations = self._header["stats"]["n_allocations"]
+        cdef CompressionOptions compression
+        compression.codec = CompressionCodec.NONE
+        cdef unique_ptr[Sink] sink
+
+        # Write to a temporary file of our own first, so that other readers
+        # never see an index that is only partly written, and concurrent
+        # writers never write to the same file.
+        directory, name = os.path.split(index_path)
+        try:
+            fd, temporary_path = tempfile.mkstemp(
+                prefix=name + b".", suffix=b".tmp", dir=directory or b"."
+            )
+        except OSError:
+            return
+        # mkstemp makes the file private to its owner: give the index the
+        # permissions that any other file we create gets instead.
+        umask = os.umask(0)
+        os.umask(umask)
+        with contextlib.suppress(OSError):
+            os.fchmod(fd, 0o666 & ~umask)
+        os.close(fd)
+
+        replaced = False
+        try:
+            sink.reset(new FileSink(temporary_path, True, compression))
+            if self._reader.get().writeIndex(
+                move(sink),
+                header,
+                capture,
+                self._memory_snapshots,
+                self._aggregated_allocations,
+            ):
+                os.replace(temporary_path, index_path)
+                replaced = True
+        except OSError:
+            pass
+        finally:
+            if not replaced:
+                with contextlib.suppress(OSError):
+                    os.unlink(temporary_path)
 
     def __dealloc__(self):
         self.close()
@@ -954,55 +1235,27 @@ cdef class FileReader:
     def __exit__(self, exc_type, exc_value, exc_traceback):
         self.close()
 
-    def _reaggregate_allocations(
-        self, size_t records_to_process, bool merge_threads, bool leaks
-    ):
-        """Aggregate records from an AGGREGATED_ALLOCATIONS capture file.
+    def _reaggregate_allocations(self, bool merge_threads, bool leaks):
+        """Aggregate the contributions found by the initial pass by location.
 
-        An extra aggregation pass is still needed to account for merge_threads,
+        An extra aggregation step is still needed to account for merge_threads,
         as well as (for now at least) different location key formats.
         """
         cdef AggregatedCaptureReaggregator aggregator
-        cdef shared_ptr[RecordReader] reader_sp = make_shared[RecordReader](
-            unique_ptr[FileSource](new FileSource(self._path))
-        )
-        cdef RecordReader* reader = reader_sp.get()
-
-        cdef ProgressIndicator progress_indicator = ProgressIndicator(
-            "Processing allocation records",
-            total=records_to_process,
-            report_progress=self._report_progress
-        )
-
         cdef AggregatedAllocation record
-        with progress_indicator:
-            while True:
-                PyErr_CheckSignals()
-                ret = reader.nextRecord()
-                if ret == RecordResult.RecordResultAggregatedAllocationRecord:
-                    record = reader.getLatestAggregatedAllocation()
-                    if leaks:
-                        aggregator.addAllocation(record.contributionToLeaks())
-                    else:
-                        aggregator.addAllocation(record.contributionToHighWaterMark())
-                    records_to_process -= 1
-                    progress_indicator.update(1)
-                elif ret == RecordResult.RecordResultMemorySnapshot:
-                    pass
-                else:
-                    assert ret != RecordResult.RecordResultMemoryRecord
-                    assert ret != RecordResult.RecordResultAllocationRecord
-                    break
+        for record in self._aggregated_allocations:
+            if leaks:
+                aggregator.addAllocation(record.contributionToLeaks())
+            else:
+                aggregator.addAllocation(record.contributionToHighWaterMark())
 
         for elem in Py_ListFromSnapshotAllocationRecords(
             aggregator.getSnapshotAllocations(merge_threads)
         ):
             alloc = AllocationRecord(elem)
-            (<AllocationRecord> alloc)._reader = reader_sp
+            (<AllocationRecord> alloc)._reader = self._reader
             yield alloc
 
-        reader.close()
-
     def _aggregate_allocations(self, size_t records_to_process, bool merge_threads,
                                size_t temporary_buffer_size=0):
         cdef unique_ptr[AbstractAggregator] the_aggregator
@@ -1051,30 +1304,11 @@ cdef class FileReader:
 
     def get_high_watermark_allocation_records(self, merge_threads=True):
         self._ensure_not_closed()
-        if self._header["file_format"] == FileFormat.AGGREGATED_ALLOCATIONS:
-            yield from self._reaggregate_allocations(
-                self._header["stats"]["n_allocations"],
-                merge_threads,
-                leaks=False,
-            )
-            return
-
-        # If allocation 0 caused the peak, we need to process 1 record, etc
-        cdef size_t max_records = self._high_watermark.index + 1
-        yield from self._aggregate_allocations(max_records, merge_threads)
+        yield from self._reaggregate_allocations(merge_threads, leaks=False)
 
     def get_leaked_allocation_records(self, merge_threads=True):
         self._ensure_not_closed()
-        if self._header["file_format"] == FileFormat.AGGREGATED_ALLOCATIONS:
-            yield from self._reaggregate_allocations(
-                self._header["stats"]["n_allocations"],
-                merge_threads,
-                leaks=True,
-            )
-            return
-
-        cdef size_t max_records = self._header["stats"]["n_allocations"]
-        yield from self._aggregate_allocations(max_records, merge_threads)
+        yield from self._reaggregate_allocations(merge_threads, leaks=True)
 
     def get_temporary_allocation_records(self, merge_threads=True, threshold=1):
         self._ensure_not_closed()
@@ -1211,13 +1445,99 @@ cdef class FileReader:
 
         reader.close()
 
+    def create_reporters(
+        self,
+        reporter_factories,
+        *,
+        show_memory_leaks=False,
+        merge_threads=True,
+        inverted=False,
+    ):
+        """Create several reporters for the high water mark or the leaks.
+
+        Every factory gets the same records, so the stack traces that several
+        of them need are only resolved once. Each factory is called like the
+        ``from_snapshot`` class methods of the reporters, and the reporters
+        are returned in the same order as the factories.
+        """
+        self._ensure_not_closed()
+        if show_memory_leaks:
+            records = self.get_leaked_allocation_records(merge_threads=merge_threads)
+        else:
+            records = self.get_high_watermark_allocation_records(
+                merge_threads=merge_threads
+            )
+        snapshot = tuple(records)
+        memory_records = tuple(self.get_memory_snapshots())
+        return [
+            factory(
+                snapshot,
+                memory_records=memory_records,
+                native_traces=self._header["native_traces"],
+                inverted=inverted,
+            )
+            for factory in reporter_factories
+        ]
+
     def get_memory_snapshots(self):
         for record in self._memory_snapshots:
             yield MemorySnapshot(record.ms_since_epoch, record.rss, record.heap)
 
+    def get_statistics(self, *, size_t num_largest=5):
+        """Return the statistics gathered while the file was first read.
+
+        Only available if the reader was created with ``collect_statistics``.
+        """
+        self._ensure_not_closed()
+        if self._stats_aggregator.get() == NULL:
+            raise ValueError(
+                "Statistics are only available with collect_statistics=True"
+            )
+        return _create_stats(
+            self._stats_aggregator.get(), self._reader.get(), self._header, num_largest
+        )
+
     @property
     def metadata(self):
-        return _create_metadata(self._header, self._high_watermark.peak_memory)
+        return _create_metadata(self._header, self._peak_memory)
+
+
+cdef object _create_stats(
+    AllocationStatsAggregator* aggregator,
+    RecordReader* reader,
+    object header,
+    size_t num_largest,
+):
+    # Convert allocation counts by allocator/by size to Python dicts.
+    cdef dict tmp = aggregator.allocationCountByAllocator()
+    allocation_count_by_allocator = {AllocatorType(k).name: v for k, v in tmp.items()}
+    cdef dict allocation_count_by_size = aggregator.allocationCountBySize()
+
+    # Convert top locations by bytes allocated/by allocation count to dicts
+    unknown = ("<unknown>", "<unknown>", 0)
+
+    top_locations_by_size = [
+        ((reader.Py_GetFrame(size_and_loc.second) or unknown), size_and_loc.first)
+        for size_and_loc in aggregator.topLocationsBySize(num_largest)
+    ]
+
+    top_locations_by_count = [
+        ((reader.Py_GetFrame(count_and_loc.second) or unknown), count_and_loc.first)
+        for count_and_loc in aggregator.topLocationsByCount(num_largest)
+    ]
+
+    # And we're done!
+    cdef uint64_t peak_memory = aggregator.peakBytesAllocated()
+    return Stats(
+        metadata=_create_metadata(header, peak_memory),
+        total_num_allocations=aggregator.totalAllocations(),
+        total_memory_allocated=aggregator.totalBytesAllocated(),
+        peak_memory_allocated=peak_memory,
+        allocation_count_by_size=allocation_count_by_size,
+        allocation_count_by_allocator=allocation_count_by_allocator,
+        top_locations_by_size=top_locations_by_size,
+        top_locations_by_count=top_locations_by_count,
+    )
 
 
 def compute_statistics(
@@ -1245,58 +1565,239 @@ def compute_statistics(
         total=total,
         report_progress=report_progress,
     )
+    cdef unique_ptr[PipelinedRecordReader] pipeline
+    pipeline.reset(new PipelinedRecordReader(reader_sp))
+    cdef RecordBatch batch
+    cdef RecordResult ret
+    cdef bool more = True
+    cdef size_t allocation_idx
     with progress_indicator:
-        while True:
+        while more:
             PyErr_CheckSignals()
-            ret = reader.nextRecord()
-            if ret == RecordResult.RecordResultAllocationRecord:
-                aggregator.addAllocation(
-                    reader.getLatestAllocation(),
-                    reader.getLatestPythonFrameId(reader.getLatestAllocation()),
-                )
-                progress_indicator.update(1)
-            elif ret == RecordResult.RecordResultMemoryRecord:
-                pass
-            elif ret == RecordResult.RecordResultMemorySnapshot:
-                pass
-            else:
-                assert ret != RecordResult.RecordResultMemorySnapshot
-                assert ret != RecordResult.RecordResultAggregatedAllocationRecord
+            with nogil:
+                more = pipeline.get().nextBatch(&batch)
+            if not more:
                 break
+            allocation_idx = 0
+            for ret in batch.results:
+                if ret == RecordResult.RecordResultAllocationRecord:
+                    aggregator.addAllocation(
+                        batch.allocations[allocation_idx],
+                        reader.getLatestPythonFrameId(batch.allocations[allocation_idx]),
+                    )
+                    allocation_idx += 1
+                elif ret == RecordResult.RecordResultMemoryRecord:
+                    pass
+                elif ret == RecordResult.RecordResultMemorySnapshot:
+                    pass
+                else:
+                    assert ret != RecordResult.RecordResultAggregatedAllocationRecord
+                    more = False
+                    break
+            progress_indicator.update(allocation_idx)
+    pipeline.reset()
 
     # Ignore the n_allocations in the header, use our observed value.
     header["stats"]["n_allocations"] = progress_indicator.num_processed
 
-    # Convert allocation counts by allocator/by size to Python dicts.
-    cdef dict tmp = aggregator.allocationCountByAllocator()
-    allocation_count_by_allocator = {AllocatorType(k).name: v for k, v in tmp.items()}
-    cdef dict allocation_count_by_size = aggregator.allocationCountBySize();
+    return _create_stats(&aggregator, reader, header, num_largest)
+
+
+cdef object _flame_graph_nodes(const FlameGraphNodes& nodes, bool temporal):
+    if nodes.name.empty():
+        return {}
+    ret = {
+        "name": nodes.name,
+        "function": nodes.function,
+        "filename": nodes.filename,
+        "lineno": nodes.lineno,
+        "children": nodes.children,
+        "thread_id": nodes.thread_id,
+        "interesting": nodes.interesting,
+        "import_system": nodes.import_system,
+    }
+    if not temporal:
+        ret["value"] = nodes.value
+        ret["n_allocations"] = nodes.n_allocations
+    return ret
+
+
+cdef size_t _intern_flame_graph_location(
+    FlameGraphBuilder* builder,
+    object describe_frame,
+    object frame,
+    const StackFrame* native_frame,
+) except *:
+    cdef size_t num_locations = builder.numLocations()
+    cdef size_t location
+    cdef cppstring function
+    cdef cppstring filename
+    if native_frame != NULL:
+        location = builder.internLocation(native_frame[0])
+    else:
+        function, filename, lineno = frame
+        location = builder.internLocation(function, filename, lineno)
+    if location != num_locations:
+        return location
+
+    if frame is None:
+        frame = (native_frame.function_name[0], native_frame.filename[0], native_frame.lineno)
+    description = describe_frame(frame)
+    builder.describeLocation(
+        location,
+        builder.registerString(description.name),
+        builder.registerString(description.function),
+        builder.registerString(description.filename),
+        description.skip,
+        description.interesting,
+        description.import_system,
+    )
+    return location
 
-    # Convert top locations by bytes allocated/by allocation count to dicts
-    unknown = ("<unknown>", "<unknown>", 0)
 
-    top_locations_by_size = [
-        ((reader.Py_GetFrame(size_and_loc.second) or unknown), size_and_loc.first)
-        for size_and_loc in aggregator.topLocationsBySize(num_largest)
-    ]
+def build_flame_graph_data(
+    allocations,
+    *,
+    bool native_traces,
+    bool temporal,
+    bool inverted,
+    size_t max_stacks,
+    describe_frame,
+    double prune_fraction=0.0,
+):
+    """Merge the stacks of allocation records into the trees of a flame graph.
 
-    top_locations_by_count = [
-        ((reader.Py_GetFrame(count_and_loc.second) or unknown), count_and_loc.first)
-        for count_and_loc in aggregator.topLocationsByCount(num_largest)
-    ]
+    Returns the packed nodes, strings and intervals that FlameGraphReporter
+    embeds in its reports. ``describe_frame`` is called once for each distinct
+    frame, and returns a FrameDescription of it. If ``prune_fraction`` is
+    given, the children of each node that account for less than that fraction
+    of the total are folded together.
+    """
+    if temporal and prune_fraction > 0:
+        raise ValueError("Temporal flame graphs can't be pruned")
+
+    cdef unique_ptr[FlameGraphBuilder] builder_ptr
+    builder_ptr.reset(new FlameGraphBuilder(inverted, max_stacks))
+    cdef FlameGraphBuilder* builder = builder_ptr.get()
+
+    cdef vector[StackFrame] frames
+    cdef vector[size_t] stack
+    cdef _Allocation allocation
+    cdef RecordReader* reader
+    # The builder looks frames up by the addresses of their strings, which
+    # their readers own, so every reader used is kept alive until the end.
+    cdef unordered_map[uintptr_t, shared_ptr[RecordReader]] readers
+    cdef AllocationRecord allocation_record
+    cdef TemporalAllocationRecord temporal_record
+    cdef pair[size_t, size_t] nodes
+    cdef size_t thread
+    cdef size_t size
+    cdef size_t n_allocations
+    cdef size_t i
+
+    cdef dict thread_by_key = {}
+    cdef set unique_threads = set()
+    interval_list = []
+    no_imports_interval_list = []
+
+    for record in allocations:
+        size = n_allocations = 0
+        stack.clear()
+        reader = NULL
+        if type(record) is AllocationRecord:
+            allocation_record = record
+            reader = allocation_record._reader.get()
+            readers[<uintptr_t>reader] = allocation_record._reader
+            (
+                tid, _, size, _, stack_id, n_allocations, native_stack_id, generation
+            ) = allocation_record._tuple
+        elif type(record) is TemporalAllocationRecord:
+            temporal_record = record
+            reader = temporal_record._reader.get()
+            readers[<uintptr_t>reader] = temporal_record._reader
+            tid, _, stack_id, native_stack_id, generation = temporal_record._tuple
+        elif not temporal:
+            size = record.size
+            n_allocations = record.n_allocations
+
+        if reader != NULL:
+            # Walk the reader's stacks natively, and only create Python
+            # objects for frames that haven't been seen before.
+            allocation.tid = tid if tid != -1 else numeric_limits[thread_id_t].max()
+            allocation.frame_index = stack_id
+            allocation.native_frame_id = native_stack_id
+            allocation.native_segment_generation = generation
+            reader.getStackFrames(allocation, native_traces, &frames)
+            for i in range(frames.size()):
+                stack.push_back(
+                    _intern_flame_graph_location(builder, describe_frame, None, &frames[i])
+                )
+            thread_key = (<uintptr_t>reader, tid)
+        else:
+            for frame in (
+                record.hybrid_stack_trace() if native_traces else record.stack_trace()
+            ):
+                stack.push_back(
+                    _intern_flame_graph_location(builder, describe_frame, frame, NULL)
+                )
+            thread_key = record.thread_name
 
-    # And we're done!
-    cdef uint64_t peak_memory = aggregator.peakBytesAllocated()
-    return Stats(
-        metadata=_create_metadata(header, peak_memory),
-        total_num_allocations=aggregator.totalAllocations(),
-        total_memory_allocated=aggregator.totalBytesAllocated(),
-        peak_memory_allocated=peak_memory,
-        allocation_count_by_size=allocation_count_by_size,
-        allocation_count_by_allocator=allocation_count_by_allocator,
-        top_locations_by_size=top_locations_by_size,
-        top_locations_by_count=top_locations_by_count,
-    )
+        if thread_key in thread_by_key:
+            thread = thread_by_key[thread_key]
+        else:
+            thread_name = record.thread_name
+            unique_threads.add(thread_name)
+            thread = thread_by_key[thread_key] = builder.registerString(thread_name)
+
+        nodes = builder.addStack(stack, thread, size, n_allocations)
+
+        if temporal:
+            for interval in record.intervals:
+                interval_list.append(
+                    (
+                        interval.allocated_before_snapshot,
+                        interval.deallocated_before_snapshot,
+                        nodes.first,
+                        interval.n_allocations,
+                        interval.n_bytes,
+                    )
+                )
+                if inverted:
+                    no_imports_interval_list.append(
+                        (
+                            interval.allocated_before_snapshot,
+                            interval.deallocated_before_snapshot,
+                            nodes.second,
+                            interval.n_allocations,
+                            interval.n_bytes,
+                        )
+                    )
+
+    if prune_fraction > 0:
+        builder.prune(prune_fraction)
+
+    data = {
+        "unique_threads": tuple(
+            builder.registerString(thread_name)
+            for thread_name in sorted(unique_threads)
+        ),
+        "nodes": _flame_graph_nodes(builder.nodes(), temporal),
+        "inverted_no_imports_nodes": _flame_graph_nodes(
+            builder.invertedNoImportsNodes(), temporal
+        ),
+        "strings": builder.strings(),
+    }
+    if interval_list:
+        data["intervals"] = interval_list
+    if no_imports_interval_list:
+        data["no_imports_interval_list"] = no_imports_interval_list
+    return data
+
+
+def encode_compact_column(values):
+    """Encode integers as the base64 of their zigzag varint deltas."""
+    cdef vector[int64_t] column = values
+    return encodeCompactColumn(column)
 
 
 def dump_all_records(object file_name):
@@ -1313,10 +1814,17 @@ cdef class SocketReader:
     cdef BackgroundSocketReader* _impl
     cdef shared_ptr[RecordReader] _reader
     cdef object _header
+    # Our view of the snapshot, indexed by merge_threads, which maps each
+    # location to its record.
+    cdef tuple _snapshot_records
+    # The records of each view as a list, only rebuilt when the view changes.
+    cdef list _snapshot_lists
     cdef object _port
+    cdef bool _collect_statistics
 
-    def __cinit__(self, int port):
+    def __cinit__(self, *args, **kwargs):
         self._impl = NULL
+        self._collect_statistics = False
 
     def __init__(self, port: int):
         self._header = {}
@@ -1327,12 +1835,12 @@ cdef class SocketReader:
             del self._impl
         self._impl = NULL
 
-    cdef unique_ptr[SocketSource] _make_source(self) except*:
+    cdef unique_ptr[Source] _make_source(self) except*:
         # Creating a SocketSource can raise Python exceptions (if is interrupted by signal
         # handlers). If this happens, this method will propagate the appropriate exception.
         # We cannot use make_unique or C++ exceptions from SocketSource() won't be caught.
         cdef SocketSource* source = new SocketSource(self._port)
-        return unique_ptr[SocketSource](source)
+        return unique_ptr[Source](source)
 
     def __enter__(self):
         if self._impl is not NULL:
@@ -1343,8 +1851,10 @@ cdef class SocketReader:
 
         self._reader = make_shared[RecordReader](move(self._make_source()))
         self._header = self._reader.get().getHeader()
+        self._snapshot_records = ({}, {})
+        self._snapshot_lists = [None, None]
 
-        self._impl = new BackgroundSocketReader(self._reader)
+        self._impl = new BackgroundSocketReader(self._reader, self._collect_statistics)
         self._impl.start()
 
         return self
@@ -1383,15 +1893,358 @@ cdef class SocketReader:
             return False
         return self._header["native_traces"]
 
+    @property
+    def dropped_allocations(self):
+        if self._impl == NULL:
+            return 0
+        return self._impl.dropped_allocations()
+
+    cdef list _update_snapshot(self, bool merge_threads):
+        """Bring our view of the snapshot up to date, and return its records.
+
+        Only the locations that changed since the previous update get new
+        records, so this takes time proportional to the number of changes. The
+        list of records is only rebuilt if there were any, and is returned
+        again otherwise, so it must not be modified.
+        """
+        cdef IncrementalSnapshotAggregatorChanges changes = self._impl.updateSnapshot(
+            merge_threads
+        )
+        cdef list cached = self._snapshot_lists[merge_threads]
+        if cached is not None and changes.removed.empty() and changes.updated.empty():
+            return cached
+
+        cdef dict records = self._snapshot_records[merge_threads]
+        for key in changes.removed:
+            # Locations that came and went since the previous update were
+            # never added.
+            records.pop((key.thread_id, key.python_frame_id, key.native_frame_id), None)
+        for item in changes.updated:
+            alloc = AllocationRecord(item.second.toPythonObject())
+            (<AllocationRecord> alloc)._reader = self._reader
+            records[
+                item.first.thread_id, item.first.python_frame_id, item.first.native_frame_id
+            ] = alloc
+        cached = list(records.values())
+        self._snapshot_lists[merge_threads] = cached
+        return cached
+
     def get_current_snapshot(self, *, bool merge_threads):
         if self._impl is NULL:
             return
 
-        snapshot_allocations = self._impl.Py_GetSnapshotAllocationRecords(merge_threads=merge_threads)
-        for elem in snapshot_allocations:
-            alloc = AllocationRecord(elem)
-            (<AllocationRecord> alloc)._reader = self._reader
-            yield alloc
+        yield from self._update_snapshot(merge_threads)
+
+    def get_current_snapshot_by_location(self, *, double memory_ratio=1.0):
+        """Return the current snapshot and its memory usage by location.
+
+        Returns a ``(records, locations)`` pair. ``records`` holds the same
+        per-thread records as ``get_current_snapshot(merge_threads=False)``.
+        ``locations`` holds one ``(function, file, own_memory, total_memory,
+        n_allocations, thread_ids)`` tuple for each location found in the
+        stacks of those records, using hybrid stacks if native traces were
+        collected. Records stop being added to the locations once they
+        account for ``memory_ratio`` of the heap.
+        """
+        if self._impl is NULL:
+            return [], []
+
+        records = list(self._update_snapshot(False))
+        return records, self._impl.Py_GetSnapshotLocations(memory_ratio)
+
+cdef class SharedMemoryReader(SocketReader):
+    """Read allocations from a tracked process through a shared memory ring.
+
+    The ring is created along with the reader. A tracked process on the same
+    host writes into it when given a `SharedMemoryDestination` for this
+    reader's ``path``. Entering the reader's context waits for that process to
+    start tracking.
+
+    Args:
+        buffer_size: The size in bytes of the ring. It's rounded up to a power
+            of two.
+    """
+    cdef unique_ptr[SharedMemorySource] _source
+    cdef object _path
+
+    def __init__(self, size_t buffer_size=16 * 1024 * 1024):
+        self._header = {}
+        self._port = None
+        self._source = unique_ptr[SharedMemorySource](new SharedMemorySource(buffer_size))
+        self._path = self._source.get().path()
+
+    @property
+    def path(self):
+        return self._path
+
+    cdef unique_ptr[Source] _make_source(self) except*:
+        if self._source.get() == NULL:
+            raise ValueError("A SharedMemoryReader can only be used once")
+        if not self._source.get().waitForWriter():
+            # Interrupted by a signal handler that raised an exception.
+            return unique_ptr[Source]()
+        return unique_ptr[Source](self._source.release())
+
+
+cdef class FileFollower(SocketReader):
+    """Read allocations from a capture file while it's still being written.
+
+    Entering the context starts reading the file in a background thread. When
+    it reaches the end of the data written so far, it waits for the tracked
+    process to write more instead of stopping, until the capture is complete or
+    the context is exited. Meanwhile, the current snapshot can be polled like
+    that of a `SocketReader`, and so can the statistics gathered so far.
+
+    Only uncompressed captures of all allocations can be followed. Compressed
+    captures are read as usual, since they're only compressed once complete.
+    The tracked process must write the file in order, never leaving a hole of
+    zeros below data it has already written, since those zeros would be read
+    as records. Memray's own writers all do.
+
+    Args:
+        file_name: The capture file to follow.
+    """
+    cdef object _path
+
+    def __init__(self, object file_name):
+        self._path = str(file_name)
+        if not pathlib.Path(self._path).exists():
+            raise IOError(f"No such file: {self._path}")
+        self._header = {}
+        self._port = None
+        self._collect_statistics = True
+
+    cdef unique_ptr[Source] _make_source(self) except*:
+        return unique_ptr[Source](new FileSource(self._path, True))
+
+    def get_current_statistics(self, *, size_t num_largest=5):
+        """Return the statistics of the allocations read so far.
+
+        Returns `None` outside of the reader's context. The peak memory is the
+        highest heap size seen so far, which can grow as the file is read.
+        """
+        if self._impl is NULL:
+            return None
+
+        cdef Statistics stats = self._impl.currentStatistics(num_largest)
+        cdef RecordReader* reader = self._reader.get()
+
+        cdef dict tmp = stats.allocation_count_by_allocator
+        allocation_count_by_allocator = {AllocatorType(k).name: v for k, v in tmp.items()}
+        cdef dict allocation_count_by_size = stats.allocation_count_by_size
+
+        unknown = ("<unknown>", "<unknown>", 0)
+        top_locations_by_size = [
+            ((reader.Py_GetFrame(size_and_loc.second) or unknown), size_and_loc.first)
+            for size_and_loc in stats.top_locations_by_size
+        ]
+        top_locations_by_count = [
+            ((reader.Py_GetFrame(count_and_loc.second) or unknown), count_and_loc.first)
+            for count_and_loc in stats.top_locations_by_count
+        ]
+
+        header = dict(self._header)
+        header["stats"] = dict(header["stats"], n_allocations=stats.total_allocations)
+        return Stats(
+            metadata=_create_metadata(header, stats.peak_bytes_allocated),
+            total_num_allocations=stats.total_allocations,
+            total_memory_allocated=stats.total_bytes_allocated,
+            peak_memory_allocated=stats.peak_bytes_allocated,
+            allocation_count_by_size=allocation_count_by_size,
+            allocation_count_by_allocator=allocation_count_by_allocator,
+            top_locations_by_size=top_locations_by_size,
+            top_locations_by_count=top_locations_by_count,
+        )
+
+
+cdef class _ChildProcessReader(SocketReader):
+    """Read allocations from a forked process connected to a `ProcessGroupReader`."""
+    cdef object _sock
+
+    def __init__(self, sock):
+        self._header = {}
+        self._port = None
+        self._sock = sock
+
+    cdef unique_ptr[Source] _make_source(self) except*:
+        if self._sock is None:
+            raise ValueError("A child process reader can only be used once")
+        cdef int fd = self._sock.detach()
+        self._sock = None
+        return unique_ptr[Source](SocketSource.fromConnectedSocket(fd).release())
+
+
+cdef class ProcessGroupReader:
+    """Read allocations from a tracked process and the processes it forks.
+
+    The tracked process must be tracked with ``follow_fork=True`` and a
+    `SocketDestination` whose ``children_port`` is this reader's
+    `children_port`. Every process it forks while tracking connects to that
+    port, and gets a `SocketReader` of its own, so that its allocations are
+    aggregated separately from those of other processes.
+
+    Entering the context enters ``reader`` and starts accepting connections
+    from forked processes. Exiting it closes all of the readers.
+
+    Args:
+        reader: The reader for the tracked process.
+    """
+    cdef object _reader
+    cdef object _readers
+    cdef object _lock
+    cdef object _listener
+    cdef object _stopping
+    cdef object _acceptor
+
+    def __init__(self, reader):
+        self._reader = reader
+        self._readers = []
+        self._lock = threading.Lock()
+        self._stopping = threading.Event()
+        self._acceptor = None
+        self._listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self._listener.bind(("127.0.0.1", 0))
+        self._listener.listen()
+
+    @property
+    def children_port(self):
+        return self._listener.getsockname()[1]
+
+    @property
+    def readers(self):
+        """The reader for each process, in the order they connected."""
+        with self._lock:
+            return list(self._readers)
+
+    @property
+    def is_active(self):
+        return any(reader.is_active for reader in self.readers)
+
+    def __enter__(self):
+        if self._acceptor is not None:
+            raise ValueError("A ProcessGroupReader can only be used once")
+
+        self._reader.__enter__()
+        with self._lock:
+            self._readers.append(self._reader)
+        self._acceptor = threading.Thread(target=self._accept_children, daemon=True)
+        self._acceptor.start()
+        return self
+
+    def __exit__(self, exc_type, exc_value, exc_traceback):
+        self._stopping.set()
+        self._acceptor.join()
+        self._listener.close()
+        for reader in self.readers:
+            reader.__exit__(exc_type, exc_value, exc_traceback)
+
+    def _accept_children(self):
+        # Reading the header holds the GIL, so don't start a child's reader
+        # until the process has sent something. Wait for every connected
+        # child at once, so one that's slow to send doesn't hold up the rest.
+        pending = []
+        try:
+            while not self._stopping.is_set():
+                readable, _, _ = select.select(
+                    [self._listener, *pending], [], [], 0.1
+                )
+                for sock in readable:
+                    if sock is self._listener:
+                        child, _ = self._listener.accept()
+                        child.settimeout(None)
+                        pending.append(child)
+                        continue
+
+                    pending.remove(sock)
+                    reader = _ChildProcessReader(sock)
+                    try:
+                        reader.__enter__()
+                    except OSError:
+                        # The process went away before it sent us its header.
+                        sock.close()
+                        continue
+                    with self._lock:
+                        self._readers.append(reader)
+        finally:
+            for sock in pending:
+                sock.close()
+
+
+cdef class LiveBroker:
+    """Share the allocations of one tracked process with many live clients.
+
+    Entering the context reads from ``reader`` in a background thread, like
+    entering the reader's own context would, and starts listening for clients
+    on ``host`` and ``port``. Any number of clients, like ``memray live``, can
+    connect while the tracked process runs, and each one receives the same
+    aggregated stream that a `Tracker` created with a `SocketDestination` and
+    ``file_format=FileFormat.AGGREGATED_ALLOCATIONS`` sends. Clients that
+    connect late start from a snapshot of the current state, and clients that
+    can't keep up are disconnected.
+
+    The broker stops being active once the tracked process stops sending
+    data, after sending the end of the stream to every connected client.
+
+    Args:
+        reader: A `SocketReader`, `SharedMemoryReader` or `FileFollower` whose
+            context hasn't been entered.
+        port: The port to listen for clients on. If 0, a free port is chosen.
+        host: The address to listen for clients on.
+    """
+    cdef NativeLiveBroker* _impl
+    cdef object _reader
+    cdef object _requested_port
+    cdef object _host
+
+    def __cinit__(self, *args, **kwargs):
+        self._impl = NULL
+
+    def __init__(self, SocketReader reader, int port=0, str host="127.0.0.1"):
+        self._reader = reader
+        self._requested_port = port
+        self._host = host
+
+    def __enter__(self):
+        if self._impl is not NULL:
+            raise ValueError("A LiveBroker can only be used once at a time")
+
+        cdef shared_ptr[RecordReader] reader = make_shared[RecordReader](
+            move((<SocketReader>self._reader)._make_source())
+        )
+        self._impl = new NativeLiveBroker(reader, self._host, self._requested_port)
+        self._impl.start()
+        return self
+
+    def __exit__(self, exc_type, exc_value, exc_traceback):
+        with nogil:
+            del self._impl
+        self._impl = NULL
+
+    def __dealloc__(self):
+        if self._impl is not NULL:
+            with nogil:
+                del self._impl
+
+    @property
+    def port(self):
+        """The port that clients can connect to."""
+        if self._impl is NULL:
+            return None
+        return self._impl.port()
+
+    @property
+    def is_active(self):
+        if self._impl is NULL:
+            return False
+        return self._impl.is_active()
+
+    @property
+    def client_count(self):
+        """The number of clients currently connected."""
+        if self._impl is NULL:
+            return 0
+        return self._impl.client_count()
+
 
 cpdef enum SymbolicSupport:
     NONE = 1
@@ -1419,24 +2272,6 @@ RTLD_NOW = _RTLD_NOW
 RTLD_DEFAULT = <long long>_RTLD_DEFAULT
 
 
-cdef extern from "snapshot.h":
-    """
-    std::vector<memray::tracking_api::AggregatedAllocation>
-    collectAllocations(const memray::api::HighWaterMarkAggregator& aggregator)
-    {
-        std::vector<memray::tracking_api::AggregatedAllocation> ret;
-        aggregator.visitAllocations([&](const memray::tracking_api::AggregatedAllocation& agg) {
-            if (agg.n_allocations_in_high_water_mark || agg.n_allocations_leaked) {
-                ret.push_back(agg);
-            }
-            return true;
-        });
-        return ret;
-    }
-    """
-    vector[AggregatedAllocation] collectAllocations(HighWaterMarkAggregator) except+
-
-
 cdef class HighWaterMarkAggregatorTestHarness:
     cdef HighWaterMarkAggregator aggregator
 
@@ -1495,6 +2330,54 @@ cdef class HighWaterMarkAggregatorTestHarness:
         return ret
 
 
+cdef class IncrementalSnapshotAggregatorTestHarness:
+    cdef IncrementalSnapshotAggregator aggregator
+    cdef SnapshotAllocationAggregator reference_aggregator
+
+    def add_allocation(
+        self,
+        tid,
+        address,
+        size,
+        allocator,
+        native_frame_id,
+        frame_index,
+        n_allocations=1,
+    ):
+        cdef _Allocation allocation
+        allocation.tid = tid
+        allocation.address = address
+        allocation.size = size
+        allocation.allocator = <Allocator><int>allocator
+        allocation.native_frame_id = native_frame_id
+        allocation.frame_index = frame_index
+        allocation.native_segment_generation = 0
+        allocation.n_allocations = n_allocations
+        self.aggregator.addAllocation(allocation)
+        self.reference_aggregator.addAllocation(allocation)
+
+    def get_snapshot(self, merge_threads):
+        return Py_ListFromSnapshotAllocationRecords(
+            self.aggregator.getSnapshotAllocations(merge_threads)
+        )
+
+    def get_reference_snapshot(self, merge_threads):
+        return Py_ListFromSnapshotAllocationRecords(
+            self.reference_aggregator.getSnapshotAllocations(merge_threads)
+        )
+
+    def take_changes(self, merge_threads):
+        cdef IncrementalSnapshotAggregatorChanges changes = self.aggregator.takeChanges(
+            merge_threads
+        )
+        updated = Py_ListFromSnapshotAllocationRecords(changes.updated)
+        removed = [
+            (key.thread_id, key.python_frame_id, key.native_frame_id)
+            for key in changes.removed
+        ]
+        return updated, removed
+
+
 cdef class AllocationLifetimeAggregatorTestHarness:
     cdef AllocationLifetimeAggregator aggregator
 
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace memray::io {
+
+// A bounded queue that hands items from one producer thread to one consumer
+// thread, used to connect the stages of a reading pipeline.
+//
+// As in SocketSink's ring, the head and tail are free-running counters: only
+// the producer advances the head and only the consumer advances the tail, so
+// neither side takes a lock while there's room or there are items. A side
+// that has to wait sleeps on a condition variable. The short timeout covers
+// wakeups sent before it started waiting, since neither side notifies under
+// the mutex.
+template<typename T>
+class BoundedQueue
+{
+  public:
+    explicit BoundedQueue(size_t capacity)
+    : d_slots(capacity)
+    {
+    }
+
+    BoundedQueue(BoundedQueue& other) = delete;
+    BoundedQueue(BoundedQueue&& other) = delete;
+    void operator=(const BoundedQueue&) = delete;
+    void operator=(BoundedQueue&&) = delete;
+
+    // Waits for room for the item. Returns false, dropping it, if the queue
+    // has been closed.
+    bool push(T item)
+    {
+        const size_t head = d_head.load(std::memory_order_relaxed);
+        auto is_full = [&] { return head - d_tail.load(std::memory_order_acquire) == d_slots.size(); };
+        if (is_full()) {
+            std::unique_lock<std::mutex> lock(d_mutex);
+            while (!d_closed.load() && is_full()) {
+                d_not_full.wait_for(lock, WAIT_INTERVAL);
+            }
+        }
+        if (d_closed.load()) {
+            return false;
+        }
+
+        d_slots[head % d_slots.size()] = std::move(item);
+        d_head.store(head + 1, std::memory_order_release);
+        d_not_empty.notify_one();
+        return true;
+    }
+
+    // Waits for the next item. Returns false once the queue has been closed
+    // and every item pushed before that has been popped.
+    bool pop(T* item)
+    {
+        const size_t tail = d_tail.load(std::memory_order_relaxed);
+        auto is_empty = [&] { return d_head.load(std::memory_order_acquire) == tail; };
+        if (is_empty()) {
+            std::unique_lock<std::mutex> lock(d_mutex);
+            while (!d_closed.load() && is_empty()) {
+                d_not_empty.wait_for(lock, WAIT_INTERVAL);
+            }
+            if (is_empty()) {
+                return false;
+            }
+        }
+
+        *item = std::move(d_slots[tail % d_slots.size()]);
+        d_tail.store(tail + 1, std::memory_order_release);
+        d_not_full.notify_one();
+        return true;
+    }
+
+    // Called by either side once it's done. Wakes up the other one.
+    void close()
+    {
+        d_closed = true;
+        d_not_empty.notify_all();
+        d_not_full.notify_all();
+    }
+
+  private:
+    static constexpr std::chrono::milliseconds WAIT_INTERVAL{1};
+
+    std::vector<T> d_slots;
+    alignas(64) std::atomic<size_t> d_head{0};
+    alignas(64) std::atomic<size_t> d_tail{0};
+    std::atomic<bool> d_closed{false};
+
+    std::mutex d_mutex;
+    std::condition_variable d_not_empty;
+    std::condition_variable d_not_full;
+};
+
+}  // namespace memray::io
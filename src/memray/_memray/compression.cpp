@@ -0,0 +1,581 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "compression.h"
+#include "logging.h"
+
+namespace memray::io {
+
+namespace {  // unnamed
+
+// zstd reserves 16 magic numbers for skippable frames. We use one of them to
+// embed the trained dictionary (if any) in front of the compressed capture, so
+// that it can be decompressed without knowing which dictionary was used.
+const uint32_t DICTIONARY_FRAME_MAGIC = ZSTD_MAGIC_SKIPPABLE_START | 0xD;
+
+const uint32_t LZ4_FRAME_MAGIC = 0x184D2204;
+
+const uint32_t LZ4_SKIPPABLE_FRAME_MAGIC = 0x184D2A50;
+const uint8_t LZ4_FLAG_CONTENT_CHECKSUM = 0x04;
+const uint8_t LZ4_FLAG_CONTENT_SIZE = 0x08;
+const uint8_t LZ4_FLAG_BLOCK_CHECKSUM = 0x10;
+const uint8_t LZ4_FLAG_DICTIONARY_ID = 0x01;
+const uint32_t LZ4_UNCOMPRESSED_BLOCK_BIT = 0x80000000;
+
+const size_t LZ4_FRAME_CONTENT_SIZE = 4 * 1024 * 1024;
+const uint64_t MAX_LZ4_FRAME_CONTENT_SIZE = 256 * 1024 * 1024;
+const unsigned int MAX_DECOMPRESSION_THREADS = 4;
+
+// How much ReadAheadInputBuffer reads at a time, and how many of those reads
+// it can be ahead of the consuming thread.
+const size_t READ_AHEAD_BLOCK_SIZE = 1024 * 1024;
+const size_t READ_AHEAD_BLOCKS = 4;
+
+uint32_t
+readLittleEndian32(const unsigned char* data)
+{
+    return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8
+           | static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+}
+
+uint64_t
+readLittleEndian64(const unsigned char* data)
+{
+    return static_cast<uint64_t>(readLittleEndian32(data))
+           | static_cast<uint64_t>(readLittleEndian32(data + 4)) << 32;
+}
+
+void
+writeLittleEndian32(std::ostream& out, uint32_t value)
+{
+    char data[4] = {
+            static_cast<char>(value & 0xff),
+            static_cast<char>((value >> 8) & 0xff),
+            static_cast<char>((value >> 16) & 0xff),
+            static_cast<char>((value >> 24) & 0xff)};
+    out.write(data, sizeof(data));
+}
+
+bool
+compressWithLz4(std::istream& in, std::ostream& out, int level)
+{
+    // Each block of the input is compressed into its own LZ4 frame, with the
+    // uncompressed size recorded in the frame header. This lets the reader
+    // decompress several frames in parallel into buffers of the right size.
+    LZ4F_preferences_t prefs;
+    memset(&prefs, 0, sizeof(prefs));
+    prefs.compressionLevel = level;
+    prefs.frameInfo.contentSize = 1;  // Replaced with the real size by LZ4F_compressFrame
+
+    std::vector<char> in_buf(LZ4_FRAME_CONTENT_SIZE);
+    std::vector<char> out_buf(LZ4F_compressFrameBound(in_buf.size(), &prefs));
+
+    while (in) {
+        in.read(in_buf.data(), in_buf.size());
+        if (in.bad()) {
+            return false;
+        }
+        if (in.gcount() == 0) {
+            break;
+        }
+        size_t ret = LZ4F_compressFrame(out_buf.data(), out_buf.size(), in_buf.data(), in.gcount(), &prefs);
+        if (LZ4F_isError(ret)) {
+            return false;
+        }
+        out.write(out_buf.data(), ret);
+    }
+    return in.eof() && out;
+}
+
+bool
+readExactly(std::istream& in, std::vector<char>* buffer, size_t length)
+{
+    size_t offset = buffer->size();
+    buffer->resize(offset + length);
+    in.read(buffer->data() + offset, length);
+    return static_cast<size_t>(in.gcount()) == length;
+}
+
+bool
+compressWithZstd(std::istream& in, std::ostream& out, int level, const std::string& dictionary_path)
+{
+    std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> ctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    if (!ctx) {
+        return false;
+    }
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_compressionLevel, level))
+        || ZSTD_isError(ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_checksumFlag, 1)))
+    {
+        return false;
+    }
+
+    if (!dictionary_path.empty()) {
+        std::ifstream dict_file(dictionary_path, std::ios::binary);
+        std::vector<char> dictionary(
+                (std::istreambuf_iterator<char>(dict_file)),
+                std::istreambuf_iterator<char>());
+        if (!dict_file || dictionary.empty()
+            || ZSTD_isError(ZSTD_CCtx_loadDictionary(ctx.get(), dictionary.data(), dictionary.size())))
+        {
+            LOG(ERROR) << "Failed to load compression dictionary " << dictionary_path;
+            return false;
+        }
+        writeLittleEndian32(out, DICTIONARY_FRAME_MAGIC);
+        writeLittleEndian32(out, static_cast<uint32_t>(dictionary.size()));
+        out.write(dictionary.data(), dictionary.size());
+    }
+
+    std::vector<char> in_buf(ZSTD_CStreamInSize());
+    std::vector<char> out_buf(ZSTD_CStreamOutSize());
+
+    bool last_chunk = false;
+    while (!last_chunk) {
+        in.read(in_buf.data(), in_buf.size());
+        if (in.bad()) {
+            return false;
+        }
+        last_chunk = in.eof();
+        ZSTD_EndDirective mode = last_chunk ? ZSTD_e_end : ZSTD_e_continue;
+        ZSTD_inBuffer input = {in_buf.data(), static_cast<size_t>(in.gcount()), 0};
+
+        bool finished = false;
+        while (!finished) {
+            ZSTD_outBuffer output = {out_buf.data(), out_buf.size(), 0};
+            size_t remaining = ZSTD_compressStream2(ctx.get(), &output, &input, mode);
+            if (ZSTD_isError(remaining)) {
+                return false;
+            }
+            out.write(out_buf.data(), output.pos);
+            finished = last_chunk ? remaining == 0 : input.pos == input.size;
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+}  // unnamed namespace
+
+bool
+compressStream(std::istream& in, std::ostream& out, const CompressionOptions& options) noexcept
+{
+    try {
+        switch (options.codec) {
+            case CompressionCodec::NONE:
+                out << in.rdbuf();
+                return static_cast<bool>(out);
+            case CompressionCodec::LZ4:
+                return compressWithLz4(in, out, options.level);
+            case CompressionCodec::ZSTD:
+                return compressWithZstd(in, out, options.level, options.dictionary_path);
+        }
+    } catch (...) {
+    }
+    return false;
+}
+
+CompressionCodec
+detectCompressionCodec(std::istream& in)
+{
+    unsigned char magic_bytes[4] = {};
+    in.read(reinterpret_cast<char*>(magic_bytes), sizeof(magic_bytes));
+    bool got_magic = in.gcount() == sizeof(magic_bytes);
+    in.clear();
+    in.seekg(0, std::ios::beg);
+    if (!got_magic) {
+        return CompressionCodec::NONE;
+    }
+
+    uint32_t magic = readLittleEndian32(magic_bytes);
+    if (magic == LZ4_FRAME_MAGIC) {
+        return CompressionCodec::LZ4;
+    }
+    if (magic == ZSTD_MAGICNUMBER || magic == DICTIONARY_FRAME_MAGIC) {
+        return CompressionCodec::ZSTD;
+    }
+    return CompressionCodec::NONE;
+}
+
+bool
+hasIndependentLz4Frames(std::istream& in)
+{
+    unsigned char header[5] = {};
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    bool got_header = in.gcount() == sizeof(header);
+    in.clear();
+    in.seekg(0, std::ios::beg);
+    return got_header && readLittleEndian32(header) == LZ4_FRAME_MAGIC
+           && (header[4] & LZ4_FLAG_CONTENT_SIZE);
+}
+
+Lz4BlockInputBuffer::Lz4BlockInputBuffer(std::istream& source, unsigned int num_threads)
+: d_source(source)
+, d_ring(2 * num_threads)
+{
+    setg(nullptr, nullptr, nullptr);
+    for (unsigned int i = 0; i < num_threads; ++i) {
+        d_workers.emplace_back(&Lz4BlockInputBuffer::workerThread, this);
+    }
+}
+
+Lz4BlockInputBuffer::~Lz4BlockInputBuffer()
+{
+    {
+        std::lock_guard<std::mutex> lock(d_mutex);
+        d_stopping = true;
+    }
+    d_work_available.notify_all();
+    for (auto& worker : d_workers) {
+        worker.join();
+    }
+}
+
+bool
+Lz4BlockInputBuffer::readNextFrame(Block* block)
+{
+    block->compressed.clear();
+    while (true) {
+        unsigned char magic_bytes[4];
+        d_source.read(reinterpret_cast<char*>(magic_bytes), sizeof(magic_bytes));
+        if (d_source.gcount() == 0) {
+            return false;
+        }
+        if (d_source.gcount() != sizeof(magic_bytes)) {
+            throw std::runtime_error("Truncated LZ4 frame header");
+        }
+        uint32_t magic = readLittleEndian32(magic_bytes);
+        if ((magic & 0xFFFFFFF0) == LZ4_SKIPPABLE_FRAME_MAGIC) {
+            unsigned char size_bytes[4];
+            d_source.read(reinterpret_cast<char*>(size_bytes), sizeof(size_bytes));
+            d_source.ignore(readLittleEndian32(size_bytes));
+            continue;
+        }
+        if (magic != LZ4_FRAME_MAGIC) {
+            throw std::runtime_error("Invalid LZ4 frame magic number");
+        }
+        block->compressed.assign(magic_bytes, magic_bytes + sizeof(magic_bytes));
+        break;
+    }
+
+    // The frame descriptor: flags, block descriptor, optional content size and
+    // dictionary id, and a header checksum.
+    auto& data = block->compressed;
+    if (!readExactly(d_source, &data, 2)) {
+        throw std::runtime_error("Truncated LZ4 frame header");
+    }
+    uint8_t flags = data[4];
+    if (!(flags & LZ4_FLAG_CONTENT_SIZE)) {
+        throw std::runtime_error("LZ4 frame without a content size");
+    }
+    size_t descriptor_size = 8 + (flags & LZ4_FLAG_DICTIONARY_ID ? 4 : 0) + 1;
+    if (!readExactly(d_source, &data, descriptor_size)) {
+        throw std::runtime_error("Truncated LZ4 frame header");
+    }
+    block->content_size = readLittleEndian64(reinterpret_cast<unsigned char*>(&data[6]));
+    if (block->content_size > MAX_LZ4_FRAME_CONTENT_SIZE) {
+        throw std::runtime_error("LZ4 frame is too large");
+    }
+
+    // The data blocks, terminated by an empty block.
+    size_t block_checksum_size = flags & LZ4_FLAG_BLOCK_CHECKSUM ? 4 : 0;
+    while (true) {
+        size_t offset = data.size();
+        if (!readExactly(d_source, &data, 4)) {
+            throw std::runtime_error("Truncated LZ4 block");
+        }
+        uint32_t block_size = readLittleEndian32(reinterpret_cast<unsigned char*>(&data[offset]))
+                              & ~LZ4_UNCOMPRESSED_BLOCK_BIT;
+        if (block_size == 0) {
+            break;
+        }
+        if (!readExactly(d_source, &data, block_size + block_checksum_size)) {
+            throw std::runtime_error("Truncated LZ4 block");
+        }
+    }
+    if ((flags & LZ4_FLAG_CONTENT_CHECKSUM) && !readExactly(d_source, &data, 4)) {
+        throw std::runtime_error("Truncated LZ4 frame checksum");
+    }
+    return true;
+}
+
+void
+Lz4BlockInputBuffer::readAhead()
+{
+    // Called by the consuming thread. Hands every free slot of the ring, in
+    // order, a new frame to be decompressed by the workers.
+    while (!d_source_exhausted) {
+        Block* block = &d_ring[d_next_to_fill];
+        {
+            std::lock_guard<std::mutex> lock(d_mutex);
+            if (block->state != Block::State::EMPTY) {
+                return;
+            }
+        }
+        if (!readNextFrame(block)) {
+            d_source_exhausted = true;
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(d_mutex);
+            block->state = Block::State::PENDING;
+            d_work_queue.push_back(block);
+        }
+        d_work_available.notify_one();
+        d_next_to_fill = (d_next_to_fill + 1) % d_ring.size();
+    }
+}
+
+Lz4BlockInputBuffer::int_type
+Lz4BlockInputBuffer::underflow()
+{
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    while (true) {
+        if (d_current) {
+            std::lock_guard<std::mutex> lock(d_mutex);
+            d_current->state = Block::State::EMPTY;
+            d_current = nullptr;
+        }
+        readAhead();
+
+        Block* block = &d_ring[d_next_to_consume];
+        std::unique_lock<std::mutex> lock(d_mutex);
+        if (block->state == Block::State::EMPTY) {
+            return traits_type::eof();
+        }
+        d_block_done.wait(lock, [&] { return block->state != Block::State::PENDING; });
+        if (block->state == Block::State::FAILED) {
+            throw std::runtime_error("Failed to decompress LZ4 frame");
+        }
+
+        d_current = block;
+        d_next_to_consume = (d_next_to_consume + 1) % d_ring.size();
+        if (block->content_size == 0) {
+            continue;
+        }
+        char* data = block->decompressed.data();
+        setg(data, data, data + block->content_size);
+        return traits_type::to_int_type(*gptr());
+    }
+}
+
+bool
+Lz4BlockInputBuffer::decompressFrame(LZ4F_dctx* ctx, Block* block)
+{
+    block->decompressed.resize(block->content_size);
+    char* src = block->compressed.data();
+    char* src_end = src + block->compressed.size();
+    char* dst = block->decompressed.data();
+    char* dst_end = dst + block->decompressed.size();
+
+    size_t ret = 1;
+    while (ret != 0 && src < src_end) {
+        size_t src_size = src_end - src;
+        size_t dst_size = dst_end - dst;
+        ret = LZ4F_decompress(ctx, dst, &dst_size, src, &src_size, nullptr);
+        if (LZ4F_isError(ret)) {
+            LZ4F_resetDecompressionContext(ctx);
+            return false;
+        }
+        src += src_size;
+        dst += dst_size;
+    }
+    return ret == 0 && dst == dst_end;
+}
+
+void
+Lz4BlockInputBuffer::workerThread()
+{
+    LZ4F_dctx* ctx = nullptr;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION))) {
+        ctx = nullptr;
+    }
+    std::unique_ptr<LZ4F_dctx, decltype(&LZ4F_freeDecompressionContext)> ctx_guard(
+            ctx,
+            LZ4F_freeDecompressionContext);
+
+    while (true) {
+        Block* block;
+        {
+            std::unique_lock<std::mutex> lock(d_mutex);
+            d_work_available.wait(lock, [&] { return d_stopping || !d_work_queue.empty(); });
+            if (d_stopping) {
+                return;
+            }
+            block = d_work_queue.front();
+            d_work_queue.pop_front();
+        }
+
+        bool success = ctx && decompressFrame(ctx, block);
+
+        {
+            std::lock_guard<std::mutex> lock(d_mutex);
+            block->state = success ? Block::State::READY : Block::State::FAILED;
+        }
+        d_block_done.notify_all();
+    }
+}
+
+Lz4BlockInputStream::Lz4BlockInputStream(std::istream& source)
+: std::istream(nullptr)
+, d_buffer(
+          source,
+          std::max(1u, std::min(MAX_DECOMPRESSION_THREADS, std::thread::hardware_concurrency())))
+{
+    rdbuf(&d_buffer);
+}
+
+ZstdInputBuffer::ZstdInputBuffer(std::istream& source)
+: d_source(source)
+, d_context(ZSTD_createDCtx())
+, d_in_buffer(ZSTD_DStreamInSize())
+, d_out_buffer(ZSTD_DStreamOutSize())
+{
+    if (!d_context) {
+        throw std::runtime_error("Failed to create zstd decompression context");
+    }
+    setg(d_out_buffer.data(), d_out_buffer.data(), d_out_buffer.data());
+    loadEmbeddedDictionary();
+}
+
+ZstdInputBuffer::~ZstdInputBuffer()
+{
+    ZSTD_freeDCtx(d_context);
+}
+
+void
+ZstdInputBuffer::loadEmbeddedDictionary()
+{
+    unsigned char frame_header[8] = {};
+    d_source.read(reinterpret_cast<char*>(frame_header), sizeof(frame_header));
+    if (d_source.gcount() != sizeof(frame_header)
+        || readLittleEndian32(frame_header) != DICTIONARY_FRAME_MAGIC)
+    {
+        d_source.clear();
+        d_source.seekg(0, std::ios::beg);
+        return;
+    }
+
+    std::vector<char> dictionary(readLittleEndian32(frame_header + 4));
+    d_source.read(dictionary.data(), dictionary.size());
+    if (static_cast<size_t>(d_source.gcount()) != dictionary.size()
+        || ZSTD_isError(ZSTD_DCtx_loadDictionary(d_context, dictionary.data(), dictionary.size())))
+    {
+        throw std::runtime_error("Failed to load the dictionary embedded in the zstd stream");
+    }
+}
+
+ZstdInputBuffer::int_type
+ZstdInputBuffer::underflow()
+{
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    while (true) {
+        // A full output buffer means zstd may still hold decompressed data,
+        // which has to be flushed before reading more or giving up.
+        if (d_input.pos == d_input.size && !d_output_was_full) {
+            d_source.read(d_in_buffer.data(), d_in_buffer.size());
+            size_t bytes_read = d_source.gcount();
+            if (bytes_read == 0) {
+                return traits_type::eof();
+            }
+            d_input = {d_in_buffer.data(), bytes_read, 0};
+        }
+
+        ZSTD_outBuffer output = {d_out_buffer.data(), d_out_buffer.size(), 0};
+        size_t ret = ZSTD_decompressStream(d_context, &output, &d_input);
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error(std::string("Failed to decompress zstd stream: ") + ZSTD_getErrorName(ret));
+        }
+        d_output_was_full = output.pos == output.size;
+        if (output.pos > 0) {
+            setg(d_out_buffer.data(), d_out_buffer.data(), d_out_buffer.data() + output.pos);
+            return traits_type::to_int_type(*gptr());
+        }
+    }
+}
+
+ZstdInputStream::ZstdInputStream(std::istream& source)
+: std::istream(nullptr)
+, d_buffer(source)
+{
+    rdbuf(&d_buffer);
+}
+
+ReadAheadInputBuffer::ReadAheadInputBuffer(std::shared_ptr<std::istream> source)
+: d_source(std::move(source))
+, d_blocks(READ_AHEAD_BLOCKS)
+{
+    setg(nullptr, nullptr, nullptr);
+    d_reader = std::thread(&ReadAheadInputBuffer::readerThread, this);
+}
+
+ReadAheadInputBuffer::~ReadAheadInputBuffer()
+{
+    close();
+}
+
+void
+ReadAheadInputBuffer::close()
+{
+    std::call_once(d_close_once, [this] {
+        d_blocks.close();
+        d_reader.join();
+    });
+}
+
+void
+ReadAheadInputBuffer::readerThread()
+{
+    try {
+        while (true) {
+            std::vector<char> block(READ_AHEAD_BLOCK_SIZE);
+            d_source->read(block.data(), block.size());
+            block.resize(d_source->gcount());
+            if (block.empty() || !d_blocks.push(std::move(block)) || !*d_source) {
+                break;
+            }
+        }
+    } catch (...) {
+        d_error = std::current_exception();
+    }
+    d_blocks.close();
+}
+
+ReadAheadInputBuffer::int_type
+ReadAheadInputBuffer::underflow()
+{
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    if (!d_blocks.pop(&d_current)) {
+        if (d_error) {
+            std::rethrow_exception(d_error);
+        }
+        return traits_type::eof();
+    }
+    setg(d_current.data(), d_current.data(), d_current.data() + d_current.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+ReadAheadInputStream::ReadAheadInputStream(std::shared_ptr<std::istream> source)
+: std::istream(nullptr)
+, d_buffer(std::move(source))
+{
+    rdbuf(&d_buffer);
+}
+
+void
+ReadAheadInputStream::close()
+{
+    d_buffer.close();
+}
+
+}  // namespace memray::io
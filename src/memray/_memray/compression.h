@@ -0,0 +1,178 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <lz4frame.h>
+#include <zstd.h>
+
+#include "bounded_queue.h"
+
+namespace memray::io {
+
+enum class CompressionCodec {
+    NONE,
+    LZ4,
+    ZSTD,
+};
+
+struct CompressionOptions
+{
+    CompressionCodec codec{CompressionCodec::LZ4};
+    int level{0};  // 0 selects the codec's default level
+    std::string dictionary_path{};
+};
+
+// Compresses everything readable from `in` into `out` using the requested codec.
+// Returns false if the input could not be read or the compressor failed.
+bool
+compressStream(std::istream& in, std::ostream& out, const CompressionOptions& options) noexcept;
+
+// Inspects the magic number at the start of `in` to find out which codec, if any, produced the
+// stream. The stream is rewound to its start before returning.
+CompressionCodec
+detectCompressionCodec(std::istream& in);
+
+// Returns true if `in` is an LZ4 stream made of independent, size-prefixed frames, as written by
+// `compressStream`, which can be decompressed in parallel by `Lz4BlockInputBuffer`. Captures
+// compressed by older versions are a single frame without a content size and must be read
+// serially. The stream is rewound to its start before returning.
+bool
+hasIndependentLz4Frames(std::istream& in);
+
+// A stream buffer over a sequence of independent LZ4 frames. Frames are read from the source by
+// the consuming thread and decompressed ahead of it by a small pool of worker threads into a ring
+// of buffers. The get area points straight into the decompressed buffer of the current frame.
+class Lz4BlockInputBuffer : public std::streambuf
+{
+  public:
+    explicit Lz4BlockInputBuffer(std::istream& source, unsigned int num_threads);
+    ~Lz4BlockInputBuffer() override;
+    Lz4BlockInputBuffer(const Lz4BlockInputBuffer&) = delete;
+    Lz4BlockInputBuffer& operator=(const Lz4BlockInputBuffer&) = delete;
+
+  private:
+    struct Block
+    {
+        enum class State {
+            EMPTY,
+            PENDING,
+            READY,
+            FAILED,
+        };
+        State state{State::EMPTY};
+        uint64_t content_size{0};
+        std::vector<char> compressed;
+        std::vector<char> decompressed;
+    };
+
+    int_type underflow() override;
+    void readAhead();
+    bool readNextFrame(Block* block);
+    void workerThread();
+    static bool decompressFrame(LZ4F_dctx* ctx, Block* block);
+
+    std::istream& d_source;
+    bool d_source_exhausted{false};
+    std::vector<Block> d_ring;
+    size_t d_next_to_fill{0};
+    size_t d_next_to_consume{0};
+    Block* d_current{nullptr};
+
+    std::mutex d_mutex;
+    std::condition_variable d_work_available;
+    std::condition_variable d_block_done;
+    std::deque<Block*> d_work_queue;
+    bool d_stopping{false};
+    std::vector<std::thread> d_workers;
+};
+
+class Lz4BlockInputStream : public std::istream
+{
+  public:
+    explicit Lz4BlockInputStream(std::istream& source);
+
+  private:
+    Lz4BlockInputBuffer d_buffer;
+};
+
+class ZstdInputBuffer : public std::streambuf
+{
+  public:
+    explicit ZstdInputBuffer(std::istream& source);
+    ~ZstdInputBuffer() override;
+    ZstdInputBuffer(const ZstdInputBuffer&) = delete;
+    ZstdInputBuffer& operator=(const ZstdInputBuffer&) = delete;
+
+  private:
+    int_type underflow() override;
+    void loadEmbeddedDictionary();
+
+    std::istream& d_source;
+    ZSTD_DCtx* d_context{nullptr};
+    std::vector<char> d_in_buffer;
+    std::vector<char> d_out_buffer;
+    ZSTD_inBuffer d_input{};
+    bool d_output_was_full{false};
+};
+
+// An input stream that decompresses a zstd stream written by `compressStream`, including the
+// trained dictionary that may be embedded at the start of it.
+class ZstdInputStream : public std::istream
+{
+  public:
+    explicit ZstdInputStream(std::istream& source);
+
+  private:
+    ZstdInputBuffer d_buffer;
+};
+
+// A stream buffer that reads another stream a block at a time on a thread of its own, ahead of the
+// consuming thread. Streams that can only be decompressed serially are read through it, so that they
+// are decompressed while the consuming thread decodes the records that were decompressed before.
+class ReadAheadInputBuffer : public std::streambuf
+{
+  public:
+    explicit ReadAheadInputBuffer(std::shared_ptr<std::istream> source);
+    ~ReadAheadInputBuffer() override;
+    ReadAheadInputBuffer(const ReadAheadInputBuffer&) = delete;
+    ReadAheadInputBuffer& operator=(const ReadAheadInputBuffer&) = delete;
+
+    // Stops reading ahead and waits for the reading thread to finish. Once it
+    // returns the source isn't read anymore, and reads from this buffer only
+    // return data that was already read from it.
+    void close();
+
+  private:
+    int_type underflow() override;
+    void readerThread();
+
+    std::shared_ptr<std::istream> d_source;
+    BoundedQueue<std::vector<char>> d_blocks;
+    std::vector<char> d_current;
+    std::exception_ptr d_error{};
+    std::thread d_reader;
+    std::once_flag d_close_once;
+};
+
+class ReadAheadInputStream : public std::istream
+{
+  public:
+    explicit ReadAheadInputStream(std::shared_ptr<std::istream> source);
+    void close();
+
+  private:
+    ReadAheadInputBuffer d_buffer;
+};
+
+}  // namespace memray::io
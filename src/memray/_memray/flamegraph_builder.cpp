@@ -0,0 +1,319 @@
+#include "flamegraph_builder.h"
+
+namespace memray::api {
+
+FlameGraphBuilder::FlameGraphBuilder(bool inverted, size_t max_stacks)
+: d_inverted(inverted)
+, d_max_stacks(max_stacks)
+{
+    addRootNode(d_tree);
+    if (d_inverted) {
+        addRootNode(d_no_imports_tree);
+    }
+}
+
+void
+FlameGraphBuilder::addRootNode(Tree& tree)
+{
+    Nodes& nodes = tree.nodes;
+    nodes.name.push_back(registerString("<root>"));
+    // Already escaped, like every other location's strings.
+    nodes.function.push_back(registerString("&lt;tracker&gt;"));
+    nodes.filename.push_back(registerString("<b>memray</b>"));
+    nodes.lineno.push_back(0);
+    nodes.children.emplace_back();
+    nodes.value.push_back(0);
+    nodes.n_allocations.push_back(0);
+    nodes.thread_id.push_back(registerString("0x0"));
+    nodes.interesting.push_back(1);
+    nodes.import_system.push_back(0);
+}
+
+FlameGraphBuilder::string_id_t
+FlameGraphBuilder::registerString(const std::string& string)
+{
+    auto [it, inserted] = d_index_by_string.try_emplace(string, d_strings.size());
+    if (inserted) {
+        d_strings.push_back(string);
+    }
+    return it->second;
+}
+
+const std::vector<std::string>&
+FlameGraphBuilder::strings() const
+{
+    return d_strings;
+}
+
+FlameGraphBuilder::location_id_t
+FlameGraphBuilder::internLocation(const RecordReader::StackFrame& frame)
+{
+    frame_key_t key{frame.function_name, frame.filename, frame.lineno};
+    auto it = d_location_by_frame.find(key);
+    if (it != d_location_by_frame.end()) {
+        return it->second;
+    }
+    location_id_t location = internLocation(*frame.function_name, *frame.filename, frame.lineno);
+    d_location_by_frame.emplace(key, location);
+    return location;
+}
+
+FlameGraphBuilder::location_id_t
+FlameGraphBuilder::internLocation(const std::string& function, const std::string& filename, int lineno)
+{
+    auto [it, inserted] = d_location_by_key.try_emplace({function, filename, lineno}, d_locations.size());
+    if (inserted) {
+        d_locations.push_back({});
+        d_locations.back().lineno = lineno;
+    }
+    return it->second;
+}
+
+size_t
+FlameGraphBuilder::numLocations() const
+{
+    return d_locations.size();
+}
+
+void
+FlameGraphBuilder::describeLocation(
+        location_id_t location,
+        string_id_t name,
+        string_id_t function,
+        string_id_t filename,
+        bool skip,
+        bool interesting,
+        bool import_system)
+{
+    Location& described = d_locations.at(location);
+    described.name = name;
+    described.function = function;
+    described.filename = filename;
+    described.skip = skip;
+    described.interesting = interesting;
+    described.import_system = import_system;
+}
+
+std::pair<FlameGraphBuilder::node_id_t, FlameGraphBuilder::node_id_t>
+FlameGraphBuilder::addStack(
+        const std::vector<location_id_t>& stack,
+        string_id_t thread,
+        size_t size,
+        size_t n_allocations)
+{
+    if (!d_inverted) {
+        node_id_t node = addToTree(d_tree, stack.rbegin(), stack.rend(), thread, size, n_allocations);
+        return {node, 0};
+    }
+
+    node_id_t node = addToTree(d_tree, stack.begin(), stack.end(), thread, size, n_allocations);
+
+    // Leave out the outermost import system frame and everything it called.
+    auto first_kept = stack.end();
+    while (first_kept != stack.begin() && !d_locations[*(first_kept - 1)].import_system) {
+        --first_kept;
+    }
+    node_id_t no_imports_node =
+            addToTree(d_no_imports_tree, first_kept, stack.end(), thread, size, n_allocations);
+    return {node, no_imports_node};
+}
+
+template<typename Iterator>
+FlameGraphBuilder::node_id_t
+FlameGraphBuilder::addToTree(
+        Tree& tree,
+        Iterator begin,
+        Iterator end,
+        string_id_t thread,
+        size_t size,
+        size_t n_allocations)
+{
+    Nodes& nodes = tree.nodes;
+    node_id_t current = 0;
+    nodes.value[current] += size;
+    nodes.n_allocations[current] += n_allocations;
+
+    size_t num_skipped_frames = 0;
+    bool is_import_system = false;
+    size_t index = 0;
+    for (auto it = begin; it != end; ++it, ++index) {
+        const Location& location = d_locations[*it];
+        auto [node_it, inserted] = tree.index_by_key.try_emplace({current, *it, thread}, nodes.name.size());
+        if (inserted) {
+            if (location.skip) {
+                tree.index_by_key.erase(node_it);
+                ++num_skipped_frames;
+                continue;
+            }
+            // Only a regular flame graph marks what the import system called.
+            if (!d_inverted && !is_import_system) {
+                is_import_system = location.import_system;
+            }
+            nodes.children[current].push_back(node_it->second);
+            nodes.name.push_back(location.name);
+            nodes.function.push_back(location.function);
+            nodes.filename.push_back(location.filename);
+            nodes.lineno.push_back(location.lineno);
+            nodes.children.emplace_back();
+            nodes.value.push_back(0);
+            nodes.n_allocations.push_back(0);
+            nodes.thread_id.push_back(thread);
+            nodes.interesting.push_back(location.interesting);
+            nodes.import_system.push_back(is_import_system);
+        }
+        current = node_it->second;
+        is_import_system = nodes.import_system[current];
+        nodes.value[current] += size;
+        nodes.n_allocations[current] += n_allocations;
+
+        if (index - num_skipped_frames > d_max_stacks) {
+            nodes.name[current] = registerString("<STACK TOO DEEP>");
+            nodes.function[current] = registerString("...");
+            nodes.filename[current] = registerString("...");
+            nodes.lineno[current] = 0;
+            break;
+        }
+    }
+    return current;
+}
+
+void
+FlameGraphBuilder::prune(double fraction)
+{
+    d_tree.nodes = pruneNodes(d_tree.nodes, fraction);
+    d_no_imports_tree.nodes = pruneNodes(d_no_imports_tree.nodes, fraction);
+    // The keys refer to the nodes' old ids.
+    d_tree.index_by_key.clear();
+    d_no_imports_tree.index_by_key.clear();
+}
+
+FlameGraphBuilder::Nodes
+FlameGraphBuilder::pruneNodes(const Nodes& nodes, double fraction)
+{
+    Nodes pruned;
+    if (nodes.name.empty()) {
+        return pruned;
+    }
+    const double threshold = fraction * static_cast<double>(nodes.value[0]);
+    const string_id_t other_name = registerString("<OTHER FRAMES>");
+    const string_id_t other_location = registerString("...");
+
+    auto copyNode = [&](node_id_t node) {
+        pruned.name.push_back(nodes.name[node]);
+        pruned.function.push_back(nodes.function[node]);
+        pruned.filename.push_back(nodes.filename[node]);
+        pruned.lineno.push_back(nodes.lineno[node]);
+        pruned.children.emplace_back();
+        pruned.value.push_back(nodes.value[node]);
+        pruned.n_allocations.push_back(nodes.n_allocations[node]);
+        pruned.thread_id.push_back(nodes.thread_id[node]);
+        pruned.interesting.push_back(nodes.interesting[node]);
+        pruned.import_system.push_back(nodes.import_system[node]);
+        return pruned.name.size() - 1;
+    };
+
+    // Pairs of the id of a node and the id of its copy, whose children are
+    // still to be copied or folded.
+    std::vector<std::pair<node_id_t, node_id_t>> pending{{0, copyNode(0)}};
+    std::vector<node_id_t> others;
+    while (!pending.empty()) {
+        auto [node, copy] = pending.back();
+        pending.pop_back();
+        others.clear();
+        for (node_id_t child : nodes.children[node]) {
+            if (static_cast<double>(nodes.value[child]) >= threshold) {
+                node_id_t child_copy = copyNode(child);
+                pruned.children[copy].push_back(child_copy);
+                pending.emplace_back(child, child_copy);
+                continue;
+            }
+
+            // Children are only folded together if they would be shown or
+            // hidden together, so that filtering by thread or by kind of
+            // frame still gives the same totals.
+            node_id_t other = 0;
+            for (node_id_t candidate : others) {
+                if (pruned.thread_id[candidate] == nodes.thread_id[child]
+                    && pruned.interesting[candidate] == nodes.interesting[child]
+                    && pruned.import_system[candidate] == nodes.import_system[child])
+                {
+                    other = candidate;
+                    break;
+                }
+            }
+            if (other == 0) {
+                other = copyNode(child);
+                pruned.name[other] = other_name;
+                pruned.function[other] = other_location;
+                pruned.filename[other] = other_location;
+                pruned.lineno[other] = 0;
+                pruned.value[other] = 0;
+                pruned.n_allocations[other] = 0;
+                pruned.children[copy].push_back(other);
+                others.push_back(other);
+            }
+            pruned.value[other] += nodes.value[child];
+            pruned.n_allocations[other] += nodes.n_allocations[child];
+        }
+    }
+    return pruned;
+}
+
+const FlameGraphBuilder::Nodes&
+FlameGraphBuilder::nodes() const
+{
+    return d_tree.nodes;
+}
+
+const FlameGraphBuilder::Nodes&
+FlameGraphBuilder::invertedNoImportsNodes() const
+{
+    return d_no_imports_tree.nodes;
+}
+
+std::string
+encodeCompactColumn(const std::vector<int64_t>& values)
+{
+    std::string bytes;
+    bytes.reserve(values.size() * 2);
+    int64_t previous = 0;
+    for (int64_t value : values) {
+        // Computed on unsigned values so that it can't overflow. The decoder
+        // adds the deltas up as doubles, so only values up to 2**53 decode
+        // exactly, which the byte counts and indexes stored never come near.
+        auto delta = static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(previous));
+        previous = value;
+        uint64_t zigzag = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+        while (zigzag >= 0x80) {
+            bytes.push_back(static_cast<char>((zigzag & 0x7f) | 0x80));
+            zigzag >>= 7;
+        }
+        bytes.push_back(static_cast<char>(zigzag));
+    }
+
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string encoded;
+    encoded.reserve((bytes.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < bytes.size(); i += 3) {
+        uint32_t chunk = (static_cast<uint8_t>(bytes[i]) << 16) | (static_cast<uint8_t>(bytes[i + 1]) << 8)
+                         | static_cast<uint8_t>(bytes[i + 2]);
+        encoded.push_back(alphabet[(chunk >> 18) & 0x3f]);
+        encoded.push_back(alphabet[(chunk >> 12) & 0x3f]);
+        encoded.push_back(alphabet[(chunk >> 6) & 0x3f]);
+        encoded.push_back(alphabet[chunk & 0x3f]);
+    }
+    if (i < bytes.size()) {
+        uint32_t chunk = static_cast<uint8_t>(bytes[i]) << 16;
+        if (i + 1 < bytes.size()) {
+            chunk |= static_cast<uint8_t>(bytes[i + 1]) << 8;
+        }
+        encoded.push_back(alphabet[(chunk >> 18) & 0x3f]);
+        encoded.push_back(alphabet[(chunk >> 12) & 0x3f]);
+        encoded.push_back(i + 1 < bytes.size() ? alphabet[(chunk >> 6) & 0x3f] : '=');
+        encoded.push_back('=');
+    }
+    return encoded;
+}
+
+}  // namespace memray::api
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "record_reader.h"
+
+namespace memray::api {
+
+// Builds the trees of nodes that the flame graph reports display, from the
+// stacks of the allocations being reported on.
+//
+// Every distinct frame seen is interned as a location, which the reporter
+// describes once: the strings shown for it, and whether it's skipped, is
+// interesting or belongs to the import system. Stacks are then merged into
+// the trees by location id, and the result is kept in the packed layout that
+// the reports embed, so it only needs to be converted to Python objects.
+class FlameGraphBuilder
+{
+  public:
+    using string_id_t = size_t;
+    using location_id_t = size_t;
+    using node_id_t = size_t;
+
+    // The nodes of one tree, as parallel arrays indexed by node id. The root
+    // is node 0, and strings are ids in strings().
+    struct Nodes
+    {
+        std::vector<string_id_t> name;
+        std::vector<string_id_t> function;
+        std::vector<string_id_t> filename;
+        std::vector<int> lineno;
+        std::vector<std::vector<node_id_t>> children;
+        std::vector<size_t> value;
+        std::vector<size_t> n_allocations;
+        std::vector<string_id_t> thread_id;
+        std::vector<int> interesting;
+        std::vector<int> import_system;
+    };
+
+    // For an inverted flame graph, a second tree is built that leaves out
+    // each stack's import system frames and everything they called.
+    FlameGraphBuilder(bool inverted, size_t max_stacks);
+
+    string_id_t registerString(const std::string& string);
+    const std::vector<std::string>& strings() const;
+
+    // Locations are numbered in the order they're first interned, so a
+    // location is new if its id is the number of locations before.
+    location_id_t internLocation(const RecordReader::StackFrame& frame);
+    location_id_t internLocation(const std::string& function, const std::string& filename, int lineno);
+    size_t numLocations() const;
+    void describeLocation(
+            location_id_t location,
+            string_id_t name,
+            string_id_t function,
+            string_id_t filename,
+            bool skip,
+            bool interesting,
+            bool import_system);
+
+    // Adds allocations made from a stack of described locations, given from
+    // the innermost frame to the outermost one like stack traces are.
+    // Returns the nodes they were added to in each tree.
+    std::pair<node_id_t, node_id_t> addStack(
+            const std::vector<location_id_t>& stack,
+            string_id_t thread,
+            size_t size,
+            size_t n_allocations);
+
+    // Folds the children of each node that account for less than `fraction`
+    // of all the memory into "other" nodes, so that huge trees can still be
+    // displayed. Nodes are renumbered, so this must only be called once every
+    // stack was added.
+    void prune(double fraction);
+
+    const Nodes& nodes() const;
+    const Nodes& invertedNoImportsNodes() const;
+
+  private:
+    struct Location
+    {
+        string_id_t name{0};
+        string_id_t function{0};
+        string_id_t filename{0};
+        int lineno{0};
+        bool skip{false};
+        bool interesting{false};
+        bool import_system{false};
+    };
+
+    template<typename Key>
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const noexcept
+        {
+            size_t hash = std::hash<decltype(key.a)>{}(key.a);
+            hash = hash * 31 + std::hash<decltype(key.b)>{}(key.b);
+            return hash * 31 + std::hash<decltype(key.c)>{}(key.c);
+        }
+    };
+
+    template<typename A, typename B, typename C>
+    struct Key
+    {
+        A a;
+        B b;
+        C c;
+
+        bool operator==(const Key& other) const
+        {
+            return a == other.a && b == other.b && c == other.c;
+        }
+    };
+
+    // Frames read from a capture have interned strings, so they're looked
+    // up by address before falling back to comparing the strings.
+    using frame_key_t = Key<const std::string*, const std::string*, int>;
+    using location_key_t = Key<std::string, std::string, int>;
+    // The parent node, the location and the thread of a node.
+    using node_key_t = Key<node_id_t, location_id_t, string_id_t>;
+
+    struct Tree
+    {
+        Nodes nodes{};
+        std::unordered_map<node_key_t, node_id_t, KeyHash<node_key_t>> index_by_key{};
+    };
+
+    void addRootNode(Tree& tree);
+    Nodes pruneNodes(const Nodes& nodes, double fraction);
+    template<typename Iterator>
+    node_id_t addToTree(
+            Tree& tree,
+            Iterator begin,
+            Iterator end,
+            string_id_t thread,
+            size_t size,
+            size_t n_allocations);
+
+    const bool d_inverted;
+    const size_t d_max_stacks;
+    std::vector<std::string> d_strings{};
+    std::unordered_map<std::string, string_id_t> d_index_by_string{};
+    std::vector<Location> d_locations{};
+    std::unordered_map<frame_key_t, location_id_t, KeyHash<frame_key_t>> d_location_by_frame{};
+    std::unordered_map<location_key_t, location_id_t, KeyHash<location_key_t>> d_location_by_key{};
+    Tree d_tree{};
+    Tree d_no_imports_tree{};
+};
+
+// Encodes a column of integers compactly for embedding in a report: as the
+// differences between consecutive values, zigzag encoded as varints, in
+// base64. The reports decode it with decodeCompactColumn().
+std::string
+encodeCompactColumn(const std::vector<int64_t>& values);
+
+}  // namespace memray::api
@@ -0,0 +1,45 @@
+from _memray.record_reader cimport StackFrame
+from libc.stdint cimport int64_t
+from libcpp cimport bool
+from libcpp.string cimport string
+from libcpp.utility cimport pair
+from libcpp.vector cimport vector
+
+
+cdef extern from "flamegraph_builder.h" namespace "memray::api":
+    cdef cppclass FlameGraphNodes "memray::api::FlameGraphBuilder::Nodes":
+        vector[size_t] name
+        vector[size_t] function
+        vector[size_t] filename
+        vector[int] lineno
+        vector[vector[size_t]] children
+        vector[size_t] value
+        vector[size_t] n_allocations
+        vector[size_t] thread_id
+        vector[int] interesting
+        vector[int] import_system
+
+    cdef cppclass FlameGraphBuilder:
+        FlameGraphBuilder(bool inverted, size_t max_stacks) except+
+        size_t registerString(const string& string) except+
+        const vector[string]& strings()
+        size_t internLocation(const StackFrame& frame) except+
+        size_t internLocation(const string& function, const string& filename, int lineno) except+
+        size_t numLocations()
+        void describeLocation(
+            size_t location,
+            size_t name,
+            size_t function,
+            size_t filename,
+            bool skip,
+            bool interesting,
+            bool import_system,
+        ) except+
+        pair[size_t, size_t] addStack(
+            const vector[size_t]& stack, size_t thread, size_t size, size_t n_allocations
+        ) except+
+        void prune(double fraction) except+
+        const FlameGraphNodes& nodes()
+        const FlameGraphNodes& invertedNoImportsNodes()
+
+    string encodeCompactColumn(const vector[int64_t]& values) except+
@@ -0,0 +1,302 @@
+#include "live_broker.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+#include "exceptions.h"
+#include "logging.h"
+#include "record_writer.h"
+#include "sink.h"
+
+using namespace memray::exception;
+using namespace std::chrono;
+
+namespace memray::socket_thread {
+
+namespace {
+
+// How often clients are sent the changes since their previous update.
+constexpr int UPDATE_INTERVAL_MS = 100;
+
+// How many bytes a client may have waiting to be sent before it's considered
+// too slow and disconnected.
+constexpr size_t MAX_CLIENT_BACKLOG = 64 * 1024 * 1024;
+
+// How long to wait for each client to receive the end of the stream.
+constexpr int FINAL_SEND_TIMEOUT_MS = 1000;
+
+// Collects what a writer writes for a client until it can be sent.
+class StringSink : public io::Sink
+{
+  public:
+    explicit StringSink(std::string* buffer)
+    : d_buffer(buffer)
+    {
+    }
+
+    bool writeAll(const char* data, size_t length) override
+    {
+        d_buffer->append(data, length);
+        return true;
+    }
+
+    bool seek(off_t, int) override
+    {
+        return false;
+    }
+
+    std::unique_ptr<io::Sink> cloneInChildProcess() override
+    {
+        return {};
+    }
+
+  private:
+    std::string* d_buffer;
+};
+
+}  // namespace
+
+struct LiveBroker::Client
+{
+    int fd{-1};
+    std::string pending{};
+    size_t pending_offset{0};
+    std::unique_ptr<tracking_api::RecordWriter> writer{};
+    api::RecordReader::ReplayCursor cursor{};
+    // The totals the client has been told about, for computing deltas.
+    api::reduced_snapshot_map_t sent_totals{};
+};
+
+LiveBroker::LiveBroker(std::shared_ptr<api::RecordReader> reader, const std::string& host, uint16_t port)
+: d_record_reader(reader)
+, d_reader(reader)
+{
+    sockaddr_in si{};
+    si.sin_family = AF_INET;
+    si.sin_addr.s_addr = ::inet_addr(host.c_str());
+    si.sin_port = htons(port);
+    int yes = 1;
+
+    if ((d_listen_fd = ::socket(PF_INET, SOCK_STREAM, 0)) == -1) {
+        LOG(ERROR) << "Encountered error in 'socket' call: " << strerror(errno);
+        throw IoError{"Failed to open socket"};
+    }
+
+    if (::setsockopt(d_listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1
+        || ::fcntl(d_listen_fd, F_SETFL, O_NONBLOCK) == -1)
+    {
+        LOG(ERROR) << "Encountered error setting socket options: " << strerror(errno);
+        ::close(d_listen_fd);
+        throw IoError{"Failed to set socket options"};
+    }
+
+    if (::bind(d_listen_fd, reinterpret_cast<sockaddr*>(&si), sizeof(si)) == -1) {
+        LOG(WARNING) << "Encountered error in 'bind' call: " << strerror(errno);
+        ::close(d_listen_fd);
+        throw IoError{"Failed to bind to host and port"};
+    }
+
+    socklen_t address_length = sizeof(si);
+    if (::listen(d_listen_fd, SOMAXCONN) == -1
+        || ::getsockname(d_listen_fd, reinterpret_cast<sockaddr*>(&si), &address_length) == -1)
+    {
+        ::close(d_listen_fd);
+        throw IoError{"Encountered error in listen call"};
+    }
+    d_port = ntohs(si.sin_port);
+}
+
+LiveBroker::~LiveBroker()
+{
+    d_stop_thread = true;
+    if (d_thread.joinable()) {
+        d_thread.join();
+    }
+    for (const auto& client : d_clients) {
+        ::close(client->fd);
+    }
+    if (d_listen_fd != -1) {
+        ::close(d_listen_fd);
+    }
+}
+
+void
+LiveBroker::start()
+{
+    d_reader.start();
+    d_active = true;
+    d_thread = std::thread(&LiveBroker::brokerThreadWorker, this);
+}
+
+bool
+LiveBroker::is_active() const
+{
+    return d_active;
+}
+
+uint16_t
+LiveBroker::port() const
+{
+    return d_port;
+}
+
+size_t
+LiveBroker::client_count() const
+{
+    return d_client_count;
+}
+
+void
+LiveBroker::brokerThreadWorker()
+{
+    while (!d_stop_thread) {
+        // Check this before taking the snapshot, so that the last update
+        // includes everything that was read.
+        const bool input_finished = !d_reader.is_active();
+
+        // Wake up early for new clients, so that they get their snapshot
+        // right away.
+        struct pollfd listener = {d_listen_fd, POLLIN, 0};
+        ::poll(&listener, 1, input_finished ? 0 : UPDATE_INTERVAL_MS);
+        acceptClients();
+        updateClients(input_finished);
+        if (input_finished) {
+            break;
+        }
+    }
+
+    for (const auto& client : d_clients) {
+        ::close(client->fd);
+    }
+    d_clients.clear();
+    d_client_count = 0;
+    ::close(d_listen_fd);
+    d_listen_fd = -1;
+    d_active = false;
+}
+
+void
+LiveBroker::acceptClients()
+{
+    while (true) {
+        int fd = ::accept(d_listen_fd, nullptr, nullptr);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;  // No more pending connections.
+        }
+
+        auto client = std::make_unique<Client>();
+        client->fd = fd;
+        client->writer = tracking_api::createForwardingRecordWriter(
+                std::make_unique<StringSink>(&client->pending),
+                d_record_reader->getHeader());
+        if (!client->writer->writeHeader(false)) {
+            ::close(fd);
+            continue;
+        }
+        d_clients.push_back(std::move(client));
+    }
+    d_client_count = d_clients.size();
+}
+
+void
+LiveBroker::updateClients(bool final_update)
+{
+    d_reader.updateSnapshot(false);
+    const std::shared_ptr<const api::reduced_snapshot_map_t> snapshot = d_reader.currentSnapshot(false);
+    tracking_api::MemoryRecord memory_record = d_reader.latestMemoryRecord();
+    memory_record.ms_since_epoch =
+            duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+
+    for (auto it = d_clients.begin(); it != d_clients.end();) {
+        Client& client = **it;
+        if (updateClient(client, *snapshot, memory_record)
+            && (!final_update || client.writer->writeTrailer()) && sendPending(client, final_update))
+        {
+            ++it;
+            continue;
+        }
+        LOG(DEBUG) << "Disconnecting live broker client";
+        ::close(client.fd);
+        it = d_clients.erase(it);
+    }
+    d_client_count = d_clients.size();
+}
+
+bool
+LiveBroker::updateClient(
+        Client& client,
+        const api::reduced_snapshot_map_t& snapshot,
+        const tracking_api::MemoryRecord& memory_record)
+{
+    tracking_api::RecordWriter& writer = *client.writer;
+
+    // The snapshot was taken first, so this sends every tree node and native
+    // frame that its locations refer to.
+    if (!d_record_reader->replayState(writer, &client.cursor)) {
+        return false;
+    }
+
+    // Every location still allocated is in the snapshot, so the ones sent
+    // before that aren't anymore have been freed since.
+    std::vector<api::LocationKey> removed;
+    for (const auto& [key, sent] : client.sent_totals) {
+        if (snapshot.find(key) == snapshot.end()) {
+            removed.push_back(key);
+        }
+    }
+    if (!tracking_api::writeLocationDeltas(writer, snapshot, removed, &client.sent_totals)) {
+        return false;
+    }
+
+    return writer.writeRecord(memory_record);
+}
+
+bool
+LiveBroker::sendPending(Client& client, bool wait)
+{
+    while (client.pending_offset < client.pending.size()) {
+        ssize_t sent = ::send(
+                client.fd,
+                client.pending.data() + client.pending_offset,
+                client.pending.size() - client.pending_offset,
+                MSG_DONTWAIT);
+        if (sent >= 0) {
+            client.pending_offset += sent;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;  // The client went away.
+        }
+        if (!wait) {
+            break;
+        }
+        struct pollfd writable = {client.fd, POLLOUT, 0};
+        if (::poll(&writable, 1, FINAL_SEND_TIMEOUT_MS) <= 0) {
+            return false;
+        }
+    }
+
+    if (client.pending_offset == client.pending.size()) {
+        client.pending.clear();
+        client.pending_offset = 0;
+    } else if (client.pending_offset > client.pending.size() / 2) {
+        client.pending.erase(0, client.pending_offset);
+        client.pending_offset = 0;
+    }
+    return client.pending.size() - client.pending_offset <= MAX_CLIENT_BACKLOG;
+}
+
+}  // namespace memray::socket_thread
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "record_reader.h"
+#include "socket_reader_thread.h"
+
+namespace memray::socket_thread {
+
+// Shares the stream read from one tracked process with any number of live
+// clients, which can connect and disconnect at any time.
+//
+// A BackgroundSocketReader reads the stream and keeps the per-location
+// totals up to date. Periodically, every client is sent the frames, stack
+// tree nodes, mappings and thread names that it hasn't seen yet, followed by
+// how the totals of each location changed since its previous update, using
+// the records that LiveAggregatingRecordWriter sends. A client that has just
+// connected hasn't seen anything, so its first update is a snapshot of the
+// whole state. Clients that fall too far behind are disconnected, and can
+// reconnect to start over from a new snapshot.
+class LiveBroker
+{
+  public:
+    LiveBroker(std::shared_ptr<api::RecordReader> reader, const std::string& host, uint16_t port);
+    ~LiveBroker();
+
+    LiveBroker(LiveBroker& other) = delete;
+    LiveBroker(LiveBroker&& other) = delete;
+    void operator=(const LiveBroker&) = delete;
+    void operator=(LiveBroker&&) = delete;
+
+    void start();
+    bool is_active() const;
+    uint16_t port() const;
+    size_t client_count() const;
+
+  private:
+    struct Client;
+
+    void brokerThreadWorker();
+    void acceptClients();
+    void updateClients(bool final_update);
+    bool updateClient(
+            Client& client,
+            const api::reduced_snapshot_map_t& snapshot,
+            const tracking_api::MemoryRecord& memory_record);
+    bool sendPending(Client& client, bool wait);
+
+    std::shared_ptr<api::RecordReader> d_record_reader;
+    BackgroundSocketReader d_reader;
+    int d_listen_fd{-1};
+    uint16_t d_port{0};
+    std::vector<std::unique_ptr<Client>> d_clients;
+    std::atomic<size_t> d_client_count{0};
+    std::atomic<bool> d_stop_thread{false};
+    std::atomic<bool> d_active{false};
+    std::thread d_thread;
+};
+
+}  // namespace memray::socket_thread
@@ -0,0 +1,15 @@
+from _memray.record_reader cimport RecordReader
+from libc.stdint cimport uint16_t
+from libcpp cimport bool
+from libcpp.memory cimport shared_ptr
+from libcpp.string cimport string
+
+
+cdef extern from "live_broker.h" namespace "memray::socket_thread":
+    cdef cppclass LiveBroker:
+        LiveBroker(shared_ptr[RecordReader], const string& host, uint16_t port) except +IOError
+
+        void start() except+
+        bool is_active()
+        uint16_t port()
+        size_t client_count()
@@ -14,14 +14,6 @@ static const logLevel RESOLVE_LIB_LOG_LEVEL = DEBUG;
 static const logLevel RESOLVE_LIB_LOG_LEVEL = WARNING;
 #endif
 
-std::unordered_set<std::string> InternedString::s_interned_data = []() {
-    std::unordered_set<std::string> ret;
-    ret.reserve(4096);
-    return ret;
-}();
-
-std::mutex InternedString::s_mutex;
-
 SymbolResolver::BacktraceStateCache SymbolResolver::s_backtrace_states = []() {
     SymbolResolver::BacktraceStateCache ret;
     ret.reserve(PREALLOCATED_BACKTRACE_STATES);
@@ -30,28 +22,16 @@ SymbolResolver::BacktraceStateCache SymbolResolver::s_backtrace_states = []() {
 
 std::mutex SymbolResolver::s_backtrace_states_mutex;
 
-InternedString::InternedString(const std::string& orig)
-: d_ref(internString(orig))
-{
-}
-
-const std::string&
-InternedString::get() const
-{
-    return d_ref.get();
-}
-
-InternedString::operator const std::string&() const
-{
-    return d_ref.get();
-}
-
-std::reference_wrapper<const std::string>
-InternedString::internString(const std::string& orig)
+// libbacktrace keeps the name of the file that a state was created for, and
+// the states are cached for the life of the process, so the names of the
+// files that segments belong to live as long as the process, too.
+static InternedString
+internSegmentFilename(const std::string& filename)
 {
-    std::lock_guard<std::mutex> lock(s_mutex);
-    auto inserted = s_interned_data.insert(orig);
-    return *inserted.first;
+    static std::mutex mutex;
+    static StringTable* filenames = new StringTable();
+    std::lock_guard<std::mutex> lock(mutex);
+    return filenames->intern(filename);
 }
 
 MemorySegment::MemorySegment(
@@ -221,11 +201,11 @@ ResolvedFrame::Line() const
 PyObject*
 ResolvedFrame::toPythonObject(python_helpers::PyUnicode_Cache& pystring_cache) const
 {
-    PyObject* pyfunction_name = pystring_cache.getUnicodeObject(Symbol());  // Borrowed
+    PyObject* pyfunction_name = pystring_cache.getUnicodeObject(d_symbol);  // Borrowed
     if (pyfunction_name == nullptr) {
         return nullptr;
     }
-    PyObject* pyfilename = pystring_cache.getUnicodeObject(File());  // Borrowed
+    PyObject* pyfilename = pystring_cache.getUnicodeObject(d_filename);  // Borrowed
     if (pyfilename == nullptr) {
         return nullptr;
     }
@@ -277,6 +257,7 @@ findModule(const uintptr_t ip, const T& segments)
 SymbolResolver::resolved_frames_t
 SymbolResolver::resolve(uintptr_t ip, size_t generation)
 {
+    std::lock_guard<std::mutex> lock(d_resolve_mutex);
     // Check if we have resolved this frame previously
     auto it = d_resolved_ips_cache.find({ip, generation});
     if (it == d_resolved_ips_cache.end()) {
@@ -312,10 +293,10 @@ SymbolResolver::resolveFromSegments(uintptr_t ip, size_t generation)
             expanded_frame.begin(),
             expanded_frame.end(),
             std::back_inserter(frames),
-            [](const auto& frame) {
+            [this](const auto& frame) {
                 return ResolvedFrame{
-                        InternedString(frame.symbol),
-                        InternedString(frame.filename),
+                        d_string_table.intern(frame.symbol),
+                        d_string_table.intern(frame.filename),
                         frame.lineno,
                 };
             });
@@ -339,7 +320,7 @@ SymbolResolver::addSegments(
         uintptr_t addr,
         const std::vector<tracking_api::Segment>& segments)
 {
-    InternedString interned_filename(filename);
+    InternedString interned_filename = internSegmentFilename(filename);
     auto state = getBacktraceState(interned_filename, addr);
     if (state == nullptr) {
         LOG(RESOLVE_LIB_LOG_LEVEL) << "Failed to prepare a backtrace state for " << filename;
@@ -371,7 +352,8 @@ backtrace_state*
 SymbolResolver::getBacktraceState(InternedString interned_filename, uintptr_t address_start)
 {
     // We hash into "s_backtrace_states" using a `const char*`. This is safe
-    // because every `const char*` we save is owned by an interned string.
+    // because every `const char*` we save is owned by an interned segment
+    // filename, which is never freed.
     const char* filename = interned_filename.get().c_str();
     auto key = std::make_pair(filename, address_start);
 
@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <unistd.h>
@@ -26,21 +27,8 @@ namespace memray::native_resolver {
 static constexpr int PREALLOCATED_BACKTRACE_STATES = 64;
 static constexpr int PREALLOCATED_IPS_CACHE_ITEMS = 32768;
 
-class InternedString
-{
-  public:
-    explicit InternedString(const std::string& orig);
-    const std::string& get() const;
-    operator const std::string&() const;
-
-  private:
-    static std::reference_wrapper<const std::string> internString(const std::string& orig);
-
-    std::reference_wrapper<const std::string> d_ref;
-
-    static std::mutex s_mutex;
-    static std::unordered_set<std::string> s_interned_data;
-};
+using tracking_api::InternedString;
+using tracking_api::StringTable;
 
 class MemorySegment
 {
@@ -171,7 +159,13 @@ class SymbolResolver
     // Data members
     std::unordered_map<size_t, std::vector<MemorySegment>> d_segments;
     bool d_are_segments_dirty = false;
+    // Owns the symbols and filenames of the frames this resolver resolved.
+    StringTable d_string_table;
     mutable std::unordered_map<ips_cache_pair_t, resolved_frames_t, pair_hash> d_resolved_ips_cache;
+    // Guards the cache and the sorting of the segments, which happen on
+    // lookups, so that a frozen RecordReader can resolve frames from
+    // several threads.
+    std::mutex d_resolve_mutex;
 
     static std::mutex s_backtrace_states_mutex;
     static BacktraceStateCache s_backtrace_states;
@@ -0,0 +1,84 @@
+#include "pipelined_reader.h"
+
+#include <utility>
+
+namespace memray::api {
+
+namespace {
+
+// How many records are handed over at a time, and how many batches the
+// decoding thread can be ahead of the calling thread.
+constexpr size_t BATCH_SIZE = 4096;
+constexpr size_t MAX_PENDING_BATCHES = 8;
+
+}  // namespace
+
+PipelinedRecordReader::PipelinedRecordReader(std::shared_ptr<RecordReader> reader)
+: d_reader(std::move(reader))
+, d_batches(MAX_PENDING_BATCHES)
+{
+    d_thread = std::thread(&PipelinedRecordReader::decoderThread, this);
+}
+
+PipelinedRecordReader::~PipelinedRecordReader()
+{
+    // If we're destroyed before reaching the end, this stops the decoding
+    // thread the next time it hands over a batch.
+    d_batches.close();
+    d_thread.join();
+}
+
+bool
+PipelinedRecordReader::nextBatch(Batch* batch)
+{
+    if (d_batches.pop(batch)) {
+        return true;
+    }
+    if (d_error) {
+        std::rethrow_exception(std::exchange(d_error, nullptr));
+    }
+    return false;
+}
+
+void
+PipelinedRecordReader::decoderThread()
+{
+    RecordReader& reader = *d_reader;
+    bool done = false;
+    try {
+        while (!done) {
+            Batch batch;
+            batch.results.reserve(BATCH_SIZE);
+            while (!done && batch.results.size() < BATCH_SIZE) {
+                RecordReader::RecordResult ret = reader.nextRecord();
+                batch.results.push_back(ret);
+                switch (ret) {
+                    case RecordReader::RecordResult::ALLOCATION_RECORD:
+                        batch.allocations.push_back(reader.getLatestAllocation());
+                        break;
+                    case RecordReader::RecordResult::MEMORY_RECORD:
+                        batch.memory_records.push_back(reader.getLatestMemoryRecord());
+                        break;
+                    case RecordReader::RecordResult::AGGREGATED_ALLOCATION_RECORD:
+                        batch.aggregated_allocations.push_back(reader.getLatestAggregatedAllocation());
+                        break;
+                    case RecordReader::RecordResult::MEMORY_SNAPSHOT:
+                        batch.memory_snapshots.push_back(reader.getLatestMemorySnapshot());
+                        break;
+                    case RecordReader::RecordResult::ERROR:
+                    case RecordReader::RecordResult::END_OF_FILE:
+                        done = true;
+                        break;
+                }
+            }
+            if (!d_batches.push(std::move(batch))) {
+                break;  // Nobody is interested in the rest.
+            }
+        }
+    } catch (...) {
+        d_error = std::current_exception();
+    }
+    d_batches.close();
+}
+
+}  // namespace memray::api
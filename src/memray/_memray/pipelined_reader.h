@@ -0,0 +1,57 @@
+#pragma once
+
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "record_reader.h"
+#include "records.h"
+
+namespace memray::api {
+
+// Decodes the records of a RecordReader on a thread of its own, while the
+// calling thread aggregates the records that were decoded before them.
+//
+// Records are handed over in batches through a bounded queue, so the decoding
+// thread can only get so far ahead. The reader's state is guarded by its
+// mutex, so the calling thread can look up the frames of the records it has
+// while more of them are being decoded.
+class PipelinedRecordReader
+{
+  public:
+    struct Batch
+    {
+        // What each call to nextRecord() returned, in order. The batch that
+        // ends with END_OF_FILE or ERROR is the last one.
+        std::vector<RecordReader::RecordResult> results;
+        // The record read by each of those calls, grouped by type.
+        std::vector<Allocation> allocations;
+        std::vector<MemoryRecord> memory_records;
+        std::vector<AggregatedAllocation> aggregated_allocations;
+        std::vector<MemorySnapshot> memory_snapshots;
+    };
+
+    explicit PipelinedRecordReader(std::shared_ptr<RecordReader> reader);
+    ~PipelinedRecordReader();
+
+    PipelinedRecordReader(PipelinedRecordReader& other) = delete;
+    PipelinedRecordReader(PipelinedRecordReader&& other) = delete;
+    void operator=(const PipelinedRecordReader&) = delete;
+    void operator=(PipelinedRecordReader&&) = delete;
+
+    // Waits for the next batch. Returns false once every batch was returned,
+    // and rethrows anything that the reader threw while decoding.
+    bool nextBatch(Batch* batch);
+
+  private:
+    void decoderThread();
+
+    std::shared_ptr<RecordReader> d_reader;
+    io::BoundedQueue<Batch> d_batches;
+    std::exception_ptr d_error{};
+    std::thread d_thread;
+};
+
+}  // namespace memray::api
@@ -0,0 +1,22 @@
+from _memray.record_reader cimport RecordReader
+from _memray.record_reader cimport RecordResult
+from _memray.records cimport AggregatedAllocation
+from _memray.records cimport Allocation
+from _memray.records cimport MemoryRecord
+from _memray.records cimport MemorySnapshot
+from libcpp cimport bool
+from libcpp.memory cimport shared_ptr
+from libcpp.vector cimport vector
+
+
+cdef extern from "pipelined_reader.h" namespace "memray::api":
+    cdef cppclass RecordBatch "memray::api::PipelinedRecordReader::Batch":
+        vector[RecordResult] results
+        vector[Allocation] allocations
+        vector[MemoryRecord] memory_records
+        vector[AggregatedAllocation] aggregated_allocations
+        vector[MemorySnapshot] memory_snapshots
+
+    cdef cppclass PipelinedRecordReader:
+        PipelinedRecordReader(shared_ptr[RecordReader] reader) except+
+        bool nextBatch(RecordBatch* batch) except + nogil
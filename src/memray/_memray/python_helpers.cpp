@@ -1,17 +1,19 @@
 #include "python_helpers.h"
+#include "records.h"
 
 namespace memray::python_helpers {
 PyObject*
-PyUnicode_Cache::getUnicodeObject(const std::string& str)
+PyUnicode_Cache::getUnicodeObject(const tracking_api::InternedString& str)
 {
-    auto it = d_cache.find(str);
+    const std::string* storage = &str.get();
+    auto it = d_cache.find(storage);
     if (it == d_cache.end()) {
-        PyObject* pystring = PyUnicode_FromString(str.c_str());
+        PyObject* pystring = PyUnicode_FromString(storage->c_str());
         if (pystring == nullptr) {
             return nullptr;
         }
         auto pystring_capsule = py_capsule_t(pystring, [](auto obj) { Py_DECREF(obj); });
-        it = d_cache.emplace(str, std::move(pystring_capsule)).first;
+        it = d_cache.emplace(storage, std::move(pystring_capsule)).first;
     }
     return it->second.get();
 }
@@ -4,18 +4,80 @@
 #include <Python.h>
 
 #include <functional>
+#include <list>
 #include <memory>
 #include <string>
 #include <unordered_map>
 
+namespace memray::tracking_api {
+class InternedString;
+}  // namespace memray::tracking_api
+
 namespace memray::python_helpers {
+// Interned strings are stored once by the table that owns them, so they're
+// looked up by the address of their storage rather than by their contents.
+// A cache must not outlive the tables of the strings that it was given.
 class PyUnicode_Cache
 {
   public:
-    PyObject* getUnicodeObject(const std::string& str);
+    PyObject* getUnicodeObject(const tracking_api::InternedString& str);
 
   private:
     using py_capsule_t = std::unique_ptr<PyObject, std::function<void(PyObject*)>>;
-    std::unordered_map<std::string, py_capsule_t> d_cache{};
+    std::unordered_map<const std::string*, py_capsule_t> d_cache{};
+};
+
+// Holds a reference to a Python object per key, and drops the least recently
+// used ones once the total cost of the cached objects exceeds a limit.
+template<typename Key, typename Hash = std::hash<Key>>
+class PyObject_LruCache
+{
+  public:
+    explicit PyObject_LruCache(size_t max_cost)
+    : d_max_cost(max_cost)
+    {
+    }
+
+    // Returns a borrowed reference to the object cached for the key, or
+    // nullptr if there isn't one. It's only valid until the next insert().
+    PyObject* find(const Key& key)
+    {
+        auto it = d_index.find(key);
+        if (it == d_index.end()) {
+            return nullptr;
+        }
+        d_entries.splice(d_entries.begin(), d_entries, it->second);
+        return it->second->object.get();
+    }
+
+    // Caches an object for a key that isn't cached yet, stealing the
+    // reference passed in, and returns a borrowed reference to it.
+    PyObject* insert(const Key& key, PyObject* object, size_t cost)
+    {
+        d_entries.push_front({key, py_capsule_t(object, [](auto obj) { Py_DECREF(obj); }), cost});
+        d_index.emplace(key, d_entries.begin());
+        d_cost += cost;
+        while (d_cost > d_max_cost && d_entries.size() > 1) {
+            d_cost -= d_entries.back().cost;
+            d_index.erase(d_entries.back().key);
+            d_entries.pop_back();
+        }
+        return object;
+    }
+
+  private:
+    using py_capsule_t = std::unique_ptr<PyObject, std::function<void(PyObject*)>>;
+    struct Entry
+    {
+        Key key;
+        py_capsule_t object;
+        size_t cost;
+    };
+
+    const size_t d_max_cost;
+    size_t d_cost{0};
+    // Most recently used first.
+    std::list<Entry> d_entries{};
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> d_index{};
 };
 }  // namespace memray::python_helpers
@@ -6,6 +6,7 @@
 #include <cinttypes>
 #include <cstdio>
 #include <stdexcept>
+#include <tuple>
 #include <unordered_map>
 
 #include "hooks.h"
@@ -21,6 +22,11 @@ using namespace io;
 
 namespace {  // unnamed
 
+// Frame ids are assigned densely, so a new id is never far past the ones seen
+// so far. One further away than this is corrupt, and would make the frame
+// table huge, or wrap around when it's grown to fit it.
+constexpr size_t MAX_FRAME_ID_GAP = 1 << 20;
+
 const char*
 allocatorName(hooks::Allocator allocator)
 {
@@ -143,7 +149,7 @@ RecordReader::RecordReader(std::unique_ptr<Source> source, bool track_stacks)
 
     if (d_track_stacks) {
         TrackerStats& stats = d_header.stats;
-        d_frame_map.reserve(stats.n_frames);
+        d_frames.reserve(stats.n_frames);
         d_native_frames.reserve(d_header.native_traces ? 2048 : 0);
     }
 }
@@ -160,6 +166,29 @@ RecordReader::isOpen() const noexcept
     return d_input->is_open();
 }
 
+void
+RecordReader::freeze()
+{
+    // Wait for any accessor that took the lock before the reader was frozen.
+    std::lock_guard<std::mutex> lock(d_mutex);
+    d_frozen.store(true, std::memory_order_release);
+}
+
+bool
+RecordReader::isFrozen() const noexcept
+{
+    return d_frozen.load(std::memory_order_acquire);
+}
+
+std::unique_lock<std::mutex>
+RecordReader::lockUnlessFrozen() const
+{
+    if (isFrozen()) {
+        return {};
+    }
+    return std::unique_lock<std::mutex>(d_mutex);
+}
+
 bool
 RecordReader::parseFramePush(FramePush* record)
 {
@@ -212,14 +241,39 @@ RecordReader::processFramePop(const FramePop& record)
     return true;
 }
 
+bool
+RecordReader::parseStringIndex(std::string* the_string)
+{
+    return d_input->getline(*the_string, '\0');
+}
+
+bool
+RecordReader::processStringIndex(const std::string& the_string)
+{
+    // String ids are implicit: each STRING_INDEX record gets the next one.
+    d_strings.push_back(d_string_table.intern(the_string));
+    return true;
+}
+
 bool
 RecordReader::parseFrameIndex(tracking_api::pyframe_map_val_t* pyframe_val, unsigned int flags)
 {
     pyframe_val->second.is_entry_frame = !(flags & 1);
-    return readIntegralDelta(&d_last.python_frame_id, &pyframe_val->first)
-           && d_input->getline(pyframe_val->second.function_name, '\0')
-           && d_input->getline(pyframe_val->second.filename, '\0')
-           && readIntegralDelta(&d_last.python_line_number, &pyframe_val->second.lineno);
+    size_t function_name_id;
+    size_t filename_id;
+    if (!readIntegralDelta(&d_last.python_frame_id, &pyframe_val->first)
+        || !readVarint(&function_name_id) || !readVarint(&filename_id)
+        || !readIntegralDelta(&d_last.python_line_number, &pyframe_val->second.lineno))
+    {
+        return false;
+    }
+
+    if (function_name_id >= d_strings.size() || filename_id >= d_strings.size()) {
+        return false;
+    }
+    pyframe_val->second.function_name = d_strings[function_name_id];
+    pyframe_val->second.filename = d_strings[filename_id];
+    return true;
 }
 
 bool
@@ -229,13 +283,36 @@ RecordReader::processFrameIndex(const tracking_api::pyframe_map_val_t& pyframe_v
         return true;
     }
     std::lock_guard<std::mutex> lock(d_mutex);
-    auto iterator = d_frame_map.insert(pyframe_val);
-    if (!iterator.second) {
+    return addFrame(pyframe_val);
+}
+
+bool
+RecordReader::addFrame(const pyframe_map_val_t& pyframe_val)
+{
+    auto& [frame_id, frame] = pyframe_val;
+    if (frame_id >= d_frames.size()) {
+        if (frame_id - d_frames.size() >= MAX_FRAME_ID_GAP) {
+            return false;
+        }
+        d_frames.resize(frame_id + 1);
+    }
+    if (d_frames[frame_id]) {
         throw std::runtime_error("Two entries with the same ID found!");
     }
+    d_frames[frame_id] = frame;
+    d_frame_ids.push_back(frame_id);
     return true;
 }
 
+const Frame&
+RecordReader::getFrame(frame_id_t frame_id) const
+{
+    if (frame_id >= d_frames.size() || !d_frames[frame_id]) {
+        throw std::out_of_range("Unknown frame ID");
+    }
+    return *d_frames[frame_id];
+}
+
 bool
 RecordReader::parseNativeFrameIndex(UnresolvedNativeFrame* frame)
 {
@@ -321,6 +398,203 @@ RecordReader::processNativeAllocationRecord(const NativeAllocationRecord& record
     return true;
 }
 
+bool
+RecordReader::parseAllocationRun(AllocationRun* run, unsigned int flags)
+{
+    // Only the fixed part of the run is parsed here. The address of each pair
+    // follows, and is consumed as the pairs are expanded.
+    run->allocator = static_cast<hooks::Allocator>(flags);
+    run->address = 0;
+    if (!d_input->read(reinterpret_cast<char*>(&run->deallocator), sizeof(run->deallocator))
+        || !readVarint(&run->size) || !readVarint(&run->count))
+    {
+        return false;
+    }
+
+    if (!d_header.native_traces) {
+        run->native_frame_id = 0;
+        return true;
+    }
+    return readIntegralDelta(&d_last.native_frame_id, &run->native_frame_id);
+}
+
+bool
+RecordReader::parseAllocationGap(size_t* dropped_allocations)
+{
+    return readVarint(dropped_allocations);
+}
+
+bool
+RecordReader::processAllocationGap(size_t dropped_allocations)
+{
+    d_dropped_allocations += dropped_allocations;
+    return true;
+}
+
+bool
+RecordReader::parseAllocationDelta(AllocationDelta* delta)
+{
+    if (!d_input->read(reinterpret_cast<char*>(&delta->tid), sizeof(delta->tid))
+        || !d_input->read(reinterpret_cast<char*>(&delta->allocator), sizeof(delta->allocator))
+        || !readSignedVarint(&delta->count) || !readSignedVarint(&delta->size))
+    {
+        return false;
+    }
+
+    delta->native_frame_id = 0;
+    if (d_header.native_traces && !readIntegralDelta(&d_last.native_frame_id, &delta->native_frame_id))
+    {
+        return false;
+    }
+
+    size_t depth;
+    if (!readVarint(&depth)) {
+        return false;
+    }
+    delta->python_stack.resize(depth);
+    for (auto& frame_id : delta->python_stack) {
+        if (!readIntegralDelta(&d_last.python_frame_id, &frame_id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+RecordReader::processAllocationDelta(const AllocationDelta& delta)
+{
+    // Summarized allocations have no address, and they carry their own
+    // thread and stack instead of using the current ones. Like location
+    // deltas, negative deltas wrap around, which subtracts them from the
+    // location's totals when added to them.
+    d_latest_allocation.tid = delta.tid;
+    d_latest_allocation.address = 0;
+    d_latest_allocation.size = static_cast<size_t>(delta.size);
+    d_latest_allocation.allocator = delta.allocator;
+    d_latest_allocation.native_frame_id = 0;
+    d_latest_allocation.frame_index = 0;
+    d_latest_allocation.native_segment_generation = 0;
+    d_latest_allocation.n_allocations = static_cast<size_t>(delta.count);
+    if (!d_track_stacks) {
+        return true;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(d_mutex);
+        FrameTree::index_t index = 0;
+        for (frame_id_t frame_id : delta.python_stack) {
+            index = d_tree.getTraceIndex(index, frame_id);
+        }
+        d_latest_allocation.frame_index = index;
+    }
+    if (d_header.native_traces) {
+        d_latest_allocation.native_frame_id = delta.native_frame_id;
+        d_latest_allocation.native_segment_generation = d_symbol_resolver.currentSegmentGeneration();
+    }
+    return true;
+}
+
+bool
+RecordReader::parsePythonTraceNode(PythonTraceNode* node)
+{
+    return readIntegralDelta(&d_last.python_frame_id, &node->frame_id)
+           && readVarint(&node->parent_index);
+}
+
+bool
+RecordReader::processPythonTraceNode(const PythonTraceNode& node)
+{
+    if (node.parent_index >= d_remote_trace_indexes.size()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(d_mutex);
+    d_remote_trace_indexes.push_back(
+            d_tree.getTraceIndex(d_remote_trace_indexes[node.parent_index], node.frame_id));
+    return true;
+}
+
+bool
+RecordReader::parseLocationDelta(LocationDelta* delta)
+{
+    if (!d_input->read(reinterpret_cast<char*>(&delta->tid), sizeof(delta->tid))
+        || !d_input->read(reinterpret_cast<char*>(&delta->allocator), sizeof(delta->allocator))
+        || !readSignedVarint(&delta->count) || !readSignedVarint(&delta->size))
+    {
+        return false;
+    }
+
+    delta->native_frame_id = 0;
+    if (d_header.native_traces && !readIntegralDelta(&d_last.native_frame_id, &delta->native_frame_id))
+    {
+        return false;
+    }
+    return readVarint(&delta->python_trace_index);
+}
+
+bool
+RecordReader::processLocationDelta(const LocationDelta& delta)
+{
+    if (delta.python_trace_index >= d_remote_trace_indexes.size()) {
+        return false;
+    }
+
+    // Like summarized allocations, deltas have no address. A negative delta
+    // is reported as an allocation with a size and a count that wrap around,
+    // which subtracts it from the location's totals when added to them.
+    d_latest_allocation.tid = delta.tid;
+    d_latest_allocation.address = 0;
+    d_latest_allocation.size = static_cast<size_t>(delta.size);
+    d_latest_allocation.allocator = delta.allocator;
+    d_latest_allocation.native_frame_id = 0;
+    d_latest_allocation.frame_index = 0;
+    d_latest_allocation.native_segment_generation = 0;
+    d_latest_allocation.n_allocations = static_cast<size_t>(delta.count);
+    if (!d_track_stacks) {
+        return true;
+    }
+
+    d_latest_allocation.frame_index = d_remote_trace_indexes[delta.python_trace_index];
+    if (d_header.native_traces) {
+        d_latest_allocation.native_frame_id = delta.native_frame_id;
+        d_latest_allocation.native_segment_generation = d_symbol_resolver.currentSegmentGeneration();
+    }
+    return true;
+}
+
+bool
+RecordReader::processAllocationRun(const AllocationRun& run)
+{
+    if (run.count == 0) {
+        return false;
+    }
+    d_current_run = run;
+    d_run_records_left = 2 * run.count;
+    return processNextRecordFromAllocationRun();
+}
+
+bool
+RecordReader::processNextRecordFromAllocationRun()
+{
+    // Runs are expanded lazily, one allocation or deallocation per call. The
+    // thread and the stack can't change until the run is exhausted, because
+    // no other records are read from the input before then.
+    assert(d_run_records_left > 0);
+    bool is_deallocation = d_run_records_left-- % 2 == 1;
+    AllocationRun& run = d_current_run;
+    if (is_deallocation) {
+        return processAllocationRecord(AllocationRecord{run.address, 0, run.deallocator});
+    }
+
+    if (!readIntegralDelta(&d_last.data_pointer, &run.address)) {
+        return false;
+    }
+    if (d_header.native_traces) {
+        return processNativeAllocationRecord(
+                NativeAllocationRecord{run.address, run.size, run.allocator, run.native_frame_id});
+    }
+    return processAllocationRecord(AllocationRecord{run.address, run.size, run.allocator});
+}
+
 bool
 RecordReader::parseMemoryMapStart()
 {
@@ -333,6 +607,7 @@ RecordReader::processMemoryMapStart()
 {
     std::lock_guard<std::mutex> lock(d_mutex);
     d_symbol_resolver.clearSegments();
+    d_mappings_by_generation.emplace_back();
     return true;
 }
 
@@ -367,6 +642,7 @@ RecordReader::processSegmentHeader(const std::string& filename, size_t num_segme
 
     if (d_track_stacks) {
         std::lock_guard<std::mutex> lock(d_mutex);
+        d_mappings_by_generation.back().push_back({filename, addr, segments});
         d_symbol_resolver.addSegments(filename, addr, segments);
     }
     return true;
@@ -392,6 +668,7 @@ RecordReader::parseThreadRecord(std::string* name)
 bool
 RecordReader::processThreadRecord(const std::string& name)
 {
+    std::lock_guard<std::mutex> lock(d_mutex);
     d_thread_names[d_last.thread_id] = name;
     return true;
 }
@@ -452,6 +729,19 @@ RecordReader::processAggregatedAllocationRecord(const AggregatedAllocation& reco
     return true;
 }
 
+bool
+RecordReader::parseIndexedCaptureRecord(IndexedCapture* record)
+{
+    return d_input->read(reinterpret_cast<char*>(record), sizeof(*record));
+}
+
+bool
+RecordReader::processIndexedCaptureRecord(const IndexedCapture& record)
+{
+    d_indexed_capture = record;
+    return true;
+}
+
 bool
 RecordReader::parsePythonTraceIndexRecord(std::pair<frame_id_t, FrameTree::index_t>* record)
 {
@@ -471,29 +761,36 @@ bool
 RecordReader::parsePythonFrameIndexRecord(tracking_api::pyframe_map_val_t* pyframe_val)
 {
     auto& [frame_id, frame] = *pyframe_val;
-    return d_input->read(reinterpret_cast<char*>(&frame_id), sizeof(frame_id))
-           && d_input->getline(frame.function_name, '\0') && d_input->getline(frame.filename, '\0')
-           && d_input->read(reinterpret_cast<char*>(&frame.lineno), sizeof(frame.lineno))
-           && d_input->read(
-                   reinterpret_cast<char*>(&frame.is_entry_frame),
-                   sizeof(frame.is_entry_frame));
+    std::string function_name;
+    std::string filename;
+    if (!d_input->read(reinterpret_cast<char*>(&frame_id), sizeof(frame_id))
+        || !d_input->getline(function_name, '\0') || !d_input->getline(filename, '\0')
+        || !d_input->read(reinterpret_cast<char*>(&frame.lineno), sizeof(frame.lineno))
+        || !d_input->read(
+                reinterpret_cast<char*>(&frame.is_entry_frame),
+                sizeof(frame.is_entry_frame)))
+    {
+        return false;
+    }
+    frame.function_name = d_string_table.intern(function_name);
+    frame.filename = d_string_table.intern(filename);
+    return true;
 }
 
 bool
 RecordReader::processPythonFrameIndexRecord(const tracking_api::pyframe_map_val_t& pyframe_val)
 {
     std::lock_guard<std::mutex> lock(d_mutex);
-    auto iterator = d_frame_map.insert(pyframe_val);
-    if (!iterator.second) {
-        throw std::runtime_error("Two entries with the same ID found!");
-    }
-    return true;
+    return addFrame(pyframe_val);
 }
 
 RecordReader::RecordResult
 RecordReader::nextRecord()
 {
     RecordReader::RecordResult ret;
+    if (isFrozen()) {
+        return RecordResult::END_OF_FILE;
+    }
 
     if (d_header.file_format == FileFormat::ALL_ALLOCATIONS) {
         ret = nextRecordFromAllAllocationsFile();
@@ -507,12 +804,23 @@ RecordReader::nextRecord()
         LOG(ERROR) << "Invalid file format enumerator";
         return RecordResult::ERROR;
     }
+    if (ret == RecordResult::END_OF_FILE) {
+        freeze();
+    }
     return ret;
 }
 
 RecordReader::RecordResult
 RecordReader::nextRecordFromAllAllocationsFile()
 {
+    if (d_run_records_left) {
+        if (!processNextRecordFromAllocationRun()) {
+            if (d_input->is_open()) LOG(ERROR) << "Failed to process allocation run";
+            return RecordResult::ERROR;
+        }
+        return RecordResult::ALLOCATION_RECORD;
+    }
+
     while (true) {
         RecordTypeAndFlags record_type_and_flags;
         if (!d_input->read(
@@ -528,6 +836,38 @@ RecordReader::nextRecordFromAllAllocationsFile()
                     case OtherRecordType::TRAILER: {
                         return RecordResult::END_OF_FILE;
                     } break;
+                    case OtherRecordType::ALLOCATION_GAP: {
+                        size_t dropped_allocations;
+                        if (!parseAllocationGap(&dropped_allocations)
+                            || !processAllocationGap(dropped_allocations))
+                        {
+                            if (d_input->is_open()) LOG(ERROR) << "Failed to process allocation gap";
+                            return RecordResult::ERROR;
+                        }
+                    } break;
+                    case OtherRecordType::ALLOCATION_DELTA: {
+                        AllocationDelta delta;
+                        if (!parseAllocationDelta(&delta) || !processAllocationDelta(delta)) {
+                            if (d_input->is_open()) LOG(ERROR) << "Failed to process allocation delta";
+                            return RecordResult::ERROR;
+                        }
+                        return RecordResult::ALLOCATION_RECORD;
+                    } break;
+                    case OtherRecordType::PYTHON_TRACE_NODE: {
+                        PythonTraceNode node;
+                        if (!parsePythonTraceNode(&node) || !processPythonTraceNode(node)) {
+                            if (d_input->is_open()) LOG(ERROR) << "Failed to process Python trace node";
+                            return RecordResult::ERROR;
+                        }
+                    } break;
+                    case OtherRecordType::LOCATION_DELTA: {
+                        LocationDelta delta;
+                        if (!parseLocationDelta(&delta) || !processLocationDelta(delta)) {
+                            if (d_input->is_open()) LOG(ERROR) << "Failed to process location delta";
+                            return RecordResult::ERROR;
+                        }
+                        return RecordResult::ALLOCATION_RECORD;
+                    } break;
                     default: {
                         if (d_input->is_open()) LOG(ERROR) << "Invalid record subtype";
                         return RecordResult::ERROR;
@@ -556,6 +896,16 @@ RecordReader::nextRecordFromAllAllocationsFile()
                 }
                 return RecordResult::ALLOCATION_RECORD;
             } break;
+            case RecordType::ALLOCATION_RUN: {
+                AllocationRun record;
+                if (!parseAllocationRun(&record, record_type_and_flags.flags)
+                    || !processAllocationRun(record))
+                {
+                    if (d_input->is_open()) LOG(ERROR) << "Failed to process allocation run";
+                    return RecordResult::ERROR;
+                }
+                return RecordResult::ALLOCATION_RECORD;
+            } break;
             case RecordType::MEMORY_RECORD: {
                 MemoryRecord record;
                 if (!parseMemoryRecord(&record) || !processMemoryRecord(record)) {
@@ -585,6 +935,13 @@ RecordReader::nextRecordFromAllAllocationsFile()
                     return RecordResult::ERROR;
                 }
             } break;
+            case RecordType::STRING_INDEX: {
+                std::string the_string;
+                if (!parseStringIndex(&the_string) || !processStringIndex(the_string)) {
+                    if (d_input->is_open()) LOG(ERROR) << "Failed to process string index";
+                    return RecordResult::ERROR;
+                }
+            } break;
             case RecordType::FRAME_INDEX: {
                 tracking_api::pyframe_map_val_t record;
                 if (!parseFrameIndex(&record, record_type_and_flags.flags) || !processFrameIndex(record))
@@ -712,6 +1069,14 @@ RecordReader::nextRecordFromAggregatedAllocationsFile()
                 return RecordResult::ERROR;
             } break;
 
+            case AggregatedRecordType::INDEXED_CAPTURE: {
+                IndexedCapture record;
+                if (!parseIndexedCaptureRecord(&record) || !processIndexedCaptureRecord(record)) {
+                    if (d_input->is_open()) LOG(ERROR) << "Failed to process indexed capture record";
+                    return RecordResult::ERROR;
+                }
+            } break;
+
             case AggregatedRecordType::THREAD_RECORD: {
                 std::string name;
                 if (!parseThreadRecord(&name) || !processThreadRecord(name)) {
@@ -758,44 +1123,64 @@ RecordReader::Py_GetStackFrameAndEntryInfo(
         PyErr_SetString(PyExc_RuntimeError, "Stack tracking is disabled");
         return NULL;
     }
+    std::lock_guard<std::mutex> lock(d_mutex);
+
+    PyObject* stack = getCachedPythonStack(index);
+    if (stack == nullptr) {
+        return nullptr;
+    }
+    const Py_ssize_t num_frames = std::min<size_t>(PyList_GET_SIZE(stack), max_stacks);
+
     if (is_entry_frame) {
         is_entry_frame->clear();
-        is_entry_frame->reserve(64);
+        is_entry_frame->reserve(num_frames);
+        FrameTree::index_t current_index = index;
+        for (Py_ssize_t i = 0; i < num_frames; ++i) {
+            auto [frame_id, next_index] = d_tree.nextNode(current_index);
+            is_entry_frame->push_back(getFrame(frame_id).is_entry_frame);
+            current_index = next_index;
+        }
+    }
+    return PyList_GetSlice(stack, 0, num_frames);
+}
+
+PyObject*
+RecordReader::Py_GetNativeStackFrame(FrameTree::index_t index, size_t generation, size_t max_stacks)
+{
+    if (!d_track_stacks) {
+        PyErr_SetString(PyExc_RuntimeError, "Stack tracking is disabled");
+        return NULL;
     }
     std::lock_guard<std::mutex> lock(d_mutex);
 
-    size_t stacks_obtained = 0;
-    FrameTree::index_t current_index = index;
-    PyObject* list = PyList_New(0);
-    if (list == nullptr) {
+    PyObject* stack = getCachedNativeStack(index, generation);
+    if (stack == nullptr) {
         return nullptr;
     }
 
+    // The limit counts native frames, each of which can have been resolved
+    // to several inlined frames or to none at all.
+    size_t num_frames = 0;
+    size_t stacks_obtained = 0;
+    FrameTree::index_t current_index = index;
     while (current_index != 0 && stacks_obtained++ != max_stacks) {
-        auto [frame_id, next_index] = d_tree.nextNode(current_index);
-        const auto& frame = d_frame_map.at(frame_id);
-        PyObject* pyframe = frame.toPythonObject(d_pystring_cache);
-        if (pyframe == nullptr) {
-            goto error;
-        }
-        int ret = PyList_Append(list, pyframe);
-        Py_DECREF(pyframe);
-        if (ret != 0) {
-            goto error;
-        }
-        if (is_entry_frame) {
-            is_entry_frame->push_back(frame.is_entry_frame);
+        const auto& frame = d_native_frames[current_index - 1];
+        current_index = frame.index;
+        auto resolved_frames = d_symbol_resolver.resolve(frame.ip, generation);
+        if (resolved_frames) {
+            num_frames += resolved_frames->frames().size();
         }
-        current_index = next_index;
     }
-    return list;
-error:
-    Py_XDECREF(list);
-    return nullptr;
+    return PyList_GetSlice(stack, 0, num_frames);
 }
 
 PyObject*
-RecordReader::Py_GetNativeStackFrame(FrameTree::index_t index, size_t generation, size_t max_stacks)
+RecordReader::Py_GetHybridStackFrame(
+        FrameTree::index_t python_index,
+        FrameTree::index_t native_index,
+        size_t generation,
+        bool is_main_thread,
+        size_t max_stacks)
 {
     if (!d_track_stacks) {
         PyErr_SetString(PyExc_RuntimeError, "Stack tracking is disabled");
@@ -803,36 +1188,217 @@ RecordReader::Py_GetNativeStackFrame(FrameTree::index_t index, size_t generation
     }
     std::lock_guard<std::mutex> lock(d_mutex);
 
-    size_t stacks_obtained = 0;
-    FrameTree::index_t current_index = index;
-    PyObject* list = PyList_New(0);
-    if (list == nullptr) {
+    PyObject* stack = getCachedHybridStack({python_index, native_index, generation, is_main_thread});
+    if (stack == nullptr) {
         return nullptr;
     }
+    return PyList_GetSlice(stack, 0, std::min<size_t>(PyList_GET_SIZE(stack), max_stacks));
+}
 
-    while (current_index != 0 && stacks_obtained++ != max_stacks) {
-        auto frame = d_native_frames[current_index - 1];
+PyObject*
+RecordReader::Py_GetStackFrames(const std::vector<FrameTree::index_t>& indexes)
+{
+    if (!d_track_stacks) {
+        PyErr_SetString(PyExc_RuntimeError, "Stack tracking is disabled");
+        return NULL;
+    }
+    std::lock_guard<std::mutex> lock(d_mutex);
+
+    PyObject* stacks = PyList_New(indexes.size());
+    if (stacks == nullptr) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        PyObject* stack = getCachedPythonStack(indexes[i]);
+        PyObject* copy = stack ? PyList_GetSlice(stack, 0, PyList_GET_SIZE(stack)) : nullptr;
+        if (copy == nullptr) {
+            Py_DECREF(stacks);
+            return nullptr;
+        }
+        PyList_SET_ITEM(stacks, i, copy);
+    }
+    return stacks;
+}
+
+PyObject*
+RecordReader::getCachedPythonStack(FrameTree::index_t index, bool cache_caller)
+{
+    PyObject* cached = d_python_stack_cache.find(index);
+    if (cached != nullptr) {
+        return cached;
+    }
+
+    std::vector<frame_id_t> frame_ids;
+    PyObject* callers = nullptr;
+    if (index != 0) {
+        auto [frame_id, next_index] = d_tree.nextNode(index);
+        frame_ids.push_back(frame_id);
+        if (cache_caller) {
+            callers = getCachedPythonStack(next_index, false);
+            if (callers == nullptr) {
+                return nullptr;
+            }
+        } else {
+            while (next_index != 0 && (callers = d_python_stack_cache.find(next_index)) == nullptr) {
+                std::tie(frame_id, next_index) = d_tree.nextNode(next_index);
+                frame_ids.push_back(frame_id);
+            }
+        }
+    }
+
+    const Py_ssize_t num_callers = callers ? PyList_GET_SIZE(callers) : 0;
+    PyObject* stack = PyList_New(frame_ids.size() + num_callers);
+    if (stack == nullptr) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < frame_ids.size(); ++i) {
+        PyObject* pyframe = getCachedPythonFrame(frame_ids[i]);
+        if (pyframe == nullptr) {
+            Py_DECREF(stack);
+            return nullptr;
+        }
+        Py_INCREF(pyframe);
+        PyList_SET_ITEM(stack, i, pyframe);
+    }
+    for (Py_ssize_t i = 0; i < num_callers; ++i) {
+        PyObject* pyframe = PyList_GET_ITEM(callers, i);
+        Py_INCREF(pyframe);
+        PyList_SET_ITEM(stack, frame_ids.size() + i, pyframe);
+    }
+    return d_python_stack_cache.insert(index, stack, PyList_GET_SIZE(stack) + 1);
+}
+
+PyObject*
+RecordReader::getCachedNativeStack(FrameTree::index_t index, size_t generation, bool cache_caller)
+{
+    PyObject* cached = d_native_stack_cache.find({index, generation});
+    if (cached != nullptr) {
+        return cached;
+    }
+
+    std::vector<native_resolver::SymbolResolver::resolved_frames_t> resolved;
+    size_t num_frames = 0;
+    PyObject* callers = nullptr;
+    FrameTree::index_t current_index = index;
+    while (current_index != 0) {
+        const auto& frame = d_native_frames[current_index - 1];
         current_index = frame.index;
         auto resolved_frames = d_symbol_resolver.resolve(frame.ip, generation);
-        if (!resolved_frames) {
-            continue;
+        if (resolved_frames) {
+            num_frames += resolved_frames->frames().size();
+            resolved.push_back(std::move(resolved_frames));
+        }
+        if (cache_caller) {
+            callers = getCachedNativeStack(current_index, generation, false);
+            if (callers == nullptr) {
+                return nullptr;
+            }
+            break;
         }
+        if (current_index != 0 && (callers = d_native_stack_cache.find({current_index, generation}))) {
+            break;
+        }
+    }
+
+    const Py_ssize_t num_callers = callers ? PyList_GET_SIZE(callers) : 0;
+    PyObject* stack = PyList_New(num_frames + num_callers);
+    if (stack == nullptr) {
+        return nullptr;
+    }
+    Py_ssize_t i = 0;
+    for (const auto& resolved_frames : resolved) {
         for (auto& native_frame : resolved_frames->frames()) {
             PyObject* pyframe = native_frame.toPythonObject(d_pystring_cache);
             if (pyframe == nullptr) {
+                Py_DECREF(stack);
                 return nullptr;
             }
-            int ret = PyList_Append(list, pyframe);
-            Py_DECREF(pyframe);
-            if (ret != 0) {
-                goto error;
-            }
+            PyList_SET_ITEM(stack, i++, pyframe);
         }
     }
-    return list;
-error:
-    Py_XDECREF(list);
-    return nullptr;
+    for (Py_ssize_t j = 0; j < num_callers; ++j) {
+        PyObject* pyframe = PyList_GET_ITEM(callers, j);
+        Py_INCREF(pyframe);
+        PyList_SET_ITEM(stack, i++, pyframe);
+    }
+    return d_native_stack_cache.insert({index, generation}, stack, PyList_GET_SIZE(stack) + 1);
+}
+
+PyObject*
+RecordReader::getCachedHybridStack(const HybridStackKey& key)
+{
+    PyObject* cached = d_hybrid_stack_cache.find(key);
+    if (cached != nullptr) {
+        return cached;
+    }
+
+    // Both lists are borrowed from caches other than the hybrid stacks one,
+    // so they stay valid until the hybrid stack is cached.
+    PyObject* pynative_stack = getCachedNativeStack(key.native_index, key.generation);
+    if (pynative_stack == nullptr) {
+        return nullptr;
+    }
+    PyObject* pypython_stack = getCachedPythonStack(key.python_index);
+    if (pypython_stack == nullptr) {
+        return nullptr;
+    }
+
+    // The native frames were symbolized to build their list, so take their
+    // function names from it rather than resolving them again.
+    const auto num_native_frames = static_cast<size_t>(PyList_GET_SIZE(pynative_stack));
+    std::vector<std::string_view> native_function_names;
+    native_function_names.reserve(num_native_frames);
+    for (size_t i = 0; i < num_native_frames; ++i) {
+        PyObject* pyfunction_name = PyTuple_GET_ITEM(PyList_GET_ITEM(pynative_stack, i), 0);
+        Py_ssize_t length;
+        const char* function_name = PyUnicode_AsUTF8AndSize(pyfunction_name, &length);
+        if (function_name == nullptr) {
+            return nullptr;
+        }
+        native_function_names.emplace_back(function_name, length);
+    }
+    std::vector<unsigned char> is_entry_frame;
+    getPythonStackFrames(key.python_index, nullptr, &is_entry_frame);
+    size_t to_skip = key.is_main_thread ? getSkippedFramesOnMainThread() : 0;
+
+    std::vector<size_t> hybrid_stack;
+    PyObject* stack;
+    if (mergeHybridStack(native_function_names, is_entry_frame, to_skip, &hybrid_stack)) {
+        stack = PyList_New(hybrid_stack.size());
+        if (stack == nullptr) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < hybrid_stack.size(); ++i) {
+            size_t index = hybrid_stack[i];
+            PyObject* pyframe = index < num_native_frames
+                                        ? PyList_GET_ITEM(pynative_stack, index)
+                                        : PyList_GET_ITEM(pypython_stack, index - num_native_frames);
+            Py_INCREF(pyframe);
+            PyList_SET_ITEM(stack, i, pyframe);
+        }
+    } else {
+        // Fall back to the Python stack, as we couldn't find where in the
+        // native stack each Python frame was evaluated.
+        stack = PyList_GetSlice(pypython_stack, 0, PyList_GET_SIZE(pypython_stack));
+        if (stack == nullptr) {
+            return nullptr;
+        }
+    }
+    return d_hybrid_stack_cache.insert(key, stack, PyList_GET_SIZE(stack) + 1);
+}
+
+PyObject*
+RecordReader::getCachedPythonFrame(frame_id_t frame_id)
+{
+    PyObject* cached = d_pyframe_cache.find(frame_id);
+    if (cached != nullptr) {
+        return cached;
+    }
+    PyObject* pyframe = getFrame(frame_id).toPythonObject(d_pystring_cache);
+    if (pyframe == nullptr) {
+        return nullptr;
+    }
+    return d_pyframe_cache.insert(frame_id, pyframe, 1);
 }
 
 std::optional<frame_id_t>
@@ -841,17 +1407,286 @@ RecordReader::getLatestPythonFrameId(const Allocation& allocation) const
     if (0 == allocation.frame_index) {
         return {};
     }
-    std::unique_lock<std::mutex> lock(d_mutex);
+    auto lock = lockUnlessFrozen();
     return d_tree.nextNode(allocation.frame_index).first;
 }
 
+void
+RecordReader::getStackFrames(
+        const Allocation& allocation,
+        bool native_traces,
+        std::vector<StackFrame>* frames)
+{
+    frames->clear();
+    if (!d_track_stacks) {
+        return;
+    }
+    auto lock = lockUnlessFrozen();
+
+    if (native_traces) {
+        getHybridStackFrames(allocation, frames);
+        return;
+    }
+
+    getPythonStackFrames(allocation.frame_index, frames, nullptr);
+    if (allocation.tid == getMainThreadTid()) {
+        size_t to_skip = getSkippedFramesOnMainThread();
+        frames->resize(frames->size() > to_skip ? frames->size() - to_skip : 0);
+    }
+}
+
+void
+RecordReader::getPythonStackFrames(
+        FrameTree::index_t index,
+        std::vector<StackFrame>* frames,
+        std::vector<unsigned char>* is_entry_frame)
+{
+    while (index != 0) {
+        auto [frame_id, next_index] = d_tree.nextNode(index);
+        const auto& frame = getFrame(frame_id);
+        if (frames) {
+            frames->push_back({&frame.function_name.get(), &frame.filename.get(), frame.lineno});
+        }
+        if (is_entry_frame) {
+            is_entry_frame->push_back(frame.is_entry_frame);
+        }
+        index = next_index;
+    }
+}
+
+void
+RecordReader::getNativeStackFrames(
+        FrameTree::index_t index,
+        size_t generation,
+        std::vector<StackFrame>* frames)
+{
+    while (index != 0) {
+        const auto& frame = d_native_frames[index - 1];
+        index = frame.index;
+        auto resolved_frames = d_symbol_resolver.resolve(frame.ip, generation);
+        if (!resolved_frames) {
+            continue;
+        }
+        for (auto& native_frame : resolved_frames->frames()) {
+            frames->push_back({&native_frame.Symbol(), &native_frame.File(), native_frame.Line()});
+        }
+    }
+}
+
+void
+RecordReader::getHybridStackFrames(const Allocation& allocation, std::vector<StackFrame>* frames)
+{
+    std::vector<StackFrame> native_stack;
+    std::vector<StackFrame> python_stack;
+    std::vector<unsigned char> is_entry_frame;
+    getNativeStackFrames(
+            allocation.native_frame_id,
+            allocation.native_segment_generation,
+            &native_stack);
+    getPythonStackFrames(allocation.frame_index, &python_stack, &is_entry_frame);
+
+    size_t to_skip = 0;
+    if (allocation.tid == getMainThreadTid()) {
+        to_skip = getSkippedFramesOnMainThread();
+    }
+    std::vector<std::string_view> native_function_names;
+    native_function_names.reserve(native_stack.size());
+    for (const auto& frame : native_stack) {
+        native_function_names.emplace_back(*frame.function_name);
+    }
+    std::vector<size_t> hybrid_stack;
+    if (!mergeHybridStack(native_function_names, is_entry_frame, to_skip, &hybrid_stack)) {
+        *frames = std::move(python_stack);
+        return;
+    }
+    frames->clear();
+    frames->reserve(hybrid_stack.size());
+    for (size_t index : hybrid_stack) {
+        frames->push_back(
+                index < native_stack.size() ? native_stack[index]
+                                            : python_stack[index - native_stack.size()]);
+    }
+}
+
+bool
+RecordReader::mergeHybridStack(
+        const std::vector<std::string_view>& native_function_names,
+        const std::vector<unsigned char>& is_entry_frame,
+        size_t frames_to_skip,
+        std::vector<size_t>* hybrid_stack)
+{
+    // This merges a Python stack and a native stack into a "hybrid" stack,
+    // substituting _PyEval_EvalFrameDefault calls in the native stack with
+    // the corresponding frames in the Python stack. Each frame of the hybrid
+    // stack is given as its index in the native stack, or as its index in the
+    // Python stack plus the size of the native stack. There are several
+    // tricky aspects:
+    // 1. For the thread that called Tracker.__enter__, we want to hide
+    //    frames (both Python and C) above the one that made that call.
+    //    For other threads we want to keep all frames.
+    // 2. If _PyEval_EvalFrameDefault allocates memory before calling our
+    //    profile function, we'll have too few Python frames to pair up
+    //    every _PyEval_EvalFrameDefault call. This happens in 3.11.
+    // 3. Since Python 3.11, one _PyEval_EvalFrameDefault call can evaluate
+    //    many Python frames. If a frame's is_entry_frame flag is unset, it
+    //    uses the same _PyEval_EvalFrameDefault call as its caller.
+    // 4. If the interpreter was stripped, we may not be able to recognize
+    //    every (or even any) _PyEval_EvalFrameDefault call, so we may
+    //    have extra Python frames left after pairing. Then we return false.
+    auto num_non_entry_frames = std::count(is_entry_frame.begin(), is_entry_frame.end(), 0);
+    // Entry frames replace native frames; non-entry frames are inserted.
+    const size_t num_native_frames = native_function_names.size();
+    hybrid_stack->resize(num_native_frames + num_non_entry_frames);
+
+    // Both stacks are from most recent to least, but we must pair things up
+    // least recent to most to handle cases where _PyEval_EvalFrameDefault
+    // allocated memory before calling the profile function.
+    ssize_t pidx = static_cast<ssize_t>(is_entry_frame.size()) - 1;
+    ssize_t hidx = static_cast<ssize_t>(hybrid_stack->size()) - 1;
+    const auto to_skip = static_cast<ssize_t>(frames_to_skip);
+    const ssize_t first_kept_frame = pidx - to_skip;
+
+    for (ssize_t nidx = static_cast<ssize_t>(num_native_frames) - 1; nidx >= 0; --nidx) {
+        if (pidx >= 0 && native_function_names[nidx].find("_PyEval_EvalFrameDefault") != std::string_view::npos)
+        {
+            while (true) {
+                // If we're not keeping all frames and we've reached the
+                // first one we want to keep, remove frames above it.
+                if (to_skip != 0 && pidx == first_kept_frame) {
+                    hybrid_stack->resize(hidx + 1);
+                }
+                if (hidx < 0) {
+                    return false;
+                }
+                (*hybrid_stack)[hidx--] = num_native_frames + pidx--;
+                // Stop when we either run out of Python frames or reach the
+                // entry frame being evaluated by the next eval loop.
+                if (pidx < 0 || is_entry_frame[pidx]) {
+                    break;
+                }
+            }
+        } else {
+            if (hidx < 0) {
+                return false;
+            }
+            (*hybrid_stack)[hidx--] = nidx;
+        }
+    }
+    return pidx < 0 && hidx == -1;
+}
+
 PyObject*
 RecordReader::Py_GetFrame(std::optional<frame_id_t> frame)
 {
     if (!frame) {
         Py_RETURN_NONE;
     }
-    return d_frame_map.at(frame.value()).toPythonObject(d_pystring_cache);
+    std::lock_guard<std::mutex> lock(d_mutex);
+    return getFrame(frame.value()).toPythonObject(d_pystring_cache);
+}
+
+bool
+RecordReader::replayState(RecordWriter& writer, ReplayCursor* cursor) const
+{
+    auto lock = lockUnlessFrozen();
+
+    for (; cursor->frames < d_frame_ids.size(); ++cursor->frames) {
+        const frame_id_t frame_id = d_frame_ids[cursor->frames];
+        const Frame& frame = getFrame(frame_id);
+        RawFrame raw{
+                frame.function_name.get().c_str(),
+                frame.filename.get().c_str(),
+                frame.lineno,
+                frame.is_entry_frame};
+        if (!writer.writeRecord(pyrawframe_map_val_t{frame_id, raw})) {
+            return false;
+        }
+    }
+
+    for (; cursor->native_frames < d_native_frames.size(); ++cursor->native_frames) {
+        if (!writer.writeRecord(d_native_frames[cursor->native_frames])) {
+            return false;
+        }
+    }
+
+    // Segments are added one image at a time, so we may have read only part
+    // of a new set of mappings. Send them all again if any were added since.
+    const size_t generation = d_mappings_by_generation.size();
+    if (generation != 0
+        && (cursor->mappings_generation != generation
+            || cursor->mappings != d_mappings_by_generation.back().size()))
+    {
+        if (!writer.writeMappings(d_mappings_by_generation.back())) {
+            return false;
+        }
+        cursor->mappings_generation = generation;
+        cursor->mappings = d_mappings_by_generation.back().size();
+    }
+
+    for (const auto& [tid, name] : d_thread_names) {
+        auto [it, inserted] = cursor->thread_names.try_emplace(tid, name);
+        if (!inserted && it->second == name) {
+            continue;
+        }
+        it->second = name;
+        if (!writer.writeThreadSpecificRecord(tid, ThreadRecord{name.c_str()})) {
+            return false;
+        }
+    }
+
+    for (; cursor->tree_nodes < d_tree.maxIndex(); ++cursor->tree_nodes) {
+        auto [frame_id, parent_index] = d_tree.nextNode(cursor->tree_nodes + 1);
+        if (!writer.writeRecord(PythonTraceNode{frame_id, parent_index})) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+RecordReader::writeIndex(
+        std::unique_ptr<memray::io::Sink> sink,
+        const HeaderRecord& header,
+        const IndexedCapture& capture,
+        const std::vector<MemorySnapshot>& memory_snapshots,
+        const std::vector<AggregatedAllocation>& allocations) const
+{
+    std::unique_ptr<RecordWriter> writer = createIndexRecordWriter(std::move(sink), header, capture);
+
+    // replayState() only writes the latest mappings, but the allocations may
+    // refer to any generation of them.
+    ReplayCursor cursor;
+    {
+        auto lock = lockUnlessFrozen();
+        for (const auto& mappings : d_mappings_by_generation) {
+            if (!writer->writeMappings(mappings)) {
+                return false;
+            }
+        }
+        cursor.mappings_generation = d_mappings_by_generation.size();
+        cursor.mappings = d_mappings_by_generation.empty() ? 0 : d_mappings_by_generation.back().size();
+    }
+    if (!replayState(*writer, &cursor)) {
+        return false;
+    }
+
+    for (const auto& snapshot : memory_snapshots) {
+        if (!writer->writeRecord(snapshot)) {
+            return false;
+        }
+    }
+    for (const auto& allocation : allocations) {
+        if (!writer->writeRecord(allocation)) {
+            return false;
+        }
+    }
+    return writer->writeTrailer();
+}
+
+IndexedCapture
+RecordReader::getIndexedCapture() const noexcept
+{
+    return d_indexed_capture;
 }
 
 HeaderRecord
@@ -875,6 +1710,7 @@ RecordReader::getSkippedFramesOnMainThread() const noexcept
 std::string
 RecordReader::getThreadName(thread_id_t tid)
 {
+    auto lock = lockUnlessFrozen();
     auto it = d_thread_names.find(tid);
     if (it != d_thread_names.end()) {
         return it->second;
@@ -888,6 +1724,12 @@ RecordReader::getLatestAllocation() const noexcept
     return d_latest_allocation;
 }
 
+size_t
+RecordReader::getDroppedAllocationCount() const noexcept
+{
+    return d_dropped_allocations;
+}
+
 MemoryRecord
 RecordReader::getLatestMemoryRecord() const noexcept
 {
@@ -990,6 +1832,80 @@ RecordReader::dumpAllRecordsFromAllAllocationsFile()
                         printf("TRAILER\n");
                         Py_RETURN_NONE;  // Treat as EOF
                     } break;
+                    case OtherRecordType::ALLOCATION_GAP: {
+                        printf("ALLOCATION_GAP ");
+
+                        size_t dropped_allocations;
+                        if (!parseAllocationGap(&dropped_allocations)) {
+                            Py_RETURN_NONE;
+                        }
+
+                        printf("dropped_allocations=%zd\n", dropped_allocations);
+                    } break;
+                    case OtherRecordType::ALLOCATION_DELTA: {
+                        printf("ALLOCATION_DELTA ");
+
+                        AllocationDelta record;
+                        if (!parseAllocationDelta(&record)) {
+                            Py_RETURN_NONE;
+                        }
+
+                        const char* allocator = allocatorName(record.allocator);
+                        std::string unknownAllocator;
+                        if (!allocator) {
+                            unknownAllocator =
+                                    "<unknown allocator " + std::to_string((int)record.allocator)
+                                    + ">";
+                            allocator = unknownAllocator.c_str();
+                        }
+
+                        printf("tid=%lu allocator=%s native_frame_id=%zd count=%zd size=%zd"
+                               " python_stack=",
+                               record.tid,
+                               allocator,
+                               record.native_frame_id,
+                               record.count,
+                               record.size);
+                        for (size_t i = 0; i < record.python_stack.size(); ++i) {
+                            printf("%s%zd", i ? "," : "", record.python_stack[i]);
+                        }
+                        printf("\n");
+                    } break;
+                    case OtherRecordType::PYTHON_TRACE_NODE: {
+                        printf("PYTHON_TRACE_NODE ");
+
+                        PythonTraceNode record;
+                        if (!parsePythonTraceNode(&record)) {
+                            Py_RETURN_NONE;
+                        }
+                        printf("frame_id=%zd parent_index=%zd\n", record.frame_id, record.parent_index);
+                    } break;
+                    case OtherRecordType::LOCATION_DELTA: {
+                        printf("LOCATION_DELTA ");
+
+                        LocationDelta record;
+                        if (!parseLocationDelta(&record)) {
+                            Py_RETURN_NONE;
+                        }
+
+                        const char* allocator = allocatorName(record.allocator);
+                        std::string unknownAllocator;
+                        if (!allocator) {
+                            unknownAllocator =
+                                    "<unknown allocator " + std::to_string((int)record.allocator)
+                                    + ">";
+                            allocator = unknownAllocator.c_str();
+                        }
+
+                        printf("tid=%lu allocator=%s native_frame_id=%zd python_trace_index=%zd"
+                               " count=%zd size=%zd\n",
+                               record.tid,
+                               allocator,
+                               record.native_frame_id,
+                               record.python_trace_index,
+                               record.count,
+                               record.size);
+                    } break;
                     default: {
                         printf("UNKNOWN OTHER RECORD TYPE %d\n", (int)record_type_and_flags.flags);
                         Py_RETURN_NONE;
@@ -1040,6 +1956,45 @@ RecordReader::dumpAllRecordsFromAllAllocationsFile()
                        record.size,
                        allocator);
             } break;
+            case RecordType::ALLOCATION_RUN: {
+                printf("ALLOCATION_RUN ");
+
+                AllocationRun record;
+                if (!parseAllocationRun(&record, record_type_and_flags.flags)) {
+                    Py_RETURN_NONE;
+                }
+
+                const char* allocator = allocatorName(record.allocator);
+                std::string unknownAllocator;
+                if (!allocator) {
+                    unknownAllocator =
+                            "<unknown allocator " + std::to_string((int)record.allocator) + ">";
+                    allocator = unknownAllocator.c_str();
+                }
+
+                const char* deallocator = allocatorName(record.deallocator);
+                std::string unknownDeallocator;
+                if (!deallocator) {
+                    unknownDeallocator =
+                            "<unknown allocator " + std::to_string((int)record.deallocator) + ">";
+                    deallocator = unknownDeallocator.c_str();
+                }
+
+                printf("size=%zd allocator=%s deallocator=%s native_frame_id=%zd count=%zd"
+                       " addresses=",
+                       record.size,
+                       allocator,
+                       deallocator,
+                       record.native_frame_id,
+                       record.count);
+                for (size_t i = 0; i < record.count; ++i) {
+                    if (!readIntegralDelta(&d_last.data_pointer, &record.address)) {
+                        Py_RETURN_NONE;
+                    }
+                    printf("%s%p", i ? "," : "", (void*)record.address);
+                }
+                printf("\n");
+            } break;
             case RecordType::FRAME_PUSH: {
                 printf("FRAME_PUSH ");
 
@@ -1060,6 +2015,16 @@ RecordReader::dumpAllRecordsFromAllAllocationsFile()
 
                 printf("count=%zd\n", record.count);
             } break;
+            case RecordType::STRING_INDEX: {
+                printf("STRING_ID ");
+
+                std::string the_string;
+                if (!parseStringIndex(&the_string) || !processStringIndex(the_string)) {
+                    Py_RETURN_NONE;
+                }
+
+                printf("string_id=%zd string=%s\n", d_strings.size() - 1, the_string.c_str());
+            } break;
             case RecordType::FRAME_INDEX: {
                 printf("FRAME_ID ");
 
@@ -1070,8 +2035,8 @@ RecordReader::dumpAllRecordsFromAllAllocationsFile()
 
                 printf("frame_id=%zd function_name=%s filename=%s lineno=%d is_entry_frame=%d\n",
                        record.first,
-                       record.second.function_name.c_str(),
-                       record.second.filename.c_str(),
+                       record.second.function_name.get().c_str(),
+                       record.second.filename.get().c_str(),
                        record.second.lineno,
                        record.second.is_entry_frame);
             } break;
@@ -1231,8 +2196,8 @@ RecordReader::dumpAllRecordsFromAggregatedAllocationsFile()
 
                 printf("frame_id=%zd function_name=%s filename=%s lineno=%d is_entry_frame=%d\n",
                        record.first,
-                       record.second.function_name.c_str(),
-                       record.second.filename.c_str(),
+                       record.second.function_name.get().c_str(),
+                       record.second.filename.get().c_str(),
                        record.second.lineno,
                        record.second.is_entry_frame);
             } break;
@@ -1282,6 +2247,17 @@ RecordReader::dumpAllRecordsFromAggregatedAllocationsFile()
                 printf("%p %" PRIxPTR "\n", (void*)record.vaddr, record.memsz);
             } break;
 
+            case AggregatedRecordType::INDEXED_CAPTURE: {
+                printf("INDEXED_CAPTURE ");
+
+                IndexedCapture record;
+                if (!parseIndexedCaptureRecord(&record)) {
+                    Py_RETURN_NONE;
+                }
+
+                printf("size=%zd mtime_ns=%lld\n", record.size, record.mtime_ns);
+            } break;
+
             case AggregatedRecordType::THREAD_RECORD: {
                 printf("THREAD_RECORD ");
 
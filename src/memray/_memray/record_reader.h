@@ -4,20 +4,24 @@
 #include <Python.h>
 
 #include <assert.h>
+#include <atomic>
 #include <fstream>
 #include <functional>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <stddef.h>
 #include <stdint.h>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include "frame_tree.h"
 #include "native_resolver.h"
 #include "python_helpers.h"
+#include "record_writer.h"
 #include "records.h"
 #include "source.h"
 
@@ -38,9 +42,37 @@ class RecordReader
         ERROR,
         END_OF_FILE,
     };
+    // A resolved frame whose strings point into interned storage, so frames
+    // can be compared and hashed by the addresses of their strings.
+    struct StackFrame
+    {
+        const std::string* function_name;
+        const std::string* filename;
+        int lineno;
+    };
+    // How much of the reader's state replayState() has written so far.
+    struct ReplayCursor
+    {
+        size_t frames{0};
+        FrameTree::index_t tree_nodes{0};
+        size_t native_frames{0};
+        size_t mappings_generation{0};
+        size_t mappings{0};
+        std::unordered_map<thread_id_t, std::string> thread_names{};
+    };
     explicit RecordReader(std::unique_ptr<memray::io::Source> source, bool track_stacks = true);
     void close() noexcept;
     bool isOpen() const noexcept;
+    // Called once the final record has been read, which happens when
+    // nextRecord() reaches the end of the input. No more records are read
+    // after that, so the state read so far never changes again, and the
+    // accessors below that don't return Python objects stop taking the lock:
+    // they can be called from several threads at once, including ones that
+    // released the GIL. The Py_* accessors always take it, because they
+    // update caches of Python objects, and creating those objects can run
+    // other Python threads, which may use the same caches.
+    void freeze();
+    bool isFrozen() const noexcept;
     PyObject*
     Py_GetStackFrame(FrameTree::index_t index, size_t max_stacks = std::numeric_limits<size_t>::max());
     PyObject* Py_GetStackFrameAndEntryInfo(
@@ -51,7 +83,21 @@ class RecordReader
             FrameTree::index_t index,
             size_t generation,
             size_t max_stacks = std::numeric_limits<size_t>::max());
+    // Returns the native stack with the Python frames that each call to the
+    // interpreter's eval loop was running substituted in. Frames above the
+    // one that started tracking are left out for the main thread.
+    PyObject* Py_GetHybridStackFrame(
+            FrameTree::index_t python_index,
+            FrameTree::index_t native_index,
+            size_t generation,
+            bool is_main_thread,
+            size_t max_stacks = std::numeric_limits<size_t>::max());
+    // Returns a list with the Python stack of each tree node, taking the lock
+    // only once for all of them.
+    PyObject* Py_GetStackFrames(const std::vector<FrameTree::index_t>& indexes);
     std::optional<frame_id_t> getLatestPythonFrameId(const Allocation& allocation) const;
+    void
+    getStackFrames(const Allocation& allocation, bool native_traces, std::vector<StackFrame>* frames);
     PyObject* Py_GetFrame(std::optional<frame_id_t> frame);
 
     RecordResult nextRecord();
@@ -61,16 +107,75 @@ class RecordReader
     PyObject* dumpAllRecords();
     std::string getThreadName(thread_id_t tid);
     Allocation getLatestAllocation() const noexcept;
+    size_t getDroppedAllocationCount() const noexcept;
     MemoryRecord getLatestMemoryRecord() const noexcept;
     AggregatedAllocation getLatestAggregatedAllocation() const noexcept;
     MemorySnapshot getLatestMemorySnapshot() const noexcept;
+    // Writes the frames, Python stack tree nodes, native frames, memory
+    // mappings and thread names read since `cursor` was last used. Tree nodes
+    // are written in index order, so the writer's node numbers are the same
+    // as our tree indexes.
+    bool replayState(RecordWriter& writer, ReplayCursor* cursor) const;
+    // Writes a pre-aggregated index of the capture being read, holding
+    // everything read so far along with the memory snapshots and the
+    // per-location aggregates computed from it. Native frames are written
+    // unresolved, with every generation of mappings, so readers of the index
+    // still resolve their symbols. See createIndexRecordWriter.
+    bool writeIndex(
+            std::unique_ptr<memray::io::Sink> sink,
+            const HeaderRecord& header,
+            const IndexedCapture& capture,
+            const std::vector<MemorySnapshot>& memory_snapshots,
+            const std::vector<AggregatedAllocation>& allocations) const;
+    // The capture that the index being read was built from, or all zeros if
+    // what's being read isn't an index.
+    IndexedCapture getIndexedCapture() const noexcept;
 
   private:
     // Aliases
     using stack_t = std::vector<FrameTree::index_t>;
     using stack_traces_t = std::unordered_map<thread_id_t, stack_t>;
+    using native_stack_key_t = std::pair<FrameTree::index_t, size_t>;
+
+    struct native_stack_key_hash
+    {
+        std::size_t operator()(const native_stack_key_t& key) const
+        {
+            return std::hash<FrameTree::index_t>()(key.first) ^ (std::hash<size_t>()(key.second) << 1);
+        }
+    };
+
+    struct HybridStackKey
+    {
+        FrameTree::index_t python_index;
+        FrameTree::index_t native_index;
+        size_t generation;
+        bool is_main_thread;
+
+        bool operator==(const HybridStackKey& other) const
+        {
+            return python_index == other.python_index && native_index == other.native_index
+                   && generation == other.generation && is_main_thread == other.is_main_thread;
+        }
+
+        struct Hash
+        {
+            std::size_t operator()(const HybridStackKey& key) const
+            {
+                size_t hash = std::hash<FrameTree::index_t>()(key.python_index);
+                hash = hash * 31 + std::hash<FrameTree::index_t>()(key.native_index);
+                hash = hash * 31 + std::hash<size_t>()(key.generation);
+                return hash * 2 + key.is_main_thread;
+            }
+        };
+    };
+
+    // How many frames the materialized stacks can hold before the least
+    // recently used ones are dropped, for each kind of stack.
+    static constexpr size_t MAX_CACHED_STACK_FRAMES = 1 << 20;
 
     // Private methods
+    std::unique_lock<std::mutex> lockUnlessFrozen() const;
     void readHeader(HeaderRecord& header);
     template<typename T>
     bool readVarint(T* val);
@@ -84,24 +189,69 @@ class RecordReader
     RecordResult nextRecordFromAggregatedAllocationsFile();
     PyObject* dumpAllRecordsFromAllAllocationsFile();
     PyObject* dumpAllRecordsFromAggregatedAllocationsFile();
+    // Either of `frames` and `is_entry_frame` may be null.
+    void getPythonStackFrames(
+            FrameTree::index_t index,
+            std::vector<StackFrame>* frames,
+            std::vector<unsigned char>* is_entry_frame);
+    void
+    getNativeStackFrames(FrameTree::index_t index, size_t generation, std::vector<StackFrame>* frames);
+    void getHybridStackFrames(const Allocation& allocation, std::vector<StackFrame>* frames);
+    static bool mergeHybridStack(
+            const std::vector<std::string_view>& native_function_names,
+            const std::vector<unsigned char>& is_entry_frame,
+            size_t frames_to_skip,
+            std::vector<size_t>* hybrid_stack);
+    // Return borrowed references to the lists of frames of whole stacks,
+    // which the public APIs copy. A stack is built on top of the cached stack
+    // of its caller, which is cached too unless `cache_caller` is false, so
+    // stacks that share a caller only need the frames below it built.
+    PyObject* getCachedPythonStack(FrameTree::index_t index, bool cache_caller = true);
+    PyObject* getCachedNativeStack(FrameTree::index_t index, size_t generation, bool cache_caller = true);
+    [[nodiscard]] bool addFrame(const pyframe_map_val_t& pyframe_val);
+    const Frame& getFrame(frame_id_t frame_id) const;
+    PyObject* getCachedHybridStack(const HybridStackKey& key);
+    PyObject* getCachedPythonFrame(frame_id_t frame_id);
 
     // Data members
     mutable std::mutex d_mutex;
+    std::atomic<bool> d_frozen{false};
     std::unique_ptr<memray::io::Source> d_input;
     const bool d_track_stacks;
     HeaderRecord d_header;
-    pyframe_map_t d_frame_map{};
+    // Python frames indexed by their ids, which writers assign in the order
+    // frames are first seen, so the table is dense.
+    std::vector<std::optional<Frame>> d_frames{};
+    std::vector<frame_id_t> d_frame_ids{};  // In the order they were read.
+    // Owns the function and file names of the frames, which STRING_INDEX
+    // records refer to by their position in d_strings.
+    StringTable d_string_table{};
+    std::vector<InternedString> d_strings{};
     stack_traces_t d_stack_traces{};
     FrameTree d_tree{};
+    // Our index for each Python stack tree node sent by the writer, indexed
+    // by the writer's node number.
+    std::vector<FrameTree::index_t> d_remote_trace_indexes{0};
     mutable python_helpers::PyUnicode_Cache d_pystring_cache{};
+    python_helpers::PyObject_LruCache<frame_id_t> d_pyframe_cache{MAX_CACHED_STACK_FRAMES};
+    python_helpers::PyObject_LruCache<FrameTree::index_t> d_python_stack_cache{MAX_CACHED_STACK_FRAMES};
+    python_helpers::PyObject_LruCache<native_stack_key_t, native_stack_key_hash> d_native_stack_cache{
+            MAX_CACHED_STACK_FRAMES};
+    python_helpers::PyObject_LruCache<HybridStackKey, HybridStackKey::Hash> d_hybrid_stack_cache{
+            MAX_CACHED_STACK_FRAMES};
     native_resolver::SymbolResolver d_symbol_resolver;
     std::vector<UnresolvedNativeFrame> d_native_frames{};
+    std::vector<std::vector<ImageSegments>> d_mappings_by_generation{};
     DeltaEncodedFields d_last;
     std::unordered_map<thread_id_t, std::string> d_thread_names;
     Allocation d_latest_allocation;
+    AllocationRun d_current_run{};
+    size_t d_run_records_left{0};
+    std::atomic<size_t> d_dropped_allocations{0};
     AggregatedAllocation d_latest_aggregated_allocation;
     MemoryRecord d_latest_memory_record{};
     MemorySnapshot d_latest_memory_snapshot{};
+    IndexedCapture d_indexed_capture{};
 
     // Methods
     [[nodiscard]] bool parseFramePush(FramePush* record);
@@ -110,6 +260,9 @@ class RecordReader
     [[nodiscard]] static bool parseFramePop(FramePop* record, unsigned int flags);
     [[nodiscard]] bool processFramePop(const FramePop& record);
 
+    [[nodiscard]] bool parseStringIndex(std::string* the_string);
+    [[nodiscard]] bool processStringIndex(const std::string& the_string);
+
     [[nodiscard]] bool parseFrameIndex(tracking_api::pyframe_map_val_t* pyframe_val, unsigned int flags);
     [[nodiscard]] bool processFrameIndex(const tracking_api::pyframe_map_val_t& pyframe_val);
 
@@ -122,6 +275,22 @@ class RecordReader
     [[nodiscard]] bool parseNativeAllocationRecord(NativeAllocationRecord* record, unsigned int flags);
     [[nodiscard]] bool processNativeAllocationRecord(const NativeAllocationRecord& record);
 
+    [[nodiscard]] bool parseAllocationRun(AllocationRun* run, unsigned int flags);
+    [[nodiscard]] bool processAllocationRun(const AllocationRun& run);
+    [[nodiscard]] bool processNextRecordFromAllocationRun();
+
+    [[nodiscard]] bool parseAllocationGap(size_t* dropped_allocations);
+    [[nodiscard]] bool processAllocationGap(size_t dropped_allocations);
+
+    [[nodiscard]] bool parseAllocationDelta(AllocationDelta* delta);
+    [[nodiscard]] bool processAllocationDelta(const AllocationDelta& delta);
+
+    [[nodiscard]] bool parsePythonTraceNode(PythonTraceNode* node);
+    [[nodiscard]] bool processPythonTraceNode(const PythonTraceNode& node);
+
+    [[nodiscard]] bool parseLocationDelta(LocationDelta* delta);
+    [[nodiscard]] bool processLocationDelta(const LocationDelta& delta);
+
     [[nodiscard]] static bool parseMemoryMapStart();
     [[nodiscard]] bool processMemoryMapStart();
 
@@ -146,6 +315,9 @@ class RecordReader
     [[nodiscard]] bool parseAggregatedAllocationRecord(AggregatedAllocation* record);
     [[nodiscard]] bool processAggregatedAllocationRecord(const AggregatedAllocation& record);
 
+    [[nodiscard]] bool parseIndexedCaptureRecord(IndexedCapture* record);
+    [[nodiscard]] bool processIndexedCaptureRecord(const IndexedCapture& record);
+
     [[nodiscard]] bool parsePythonTraceIndexRecord(std::pair<frame_id_t, FrameTree::index_t>* record);
     [[nodiscard]] bool processPythonTraceIndexRecord(const std::pair<frame_id_t, FrameTree::index_t>&);
 
@@ -1,9 +1,11 @@
 from _memray.records cimport AggregatedAllocation
 from _memray.records cimport Allocation
 from _memray.records cimport HeaderRecord
+from _memray.records cimport IndexedCapture
 from _memray.records cimport MemoryRecord
 from _memray.records cimport MemorySnapshot
 from _memray.records cimport optional_frame_id_t
+from _memray.sink cimport Sink
 from _memray.source cimport Source
 from libcpp cimport bool
 from libcpp.memory cimport unique_ptr
@@ -20,6 +22,11 @@ cdef extern from "record_reader.h" namespace "memray::api":
         RecordResultError 'memray::api::RecordReader::RecordResult::ERROR'
         RecordResultEndOfFile 'memray::api::RecordReader::RecordResult::END_OF_FILE'
 
+    cdef cppclass StackFrame 'memray::api::RecordReader::StackFrame':
+        const string* function_name
+        const string* filename
+        int lineno
+
     cdef cppclass RecordReader:
         RecordReader(unique_ptr[Source]) except+
         RecordReader(unique_ptr[Source], bool track_stacks) except+
@@ -36,7 +43,24 @@ cdef extern from "record_reader.h" namespace "memray::api":
         ) except+
         object Py_GetNativeStackFrame(int frame_id, size_t generation) except+
         object Py_GetNativeStackFrame(int frame_id, size_t generation, size_t max_stacks) except+
+        object Py_GetHybridStackFrame(
+            unsigned int python_frame_id,
+            unsigned int native_frame_id,
+            size_t generation,
+            bool is_main_thread,
+        ) except+
+        object Py_GetHybridStackFrame(
+            unsigned int python_frame_id,
+            unsigned int native_frame_id,
+            size_t generation,
+            bool is_main_thread,
+            size_t max_stacks,
+        ) except+
+        object Py_GetStackFrames(const vector[unsigned int]& frame_ids) except+
         optional_frame_id_t getLatestPythonFrameId(const Allocation&) except+
+        void getStackFrames(
+            const Allocation& allocation, bool native_traces, vector[StackFrame]* frames
+        ) except+
         object Py_GetFrame(optional_frame_id_t frame) except+
         HeaderRecord getHeader()
         size_t getMainThreadTid()
@@ -47,3 +71,11 @@ cdef extern from "record_reader.h" namespace "memray::api":
         MemoryRecord getLatestMemoryRecord()
         AggregatedAllocation getLatestAggregatedAllocation()
         MemorySnapshot getLatestMemorySnapshot()
+        bool writeIndex(
+            unique_ptr[Sink] sink,
+            const HeaderRecord& header,
+            const IndexedCapture& capture,
+            const vector[MemorySnapshot]& memory_snapshots,
+            const vector[AggregatedAllocation]& allocations,
+        ) except+
+        IndexedCapture getIndexedCapture()
@@ -1,10 +1,12 @@
 #include "record_writer.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <chrono>
 #include <cstring>
 #include <fcntl.h>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 
 #include "frame_tree.h"
@@ -15,6 +17,15 @@ namespace memray::tracking_api {
 
 using namespace std::chrono;
 
+// Upper bound on the number of allocation/deallocation pairs collapsed into
+// a single run, which bounds how many addresses the writer holds on to.
+static const size_t MAX_ALLOCATION_RUN_LENGTH = 4096;
+
+// Upper bounds on how much the writer holds on to while summarizing
+// allocations because the sink is congested.
+static const size_t MAX_PENDING_DELTAS = 4096;
+static const size_t MAX_SUMMARIZED_ALLOCATIONS = 65536;
+
 static PythonAllocatorType
 getPythonAllocator()
 {
@@ -51,6 +62,7 @@ class StreamingRecordWriter : public RecordWriter
             const std::string& command_line,
             bool native_traces,
             bool trace_python_allocators);
+    StreamingRecordWriter(std::unique_ptr<memray::io::Sink> sink, const HeaderRecord& header);
 
     StreamingRecordWriter(StreamingRecordWriter& other) = delete;
     StreamingRecordWriter(StreamingRecordWriter&& other) = delete;
@@ -60,6 +72,10 @@ class StreamingRecordWriter : public RecordWriter
     bool writeRecord(const MemoryRecord& record) override;
     bool writeRecord(const pyrawframe_map_val_t& item) override;
     bool writeRecord(const UnresolvedNativeFrame& record) override;
+    bool writeRecord(const PythonTraceNode& record) override;
+    bool writeRecord(const LocationDelta& record) override;
+    bool writeRecord(const MemorySnapshot& record) override;
+    bool writeRecord(const AggregatedAllocation& record) override;
 
     bool writeMappings(const std::vector<ImageSegments>& mappings) override;
 
@@ -75,14 +91,119 @@ class StreamingRecordWriter : public RecordWriter
     void setMainTidAndSkippedFrames(thread_id_t main_tid, size_t skipped_frames_on_main_tid) override;
     std::unique_ptr<RecordWriter> cloneInChildProcess() override;
 
-  private:
+  protected:
     bool maybeWriteContextSwitchRecordUnsafe(thread_id_t tid);
+    bool writeStringIndexIfNeeded(const char* the_string, size_t* string_id);
+
+    // Immediate allocation/deallocation pairs are collapsed into runs. The
+    // most recent allocation is held back until we know whether it is freed
+    // by the very next record, and the run being built is written out as soon
+    // as any record that doesn't extend it arrives.
+    bool canStartAllocationRun(hooks::Allocator allocator, bool has_native_info) const;
+    bool bufferAllocationUnsafe(thread_id_t tid, const NativeAllocationRecord& record);
+    bool bufferDeallocationUnsafe(thread_id_t tid, const AllocationRecord& record);
+    bool flushPendingAllocationsUnsafe();
+    bool flushAllocationRunUnsafe();
+    bool writeAllocationUnsafe(thread_id_t tid, const AllocationRecord& record);
+    bool writeNativeAllocationUnsafe(thread_id_t tid, const NativeAllocationRecord& record);
+    bool writeAllocationRecordUnsafe(const AllocationRecord& record);
+    bool writeNativeAllocationRecordUnsafe(const NativeAllocationRecord& record);
+
+    // When the sink can't keep up, allocation records are dropped or
+    // summarized according to its backpressure policy. Dropped records are
+    // counted, and the count is written out as a gap marker once the sink
+    // catches up. Summarized allocations are accumulated into one delta per
+    // thread, stack, and allocator, which is written out once the sink
+    // catches up. Summarized allocations are remembered until they're freed,
+    // and their deallocations are subtracted from the delta of their
+    // location, even once the allocations themselves were written out.
+    struct DeltaKey
+    {
+        thread_id_t tid;
+        FrameTree::index_t python_stack_id;
+        hooks::Allocator allocator;
+        frame_id_t native_frame_id;
+
+        bool operator==(const DeltaKey& other) const;
+    };
+    struct DeltaKeyHash
+    {
+        size_t operator()(const DeltaKey& key) const;
+    };
+
+    bool
+    shedAllocationUnsafe(thread_id_t tid, const NativeAllocationRecord& record, bool has_native_info);
+    bool summarizeAllocationUnsafe(thread_id_t tid, const NativeAllocationRecord& record);
+    bool cancelSummarizedAllocationUnsafe(uintptr_t address);
+    bool writeBackpressureSummariesUnsafe();
+    bool flushAllocationDeltasUnsafe();
 
     // Data members
     int d_version{CURRENT_HEADER_VERSION};
     HeaderRecord d_header{};
     TrackerStats d_stats{};
     DeltaEncodedFields d_last;
+    std::optional<NativeAllocationRecord> d_pending_allocation{};
+    AllocationRun d_pending_run{};
+    std::vector<uintptr_t> d_pending_run_addresses{};
+    std::unordered_map<std::string, size_t> d_string_ids{};
+    const io::BackpressurePolicy d_backpressure_policy;
+    size_t d_dropped_allocations{0};
+    std::unordered_map<DeltaKey, AllocationDelta, DeltaKeyHash> d_pending_deltas{};
+    std::unordered_map<uintptr_t, std::pair<DeltaKey, size_t>> d_summarized_allocations{};
+    // The Python stack of each thread, which is only tracked in order to
+    // attribute summarized allocations. Stacks are only added to the tree
+    // once an allocation made from them is summarized, and the tree is
+    // emptied again once every summarized allocation was freed.
+    struct PythonStack
+    {
+        std::vector<frame_id_t> frame_ids{};
+        // The tree index of each of the frames that were added to the tree.
+        std::vector<FrameTree::index_t> indexes{};
+    };
+    FrameTree::index_t pythonStackIdUnsafe(thread_id_t tid);
+    FrameTree d_python_frame_tree{};
+    std::unordered_map<thread_id_t, PythonStack> d_python_stack_by_thread{};
+};
+
+// Streams the net change in live memory per location instead of individual
+// allocations, for live clients of processes that allocate too quickly for
+// every record to be sent. Allocations are reduced in process to per-thread,
+// per-location totals, and each memory record is preceded by deltas for the
+// locations whose totals changed since the previous one, along with the
+// Python stack tree nodes those deltas refer to. Frame push and pop records
+// aren't written at all, since deltas carry their own stack.
+//
+// Everything else is written exactly as StreamingRecordWriter writes it, so
+// the stream is still in the ALL_ALLOCATIONS format.
+class LiveAggregatingRecordWriter : public StreamingRecordWriter
+{
+  public:
+    using StreamingRecordWriter::StreamingRecordWriter;
+
+    bool writeRecord(const MemoryRecord& record) override;
+    using StreamingRecordWriter::writeRecord;
+
+    bool writeThreadSpecificRecord(thread_id_t tid, const FramePop& record) override;
+    bool writeThreadSpecificRecord(thread_id_t tid, const FramePush& record) override;
+    bool writeThreadSpecificRecord(thread_id_t tid, const AllocationRecord& record) override;
+    bool writeThreadSpecificRecord(thread_id_t tid, const NativeAllocationRecord& record) override;
+    using StreamingRecordWriter::writeThreadSpecificRecord;
+
+    bool writeTrailer() override;
+
+    std::unique_ptr<RecordWriter> cloneInChildProcess() override;
+
+  private:
+    void addAllocationUnsafe(thread_id_t tid, const NativeAllocationRecord& record);
+    bool flushLocationDeltasUnsafe();
+
+    FrameTree d_stack_tree{};
+    std::unordered_map<thread_id_t, std::vector<FrameTree::index_t>> d_stack_ids_by_thread{};
+    FrameTree::index_t d_sent_stack_tree_nodes{0};
+    api::IncrementalSnapshotAggregator d_aggregator{};
+    // The totals the reader has been told about, for computing deltas.
+    api::reduced_snapshot_map_t d_sent_totals{};
 };
 
 class AggregatingRecordWriter : public RecordWriter
@@ -93,6 +214,10 @@ class AggregatingRecordWriter : public RecordWriter
             const std::string& command_line,
             bool native_traces,
             bool trace_python_allocators);
+    AggregatingRecordWriter(
+            std::unique_ptr<memray::io::Sink> sink,
+            const HeaderRecord& header,
+            const IndexedCapture& capture);
 
     AggregatingRecordWriter(StreamingRecordWriter& other) = delete;
     AggregatingRecordWriter(StreamingRecordWriter&& other) = delete;
@@ -102,6 +227,10 @@ class AggregatingRecordWriter : public RecordWriter
     bool writeRecord(const MemoryRecord& record) override;
     bool writeRecord(const pyrawframe_map_val_t& item) override;
     bool writeRecord(const UnresolvedNativeFrame& record) override;
+    bool writeRecord(const PythonTraceNode& record) override;
+    bool writeRecord(const LocationDelta& record) override;
+    bool writeRecord(const MemorySnapshot& record) override;
+    bool writeRecord(const AggregatedAllocation& record) override;
 
     bool writeMappings(const std::vector<ImageSegments>& mappings) override;
 
@@ -125,6 +254,9 @@ class AggregatingRecordWriter : public RecordWriter
     // Data members
     HeaderRecord d_header;
     TrackerStats d_stats;
+    std::optional<IndexedCapture> d_indexed_capture{};
+    std::vector<AggregatedAllocation> d_aggregated_allocations{};
+    StringTable d_string_table;
     pyframe_map_t d_frames_by_id;
     std::vector<UnresolvedNativeFrame> d_native_frames{};
     std::vector<std::vector<ImageSegments>> d_mappings_by_generation{};
@@ -135,6 +267,61 @@ class AggregatingRecordWriter : public RecordWriter
     api::HighWaterMarkAggregator d_high_water_mark_aggregator;
 };
 
+bool
+writeLocationDeltas(
+        RecordWriter& writer,
+        const api::reduced_snapshot_map_t& updated,
+        const std::vector<api::LocationKey>& removed,
+        api::reduced_snapshot_map_t* sent)
+{
+    auto writeDelta = [&](const api::LocationKey& key,
+                          const Allocation& totals,
+                          ssize_t count,
+                          ssize_t size) {
+        return writer.writeRecord(LocationDelta{
+                key.thread_id,
+                totals.allocator,
+                key.native_frame_id,
+                key.python_frame_id,
+                count,
+                size});
+    };
+
+    for (const auto& key : removed) {
+        auto it = sent->find(key);
+        if (it == sent->end()) {
+            continue;  // Allocated and freed again between two updates.
+        }
+        const Allocation& sent_totals = it->second;
+        ssize_t count = -static_cast<ssize_t>(sent_totals.n_allocations);
+        ssize_t size = -static_cast<ssize_t>(sent_totals.size);
+        if (!writeDelta(key, sent_totals, count, size)) {
+            return false;
+        }
+        sent->erase(it);
+    }
+
+    for (const auto& [key, totals] : updated) {
+        auto [it, inserted] = sent->try_emplace(key, totals);
+        Allocation& sent_totals = it->second;
+        if (inserted) {
+            sent_totals.n_allocations = 0;
+            sent_totals.size = 0;
+        }
+        // Totals are unsigned, but the differences may be negative.
+        auto count = static_cast<ssize_t>(totals.n_allocations - sent_totals.n_allocations);
+        auto size = static_cast<ssize_t>(totals.size - sent_totals.size);
+        if (count == 0 && size == 0) {
+            continue;
+        }
+        if (!writeDelta(key, totals, count, size)) {
+            return false;
+        }
+        sent_totals = totals;
+    }
+    return true;
+}
+
 std::unique_ptr<RecordWriter>
 createRecordWriter(
         std::unique_ptr<memray::io::Sink> sink,
@@ -161,6 +348,35 @@ createRecordWriter(
     }
 }
 
+std::unique_ptr<RecordWriter>
+createForwardingRecordWriter(std::unique_ptr<memray::io::Sink> sink, const HeaderRecord& header)
+{
+    return std::make_unique<StreamingRecordWriter>(std::move(sink), header);
+}
+
+std::unique_ptr<RecordWriter>
+createIndexRecordWriter(
+        std::unique_ptr<memray::io::Sink> sink,
+        const HeaderRecord& header,
+        const IndexedCapture& capture)
+{
+    return std::make_unique<AggregatingRecordWriter>(std::move(sink), header, capture);
+}
+
+std::unique_ptr<RecordWriter>
+createLiveAggregatingRecordWriter(
+        std::unique_ptr<memray::io::Sink> sink,
+        const std::string& command_line,
+        bool native_traces,
+        bool trace_python_allocators)
+{
+    return std::make_unique<LiveAggregatingRecordWriter>(
+            std::move(sink),
+            command_line,
+            native_traces,
+            trace_python_allocators);
+}
+
 StreamingRecordWriter::StreamingRecordWriter(
         std::unique_ptr<memray::io::Sink> sink,
         const std::string& command_line,
@@ -168,6 +384,7 @@ StreamingRecordWriter::StreamingRecordWriter(
         bool trace_python_allocators)
 : RecordWriter(std::move(sink))
 , d_stats({0, 0, duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count()})
+, d_backpressure_policy(d_sink->backpressurePolicy())
 {
     d_header = HeaderRecord{
             "",
@@ -184,6 +401,21 @@ StreamingRecordWriter::StreamingRecordWriter(
     strncpy(d_header.magic, MAGIC, sizeof(d_header.magic));
 }
 
+StreamingRecordWriter::StreamingRecordWriter(
+        std::unique_ptr<memray::io::Sink> sink,
+        const HeaderRecord& header)
+: RecordWriter(std::move(sink))
+, d_stats({0, 0, header.stats.start_time})
+, d_backpressure_policy(d_sink->backpressurePolicy())
+{
+    // Keep the start time, so that memory records forwarded from the other
+    // process are encoded relative to the same point in time.
+    d_header = header;
+    d_header.version = d_version;
+    d_header.file_format = FileFormat::ALL_ALLOCATIONS;
+    d_header.stats = d_stats;
+}
+
 void
 StreamingRecordWriter::setMainTidAndSkippedFrames(
         thread_id_t main_tid,
@@ -196,6 +428,21 @@ StreamingRecordWriter::setMainTidAndSkippedFrames(
 bool
 StreamingRecordWriter::writeRecord(const MemoryRecord& record)
 {
+    if (d_backpressure_policy != io::BackpressurePolicy::BLOCK) {
+        if (d_sink->isCongested()) {
+            // Nothing depends on these samples, so they can be skipped.
+            return d_sink->flush();
+        }
+        // These records are written periodically, so they're a good time to
+        // tell the reader about allocations we had to drop or summarize.
+        if (!writeBackpressureSummariesUnsafe()) {
+            return false;
+        }
+    }
+    if (!flushPendingAllocationsUnsafe()) {
+        return false;
+    }
+
     RecordTypeAndFlags token{RecordType::MEMORY_RECORD, 0};
     return writeSimpleType(token) && writeVarint(record.rss)
            && writeVarint(record.ms_since_epoch - d_stats.start_time) && d_sink->flush();
@@ -204,25 +451,94 @@ StreamingRecordWriter::writeRecord(const MemoryRecord& record)
 bool
 StreamingRecordWriter::writeRecord(const pyrawframe_map_val_t& item)
 {
+    if (!flushPendingAllocationsUnsafe()) {
+        return false;
+    }
+
+    size_t function_name_id;
+    size_t filename_id;
+    if (!writeStringIndexIfNeeded(item.second.function_name, &function_name_id)
+        || !writeStringIndexIfNeeded(item.second.filename, &filename_id))
+    {
+        return false;
+    }
+
     d_stats.n_frames += 1;
     RecordTypeAndFlags token{RecordType::FRAME_INDEX, !item.second.is_entry_frame};
     return writeSimpleType(token) && writeIntegralDelta(&d_last.python_frame_id, item.first)
-           && writeString(item.second.function_name) && writeString(item.second.filename)
+           && writeVarint(function_name_id) && writeVarint(filename_id)
            && writeIntegralDelta(&d_last.python_line_number, item.second.lineno);
 }
 
+bool
+StreamingRecordWriter::writeStringIndexIfNeeded(const char* the_string, size_t* string_id)
+{
+    auto [it, inserted] = d_string_ids.emplace(the_string, d_string_ids.size());
+    *string_id = it->second;
+    if (!inserted) {
+        return true;
+    }
+
+    // String ids are implicit: each STRING_INDEX record gets the next one.
+    RecordTypeAndFlags token{RecordType::STRING_INDEX, 0};
+    return writeSimpleType(token) && writeString(the_string);
+}
+
 bool
 StreamingRecordWriter::writeRecord(const UnresolvedNativeFrame& record)
 {
+    if (!flushPendingAllocationsUnsafe()) {
+        return false;
+    }
+
     return writeSimpleType(RecordTypeAndFlags{RecordType::NATIVE_TRACE_INDEX, 0})
            && writeIntegralDelta(&d_last.instruction_pointer, record.ip)
            && writeIntegralDelta(&d_last.native_frame_id, record.index);
 }
 
+bool
+StreamingRecordWriter::writeRecord(const PythonTraceNode& record)
+{
+    if (!flushPendingAllocationsUnsafe()) {
+        return false;
+    }
+
+    RecordTypeAndFlags token{RecordType::OTHER, int(OtherRecordType::PYTHON_TRACE_NODE)};
+    return writeSimpleType(token) && writeIntegralDelta(&d_last.python_frame_id, record.frame_id)
+           && writeVarint(record.parent_index);
+}
+
+bool
+StreamingRecordWriter::writeRecord(const LocationDelta& record)
+{
+    if (!flushPendingAllocationsUnsafe()) {
+        return false;
+    }
+
+    RecordTypeAndFlags token{RecordType::OTHER, int(OtherRecordType::LOCATION_DELTA)};
+    return writeSimpleType(token) && writeSimpleType(record.tid) && writeSimpleType(record.allocator)
+           && writeSignedVarint(record.count) && writeSignedVarint(record.size)
+           && (!d_header.native_traces
+               || writeIntegralDelta(&d_last.native_frame_id, record.native_frame_id))
+           && writeVarint(record.python_trace_index);
+}
+
+bool
+StreamingRecordWriter::writeRecord(const MemorySnapshot&)
+{
+    return false;
+}
+
+bool
+StreamingRecordWriter::writeRecord(const AggregatedAllocation&)
+{
+    return false;
+}
+
 bool
 StreamingRecordWriter::writeMappings(const std::vector<ImageSegments>& mappings)
 {
-    return writeMappingsCommon(mappings);
+    return flushPendingAllocationsUnsafe() && writeMappingsCommon(mappings);
 }
 
 bool
@@ -261,6 +577,11 @@ StreamingRecordWriter::maybeWriteContextSwitchRecordUnsafe(thread_id_t tid)
     if (d_last.thread_id == tid) {
         return true;  // nothing to do.
     }
+
+    // Pending allocations belong to the previous thread.
+    if (!flushPendingAllocationsUnsafe()) {
+        return false;
+    }
     d_last.thread_id = tid;
 
     RecordTypeAndFlags token{RecordType::CONTEXT_SWITCH, 0};
@@ -271,10 +592,18 @@ StreamingRecordWriter::maybeWriteContextSwitchRecordUnsafe(thread_id_t tid)
 bool
 StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const FramePop& record)
 {
-    if (!maybeWriteContextSwitchRecordUnsafe(tid)) {
+    if (!flushPendingAllocationsUnsafe() || !maybeWriteContextSwitchRecordUnsafe(tid)) {
         return false;
     }
 
+    if (d_backpressure_policy == io::BackpressurePolicy::AGGREGATE) {
+        auto& stack = d_python_stack_by_thread[tid];
+        stack.frame_ids.resize(stack.frame_ids.size() - std::min(record.count, stack.frame_ids.size()));
+        if (stack.indexes.size() > stack.frame_ids.size()) {
+            stack.indexes.resize(stack.frame_ids.size());
+        }
+    }
+
     size_t count = record.count;
     while (count) {
         uint8_t to_pop = (count > 16 ? 16 : count);
@@ -294,10 +623,14 @@ StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const FramePop
 bool
 StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const FramePush& record)
 {
-    if (!maybeWriteContextSwitchRecordUnsafe(tid)) {
+    if (!flushPendingAllocationsUnsafe() || !maybeWriteContextSwitchRecordUnsafe(tid)) {
         return false;
     }
 
+    if (d_backpressure_policy == io::BackpressurePolicy::AGGREGATE) {
+        d_python_stack_by_thread[tid].frame_ids.push_back(record.frame_id);
+    }
+
     RecordTypeAndFlags token{RecordType::FRAME_PUSH, 0};
     return writeSimpleType(token) && writeIntegralDelta(&d_last.python_frame_id, record.frame_id);
 }
@@ -305,11 +638,354 @@ StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const FramePus
 bool
 StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const AllocationRecord& record)
 {
+    d_stats.n_allocations += 1;
+    if (!d_summarized_allocations.empty()
+        && hooks::allocatorKind(record.allocator) == hooks::AllocatorKind::SIMPLE_DEALLOCATOR
+        && cancelSummarizedAllocationUnsafe(record.address))
+    {
+        return true;
+    }
+    if (d_backpressure_policy != io::BackpressurePolicy::BLOCK) {
+        if (d_sink->isCongested()) {
+            return shedAllocationUnsafe(
+                    tid,
+                    NativeAllocationRecord{record.address, record.size, record.allocator, 0},
+                    false);
+        }
+        if (!writeBackpressureSummariesUnsafe()) {
+            return false;
+        }
+    }
+    return writeAllocationUnsafe(tid, record);
+}
+
+bool
+StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const NativeAllocationRecord& record)
+{
+    d_stats.n_allocations += 1;
+    if (d_backpressure_policy != io::BackpressurePolicy::BLOCK) {
+        if (d_sink->isCongested()) {
+            return shedAllocationUnsafe(tid, record, true);
+        }
+        if (!writeBackpressureSummariesUnsafe()) {
+            return false;
+        }
+    }
+    return writeNativeAllocationUnsafe(tid, record);
+}
+
+bool
+StreamingRecordWriter::writeAllocationUnsafe(thread_id_t tid, const AllocationRecord& record)
+{
+    if (canStartAllocationRun(record.allocator, false)) {
+        return bufferAllocationUnsafe(
+                tid,
+                NativeAllocationRecord{record.address, record.size, record.allocator, 0});
+    }
+    if (hooks::allocatorKind(record.allocator) == hooks::AllocatorKind::SIMPLE_DEALLOCATOR) {
+        return bufferDeallocationUnsafe(tid, record);
+    }
+
+    return flushPendingAllocationsUnsafe() && maybeWriteContextSwitchRecordUnsafe(tid)
+           && writeAllocationRecordUnsafe(record);
+}
+
+bool
+StreamingRecordWriter::writeNativeAllocationUnsafe(thread_id_t tid, const NativeAllocationRecord& record)
+{
+    if (canStartAllocationRun(record.allocator, true)) {
+        return bufferAllocationUnsafe(tid, record);
+    }
+
+    return flushPendingAllocationsUnsafe() && maybeWriteContextSwitchRecordUnsafe(tid)
+           && writeNativeAllocationRecordUnsafe(record);
+}
+
+bool
+StreamingRecordWriter::DeltaKey::operator==(const DeltaKey& other) const
+{
+    return tid == other.tid && python_stack_id == other.python_stack_id
+           && allocator == other.allocator && native_frame_id == other.native_frame_id;
+}
+
+size_t
+StreamingRecordWriter::DeltaKeyHash::operator()(const DeltaKey& key) const
+{
+    return std::hash<thread_id_t>{}(key.tid) ^ std::hash<size_t>{}(key.python_stack_id)
+           ^ std::hash<size_t>{}(key.native_frame_id + 2147483647)
+           ^ std::hash<int>{}(static_cast<int>(key.allocator) << 24);
+}
+
+bool
+StreamingRecordWriter::shedAllocationUnsafe(
+        thread_id_t tid,
+        const NativeAllocationRecord& record,
+        bool has_native_info)
+{
+    if (d_backpressure_policy == io::BackpressurePolicy::DROP) {
+        d_dropped_allocations += 1;
+        return true;
+    }
+
+    assert(d_backpressure_policy == io::BackpressurePolicy::AGGREGATE);
+    if (hooks::allocatorKind(record.allocator) == hooks::AllocatorKind::SIMPLE_ALLOCATOR
+        && d_summarized_allocations.size() < MAX_SUMMARIZED_ALLOCATIONS)
+    {
+        return summarizeAllocationUnsafe(tid, record);
+    }
+
+    // Deallocations can't be summarized without knowing their sizes, and
+    // ranged allocations may later be partially unmapped, so neither can be
+    // summarized without losing track of the heap. Once too many summarized
+    // allocations are live, allocations are written out as usual too.
+    if (has_native_info) {
+        return writeNativeAllocationUnsafe(tid, record);
+    }
+    return writeAllocationUnsafe(
+            tid,
+            AllocationRecord{record.address, record.size, record.allocator});
+}
+
+FrameTree::index_t
+StreamingRecordWriter::pythonStackIdUnsafe(thread_id_t tid)
+{
+    auto& stack = d_python_stack_by_thread[tid];
+    while (stack.indexes.size() < stack.frame_ids.size()) {
+        FrameTree::index_t parent = stack.indexes.empty() ? 0 : stack.indexes.back();
+        stack.indexes.push_back(
+                d_python_frame_tree.getTraceIndex(parent, stack.frame_ids[stack.indexes.size()]));
+    }
+    return stack.indexes.empty() ? 0 : stack.indexes.back();
+}
+
+bool
+StreamingRecordWriter::summarizeAllocationUnsafe(thread_id_t tid, const NativeAllocationRecord& record)
+{
+    // If the address is still summarized, we missed its deallocation.
+    cancelSummarizedAllocationUnsafe(record.address);
+
+    DeltaKey key{tid, pythonStackIdUnsafe(tid), record.allocator, record.native_frame_id};
+    auto [it, inserted] = d_pending_deltas.emplace(
+            key,
+            AllocationDelta{tid, record.allocator, record.native_frame_id, 0, 0, {}});
+    it->second.count += 1;
+    it->second.size += record.size;
+    d_summarized_allocations.emplace(record.address, std::make_pair(key, record.size));
+
+    if (d_pending_deltas.size() >= MAX_PENDING_DELTAS) {
+        return flushAllocationDeltasUnsafe();
+    }
+    return true;
+}
+
+bool
+StreamingRecordWriter::cancelSummarizedAllocationUnsafe(uintptr_t address)
+{
+    auto it = d_summarized_allocations.find(address);
+    if (it == d_summarized_allocations.end()) {
+        return false;
+    }
+
+    const auto& [key, size] = it->second;
+    auto [delta, inserted] = d_pending_deltas.emplace(
+            key,
+            AllocationDelta{key.tid, key.allocator, key.native_frame_id, 0, 0, {}});
+    delta->second.count -= 1;
+    delta->second.size -= static_cast<ssize_t>(size);
+    d_summarized_allocations.erase(it);
+    return true;
+}
+
+bool
+StreamingRecordWriter::writeBackpressureSummariesUnsafe()
+{
+    if (!flushAllocationDeltasUnsafe()) {
+        return false;
+    }
+    if (!d_dropped_allocations) {
+        return true;
+    }
+
+    RecordTypeAndFlags token{RecordType::OTHER, int(OtherRecordType::ALLOCATION_GAP)};
+    size_t dropped = d_dropped_allocations;
+    d_dropped_allocations = 0;
+    return writeSimpleType(token) && writeVarint(dropped);
+}
+
+bool
+StreamingRecordWriter::flushAllocationDeltasUnsafe()
+{
+    if (d_pending_deltas.empty()) {
+        return true;
+    }
+
+    // Deltas carry their own thread and stack, so unlike other allocation
+    // records they can be written regardless of the current thread and
+    // stack, as long as every frame in the stack was already written.
+    bool ret = true;
+    RecordTypeAndFlags token{RecordType::OTHER, int(OtherRecordType::ALLOCATION_DELTA)};
+    std::vector<frame_id_t> python_stack;
+    for (auto it = d_pending_deltas.begin(); ret && it != d_pending_deltas.end(); ++it) {
+        const auto& [key, delta] = *it;
+        if (delta.count == 0 && delta.size == 0) {
+            continue;  // Everything was freed again.
+        }
+
+        python_stack.clear();
+        for (FrameTree::index_t index = key.python_stack_id; index != 0;) {
+            auto [frame_id, parent_index] = d_python_frame_tree.nextNode(index);
+            python_stack.push_back(frame_id);
+            index = parent_index;
+        }
+
+        ret = writeSimpleType(token) && writeSimpleType(delta.tid)
+              && writeSimpleType(delta.allocator) && writeSignedVarint(delta.count)
+              && writeSignedVarint(delta.size)
+              && (!d_header.native_traces
+                  || writeIntegralDelta(&d_last.native_frame_id, delta.native_frame_id))
+              && writeVarint(python_stack.size());
+        // Outermost frame first.
+        for (auto frame = python_stack.rbegin(); ret && frame != python_stack.rend(); ++frame) {
+            ret = writeIntegralDelta(&d_last.python_frame_id, *frame);
+        }
+    }
+
+    d_pending_deltas.clear();
+    if (d_summarized_allocations.empty()) {
+        // No delta refers to the tree anymore.
+        d_python_frame_tree = FrameTree();
+        for (auto& [tid, stack] : d_python_stack_by_thread) {
+            stack.indexes.clear();
+        }
+    }
+    return ret;
+}
+
+bool
+StreamingRecordWriter::canStartAllocationRun(hooks::Allocator allocator, bool has_native_info) const
+{
+    // Runs are encoded with a native frame id if and only if the capture has
+    // native traces, so only allocations matching the file's mode can be
+    // collapsed.
+    return has_native_info == d_header.native_traces
+           && hooks::allocatorKind(allocator) == hooks::AllocatorKind::SIMPLE_ALLOCATOR;
+}
+
+bool
+StreamingRecordWriter::bufferAllocationUnsafe(thread_id_t tid, const NativeAllocationRecord& record)
+{
+    // An allocation that is still pending was not immediately freed. The run
+    // before it is kept open, since this allocation may still extend it.
+    if (d_pending_allocation && !flushPendingAllocationsUnsafe()) {
+        return false;
+    }
     if (!maybeWriteContextSwitchRecordUnsafe(tid)) {
         return false;
     }
+    d_pending_allocation = record;
+    return true;
+}
 
-    d_stats.n_allocations += 1;
+bool
+StreamingRecordWriter::bufferDeallocationUnsafe(thread_id_t tid, const AllocationRecord& record)
+{
+    if (!d_pending_allocation || d_last.thread_id != tid
+        || d_pending_allocation->address != record.address)
+    {
+        return flushPendingAllocationsUnsafe() && maybeWriteContextSwitchRecordUnsafe(tid)
+               && writeAllocationRecordUnsafe(record);
+    }
+
+    const NativeAllocationRecord& allocation = *d_pending_allocation;
+    if (d_pending_run.count && d_pending_run.count < MAX_ALLOCATION_RUN_LENGTH
+        && d_pending_run.size == allocation.size && d_pending_run.allocator == allocation.allocator
+        && d_pending_run.deallocator == record.allocator
+        && d_pending_run.native_frame_id == allocation.native_frame_id)
+    {
+        d_pending_run.count += 1;
+    } else {
+        if (!flushAllocationRunUnsafe()) {
+            return false;
+        }
+        d_pending_run = AllocationRun{
+                allocation.address,
+                allocation.size,
+                allocation.allocator,
+                record.allocator,
+                allocation.native_frame_id,
+                1};
+    }
+    d_pending_run_addresses.push_back(allocation.address);
+    d_pending_allocation.reset();
+    return true;
+}
+
+bool
+StreamingRecordWriter::flushPendingAllocationsUnsafe()
+{
+    if (!flushAllocationRunUnsafe()) {
+        return false;
+    }
+
+    if (!d_pending_allocation) {
+        return true;
+    }
+    NativeAllocationRecord allocation = *d_pending_allocation;
+    d_pending_allocation.reset();
+    if (d_header.native_traces) {
+        return writeNativeAllocationRecordUnsafe(allocation);
+    }
+    return writeAllocationRecordUnsafe(
+            AllocationRecord{allocation.address, allocation.size, allocation.allocator});
+}
+
+bool
+StreamingRecordWriter::flushAllocationRunUnsafe()
+{
+    const AllocationRun& run = d_pending_run;
+    if (run.count == 0) {
+        return true;
+    }
+    assert(run.count == d_pending_run_addresses.size());
+
+    bool ret = true;
+    if (run.count == 1) {
+        // A lone pair is cheaper to encode as two plain records.
+        AllocationRecord deallocation{run.address, 0, run.deallocator};
+        if (d_header.native_traces) {
+            ret = writeNativeAllocationRecordUnsafe(NativeAllocationRecord{
+                          run.address,
+                          run.size,
+                          run.allocator,
+                          run.native_frame_id})
+                  && writeAllocationRecordUnsafe(deallocation);
+        } else {
+            ret = writeAllocationRecordUnsafe(AllocationRecord{run.address, run.size, run.allocator})
+                  && writeAllocationRecordUnsafe(deallocation);
+        }
+    } else {
+        RecordTypeAndFlags token{
+                RecordType::ALLOCATION_RUN,
+                static_cast<unsigned char>(run.allocator)};
+        ret = writeSimpleType(token) && writeSimpleType(run.deallocator) && writeVarint(run.size)
+              && writeVarint(run.count)
+              && (!d_header.native_traces
+                  || writeIntegralDelta(&d_last.native_frame_id, run.native_frame_id));
+        for (auto it = d_pending_run_addresses.begin(); ret && it != d_pending_run_addresses.end();
+             ++it)
+        {
+            ret = writeIntegralDelta(&d_last.data_pointer, *it);
+        }
+    }
+
+    d_pending_run.count = 0;
+    d_pending_run_addresses.clear();
+    return ret;
+}
+
+bool
+StreamingRecordWriter::writeAllocationRecordUnsafe(const AllocationRecord& record)
+{
     RecordTypeAndFlags token{RecordType::ALLOCATION, static_cast<unsigned char>(record.allocator)};
     return writeSimpleType(token) && writeIntegralDelta(&d_last.data_pointer, record.address)
            && (hooks::allocatorKind(record.allocator) == hooks::AllocatorKind::SIMPLE_DEALLOCATOR
@@ -317,13 +993,8 @@ StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const Allocati
 }
 
 bool
-StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const NativeAllocationRecord& record)
+StreamingRecordWriter::writeNativeAllocationRecordUnsafe(const NativeAllocationRecord& record)
 {
-    if (!maybeWriteContextSwitchRecordUnsafe(tid)) {
-        return false;
-    }
-
-    d_stats.n_allocations += 1;
     RecordTypeAndFlags token{
             RecordType::ALLOCATION_WITH_NATIVE,
             static_cast<unsigned char>(record.allocator)};
@@ -335,7 +1006,7 @@ StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const NativeAl
 bool
 StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const ThreadRecord& record)
 {
-    if (!maybeWriteContextSwitchRecordUnsafe(tid)) {
+    if (!flushPendingAllocationsUnsafe() || !maybeWriteContextSwitchRecordUnsafe(tid)) {
         return false;
     }
 
@@ -346,6 +1017,10 @@ StreamingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const ThreadRe
 bool
 StreamingRecordWriter::writeHeader(bool seek_to_start)
 {
+    if (!flushPendingAllocationsUnsafe()) {
+        return false;
+    }
+
     if (seek_to_start) {
         // If we can't seek to the beginning to the stream (e.g. dealing with a socket), just give
         // up.
@@ -380,7 +1055,8 @@ StreamingRecordWriter::writeTrailer()
     // The FileSource will ignore trailing 0x00 bytes. This non-zero trailer
     // marks the boundary between bytes we wrote and padding bytes.
     RecordTypeAndFlags token{RecordType::OTHER, int(OtherRecordType::TRAILER)};
-    return writeSimpleType(token);
+    return flushPendingAllocationsUnsafe() && writeBackpressureSummariesUnsafe()
+           && writeSimpleType(token);
 }
 
 std::unique_ptr<RecordWriter>
@@ -397,6 +1073,106 @@ StreamingRecordWriter::cloneInChildProcess()
             d_header.trace_python_allocators);
 }
 
+bool
+LiveAggregatingRecordWriter::writeRecord(const MemoryRecord& record)
+{
+    return flushLocationDeltasUnsafe() && StreamingRecordWriter::writeRecord(record);
+}
+
+bool
+LiveAggregatingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const FramePop& record)
+{
+    auto& stack = d_stack_ids_by_thread[tid];
+    stack.resize(stack.size() - std::min<size_t>(record.count, stack.size()));
+    return true;
+}
+
+bool
+LiveAggregatingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const FramePush& record)
+{
+    auto& stack = d_stack_ids_by_thread[tid];
+    FrameTree::index_t parent = stack.empty() ? 0 : stack.back();
+    stack.push_back(d_stack_tree.getTraceIndex(parent, record.frame_id));
+    return true;
+}
+
+bool
+LiveAggregatingRecordWriter::writeThreadSpecificRecord(thread_id_t tid, const AllocationRecord& record)
+{
+    addAllocationUnsafe(tid, NativeAllocationRecord{record.address, record.size, record.allocator, 0});
+    return true;
+}
+
+bool
+LiveAggregatingRecordWriter::writeThreadSpecificRecord(
+        thread_id_t tid,
+        const NativeAllocationRecord& record)
+{
+    addAllocationUnsafe(tid, record);
+    return true;
+}
+
+void
+LiveAggregatingRecordWriter::addAllocationUnsafe(thread_id_t tid, const NativeAllocationRecord& record)
+{
+    d_stats.n_allocations += 1;
+
+    Allocation allocation;
+    allocation.tid = tid;
+    allocation.address = record.address;
+    allocation.size = record.size;
+    allocation.allocator = record.allocator;
+    allocation.native_frame_id = record.native_frame_id;
+    allocation.frame_index = 0;
+    if (!hooks::isDeallocator(record.allocator)) {
+        const auto& stack = d_stack_ids_by_thread[tid];
+        allocation.frame_index = stack.empty() ? 0 : stack.back();
+    }
+    allocation.native_segment_generation = 0;
+    allocation.n_allocations = 1;
+    d_aggregator.addAllocation(allocation);
+}
+
+bool
+LiveAggregatingRecordWriter::flushLocationDeltasUnsafe()
+{
+    // Only the per-thread totals are sent. Drain the merged view's changes
+    // too, so that they don't pile up.
+    auto changes = d_aggregator.takeChanges(false);
+    d_aggregator.takeChanges(true);
+
+    // Send the stack tree nodes created since the last flush first, so that
+    // the reader knows every node the deltas refer to.
+    for (; d_sent_stack_tree_nodes < d_stack_tree.maxIndex(); ++d_sent_stack_tree_nodes) {
+        auto [frame_id, parent_index] = d_stack_tree.nextNode(d_sent_stack_tree_nodes + 1);
+        if (!writeRecord(PythonTraceNode{frame_id, parent_index})) {
+            return false;
+        }
+    }
+
+    return writeLocationDeltas(*this, changes.updated, changes.removed, &d_sent_totals);
+}
+
+bool
+LiveAggregatingRecordWriter::writeTrailer()
+{
+    return flushLocationDeltasUnsafe() && StreamingRecordWriter::writeTrailer();
+}
+
+std::unique_ptr<RecordWriter>
+LiveAggregatingRecordWriter::cloneInChildProcess()
+{
+    std::unique_ptr<io::Sink> new_sink = d_sink->cloneInChildProcess();
+    if (!new_sink) {
+        return {};
+    }
+    return std::make_unique<LiveAggregatingRecordWriter>(
+            std::move(new_sink),
+            d_header.command_line,
+            d_header.native_traces,
+            d_header.trace_python_allocators);
+}
+
 AggregatingRecordWriter::AggregatingRecordWriter(
         std::unique_ptr<memray::io::Sink> sink,
         const std::string& command_line,
@@ -416,6 +1192,19 @@ AggregatingRecordWriter::AggregatingRecordWriter(
     d_stats.start_time = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
 }
 
+AggregatingRecordWriter::AggregatingRecordWriter(
+        std::unique_ptr<memray::io::Sink> sink,
+        const HeaderRecord& header,
+        const IndexedCapture& capture)
+: RecordWriter(std::move(sink))
+, d_header(header)
+, d_stats({header.stats.n_allocations, 0, header.stats.start_time, header.stats.end_time})
+, d_indexed_capture(capture)
+{
+    d_header.version = CURRENT_HEADER_VERSION;
+    d_header.file_format = FileFormat::AGGREGATED_ALLOCATIONS;
+}
+
 void
 AggregatingRecordWriter::setMainTidAndSkippedFrames(
         thread_id_t main_tid,
@@ -436,12 +1225,21 @@ AggregatingRecordWriter::writeHeader(bool seek_to_start)
 bool
 AggregatingRecordWriter::writeTrailer()
 {
-    d_stats.end_time = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    if (!d_indexed_capture) {
+        d_stats.end_time = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    }
     d_header.stats = d_stats;
     if (!writeHeaderCommon(d_header)) {
         return false;
     }
 
+    if (d_indexed_capture
+        && (!writeSimpleType(AggregatedRecordType::INDEXED_CAPTURE)
+            || !writeSimpleType(*d_indexed_capture)))
+    {
+        return false;
+    }
+
     for (const auto& memory_snapshot : d_memory_snapshots) {
         if (!writeSimpleType(AggregatedRecordType::MEMORY_SNAPSHOT) || !writeSimpleType(memory_snapshot))
         {
@@ -477,7 +1275,8 @@ AggregatingRecordWriter::writeTrailer()
 
     for (const auto& [frame_id, frame] : d_frames_by_id) {
         if (!writeSimpleType(AggregatedRecordType::PYTHON_FRAME_INDEX) || !writeSimpleType(frame_id)
-            || !writeString(frame.function_name.c_str()) || !writeString(frame.filename.c_str())
+            || !writeString(frame.function_name.get().c_str())
+            || !writeString(frame.filename.get().c_str())
             || !writeSimpleType(frame.lineno) || !writeSimpleType(frame.is_entry_frame))
         {
             return false;
@@ -506,6 +1305,14 @@ AggregatingRecordWriter::writeTrailer()
                && writeSimpleType(allocation);
     });
 
+    for (const auto& allocation : d_aggregated_allocations) {
+        if (!writeSimpleType(AggregatedRecordType::AGGREGATED_ALLOCATION)
+            || !writeSimpleType(allocation))
+        {
+            return false;
+        }
+    }
+
     // The FileSource will ignore trailing 0x00 bytes. This non-zero trailer
     // marks the boundary between bytes we wrote and padding bytes.
     if (!writeSimpleType(AggregatedRecordType::AGGREGATED_TRAILER)) {
@@ -547,7 +1354,11 @@ AggregatingRecordWriter::writeRecord(const pyrawframe_map_val_t& item)
     const auto& [frame_id, raw] = item;
     d_frames_by_id.emplace(
             frame_id,
-            Frame{raw.function_name, raw.filename, raw.lineno, raw.is_entry_frame});
+            Frame{
+                    d_string_table.intern(raw.function_name),
+                    d_string_table.intern(raw.filename),
+                    raw.lineno,
+                    raw.is_entry_frame});
     return true;
 }
 
@@ -558,6 +1369,34 @@ AggregatingRecordWriter::writeRecord(const UnresolvedNativeFrame& record)
     return true;
 }
 
+bool
+AggregatingRecordWriter::writeRecord(const PythonTraceNode& record)
+{
+    // Nodes are replayed in index order, so they get the same indexes here.
+    d_python_frame_tree.getTraceIndex(record.parent_index, record.frame_id);
+    return true;
+}
+
+bool
+AggregatingRecordWriter::writeRecord(const LocationDelta&)
+{
+    return false;
+}
+
+bool
+AggregatingRecordWriter::writeRecord(const MemorySnapshot& record)
+{
+    d_memory_snapshots.push_back(record);
+    return true;
+}
+
+bool
+AggregatingRecordWriter::writeRecord(const AggregatedAllocation& record)
+{
+    d_aggregated_allocations.push_back(record);
+    return true;
+}
+
 bool
 AggregatingRecordWriter::writeMappings(const std::vector<ImageSegments>& mappings)
 {
@@ -4,8 +4,10 @@
 #include <string>
 #include <type_traits>
 #include <unistd.h>
+#include <vector>
 
 #include "sink.h"
+#include "snapshot.h"
 
 namespace memray::tracking_api {
 
@@ -22,6 +24,12 @@ class RecordWriter
     virtual bool writeRecord(const MemoryRecord& record) = 0;
     virtual bool writeRecord(const pyrawframe_map_val_t& item) = 0;
     virtual bool writeRecord(const UnresolvedNativeFrame& record) = 0;
+    // Only live streams carry these. See LiveAggregatingRecordWriter.
+    virtual bool writeRecord(const PythonTraceNode& record) = 0;
+    virtual bool writeRecord(const LocationDelta& record) = 0;
+    // Only pre-aggregated indexes carry these. See createIndexRecordWriter.
+    virtual bool writeRecord(const MemorySnapshot& record) = 0;
+    virtual bool writeRecord(const AggregatedAllocation& record) = 0;
 
     virtual bool writeMappings(const std::vector<ImageSegments>& mappings) = 0;
 
@@ -65,6 +73,42 @@ createRecordWriter(
         FileFormat file_format,
         bool trace_python_allocators);
 
+// Creates a writer for live clients that sends per-location deltas instead
+// of individual allocations. See LiveAggregatingRecordWriter.
+std::unique_ptr<RecordWriter>
+createLiveAggregatingRecordWriter(
+        std::unique_ptr<memray::io::Sink> sink,
+        const std::string& command_line,
+        bool native_traces,
+        bool trace_python_allocators);
+
+// Creates a writer that streams records on behalf of the tracked process that
+// `header` describes, rather than the calling one. LiveBroker uses it to send
+// what it read from that process to each of its clients.
+std::unique_ptr<RecordWriter>
+createForwardingRecordWriter(std::unique_ptr<memray::io::Sink> sink, const HeaderRecord& header);
+
+// Creates a writer for a pre-aggregated index of the capture file that
+// `header` describes, to which the memory snapshots and the per-location
+// aggregates computed from that capture are written directly. Reading the
+// index gives the same results as reading the capture in far less time.
+std::unique_ptr<RecordWriter>
+createIndexRecordWriter(
+        std::unique_ptr<memray::io::Sink> sink,
+        const HeaderRecord& header,
+        const IndexedCapture& capture);
+
+// Writes a LocationDelta for each location in `removed` that was sent before
+// and for each location in `updated` whose totals differ from those sent, and
+// records the new totals in `sent`. Locations in `updated` that weren't sent
+// before are sent in full.
+bool
+writeLocationDeltas(
+        RecordWriter& writer,
+        const api::reduced_snapshot_map_t& updated,
+        const std::vector<api::LocationKey>& removed,
+        api::reduced_snapshot_map_t* sent);
+
 template<typename T>
 bool inline RecordWriter::writeSimpleType(const T& item)
 {
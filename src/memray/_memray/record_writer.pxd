@@ -15,3 +15,9 @@ cdef extern from "record_writer.h" namespace "memray::api":
         FileFormat file_format,
         bool trace_python_allocators,
     ) except+
+    cdef unique_ptr[RecordWriter] createLiveAggregatingRecordWriter(
+        unique_ptr[Sink],
+        string command_line,
+        bool native_trace,
+        bool trace_python_allocators,
+    ) except+
@@ -6,6 +6,45 @@
 
 namespace memray::tracking_api {
 
+static const std::string&
+emptyString()
+{
+    static const std::string empty;
+    return empty;
+}
+
+InternedString::InternedString()
+: d_ref(&emptyString())
+{
+}
+
+InternedString::InternedString(const std::string& storage)
+: d_ref(&storage)
+{
+}
+
+const std::string&
+InternedString::get() const
+{
+    return *d_ref;
+}
+
+InternedString::operator const std::string&() const
+{
+    return *d_ref;
+}
+
+InternedString
+StringTable::intern(const std::string& str)
+{
+    // The empty string is shared, so that it's equal to default constructed
+    // handles.
+    if (str.empty()) {
+        return InternedString();
+    }
+    return InternedString(*d_strings.insert(str).first);
+}
+
 const char MAGIC[7] = "memray";
 
 PyObject*
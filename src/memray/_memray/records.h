@@ -4,11 +4,13 @@
 #include <Python.h>
 
 #include <fstream>
+#include <functional>
 #include <mutex>
 #include <stddef.h>
 #include <string>
 #include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -18,7 +20,7 @@
 namespace memray::tracking_api {
 
 extern const char MAGIC[7];  // Value assigned in records.cpp
-const int CURRENT_HEADER_VERSION = 11;
+const int CURRENT_HEADER_VERSION = 13;
 
 using frame_id_t = size_t;
 using thread_id_t = unsigned long;
@@ -38,10 +40,16 @@ enum class RecordType : unsigned char {
     THREAD_RECORD = 10,
     MEMORY_RECORD = 11,
     CONTEXT_SWITCH = 12,
+    ALLOCATION_RUN = 13,
+    STRING_INDEX = 14,
 };
 
 enum class OtherRecordType : unsigned char {
     TRAILER = 1,
+    ALLOCATION_GAP = 2,
+    ALLOCATION_DELTA = 3,
+    PYTHON_TRACE_NODE = 4,
+    LOCATION_DELTA = 5,
 };
 
 // Enumerators that have the same name as in RecordType are encoded the same
@@ -57,6 +65,7 @@ enum class AggregatedRecordType : unsigned char {
     MEMORY_MAP_START = 6,
     SEGMENT_HEADER = 7,
     SEGMENT = 8,
+    INDEXED_CAPTURE = 9,
     THREAD_RECORD = 10,
     CONTEXT_SWITCH = 12,
 
@@ -134,6 +143,14 @@ struct MemorySnapshot
     size_t heap;
 };
 
+// The capture file that a pre-aggregated index was built from, as it was
+// when it was read, so that a stale index can be recognized.
+struct IndexedCapture
+{
+    size_t size;
+    long long mtime_ns;
+};
+
 struct AllocationRecord
 {
     uintptr_t address;
@@ -149,6 +166,58 @@ struct NativeAllocationRecord
     frame_id_t native_frame_id{0};
 };
 
+// A run of `count` allocation/deallocation pairs from the same thread and
+// stack, where each allocation is immediately followed by the deallocation of
+// the same address. Only the addresses may differ between pairs; `address`
+// holds the address of the most recently expanded pair.
+struct AllocationRun
+{
+    uintptr_t address;
+    size_t size;
+    hooks::Allocator allocator;
+    hooks::Allocator deallocator;
+    frame_id_t native_frame_id{0};
+    size_t count{0};
+};
+
+// The net effect of `count` allocations totalling `size` bytes that a thread
+// made from a single location while the sink was congested, and that were
+// summarized instead of being written one by one, less the ones among those
+// summarized before that were freed since. Both may therefore be negative.
+// Their addresses are not recorded, so readers report them with an address
+// of 0, which is never the address of a tracked allocation.
+struct AllocationDelta
+{
+    thread_id_t tid;
+    hooks::Allocator allocator;
+    frame_id_t native_frame_id{0};
+    ssize_t count{0};
+    ssize_t size{0};
+    std::vector<frame_id_t> python_stack{};  // Outermost frame first.
+};
+
+// A node of the writer's Python stack tree, sent by aggregated live streams
+// before the first location delta that refers to it. Nodes are numbered in
+// the order they are sent, starting from 1.
+struct PythonTraceNode
+{
+    frame_id_t frame_id;
+    size_t parent_index;
+};
+
+// The change since the previous delta in the memory that a thread has live
+// at one location, sent periodically by aggregated live streams in place of
+// individual allocations. Both changes may be negative.
+struct LocationDelta
+{
+    thread_id_t tid;
+    hooks::Allocator allocator;
+    frame_id_t native_frame_id{0};
+    size_t python_trace_index{0};
+    ssize_t count{0};
+    ssize_t size{0};
+};
+
 struct Allocation
 {
     thread_id_t tid;
@@ -238,10 +307,53 @@ struct RawFrame
     };
 };
 
+// A handle to a string owned by a StringTable. Strings interned by the same
+// table are equal if and only if they refer to the same storage, so they're
+// compared and hashed without looking at their contents. A handle must not
+// outlive the table that it came from.
+class InternedString
+{
+  public:
+    InternedString();
+    const std::string& get() const;
+    operator const std::string&() const;
+
+    auto operator==(const InternedString& other) const -> bool
+    {
+        return d_ref == other.d_ref;
+    }
+
+    struct Hash
+    {
+        auto operator()(const InternedString& str) const noexcept -> std::size_t
+        {
+            return std::hash<const std::string*>{}(&str.get());
+        }
+    };
+
+  private:
+    friend class StringTable;
+    explicit InternedString(const std::string& storage);
+
+    const std::string* d_ref;
+};
+
+// Owns one copy of each distinct string interned through it. Every reader
+// and writer has a table of its own, so the strings that it saw are freed
+// along with it. Only one thread may intern strings at a time.
+class StringTable
+{
+  public:
+    InternedString intern(const std::string& str);
+
+  private:
+    std::unordered_set<std::string> d_strings{};
+};
+
 struct Frame
 {
-    std::string function_name;
-    std::string filename;
+    InternedString function_name;
+    InternedString filename;
     int lineno{0};
     bool is_entry_frame{true};
 
@@ -257,17 +369,9 @@ struct Frame
     {
         auto operator()(memray::tracking_api::Frame const& frame) const noexcept -> std::size_t
         {
-            // Keep this hashing fast and simple as this has a non trivial
-            // performance impact on the tracing functionality. We don't hash
-            // the contents of the strings because the interpreter will give us
-            // the same char* for the same code object. Of course, we can have
-            // some scenarios where two functions with the same function name have
-            // two different char* but in that case we will end registering the
-            // name twice, which is a good compromise given the speed that we
-            // gain keeping this simple.
-
-            auto the_func = std::hash<std::string>{}(frame.function_name);
-            auto the_filename = std::hash<std::string>{}(frame.filename);
+            // The strings are interned, so there's no need to hash their contents.
+            auto the_func = InternedString::Hash{}(frame.function_name);
+            auto the_filename = InternedString::Hash{}(frame.filename);
             auto lineno = std::hash<int>{}(frame.lineno);
             return the_func ^ the_filename ^ lineno ^ frame.is_entry_frame;
         }
@@ -9,10 +9,7 @@ cdef extern from "records.h" namespace "memray::tracking_api":
    ctypedef unsigned long thread_id_t
    ctypedef size_t frame_id_t
 
-   struct Frame:
-       string function_name
-       string filename
-       int lineno
+   const char MAGIC[7]
 
    struct TrackerStats:
        size_t n_allocations
@@ -72,6 +69,10 @@ cdef extern from "records.h" namespace "memray::tracking_api":
        size_t rss
        size_t heap
 
+   struct IndexedCapture:
+       size_t size
+       long long mtime_ns
+
 
 cdef extern from "<optional>":
    # Cython doesn't have libcpp.optional yet, so just declare this opaquely.
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__linux__)
+#    define MEMRAY_HAS_SHARED_MEMORY_RING 1
+#    include <cerrno>
+#    include <csignal>
+#    include <ctime>
+#    include <linux/futex.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
+namespace memray::io {
+
+// Layout of the start of the shared memory region used to stream records
+// from a tracked process to a live reader running on the same host.
+//
+// The reader creates the region in a memfd and the tracked process maps it
+// through /proc/<reader pid>/fd/<fd>. The data area follows this header at
+// `data_offset`. As in SocketSink's ring, `head` and `tail` are free-running
+// byte counters: only the writer advances `head` and only the reader
+// advances `tail`.
+//
+// A side that finds nothing to do sets its `*_waiting` flag, re-checks the
+// counters, and sleeps on the other side's sequence word with a futex. The
+// other side bumps that word and wakes it when it sees the flag set.
+struct SharedRingHeader
+{
+    static constexpr uint64_t MAGIC{0x4d454d5241595247};  // "MEMRAYRG"
+    static constexpr uint32_t VERSION{1};
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reader_pid;
+    uint64_t capacity;  // Always a power of two.
+    uint64_t data_offset;
+
+    alignas(64) std::atomic<uint64_t> head;
+    std::atomic<uint32_t> head_seq;
+    std::atomic<uint32_t> reader_waiting;
+    std::atomic<uint32_t> writer_pid;  // 0 until a writer attaches.
+    std::atomic<uint32_t> writer_closed;
+
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> tail_seq;
+    std::atomic<uint32_t> writer_waiting;
+    std::atomic<uint32_t> reader_closed;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+
+#ifdef MEMRAY_HAS_SHARED_MEMORY_RING
+
+// The region is shared between processes, so these can't use the
+// FUTEX_PRIVATE_FLAG variants.
+inline void
+futexWait(std::atomic<uint32_t>* word, uint32_t expected, long timeout_ns)
+{
+    struct timespec timeout = {timeout_ns / 1000000000L, timeout_ns % 1000000000L};
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+inline void
+futexWakeAll(std::atomic<uint32_t>* word)
+{
+    word->fetch_add(1);
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+// Each side only needs this to notice that the other one went away without
+// closing the ring, so a pid that was recycled since is not a concern.
+inline bool
+processIsAlive(pid_t pid)
+{
+    return ::kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+#endif
+
+}  // namespace memray::io
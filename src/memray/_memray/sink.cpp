@@ -1,24 +1,42 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include <algorithm>
+#include <array>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
 
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <utility>
 
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#    define MEMRAY_HAS_IO_URING 1
+#    include <linux/io_uring.h>
+#    include <sys/syscall.h>
+#endif
+
 #include "exceptions.h"
-#include "lz4_stream.h"
+#include "logging.h"
 #include "sink.h"
+#include "tracking_api.h"
 
 namespace memray::io {
 
 using namespace memray::exception;
+using memray::tracking_api::RecursionGuard;
 
 namespace {  // unnamed
 
@@ -55,6 +73,57 @@ removeSuffix(const std::string& s, const std::string& suffix)
     return s.substr(0, s.size() - suffix.size());
 }
 
+void
+compressFileInPlace(const std::string& filename, const CompressionOptions& compression) noexcept
+{
+    std::ifstream in_file(filename, std::ios::binary);
+    std::string tmp_filename = filename + ".compressed.tmp";
+    std::ofstream out_file(tmp_filename, std::ios::binary);
+
+    bool success = compressStream(in_file, out_file, compression);
+    out_file.close();
+    if (!out_file) {
+        success = false;
+    }
+
+    if (!success) {
+        std::cerr << "Failed to compress input file" << std::endl;
+        ::unlink(tmp_filename.c_str());
+    } else if (0 != std::rename(tmp_filename.c_str(), filename.c_str())) {
+        std::perror("Error moving compressed file back to original name");
+        ::unlink(tmp_filename.c_str());
+    }
+}
+
+int
+openOutputFile(const std::string& file_name, bool overwrite)
+{
+    int flags = O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC;
+    if (!overwrite) {
+        flags |= O_EXCL;
+    }
+    int fd;
+    do {
+        fd = ::open(file_name.c_str(), flags, 0644);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        throw IoError{"Could not create output file " + file_name + ": " + std::string(strerror(errno))};
+    }
+    return fd;
+}
+
+void
+checkCompressionDictionary(const CompressionOptions& compression)
+{
+    if (!compression.dictionary_path.empty()
+        && 0 != ::access(compression.dictionary_path.c_str(), R_OK))
+    {
+        throw IoError{
+                "Could not read compression dictionary " + compression.dictionary_path + ": "
+                + std::string(strerror(errno))};
+    }
+}
+
 }  // unnamed namespace
 
 bool
@@ -87,21 +156,13 @@ FileSink::writeAll(const char* data, size_t length)
     return true;
 }
 
-FileSink::FileSink(const std::string& file_name, bool overwrite, bool compress)
+FileSink::FileSink(const std::string& file_name, bool overwrite, CompressionOptions compression)
 : d_filename(file_name)
 , d_fileNameStem(removeSuffix(file_name, "." + std::to_string(::getpid())))
-, d_compress(compress)
+, d_compression(std::move(compression))
 {
-    int flags = O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC;
-    if (!overwrite) {
-        flags |= O_EXCL;
-    }
-    do {
-        d_fd = ::open(file_name.c_str(), flags, 0644);
-    } while (d_fd < 0 && errno == EINTR);
-    if (d_fd < 0) {
-        throw IoError{"Could not create output file " + file_name + ": " + std::string(strerror(errno))};
-    }
+    checkCompressionDictionary(d_compression);
+    d_fd = openOutputFile(file_name, overwrite);
 }
 
 bool
@@ -185,42 +246,13 @@ std::unique_ptr<Sink>
 FileSink::cloneInChildProcess()
 {
     std::string file_name = d_fileNameStem + "." + std::to_string(::getpid());
-    return std::make_unique<FileSink>(file_name, true, d_compress);
+    return std::make_unique<FileSink>(file_name, true, d_compression);
 }
 
 void
 FileSink::compress() noexcept
 {
-    std::ifstream in_file(d_filename);
-    std::string tmp_filename = d_filename + ".lz4.tmp";
-    std::ofstream out_file(tmp_filename);
-    bool success = true;
-    constexpr size_t bufsize = 4 * 1024;
-
-    // lz4_stream is using exceptions rather than failbit/badbit
-    try {
-        lz4_stream::ostream lz4_stream(out_file);
-        std::vector<char> buf(bufsize);
-        while (in_file) {
-            in_file.read(&buf[0], buf.size());
-            lz4_stream.write(&buf[0], in_file.gcount());
-        }
-    } catch (...) {
-        success = false;
-    }
-
-    out_file.close();
-    if (!in_file.eof() || !out_file) {
-        success = false;
-    }
-
-    if (!success) {
-        std::cerr << "Failed to compress input file" << std::endl;
-        ::unlink(tmp_filename.c_str());
-    } else if (0 != std::rename(tmp_filename.c_str(), d_filename.c_str())) {
-        std::perror("Error moving compressed file back to original name");
-        ::unlink(tmp_filename.c_str());
-    }
+    compressFileInPlace(d_filename, d_compression);
 }
 
 FileSink::~FileSink()
@@ -235,71 +267,823 @@ FileSink::~FileSink()
         ::close(d_fd);
     }
 
-    if (d_compress) {
+    if (d_compression.codec != CompressionCodec::NONE) {
         compress();
     }
 }
 
-SocketSink::SocketSink(std::string host, uint16_t port)
-: d_host(std::move(host))
-, d_port(port)
-, d_buffer(new char[BUFFER_SIZE])
-, d_bufferNeedle(d_buffer.get())
+class AsyncWriter
 {
-    open();
+  public:
+    virtual ~AsyncWriter() = default;
+
+    // Start writing `length` bytes of `data` at `offset` in the file. The data
+    // must not be modified until `wait()` returns for the same `tag`.
+    virtual bool submit(const char* data, size_t length, off_t offset, unsigned int tag) = 0;
+
+    // Block until every write submitted with `tag` is complete. Returns false
+    // if any write submitted so far failed, since the file then has a hole.
+    virtual bool wait(unsigned int tag) = 0;
+};
+
+namespace {  // unnamed
+
+const unsigned int MAX_WRITES_IN_FLIGHT = 32;
+const unsigned int NUM_WRITE_TAGS = 2;
+
+bool
+pwriteAll(int fd, const char* data, size_t length, off_t offset)
+{
+    while (length) {
+        ssize_t ret = ::pwrite(fd, data, length, offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += ret;
+        offset += ret;
+        length -= ret;
+    }
+    return true;
 }
 
-size_t
-SocketSink::freeSpaceInBuffer()
+// Writes are performed by a dedicated thread, one after the other, so they
+// complete in the order they were submitted. The thread must not allocate
+// any memory: the tracker may be waiting for it while holding its lock, and
+// any allocation would need that lock to be tracked. That is why the queue of
+// pending writes has a fixed capacity.
+class ThreadedPwriteWriter : public AsyncWriter
+{
+  public:
+    explicit ThreadedPwriteWriter(int fd)
+    : d_fd(fd)
+    , d_thread(&ThreadedPwriteWriter::writerThread, this)
+    {
+    }
+
+    ~ThreadedPwriteWriter() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(d_mutex);
+            d_stop = true;
+        }
+        d_work_available.notify_one();
+        d_thread.join();
+    }
+
+    bool submit(const char* data, size_t length, off_t offset, unsigned int tag) override
+    {
+        std::unique_lock<std::mutex> lock(d_mutex);
+        d_work_done.wait(lock, [this] { return d_queue_size < d_queue.size(); });
+        d_queue[(d_queue_head + d_queue_size) % d_queue.size()] = Request{data, length, offset, tag};
+        ++d_queue_size;
+        ++d_pending[tag];
+        lock.unlock();
+        d_work_available.notify_one();
+        return true;
+    }
+
+    bool wait(unsigned int tag) override
+    {
+        std::unique_lock<std::mutex> lock(d_mutex);
+        d_work_done.wait(lock, [&] { return d_pending[tag] == 0; });
+        return !d_failed;
+    }
+
+  private:
+    struct Request
+    {
+        const char* data;
+        size_t length;
+        off_t offset;
+        unsigned int tag;
+    };
+
+    void writerThread()
+    {
+        // Anything this thread allocates anyway, like libc does internally,
+        // must not be tracked, or it would wait for the lock held by a thread
+        // waiting for us.
+        RecursionGuard::isActive = true;
+        std::unique_lock<std::mutex> lock(d_mutex);
+        while (true) {
+            d_work_available.wait(lock, [this] { return d_stop || d_queue_size > 0; });
+            if (d_queue_size == 0) {
+                return;
+            }
+            Request request = d_queue[d_queue_head];
+            d_queue_head = (d_queue_head + 1) % d_queue.size();
+            --d_queue_size;
+
+            lock.unlock();
+            bool success = pwriteAll(d_fd, request.data, request.length, request.offset);
+            lock.lock();
+
+            d_failed |= !success;
+            --d_pending[request.tag];
+            d_work_done.notify_all();
+        }
+    }
+
+    int d_fd;
+    std::mutex d_mutex;
+    std::condition_variable d_work_available;
+    std::condition_variable d_work_done;
+    std::array<Request, MAX_WRITES_IN_FLIGHT> d_queue{};
+    size_t d_queue_head{0};
+    size_t d_queue_size{0};
+    size_t d_pending[NUM_WRITE_TAGS]{};
+    bool d_failed{false};
+    bool d_stop{false};
+    std::thread d_thread;
+};
+
+#ifdef MEMRAY_HAS_IO_URING
+// Writes are performed through an io_uring instance, driven by raw system
+// calls to avoid a dependency on liburing. The rings are only ever touched by
+// a thread of our own: the kernel cancels the writes it queued on behalf of a
+// thread once that thread exits, and the thread calling submit() may be any
+// thread of the tracked process. Our thread only exits once every write it
+// submitted is complete. Like ThreadedPwriteWriter's, it must not allocate
+// any memory.
+class IoUringWriter : public AsyncWriter
+{
+  public:
+    static std::unique_ptr<IoUringWriter> create(int fd)
+    {
+        std::unique_ptr<IoUringWriter> writer(new IoUringWriter(fd));
+        if (!writer->setUpRings()) {
+            return {};
+        }
+        writer->d_thread = std::thread(&IoUringWriter::ringThread, writer.get());
+        return writer;
+    }
+
+    ~IoUringWriter() override
+    {
+        if (d_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(d_mutex);
+                d_stop = true;
+            }
+            d_work_available.notify_one();
+            d_thread.join();
+        }
+        if (d_sqes) {
+            ::munmap(d_sqes, d_sqes_size);
+        }
+        if (d_cq_ring && d_cq_ring != d_sq_ring) {
+            ::munmap(d_cq_ring, d_cq_ring_size);
+        }
+        if (d_sq_ring) {
+            ::munmap(d_sq_ring, d_sq_ring_size);
+        }
+        if (d_ring_fd != -1) {
+            ::close(d_ring_fd);
+        }
+    }
+
+    bool submit(const char* data, size_t length, off_t offset, unsigned int tag) override
+    {
+        std::unique_lock<std::mutex> lock(d_mutex);
+        d_work_done.wait(lock, [this] { return d_queue_size < d_queue.size(); });
+        struct iovec iov = {const_cast<char*>(data), length};
+        d_queue[(d_queue_head + d_queue_size) % d_queue.size()] = Request{iov, offset, tag, false};
+        ++d_queue_size;
+        ++d_pending[tag];
+        lock.unlock();
+        d_work_available.notify_one();
+        return true;
+    }
+
+    bool wait(unsigned int tag) override
+    {
+        std::unique_lock<std::mutex> lock(d_mutex);
+        d_work_done.wait(lock, [&] { return d_pending[tag] == 0; });
+        return !d_failed;
+    }
+
+  private:
+    struct Request
+    {
+        struct iovec iov;
+        off_t offset;
+        unsigned int tag;
+        bool in_use;
+    };
+
+    explicit IoUringWriter(int fd)
+    : d_fd(fd)
+    {
+    }
+
+    static int ioUringSetup(unsigned int entries, struct io_uring_params* params)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int ioUringEnter(unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+    {
+        int ret;
+        do {
+            ret = static_cast<int>(::syscall(
+                    __NR_io_uring_enter,
+                    d_ring_fd,
+                    to_submit,
+                    min_complete,
+                    flags,
+                    nullptr,
+                    0));
+        } while (ret < 0 && errno == EINTR);
+        return ret;
+    }
+
+    bool setUpRings()
+    {
+        struct io_uring_params params = {};
+        d_ring_fd = ioUringSetup(MAX_WRITES_IN_FLIGHT, &params);
+        if (d_ring_fd < 0) {
+            return false;
+        }
+
+        d_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        d_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            d_sq_ring_size = d_cq_ring_size = std::max(d_sq_ring_size, d_cq_ring_size);
+        }
+
+        d_sq_ring = mapRing(d_sq_ring_size, IORING_OFF_SQ_RING);
+        if (!d_sq_ring) {
+            return false;
+        }
+        d_cq_ring = single_mmap ? d_sq_ring : mapRing(d_cq_ring_size, IORING_OFF_CQ_RING);
+        if (!d_cq_ring) {
+            return false;
+        }
+        d_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        d_sqes = static_cast<struct io_uring_sqe*>(mapRing(d_sqes_size, IORING_OFF_SQES));
+        if (!d_sqes) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(d_sq_ring);
+        d_sq_head = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+        d_sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+        d_sq_mask = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+        d_sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(d_cq_ring);
+        d_cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+        d_cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+        d_cq_mask = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+        d_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void* mapRing(size_t size, off_t offset)
+    {
+        void* ring = ::mmap(
+                nullptr,
+                size,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,
+                d_ring_fd,
+                offset);
+        return ring == MAP_FAILED ? nullptr : ring;
+    }
+
+    void ringThread()
+    {
+        // As in ThreadedPwriteWriter::writerThread().
+        RecursionGuard::isActive = true;
+        std::unique_lock<std::mutex> lock(d_mutex);
+        while (true) {
+            auto has_work = [this] { return d_queue_size > 0 || numPrepared() > 0 || d_in_flight > 0; };
+            d_work_available.wait(lock, [&] { return d_stop || has_work(); });
+            if (!has_work()) {
+                return;
+            }
+
+            // Writes are submitted one at a time, so that they complete in
+            // the order they were queued, like ThreadedPwriteWriter's. If
+            // several were in flight, a later one could land first and leave
+            // a hole of zeros below it, which a FileFollower reading the file
+            // meanwhile would take for data.
+            if (d_queue_size > 0 && numPrepared() == 0 && d_in_flight == 0) {
+                size_t index = 0;
+                while (d_requests[index].in_use) {
+                    ++index;
+                }
+                d_requests[index] = d_queue[d_queue_head];
+                d_requests[index].in_use = true;
+                d_queue_head = (d_queue_head + 1) % d_queue.size();
+                --d_queue_size;
+                prepare(index);
+            }
+            lock.unlock();
+            d_work_done.notify_all();
+
+            bool submitted = submitPrepared();
+            if (submitted) {
+                reapCompletions();
+            }
+
+            lock.lock();
+            if (!submitted) {
+                failUnfinished();
+            }
+            for (; d_num_done > 0; --d_num_done) {
+                Request& request = d_requests[d_done[d_num_done - 1]];
+                request.in_use = false;
+                --d_pending[request.tag];
+            }
+            d_work_done.notify_all();
+        }
+    }
+
+    void prepare(size_t index)
+    {
+        // There are as many entries in the submission queue as there are
+        // requests, so it can never be full.
+        unsigned int tail = *d_sq_tail;
+        unsigned int slot = tail & *d_sq_mask;
+        const Request& request = d_requests[index];
+
+        struct io_uring_sqe* sqe = &d_sqes[slot];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = d_fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&request.iov);
+        sqe->len = 1;
+        sqe->off = request.offset;
+        sqe->user_data = index;
+        d_sq_array[slot] = slot;
+        __atomic_store_n(d_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    unsigned int numPrepared() const
+    {
+        return *d_sq_tail - __atomic_load_n(d_sq_head, __ATOMIC_ACQUIRE);
+    }
+
+    // Submits the prepared writes and waits for at least one write to
+    // complete. Returns false if the writes can't be submitted at all.
+    bool submitPrepared()
+    {
+        unsigned int prepared = numPrepared();
+        int ret = ioUringEnter(prepared, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && (errno == EAGAIN || errno == EBUSY) && d_in_flight > 0) {
+            // Out of resources: submit the rest once some writes complete.
+            ret = ioUringEnter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+        d_in_flight += prepared - numPrepared();
+        return ret >= 0;
+    }
+
+    // Called when io_uring_enter fails for a reason other than a temporary
+    // lack of resources, which means the ring can't be used anymore. Writes
+    // still in flight are given up on too: the capture is broken anyway, and
+    // waiting for them would never end.
+    void failUnfinished()
+    {
+        // The kernel only consumes submission queue entries inside
+        // io_uring_enter, so the ones it didn't consume can be taken back.
+        __atomic_store_n(d_sq_tail, __atomic_load_n(d_sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+        for (size_t index = 0; index < d_requests.size(); ++index) {
+            if (d_requests[index].in_use) {
+                d_done[d_num_done++] = index;
+            }
+        }
+        d_in_flight = 0;
+        d_failed = true;
+    }
+
+    void reapCompletions()
+    {
+        unsigned int head = *d_cq_head;
+        unsigned int tail = __atomic_load_n(d_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe& cqe = d_cqes[head & *d_cq_mask];
+            --d_in_flight;
+            completeRequest(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(d_cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    void completeRequest(size_t index, int result)
+    {
+        Request& request = d_requests[index];
+        if (result == -EINTR || result == -EAGAIN) {
+            prepare(index);
+            return;
+        }
+        if (result > 0 && static_cast<size_t>(result) < request.iov.iov_len) {
+            // Short write: submit the remainder.
+            request.iov.iov_base = static_cast<char*>(request.iov.iov_base) + result;
+            request.iov.iov_len -= result;
+            request.offset += result;
+            prepare(index);
+            return;
+        }
+        if (result < 0 || (result == 0 && request.iov.iov_len)) {
+            d_failed = true;
+        }
+        d_done[d_num_done++] = index;
+    }
+
+    int d_fd;
+    int d_ring_fd{-1};
+    void* d_sq_ring{nullptr};
+    size_t d_sq_ring_size{0};
+    void* d_cq_ring{nullptr};
+    size_t d_cq_ring_size{0};
+    struct io_uring_sqe* d_sqes{nullptr};
+    size_t d_sqes_size{0};
+    unsigned int* d_sq_head{nullptr};
+    unsigned int* d_sq_tail{nullptr};
+    unsigned int* d_sq_mask{nullptr};
+    unsigned int* d_sq_array{nullptr};
+    unsigned int* d_cq_head{nullptr};
+    unsigned int* d_cq_tail{nullptr};
+    unsigned int* d_cq_mask{nullptr};
+    struct io_uring_cqe* d_cqes{nullptr};
+
+    // Only used by the ring thread.
+    std::array<Request, MAX_WRITES_IN_FLIGHT> d_requests{};
+    size_t d_in_flight{0};
+    std::array<size_t, MAX_WRITES_IN_FLIGHT> d_done{};
+    size_t d_num_done{0};
+
+    std::mutex d_mutex;
+    std::condition_variable d_work_available;
+    std::condition_variable d_work_done;
+    std::array<Request, MAX_WRITES_IN_FLIGHT> d_queue{};
+    size_t d_queue_head{0};
+    size_t d_queue_size{0};
+    size_t d_pending[NUM_WRITE_TAGS]{};
+    std::atomic<bool> d_failed{false};
+    bool d_stop{false};
+    std::thread d_thread;
+};
+#endif
+
+}  // unnamed namespace
+
+AsyncFileSink::AsyncFileSink(
+        const std::string& file_name,
+        bool overwrite,
+        CompressionOptions compression,
+        Backend backend)
+: d_filename(file_name)
+, d_fileNameStem(removeSuffix(file_name, "." + std::to_string(::getpid())))
+, d_compression(std::move(compression))
 {
-    return BUFFER_SIZE - (d_bufferNeedle - d_buffer.get());
+    checkCompressionDictionary(d_compression);
+
+    for (auto& buffer : d_buffers) {
+        void* data =
+                ::mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            throw IoError{"Could not allocate output buffer: " + std::string(strerror(errno))};
+        }
+        buffer.data = static_cast<char*>(data);
+    }
+
+    d_fd = openOutputFile(file_name, overwrite);
+
+#ifdef MEMRAY_HAS_IO_URING
+    if (backend == Backend::IO_URING) {
+        d_writer = IoUringWriter::create(d_fd);
+    }
+#endif
+    if (!d_writer) {
+        // Either io_uring wasn't requested, or it is unavailable (because the
+        // kernel is too old, or a seccomp filter forbids it). Use a thread.
+        d_writer = std::make_unique<ThreadedPwriteWriter>(d_fd);
+    }
+}
+
+AsyncFileSink::~AsyncFileSink()
+{
+    if (d_writer && !(submitPending() && waitForAllWrites())) {
+        LOG(ERROR) << "Failed to write to output file: " << strerror(errno);
+    }
+    d_writer.reset();
+    for (auto& buffer : d_buffers) {
+        if (buffer.data) {
+            ::munmap(buffer.data, BUFFER_SIZE);
+        }
+    }
+    if (d_fd != -1) {
+        ::close(d_fd);
+    }
+
+    if (d_compression.codec != CompressionCodec::NONE) {
+        compressFileInPlace(d_filename, d_compression);
+    }
 }
 
 bool
-SocketSink::writeAll(const char* data, size_t length)
+AsyncFileSink::writeAll(const char* data, size_t length)
 {
-    while (freeSpaceInBuffer() < length) {
-        size_t toWrite = freeSpaceInBuffer();
-        memcpy(d_bufferNeedle, data, toWrite);
-        d_bufferNeedle += toWrite;
-        data += toWrite;
-        length -= toWrite;
-        if (!flush()) {
+    while (length) {
+        Buffer& buffer = d_buffers[d_active];
+        if (buffer.used == BUFFER_SIZE && !switchBuffers()) {
             return false;
         }
+        Buffer& active = d_buffers[d_active];
+        size_t toCopy = std::min(BUFFER_SIZE - active.used, length);
+        memcpy(active.data + active.used, data, toCopy);
+        active.used += toCopy;
+        data += toCopy;
+        length -= toCopy;
+        d_end_of_data = std::max(d_end_of_data, active.file_offset + static_cast<off_t>(active.used));
     }
+    return true;
+}
 
-    memcpy(d_bufferNeedle, data, length);
-    d_bufferNeedle += length;
+bool
+AsyncFileSink::submitPending()
+{
+    Buffer& buffer = d_buffers[d_active];
+    if (buffer.submitted == buffer.used) {
+        return true;
+    }
+    if (!d_writer->submit(
+                buffer.data + buffer.submitted,
+                buffer.used - buffer.submitted,
+                buffer.file_offset + buffer.submitted,
+                d_active))
+    {
+        return false;
+    }
+    buffer.submitted = buffer.used;
     return true;
 }
 
 bool
-SocketSink::flush()
+AsyncFileSink::switchBuffers()
 {
-    return _flush();
+    if (!submitPending()) {
+        return false;
+    }
+    const Buffer& previous = d_buffers[d_active];
+    unsigned int next_index = 1 - d_active;
+    // The next buffer may still be in use by writes submitted the last time it
+    // was active. Wait for them before reusing it.
+    if (!d_writer->wait(next_index)) {
+        return false;
+    }
+    Buffer& next = d_buffers[next_index];
+    next.file_offset = previous.file_offset + previous.used;
+    next.used = next.submitted = 0;
+    d_active = next_index;
+    return true;
+}
+
+bool
+AsyncFileSink::waitForAllWrites()
+{
+    bool success = true;
+    for (unsigned int i = 0; i < NUM_WRITE_TAGS; ++i) {
+        success &= d_writer->wait(i);
+    }
+    return success;
 }
 
 bool
-SocketSink::_flush()
+AsyncFileSink::flush()
+{
+    // Start writing whatever has been buffered so far, without waiting for
+    // it, so that a capture from a process that gets killed still contains
+    // most of the records written before its death.
+    return submitPending();
+}
+
+bool
+AsyncFileSink::seek(off_t offset, int whence)
+{
+    // As with FileSink, only absolute seeks are supported.
+    if (whence != SEEK_SET && whence != SEEK_END) {
+        errno = EINVAL;
+        return false;
+    }
+    if (!submitPending() || !waitForAllWrites()) {
+        return false;
+    }
+
+    if (whence == SEEK_END) {
+        offset += d_end_of_data;
+    }
+    if (offset < 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    for (auto& buffer : d_buffers) {
+        buffer.used = buffer.submitted = 0;
+    }
+    d_buffers[d_active].file_offset = offset;
+    return true;
+}
+
+std::unique_ptr<Sink>
+AsyncFileSink::cloneInChildProcess()
+{
+    // Forked children often exit through _exit() without destroying their
+    // tracker (multiprocessing workers do this, for instance), which would
+    // lose whatever is still sitting in our buffers. Records written through
+    // a shared memory mapping survive that, so children use a FileSink.
+    std::string file_name = d_fileNameStem + "." + std::to_string(::getpid());
+    return std::make_unique<FileSink>(file_name, true, d_compression);
+}
+
+namespace {  // unnamed
+
+size_t
+ringBufferSize(size_t requested)
 {
-    const char* data = d_buffer.get();
-    size_t length = d_bufferNeedle - data;
+    // Round up to a power of two, so positions in the ring can be masked.
+    size_t size = 64 * 1024;
+    while (size < requested) {
+        size *= 2;
+    }
+    return size;
+}
 
-    d_bufferNeedle = d_buffer.get();
+}  // unnamed namespace
+
+SocketSink::SocketSink(
+        std::string host,
+        uint16_t port,
+        BackpressurePolicy policy,
+        size_t buffer_size,
+        uint16_t children_port)
+: d_host(std::move(host))
+, d_port(port)
+, d_children_port(children_port)
+, d_policy(policy)
+, d_buffer_size(ringBufferSize(buffer_size))
+, d_buffer(new char[d_buffer_size])
+{
+    open();
+    startSenderThread();
+}
+
+SocketSink::SocketSink(
+        ConnectToReader,
+        std::string host,
+        uint16_t port,
+        BackpressurePolicy policy,
+        size_t buffer_size,
+        uint16_t children_port)
+: d_host(std::move(host))
+, d_port(port)
+, d_children_port(children_port)
+, d_policy(policy)
+, d_buffer_size(ringBufferSize(buffer_size))
+, d_buffer(new char[d_buffer_size])
+{
+    connect();
+    startSenderThread();
+}
+
+void
+SocketSink::startSenderThread()
+{
+    if (d_socket_open) {
+        d_sender = std::thread(&SocketSink::senderThread, this);
+    }
+}
+
+bool
+SocketSink::writeAll(const char* data, size_t length)
+{
+    if (!d_socket_open) {
+        return false;
+    }
 
     while (length) {
-        ssize_t ret = ::send(d_socket_fd, data, length, 0);
-        if (ret < 0 && errno != EINTR) {
+        if (d_failed.load(std::memory_order_relaxed)) {
             return false;
-        } else if (ret >= 0) {
-            data += ret;
-            length -= ret;
+        }
+
+        size_t head = d_head.load(std::memory_order_relaxed);
+        size_t used = head - d_tail.load(std::memory_order_acquire);
+        size_t free_space = d_buffer_size - used;
+        if (free_space == 0) {
+            if (!waitForSpace()) {
+                return false;
+            }
+            continue;
+        }
+
+        size_t offset = head & (d_buffer_size - 1);
+        size_t chunk = std::min({length, free_space, d_buffer_size - offset});
+        ::memcpy(d_buffer.get() + offset, data, chunk);
+        d_head.store(head + chunk, std::memory_order_release);
+        data += chunk;
+        length -= chunk;
+
+        // Don't wait for the next flush to start draining a filling ring.
+        if (used < d_buffer_size / 2 && used + chunk >= d_buffer_size / 2) {
+            d_data_available.notify_one();
         }
     }
     return true;
 }
 
+bool
+SocketSink::waitForSpace()
+{
+    // The sender thread never takes the tracker's lock, so it's safe for us
+    // to wait for it while holding it. The short timeout covers wakeups sent
+    // before we started waiting, since neither side notifies under the mutex.
+    d_data_available.notify_one();
+    auto has_space = [this] {
+        return d_failed.load() || d_head.load() - d_tail.load() < d_buffer_size;
+    };
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+    std::unique_lock<std::mutex> lock(d_mutex);
+    while (!has_space()) {
+        d_space_available.wait_for(lock, std::chrono::milliseconds(1));
+        if (d_policy != BackpressurePolicy::BLOCK && std::chrono::steady_clock::now() > deadline
+            && !has_space())
+        {
+            // Only a client that stopped reading altogether can fill even the
+            // reserved part of the ring. Cut it off rather than stall.
+            LOG(WARNING) << "Live tracking client stopped reading, disconnecting it";
+            d_failed = true;
+            ::shutdown(d_socket_fd, SHUT_RDWR);
+        }
+    }
+    return !d_failed.load();
+}
+
+void
+SocketSink::senderThread()
+{
+    // This thread must not allocate memory: if it did, the tracker would
+    // need its lock, which the tracked process may hold while waiting for us
+    // to free up space in the ring. Whatever it allocates anyway, like libc
+    // does internally, must not be tracked.
+    RecursionGuard::isActive = true;
+    while (true) {
+        size_t tail = d_tail.load(std::memory_order_relaxed);
+        size_t head = d_head.load(std::memory_order_acquire);
+        if (head == tail) {
+            if (d_stopping.load()) {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(d_mutex);
+            d_data_available.wait_for(lock, std::chrono::milliseconds(10), [this, tail] {
+                return d_stopping.load() || d_head.load() != tail;
+            });
+            continue;
+        }
+
+        size_t offset = tail & (d_buffer_size - 1);
+        size_t length = std::min(head - tail, d_buffer_size - offset);
+        ssize_t ret = ::send(d_socket_fd, d_buffer.get() + offset, length, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            d_failed = true;
+            d_space_available.notify_all();
+            return;
+        }
+        d_tail.store(tail + ret, std::memory_order_release);
+        d_space_available.notify_all();
+    }
+}
+
+bool
+SocketSink::flush()
+{
+    // Records are sent by the sender thread, so all we can do is wake it up.
+    d_data_available.notify_one();
+    return d_socket_open && !d_failed.load();
+}
+
+BackpressurePolicy
+SocketSink::backpressurePolicy() const
+{
+    return d_policy;
+}
+
+bool
+SocketSink::isCongested() const
+{
+    // Keep a quarter of the ring in reserve for the records that must be
+    // sent no matter what, like frame pushes and pops.
+    size_t used = d_head.load(std::memory_order_relaxed) - d_tail.load(std::memory_order_relaxed);
+    return d_buffer_size - used < d_buffer_size / 4;
+}
+
 bool
 SocketSink::seek(__attribute__((unused)) off_t offset, __attribute__((unused)) int whence)
 {
@@ -309,17 +1093,58 @@ SocketSink::seek(__attribute__((unused)) off_t offset, __attribute__((unused)) i
 std::unique_ptr<Sink>
 SocketSink::cloneInChildProcess()
 {
-    // We can't clone ourselves. We can't start a new TCP stream and block
-    // waiting for a client, and we can't create a new sink that shares the
-    // same socket because the client would see writes from all processes
-    // interleaved.
-    return {};
+    // We can't start a new TCP stream and block waiting for a client, and we
+    // can't create a new sink that shares the same socket because the client
+    // would see writes from all processes interleaved. We can only connect to
+    // a reader that's listening for the processes we fork.
+    if (!d_children_port) {
+        return {};
+    }
+
+    // Our connection belongs to the parent. Don't keep it open after the
+    // parent closes it, or the reader would never see it go away.
+    if (d_socket_open) {
+        ::close(d_socket_fd);
+        d_socket_open = false;
+    }
+
+    try {
+        return std::unique_ptr<Sink>(new SocketSink(
+                ConnectToReader{},
+                d_host,
+                d_children_port,
+                d_policy,
+                d_buffer_size,
+                d_children_port));
+    } catch (const IoError&) {
+        return {};
+    }
+}
+
+void
+SocketSink::stopSenderThread()
+{
+    d_stopping = true;
+    d_data_available.notify_one();
+
+    if (d_policy != BackpressurePolicy::BLOCK) {
+        // A client that stopped reading must not keep us from exiting. Give
+        // it a moment to catch up, then cut it off.
+        for (int i = 0; i < 100 && !d_failed.load() && d_head.load() != d_tail.load(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (d_head.load() != d_tail.load()) {
+            ::shutdown(d_socket_fd, SHUT_RDWR);
+        }
+    }
+
+    d_sender.join();
 }
 
 SocketSink::~SocketSink()
 {
     if (d_socket_open) {
-        _flush();
+        stopSenderThread();
         ::close(d_socket_fd);
         d_socket_open = false;
     }
@@ -383,6 +1208,228 @@ SocketSink::open()
     d_socket_open = true;
 }
 
+void
+SocketSink::connect()
+{
+    sockaddr_in si;
+    si.sin_family = AF_INET;
+    si.sin_addr.s_addr = ::inet_addr(d_host.c_str());
+    si.sin_port = htons(d_port);
+
+    d_socket_fd = ::socket(PF_INET, SOCK_STREAM, 0);
+    if (d_socket_fd == -1) {
+        LOG(ERROR) << "Encountered error in 'socket' call: " << strerror(errno);
+        throw IoError{"Failed to open socket"};
+    }
+
+    int ret;
+    do {
+        ret = ::connect(d_socket_fd, (sockaddr*)&si, sizeof si);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1) {
+        LOG(ERROR) << "Failed to connect to the live reader on port " << d_port << ": "
+                   << strerror(errno);
+        ::close(d_socket_fd);
+        throw IoError{"Failed to connect to the live reader"};
+    }
+
+    d_socket_open = true;
+}
+
+#ifdef MEMRAY_HAS_SHARED_MEMORY_RING
+
+SharedMemorySink::SharedMemorySink(const std::string& path, BackpressurePolicy policy)
+: d_policy(policy)
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        throw IoError{"Could not open shared memory ring " + path + ": " + ::strerror(errno)};
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SharedRingHeader)) {
+        ::close(fd);
+        throw IoError{"Invalid shared memory ring " + path};
+    }
+    d_mapping_size = info.st_size;
+    void* mapping = ::mmap(nullptr, d_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw IoError{"Could not map shared memory ring " + path + ": " + ::strerror(errno)};
+    }
+
+    d_ring = static_cast<SharedRingHeader*>(mapping);
+    d_capacity = d_ring->capacity;
+    if (d_ring->magic != SharedRingHeader::MAGIC || d_ring->version != SharedRingHeader::VERSION
+        || d_capacity == 0 || (d_capacity & (d_capacity - 1)) != 0
+        || d_ring->data_offset + d_capacity > d_mapping_size)
+    {
+        ::munmap(mapping, d_mapping_size);
+        throw IoError{"Invalid shared memory ring " + path};
+    }
+
+    uint32_t no_writer = 0;
+    if (!d_ring->writer_pid.compare_exchange_strong(no_writer, static_cast<uint32_t>(::getpid()))) {
+        ::munmap(mapping, d_mapping_size);
+        throw IoError{"The shared memory ring " + path + " is already in use"};
+    }
+    d_data = static_cast<char*>(mapping) + d_ring->data_offset;
+    wakeReader();
+}
+
+SharedMemorySink::~SharedMemorySink()
+{
+    if (!d_ring) {
+        return;
+    }
+    d_ring->writer_closed.store(1);
+    wakeReader();
+    ::munmap(d_ring, d_mapping_size);
+}
+
+bool
+SharedMemorySink::writeAll(const char* data, size_t length)
+{
+    while (length) {
+        if (d_failed) {
+            return false;
+        }
+
+        uint64_t head = d_ring->head.load(std::memory_order_relaxed);
+        size_t used = head - d_ring->tail.load(std::memory_order_acquire);
+        size_t free_space = d_capacity - used;
+        if (free_space == 0) {
+            if (!waitForSpace()) {
+                return false;
+            }
+            continue;
+        }
+
+        size_t offset = head & (d_capacity - 1);
+        size_t chunk = std::min({length, free_space, d_capacity - offset});
+        ::memcpy(d_data + offset, data, chunk);
+        d_ring->head.store(head + chunk, std::memory_order_release);
+        data += chunk;
+        length -= chunk;
+
+        if (used < d_capacity / 2 && used + chunk >= d_capacity / 2) {
+            wakeReader();
+        }
+    }
+    return true;
+}
+
+bool
+SharedMemorySink::waitForSpace()
+{
+    wakeReader();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (true) {
+        uint32_t seq = d_ring->tail_seq.load();
+        d_ring->writer_waiting.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (d_ring->head.load(std::memory_order_relaxed) - d_ring->tail.load() < d_capacity) {
+            break;
+        }
+        if (d_ring->reader_closed.load() || !processIsAlive(d_ring->reader_pid)) {
+            d_failed = true;
+            break;
+        }
+        if (d_policy != BackpressurePolicy::BLOCK && std::chrono::steady_clock::now() > deadline) {
+            LOG(WARNING) << "Live tracking client stopped reading, disconnecting it";
+            d_failed = true;
+            break;
+        }
+        futexWait(&d_ring->tail_seq, seq, 10 * 1000 * 1000);
+    }
+    d_ring->writer_waiting.store(0);
+
+    if (d_failed) {
+        d_ring->writer_closed.store(1);
+        wakeReader();
+    }
+    return !d_failed;
+}
+
+void
+SharedMemorySink::wakeReader()
+{
+    // Pairs with the fence the reader issues between announcing that it's
+    // going to sleep and checking the head one last time.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (d_ring->reader_waiting.load(std::memory_order_relaxed)) {
+        futexWakeAll(&d_ring->head_seq);
+    }
+}
+
+bool
+SharedMemorySink::flush()
+{
+    wakeReader();
+    return !d_failed;
+}
+
+bool
+SharedMemorySink::isCongested() const
+{
+    size_t used = d_ring->head.load(std::memory_order_relaxed)
+                  - d_ring->tail.load(std::memory_order_relaxed);
+    return d_capacity - used < d_capacity / 4;
+}
+
+#else
+
+SharedMemorySink::SharedMemorySink(const std::string&, BackpressurePolicy policy)
+: d_policy(policy)
+{
+    throw IoError{"Shared memory rings are only supported on Linux"};
+}
+
+SharedMemorySink::~SharedMemorySink()
+{
+}
+
+bool
+SharedMemorySink::writeAll(const char*, size_t)
+{
+    return false;
+}
+
+bool
+SharedMemorySink::flush()
+{
+    return false;
+}
+
+bool
+SharedMemorySink::isCongested() const
+{
+    return false;
+}
+
+#endif
+
+BackpressurePolicy
+SharedMemorySink::backpressurePolicy() const
+{
+    return d_policy;
+}
+
+bool
+SharedMemorySink::seek(__attribute__((unused)) off_t offset, __attribute__((unused)) int whence)
+{
+    return false;
+}
+
+std::unique_ptr<Sink>
+SharedMemorySink::cloneInChildProcess()
+{
+    // Like SocketSink, we can't share the ring with a child process without
+    // interleaving its records with ours, and there is no reader for a new one.
+    return {};
+}
+
 NullSink::~NullSink()
 {
 }
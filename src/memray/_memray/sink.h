@@ -1,14 +1,27 @@
 #pragma once
 
+#include <atomic>
 #include <cerrno>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unistd.h>
 
+#include "compression.h"
 #include "records.h"
+#include "shm_ring.h"
 
 namespace memray::io {
 
+// What to do with allocation records when a sink can't keep up with them.
+enum class BackpressurePolicy {
+    BLOCK,  // Wait for the sink to catch up.
+    DROP,  // Drop them, and tell the reader how many were dropped.
+    AGGREGATE,  // Summarize them into per-location deltas.
+};
+
 class Sink
 {
   public:
@@ -20,12 +33,22 @@ class Sink
     {
         return true;
     }
+    virtual BackpressurePolicy backpressurePolicy() const
+    {
+        return BackpressurePolicy::BLOCK;
+    }
+    // Returns true if the sink is falling behind, in which case writers
+    // should apply the sink's backpressure policy to allocation records.
+    virtual bool isCongested() const
+    {
+        return false;
+    }
 };
 
 class FileSink : public memray::io::Sink
 {
   public:
-    FileSink(const std::string& file_name, bool overwrite, bool compress);
+    FileSink(const std::string& file_name, bool overwrite, CompressionOptions compression);
     ~FileSink() override;
     FileSink(FileSink&) = delete;
     FileSink(FileSink&&) = delete;
@@ -44,7 +67,7 @@ class FileSink : public memray::io::Sink
 
     std::string d_filename;
     std::string d_fileNameStem;
-    bool d_compress{1};
+    CompressionOptions d_compression;
     int d_fd{-1};
     size_t d_fileSize{0};
     const size_t BUFFER_SIZE{16 * 1024 * 1024};  // 16 MiB
@@ -54,10 +77,78 @@ class FileSink : public memray::io::Sink
     char* d_bufferNeedle{nullptr};
 };
 
+class AsyncWriter;
+
+// A file sink that avoids mapping the output file into memory. Records are
+// copied into one of two anonymous buffers, and each buffer is written out
+// asynchronously, either through io_uring or by a writer thread calling
+// pwrite(), while the other one is being filled.
+class AsyncFileSink : public memray::io::Sink
+{
+  public:
+    enum class Backend {
+        IO_URING,
+        PWRITE,
+    };
+
+    AsyncFileSink(
+            const std::string& file_name,
+            bool overwrite,
+            CompressionOptions compression,
+            Backend backend);
+    ~AsyncFileSink() override;
+    AsyncFileSink(AsyncFileSink&) = delete;
+    AsyncFileSink(AsyncFileSink&&) = delete;
+    void operator=(const AsyncFileSink&) = delete;
+    void operator=(const AsyncFileSink&&) = delete;
+
+    bool writeAll(const char* data, size_t length) override;
+    bool seek(off_t offset, int whence) override;
+    std::unique_ptr<Sink> cloneInChildProcess() override;
+    bool flush() override;
+
+  private:
+    struct Buffer
+    {
+        char* data{nullptr};
+        size_t used{0};
+        size_t submitted{0};
+        off_t file_offset{0};
+    };
+
+    bool submitPending();
+    bool switchBuffers();
+    bool waitForAllWrites();
+
+    std::string d_filename;
+    std::string d_fileNameStem;
+    CompressionOptions d_compression;
+    int d_fd{-1};
+    std::unique_ptr<AsyncWriter> d_writer;
+    const size_t BUFFER_SIZE{4 * 1024 * 1024};  // 4 MiB
+    Buffer d_buffers[2];
+    unsigned int d_active{0};
+    off_t d_end_of_data{0};
+};
+
+// A sink that serves records to a single client over a TCP connection.
+// Records are copied into a ring buffer that is drained by a background
+// thread, so a slow client only slows down the tracked process once the ring
+// fills up, and then only for records that the writer can't drop or
+// summarize according to the backpressure policy.
 class SocketSink : public Sink
 {
   public:
-    explicit SocketSink(std::string host, uint16_t port);
+    static constexpr size_t DEFAULT_BUFFER_SIZE{16 * 1024 * 1024};  // 16 MiB
+
+    // If `children_port` is not 0, processes forked while tracking connect
+    // to a live reader listening on it, each with a sink of its own.
+    explicit SocketSink(
+            std::string host,
+            uint16_t port,
+            BackpressurePolicy policy = BackpressurePolicy::BLOCK,
+            size_t buffer_size = DEFAULT_BUFFER_SIZE,
+            uint16_t children_port = 0);
     ~SocketSink() override;
 
     SocketSink(SocketSink&) = delete;
@@ -69,20 +160,85 @@ class SocketSink : public Sink
     bool seek(off_t offset, int whence) override;
     std::unique_ptr<Sink> cloneInChildProcess() override;
     bool flush() override;
+    BackpressurePolicy backpressurePolicy() const override;
+    bool isCongested() const override;
 
   private:
-    size_t freeSpaceInBuffer();
+    struct ConnectToReader
+    {
+    };
+    SocketSink(
+            ConnectToReader,
+            std::string host,
+            uint16_t port,
+            BackpressurePolicy policy,
+            size_t buffer_size,
+            uint16_t children_port);
+
     void open();
-    bool _flush();
+    void connect();
+    void startSenderThread();
+    bool waitForSpace();
+    void senderThread();
+    void stopSenderThread();
 
     const std::string d_host;
     uint16_t d_port;
+    const uint16_t d_children_port;
     int d_socket_fd{-1};
     bool d_socket_open{false};
+    const BackpressurePolicy d_policy;
 
-    const size_t BUFFER_SIZE{PIPE_BUF};
+    // The ring buffer. Its size is a power of two, and the head and tail are
+    // free-running byte counters: the tracked process (serialized by the
+    // tracker's lock) only advances the head, and the sender thread only
+    // advances the tail.
+    const size_t d_buffer_size;
     std::unique_ptr<char[]> d_buffer{nullptr};
-    char* d_bufferNeedle{nullptr};
+    std::atomic<size_t> d_head{0};
+    std::atomic<size_t> d_tail{0};
+    std::atomic<bool> d_failed{false};
+    std::atomic<bool> d_stopping{false};
+
+    std::mutex d_mutex;
+    std::condition_variable d_data_available;
+    std::condition_variable d_space_available;
+    std::thread d_sender;
+};
+
+// Writes records into a shared memory ring created by a live reader running
+// on the same host (see SharedMemorySource), so they never go through the
+// kernel's socket stack.
+class SharedMemorySink : public Sink
+{
+  public:
+    explicit SharedMemorySink(
+            const std::string& path,
+            BackpressurePolicy policy = BackpressurePolicy::BLOCK);
+    ~SharedMemorySink() override;
+
+    SharedMemorySink(SharedMemorySink&) = delete;
+    SharedMemorySink(SharedMemorySink&&) = delete;
+    void operator=(const SharedMemorySink&) = delete;
+    void operator=(const SharedMemorySink&&) = delete;
+
+    bool writeAll(const char* data, size_t length) override;
+    bool seek(off_t offset, int whence) override;
+    std::unique_ptr<Sink> cloneInChildProcess() override;
+    bool flush() override;
+    BackpressurePolicy backpressurePolicy() const override;
+    bool isCongested() const override;
+
+  private:
+    bool waitForSpace();
+    void wakeReader();
+
+    const BackpressurePolicy d_policy;
+    SharedRingHeader* d_ring{nullptr};
+    char* d_data{nullptr};
+    size_t d_mapping_size{0};
+    size_t d_capacity{0};
+    bool d_failed{false};
 };
 
 class NullSink : public Sink
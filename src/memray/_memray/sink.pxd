@@ -3,15 +3,53 @@ from libcpp cimport bool
 from libcpp.string cimport string
 
 
+cdef extern from "compression.h" namespace "memray::io":
+    cdef enum class CompressionCodec:
+        NONE
+        LZ4
+        ZSTD
+
+    struct CompressionOptions:
+        CompressionCodec codec
+        int level
+        string dictionary_path
+
+
 cdef extern from "sink.h" namespace "memray::io":
     cdef cppclass Sink:
         pass
 
     cdef cppclass FileSink(Sink):
-        FileSink(const string& file_name, bool overwrite, bool compress) except +IOError
+        FileSink(const string& file_name, bool overwrite, CompressionOptions compression) except +IOError
+
+    cdef enum class AsyncFileSinkBackend "memray::io::AsyncFileSink::Backend":
+        IO_URING
+        PWRITE
+
+    cdef cppclass AsyncFileSink(Sink):
+        AsyncFileSink(
+            const string& file_name,
+            bool overwrite,
+            CompressionOptions compression,
+            AsyncFileSinkBackend backend,
+        ) except +IOError
+
+    cdef enum class BackpressurePolicy:
+        BLOCK
+        DROP
+        AGGREGATE
 
     cdef cppclass SocketSink(Sink):
-        SocketSink(string host, unsigned int port) except +IOError
+        SocketSink(
+            string host,
+            unsigned int port,
+            BackpressurePolicy policy,
+            size_t buffer_size,
+            unsigned int children_port,
+        ) except +IOError
+
+    cdef cppclass SharedMemorySink(Sink):
+        SharedMemorySink(const string& path, BackpressurePolicy policy) except +IOError
 
     cdef cppclass NullSink(Sink):
         NullSink() except +IOError
@@ -113,6 +113,23 @@ SnapshotAllocationAggregator::addAllocation(const Allocation& allocation)
 {
     switch (hooks::allocatorKind(allocation.allocator)) {
         case hooks::AllocatorKind::SIMPLE_ALLOCATOR: {
+            if (allocation.address == 0) {
+                // Allocations summarized by the writer are freed by negative
+                // deltas, which unsigned wraparound takes care of.
+                auto loc_key = LocationKey{
+                        allocation.frame_index,
+                        allocation.native_frame_id,
+                        allocation.tid};
+                auto [it, inserted] = d_summarized_allocations.emplace(loc_key, allocation);
+                if (!inserted) {
+                    it->second.size += allocation.size;
+                    it->second.n_allocations += allocation.n_allocations;
+                }
+                if (it->second.n_allocations == 0) {
+                    d_summarized_allocations.erase(it);
+                }
+                break;
+            }
             d_ptr_to_allocation[allocation.address] = allocation;
             break;
         }
@@ -140,8 +157,7 @@ SnapshotAllocationAggregator::getSnapshotAllocations(bool merge_threads)
 {
     reduced_snapshot_map_t stack_to_allocation{};
 
-    for (const auto& it : d_ptr_to_allocation) {
-        const Allocation& record = it.second;
+    auto add_simple_allocation = [&](const Allocation& record) {
         const thread_id_t thread_id = merge_threads ? NO_THREAD_INFO : record.tid;
         auto loc_key = LocationKey{record.frame_index, record.native_frame_id, thread_id};
         auto alloc_it = stack_to_allocation.find(loc_key);
@@ -149,8 +165,14 @@ SnapshotAllocationAggregator::getSnapshotAllocations(bool merge_threads)
             stack_to_allocation.insert(alloc_it, std::pair(loc_key, record));
         } else {
             alloc_it->second.size += record.size;
-            alloc_it->second.n_allocations += 1;
+            alloc_it->second.n_allocations += record.n_allocations;
         }
+    };
+    for (const auto& it : d_ptr_to_allocation) {
+        add_simple_allocation(it.second);
+    }
+    for (const auto& it : d_summarized_allocations) {
+        add_simple_allocation(it.second);
     }
 
     // Process ranged allocations. As there can be partial deallocations in mmap'd regions,
@@ -173,6 +195,110 @@ SnapshotAllocationAggregator::getSnapshotAllocations(bool merge_threads)
     return stack_to_allocation;
 }
 
+void
+IncrementalSnapshotAggregator::updateTotals(
+        const Allocation& allocation,
+        size_t size_delta,
+        size_t count_delta)
+{
+    // The deltas may be negative, which unsigned wraparound takes care of.
+    for (bool merge_threads : {false, true}) {
+        View& view = d_views[merge_threads];
+        const thread_id_t thread_id = merge_threads ? NO_THREAD_INFO : allocation.tid;
+        auto loc_key = LocationKey{allocation.frame_index, allocation.native_frame_id, thread_id};
+
+        auto [it, inserted] = view.totals.try_emplace(loc_key, allocation);
+        if (inserted) {
+            it->second.size = 0;
+            it->second.n_allocations = 0;
+        }
+        it->second.size += size_delta;
+        it->second.n_allocations += count_delta;
+        if (it->second.n_allocations == 0) {
+            view.totals.erase(it);
+        }
+        view.changed.insert(loc_key);
+    }
+}
+
+void
+IncrementalSnapshotAggregator::addAllocation(const Allocation& allocation)
+{
+    switch (hooks::allocatorKind(allocation.allocator)) {
+        case hooks::AllocatorKind::SIMPLE_ALLOCATOR: {
+            if (allocation.address == 0) {
+                // Allocations summarized by the writer are freed by negative
+                // deltas, which updateTotals() subtracts.
+                updateTotals(allocation, allocation.size, allocation.n_allocations);
+                break;
+            }
+            auto [it, inserted] = d_ptr_to_allocation.try_emplace(allocation.address, allocation);
+            if (!inserted) {
+                // We missed the deallocation of the previous allocation here.
+                updateTotals(it->second, -it->second.size, -it->second.n_allocations);
+                it->second = allocation;
+            }
+            updateTotals(allocation, allocation.size, allocation.n_allocations);
+            break;
+        }
+        case hooks::AllocatorKind::SIMPLE_DEALLOCATOR: {
+            auto it = d_ptr_to_allocation.find(allocation.address);
+            if (it != d_ptr_to_allocation.end()) {
+                updateTotals(it->second, -it->second.size, -it->second.n_allocations);
+                d_ptr_to_allocation.erase(it);
+            }
+            break;
+        }
+        case hooks::AllocatorKind::RANGED_ALLOCATOR: {
+            if (allocation.size == 0) {
+                break;
+            }
+            d_interval_tree.addInterval(allocation.address, allocation.size, allocation);
+            updateTotals(allocation, allocation.size, 1);
+            break;
+        }
+        case hooks::AllocatorKind::RANGED_DEALLOCATOR: {
+            // Each remaining interval counts as one allocation, so a split
+            // allocation counts twice, like in SnapshotAllocationAggregator.
+            auto stats = d_interval_tree.removeInterval(allocation.address, allocation.size);
+            for (const auto& [interval, freed] : stats.freed_allocations) {
+                updateTotals(freed, -interval.size(), -1);
+            }
+            for (const auto& [interval, shrunk] : stats.shrunk_allocations) {
+                updateTotals(shrunk, -interval.size(), 0);
+            }
+            for (const auto& [interval, split] : stats.split_allocations) {
+                updateTotals(split, -interval.size(), 1);
+            }
+            break;
+        }
+    }
+}
+
+reduced_snapshot_map_t
+IncrementalSnapshotAggregator::getSnapshotAllocations(bool merge_threads)
+{
+    return d_views[merge_threads].totals;
+}
+
+IncrementalSnapshotAggregator::Changes
+IncrementalSnapshotAggregator::takeChanges(bool merge_threads)
+{
+    View& view = d_views[merge_threads];
+    Changes changes;
+    changes.updated.reserve(view.changed.size());
+    for (const auto& loc_key : view.changed) {
+        auto it = view.totals.find(loc_key);
+        if (it != view.totals.end()) {
+            changes.updated.emplace(loc_key, it->second);
+        } else {
+            changes.removed.push_back(loc_key);
+        }
+    }
+    view.changed.clear();
+    return changes;
+}
+
 TemporaryAllocationsAggregator::TemporaryAllocationsAggregator(size_t max_items)
 : d_max_items(max_items)
 {
@@ -181,21 +307,18 @@ TemporaryAllocationsAggregator::TemporaryAllocationsAggregator(size_t max_items)
 void
 TemporaryAllocationsAggregator::addAllocation(const Allocation& allocation)
 {
+    if (d_max_items == 0) {
+        return;
+    }
     hooks::AllocatorKind kind = hooks::allocatorKind(allocation.allocator);
     auto it = d_current_allocations.find(allocation.tid);
     switch (kind) {
         case hooks::AllocatorKind::SIMPLE_ALLOCATOR:
         case hooks::AllocatorKind::RANGED_ALLOCATOR: {
             if (it == d_current_allocations.end()) {
-                it = d_current_allocations.insert(
-                        it,
-                        std::pair(allocation.tid, std::deque<Allocation>()));
-            }
-
-            it->second.emplace_front(allocation);
-            if (it->second.size() > d_max_items) {
-                it->second.pop_back();
+                it = d_current_allocations.emplace(allocation.tid, RecentAllocations{}).first;
             }
+            addRecentAllocation(it->second, allocation);
             break;
         }
         case hooks::AllocatorKind::SIMPLE_DEALLOCATOR:
@@ -203,24 +326,62 @@ TemporaryAllocationsAggregator::addAllocation(const Allocation& allocation)
             if (it == d_current_allocations.end()) {
                 break;
             }
-
-            auto alloc_it =
-                    std::find_if(it->second.begin(), it->second.end(), [&](auto& current_allocation) {
-                        bool match = (current_allocation.address == allocation.address);
-                        if (kind == hooks::AllocatorKind::RANGED_DEALLOCATOR) {
-                            match = match && (current_allocation.size == allocation.size);
-                        }
-                        return match;
-                    });
-
-            if (alloc_it != it->second.end()) {
-                d_temporary_allocations.push_back(*alloc_it);
+            const bool match_size = kind == hooks::AllocatorKind::RANGED_DEALLOCATOR;
+            const Allocation* match = findRecentAllocation(it->second, allocation, match_size);
+            if (match) {
+                d_temporary_allocations.push_back(*match);
             }
             break;
         }
     }
 }
 
+void
+TemporaryAllocationsAggregator::addRecentAllocation(RecentAllocations& recent, const Allocation& allocation)
+{
+    const uint64_t sequence_number = recent.next_sequence_number++;
+    const size_t slot = sequence_number % d_max_items;
+    if (slot == recent.allocations.size()) {
+        recent.allocations.push_back(allocation);
+        recent.previous_with_same_address.push_back(RecentAllocations::NONE);
+    } else {
+        // Forget the oldest allocation, unless a newer one has its address.
+        auto evicted = recent.latest_by_address.find(recent.allocations[slot].address);
+        if (evicted != recent.latest_by_address.end() && evicted->second == sequence_number - d_max_items) {
+            recent.latest_by_address.erase(evicted);
+        }
+        recent.allocations[slot] = allocation;
+    }
+
+    auto [latest, inserted] = recent.latest_by_address.try_emplace(allocation.address, sequence_number);
+    recent.previous_with_same_address[slot] = inserted ? RecentAllocations::NONE : latest->second;
+    latest->second = sequence_number;
+}
+
+const Allocation*
+TemporaryAllocationsAggregator::findRecentAllocation(
+        const RecentAllocations& recent,
+        const Allocation& deallocation,
+        bool match_size) const
+{
+    auto latest = recent.latest_by_address.find(deallocation.address);
+    if (latest == recent.latest_by_address.end()) {
+        return nullptr;
+    }
+    // Older allocations with the same address may have left the ring.
+    for (uint64_t sequence_number = latest->second;
+         sequence_number != RecentAllocations::NONE
+         && recent.next_sequence_number - sequence_number <= d_max_items;
+         sequence_number = recent.previous_with_same_address[sequence_number % d_max_items])
+    {
+        const Allocation& allocation = recent.allocations[sequence_number % d_max_items];
+        if (!match_size || allocation.size == deallocation.size) {
+            return &allocation;
+        }
+    }
+    return nullptr;
+}
+
 reduced_snapshot_map_t
 TemporaryAllocationsAggregator::getSnapshotAllocations(bool merge_threads)
 {
@@ -267,7 +428,7 @@ AggregatedCaptureReaggregator::getSnapshotAllocations(bool merge_threads)
             stack_to_allocation.insert(alloc_it, std::pair(loc_key, record));
         } else {
             alloc_it->second.size += record.size;
-            alloc_it->second.n_allocations += 1;
+            alloc_it->second.n_allocations += record.n_allocations;
         }
     }
 
@@ -286,8 +447,8 @@ operator!=(const Contribution& lhs, const Contribution& rhs)
     return !(lhs == rhs);
 }
 
-UsageHistory&
-HighWaterMarkAggregator::getUsageHistory(const Allocation& allocation)
+HighWaterMarkAggregator::location_id_t
+HighWaterMarkAggregator::getLocationId(const Allocation& allocation)
 {
     HighWaterMarkLocationKey loc_key{
             allocation.tid,
@@ -296,10 +457,11 @@ HighWaterMarkAggregator::getUsageHistory(const Allocation& allocation)
             allocation.native_segment_generation,
             allocation.allocator};
 
-    auto it = d_usage_history_by_location.find(loc_key);
-    if (it == d_usage_history_by_location.end()) {
+    auto [it, inserted] = d_location_ids.try_emplace(loc_key, d_locations.size());
+    if (inserted) {
         assert(!hooks::isDeallocator(allocation.allocator));
-        it = d_usage_history_by_location.emplace(loc_key, UsageHistory{}).first;
+        d_locations.push_back(loc_key);
+        d_usage_history_by_location.emplace_back();
     }
     return it->second;
 }
@@ -473,10 +635,7 @@ UsageHistory::contributionsBySnapshot(
 }
 
 void
-HighWaterMarkAggregator::recordUsageDelta(
-        const Allocation& allocation,
-        size_t count_delta,
-        size_t bytes_delta)
+HighWaterMarkAggregator::recordUsageDelta(location_id_t location, size_t count_delta, size_t bytes_delta)
 {
     size_t new_heap_size = d_current_heap_size + bytes_delta;
     if (d_current_heap_size >= d_heap_size_at_last_peak && new_heap_size < d_current_heap_size) {
@@ -486,7 +645,7 @@ HighWaterMarkAggregator::recordUsageDelta(
     }
     d_current_heap_size = new_heap_size;
 
-    auto& history = getUsageHistory(allocation);
+    auto& history = d_usage_history_by_location[location];
     history.recordUsageDelta(
             d_high_water_mark_index_by_snapshot,
             d_peak_count,
@@ -503,38 +662,40 @@ HighWaterMarkAggregator::addAllocation(const Allocation& allocation_or_deallocat
     switch (hooks::allocatorKind(allocation_or_deallocation.allocator)) {
         case hooks::AllocatorKind::SIMPLE_ALLOCATOR: {
             const Allocation& allocation = allocation_or_deallocation;
-            recordUsageDelta(allocation, 1, allocation.size);
-            d_ptr_to_allocation[allocation.address] = allocation;
+            location_id_t location = getLocationId(allocation);
+            recordUsageDelta(location, 1, allocation.size);
+            d_ptr_to_allocation[allocation.address] = LiveAllocation{allocation.size, location};
             break;
         }
         case hooks::AllocatorKind::SIMPLE_DEALLOCATOR: {
             const Allocation& deallocation = allocation_or_deallocation;
             auto it = d_ptr_to_allocation.find(deallocation.address);
             if (it != d_ptr_to_allocation.end()) {
-                const Allocation& allocation = it->second;
-                recordUsageDelta(allocation, -1, -allocation.size);
+                const LiveAllocation& allocation = it->second;
+                recordUsageDelta(allocation.location, -1, -allocation.size);
                 d_ptr_to_allocation.erase(it);
             }
             break;
         }
         case hooks::AllocatorKind::RANGED_ALLOCATOR: {
             const Allocation& allocation = allocation_or_deallocation;
-            recordUsageDelta(allocation, 1, allocation.size);
-            d_mmap_intervals.addInterval(allocation.address, allocation.size, allocation);
+            location_id_t location = getLocationId(allocation);
+            recordUsageDelta(location, 1, allocation.size);
+            d_mmap_intervals.addInterval(allocation.address, allocation.size, location);
             break;
         }
         case hooks::AllocatorKind::RANGED_DEALLOCATOR: {
             const Allocation& deallocation = allocation_or_deallocation;
             auto removal_stats =
                     d_mmap_intervals.removeInterval(deallocation.address, deallocation.size);
-            for (const auto& [interval, allocation] : removal_stats.freed_allocations) {
-                recordUsageDelta(allocation, -1, -interval.size());
+            for (const auto& [interval, location] : removal_stats.freed_allocations) {
+                recordUsageDelta(location, -1, -interval.size());
             }
-            for (const auto& [interval, allocation] : removal_stats.shrunk_allocations) {
-                recordUsageDelta(allocation, 0, -interval.size());
+            for (const auto& [interval, location] : removal_stats.shrunk_allocations) {
+                recordUsageDelta(location, 0, -interval.size());
             }
-            for (const auto& [interval, allocation] : removal_stats.split_allocations) {
-                recordUsageDelta(allocation, 1, -interval.size());
+            for (const auto& [interval, location] : removal_stats.split_allocations) {
+                recordUsageDelta(location, 1, -interval.size());
             }
             break;
         }
@@ -565,6 +726,16 @@ HighWaterMarkAggregator::getCurrentHeapSize() const noexcept
     return d_current_heap_size;
 }
 
+size_t
+HighWaterMarkAggregator::getPeakHeapSize() const noexcept
+{
+    size_t peak = std::max(d_heap_size_at_last_peak, d_current_heap_size);
+    for (size_t snapshot_peak : d_high_water_mark_bytes_by_snapshot) {
+        peak = std::max(peak, snapshot_peak);
+    }
+    return peak;
+}
+
 std::vector<size_t>
 HighWaterMarkAggregator::highWaterMarkBytesBySnapshot() const
 {
@@ -584,9 +755,11 @@ HighWaterMarkAggregator::generateIndex() const
         final_peak_count++;
     }
 
-    for (const auto& [location, history] : d_usage_history_by_location) {
-        auto contribs =
-                history.contributionsBySnapshot(d_high_water_mark_index_by_snapshot, final_peak_count);
+    for (location_id_t location_id = 0; location_id < d_locations.size(); ++location_id) {
+        const auto& location = d_locations[location_id];
+        auto contribs = d_usage_history_by_location[location_id].contributionsBySnapshot(
+                d_high_water_mark_index_by_snapshot,
+                final_peak_count);
 
         // Loop over all but the last historical contribution.
         for (size_t i = 0; i + 1 < contribs.size(); ++i) {
@@ -644,26 +817,27 @@ HighWaterMarkAggregator::visitAllocations(const allocation_callback_t& callback)
         final_peak_bytes = d_current_heap_size;
     }
 
-    return std::all_of(
-            d_usage_history_by_location.begin(),
-            d_usage_history_by_location.end(),
-            [&](const auto& entry) {
-                const auto& [loc, usage] = entry;
-                Contribution hwm = usage.highWaterMarkContribution(final_peak_count);
-                Contribution leaks = usage.leaksContribution();
-                AggregatedAllocation alloc{
-                        loc.thread_id,
-                        loc.allocator,
-                        loc.native_frame_id,
-                        loc.python_frame_id,
-                        loc.native_segment_generation,
-                        hwm.allocations,
-                        leaks.allocations,
-                        hwm.bytes,
-                        leaks.bytes};
-
-                return callback(alloc);
-            });
+    for (location_id_t location = 0; location < d_locations.size(); ++location) {
+        const auto& loc = d_locations[location];
+        const auto& usage = d_usage_history_by_location[location];
+        Contribution hwm = usage.highWaterMarkContribution(final_peak_count);
+        Contribution leaks = usage.leaksContribution();
+        AggregatedAllocation alloc{
+                loc.thread_id,
+                loc.allocator,
+                loc.native_frame_id,
+                loc.python_frame_id,
+                loc.native_segment_generation,
+                hwm.allocations,
+                leaks.allocations,
+                hwm.bytes,
+                leaks.bytes};
+
+        if (!callback(alloc)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void
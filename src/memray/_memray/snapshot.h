@@ -3,10 +3,13 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
-#include <deque>
+#include <array>
+#include <cstdint>
 #include <functional>
+#include <limits>
 #include <optional>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "frame_tree.h"
@@ -185,17 +188,74 @@ class SnapshotAllocationAggregator : public AbstractAggregator
     size_t d_index{0};
     IntervalTree<Allocation> d_interval_tree;
     std::unordered_map<uintptr_t, Allocation> d_ptr_to_allocation{};
+    reduced_snapshot_map_t d_summarized_allocations{};
 
   public:
     void addAllocation(const Allocation& allocation) override;
     reduced_snapshot_map_t getSnapshotAllocations(bool merge_threads) override;
 };
 
+// Like SnapshotAllocationAggregator, but the totals for each location are
+// kept up to date as allocations arrive instead of being computed on demand,
+// and the locations that changed since they were last collected are tracked,
+// so that a live reader can be polled at a cost that depends only on how much
+// changed since the previous poll.
+class IncrementalSnapshotAggregator : public AbstractAggregator
+{
+  public:
+    struct Changes
+    {
+        reduced_snapshot_map_t updated;  // Current totals of changed locations.
+        std::vector<LocationKey> removed;  // Locations without any allocations left.
+    };
+
+    void addAllocation(const Allocation& allocation) override;
+    reduced_snapshot_map_t getSnapshotAllocations(bool merge_threads) override;
+
+    // Returns the changes since the previous call with the same value of
+    // `merge_threads`, or since the aggregator was created.
+    Changes takeChanges(bool merge_threads);
+
+  private:
+    struct View
+    {
+        reduced_snapshot_map_t totals;
+        std::unordered_set<LocationKey, index_thread_pair_hash> changed;
+    };
+
+    void updateTotals(const Allocation& allocation, size_t size_delta, size_t count_delta);
+
+    IntervalTree<Allocation> d_interval_tree;
+    std::unordered_map<uintptr_t, Allocation> d_ptr_to_allocation{};
+    std::array<View, 2> d_views{};  // Indexed by merge_threads.
+};
+
 class TemporaryAllocationsAggregator : public AbstractAggregator
 {
   private:
+    // The last `max_items` allocations made by a thread, in a ring indexed
+    // by each allocation's sequence number modulo `max_items`. Allocations
+    // are found by address through the most recent one with that address,
+    // which links to the previous one with the same address, if any, so a
+    // deallocation is matched without scanning the whole ring.
+    struct RecentAllocations
+    {
+        static constexpr uint64_t NONE = std::numeric_limits<uint64_t>::max();
+
+        std::vector<Allocation> allocations{};
+        std::vector<uint64_t> previous_with_same_address{};
+        std::unordered_map<uintptr_t, uint64_t> latest_by_address{};
+        uint64_t next_sequence_number{0};
+    };
+
+    void addRecentAllocation(RecentAllocations& recent, const Allocation& allocation);
+    const Allocation* findRecentAllocation(
+            const RecentAllocations& recent,
+            const Allocation& deallocation,
+            bool match_size) const;
+
     size_t d_max_items;
-    std::unordered_map<thread_id_t, std::deque<Allocation>> d_current_allocations{};
+    std::unordered_map<thread_id_t, RecentAllocations> d_current_allocations{};
     std::vector<Allocation> d_temporary_allocations{};
 
   public:
@@ -366,6 +426,7 @@ class HighWaterMarkAggregator
     void captureSnapshot();
 
     size_t getCurrentHeapSize() const noexcept;
+    size_t getPeakHeapSize() const noexcept;
     std::vector<size_t> highWaterMarkBytesBySnapshot() const;
     Index generateIndex() const;
 
@@ -387,19 +448,33 @@ class HighWaterMarkAggregator
     size_t d_heap_size_at_last_peak{};
     size_t d_current_heap_size{};
 
-    // Information about allocations and deallocations, aggregated by location.
-    using UsageHistoryByLocation =
-            std::unordered_map<HighWaterMarkLocationKey, UsageHistory, HighWaterMarkLocationKeyHash>;
-    UsageHistoryByLocation d_usage_history_by_location;
+    // Every distinct location seen, numbered in the order it was first seen,
+    // so that live allocations only need to remember a location's id. This
+    // keeps the memory used proportional to the number of locations rather
+    // than to the number of live allocations, which matters when aggregating
+    // in the tracked process.
+    using location_id_t = size_t;
+    std::vector<HighWaterMarkLocationKey> d_locations;
+    std::unordered_map<HighWaterMarkLocationKey, location_id_t, HighWaterMarkLocationKeyHash>
+            d_location_ids;
+
+    // Information about allocations and deallocations, indexed by location id.
+    std::vector<UsageHistory> d_usage_history_by_location;
+
+    struct LiveAllocation
+    {
+        size_t size;
+        location_id_t location;
+    };
 
     // Simple allocations contributing to the current heap size.
-    std::unordered_map<uintptr_t, Allocation> d_ptr_to_allocation;
+    std::unordered_map<uintptr_t, LiveAllocation> d_ptr_to_allocation;
 
     // Ranged allocations contributing to the current heap size.
-    IntervalTree<Allocation> d_mmap_intervals;
+    IntervalTree<location_id_t> d_mmap_intervals;
 
-    UsageHistory& getUsageHistory(const Allocation& allocation);
-    void recordUsageDelta(const Allocation& allocation, size_t count_delta, size_t bytes_delta);
+    location_id_t getLocationId(const Allocation& allocation);
+    void recordUsageDelta(location_id_t location, size_t count_delta, size_t bytes_delta);
     reduced_snapshot_map_t getAllocations(bool merge_threads, bool stop_at_high_water_mark) const;
 };
 
@@ -472,6 +547,11 @@ class AllocationStatsAggregator
         return d_high_water_mark_finder.getHighWatermark().peak_memory;
     }
 
+    uint64_t currentBytesAllocated()
+    {
+        return d_high_water_mark_finder.getCurrentWatermark();
+    }
+
     const std::unordered_map<size_t, uint64_t>& allocationCountBySize()
     {
         return d_allocation_count_by_size;
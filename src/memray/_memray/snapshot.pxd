@@ -22,8 +22,19 @@ cdef extern from "snapshot.h" namespace "memray::api":
         HighWatermark getHighWatermark()
         size_t getCurrentWatermark()
 
+    cdef cppclass LocationKey:
+        size_t python_frame_id
+        size_t native_frame_id
+        unsigned long thread_id
+
     cdef cppclass reduced_snapshot_map_t:
-        pass
+        cppclass iterator:
+            pair[LocationKey, Allocation]& operator*()
+            iterator operator++()
+            bint operator!=(iterator)
+        iterator begin()
+        iterator end()
+        bint empty()
 
     cdef cppclass AbstractAggregator:
         void addAllocation(const Allocation&) except+
@@ -38,10 +49,12 @@ cdef extern from "snapshot.h" namespace "memray::api":
     cdef cppclass AggregatedCaptureReaggregator(AbstractAggregator):
         pass
 
-    cdef cppclass LocationKey:
-        size_t python_frame_id
-        size_t native_frame_id
-        unsigned long thread_id
+    cdef cppclass IncrementalSnapshotAggregatorChanges "memray::api::IncrementalSnapshotAggregator::Changes":
+        reduced_snapshot_map_t updated
+        vector[LocationKey] removed
+
+    cdef cppclass IncrementalSnapshotAggregator(AbstractAggregator):
+        IncrementalSnapshotAggregatorChanges takeChanges(bool merge_threads) except+
 
     cdef cppclass index_thread_pair_hash:
         pass
@@ -73,6 +86,7 @@ cdef extern from "snapshot.h" namespace "memray::api":
         void captureSnapshot() except+
 
         size_t getCurrentHeapSize()
+        size_t getPeakHeapSize()
         bool visitAllocations[T](const T& callback) except+
         vector[size_t] highWaterMarkBytesBySnapshot() except+
         vector[AllocationLifetime] generateIndex() except+
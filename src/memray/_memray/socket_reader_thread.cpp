@@ -1,9 +1,155 @@
 #include "socket_reader_thread.h"
 
+#include <algorithm>
 #include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace memray::socket_thread {
 
+namespace {
+
+// Own and total memory of every (function, file) location in a snapshot,
+// computed the way the TUI reporter displays them. The reader's strings are
+// interned, so locations are identified by the addresses of their strings.
+class LocationAggregator
+{
+  public:
+    void addAllocation(
+            const tracking_api::Allocation& allocation,
+            const std::vector<api::RecordReader::StackFrame>& frames);
+    PyObject* toPythonObject() const;
+
+  private:
+    using location_t = std::pair<const std::string*, const std::string*>;
+
+    struct location_hash
+    {
+        size_t operator()(const location_t& location) const
+        {
+            return std::hash<const std::string*>{}(location.first)
+                   ^ (std::hash<const std::string*>{}(location.second) << 1);
+        }
+    };
+
+    struct Totals
+    {
+        location_t location;
+        size_t own_memory{0};
+        size_t total_memory{0};
+        size_t n_allocations{0};
+        std::vector<tracking_api::thread_id_t> thread_ids{};
+        // The last allocation counted here, so that recursive calls only
+        // count each allocation once without a per-stack visited set.
+        uint64_t epoch{0};
+    };
+
+    Totals& totalsFor(const location_t& location);
+
+    std::unordered_map<location_t, size_t, location_hash> d_index_by_location{};
+    std::vector<Totals> d_totals{};
+    uint64_t d_epoch{0};
+};
+
+LocationAggregator::Totals&
+LocationAggregator::totalsFor(const location_t& location)
+{
+    auto [it, inserted] = d_index_by_location.try_emplace(location, d_totals.size());
+    if (inserted) {
+        d_totals.push_back({location});
+    }
+    return d_totals[it->second];
+}
+
+void
+LocationAggregator::addAllocation(
+        const tracking_api::Allocation& allocation,
+        const std::vector<api::RecordReader::StackFrame>& frames)
+{
+    static const std::string unknown("???");
+
+    const uint64_t epoch = ++d_epoch;
+    auto add = [&](Totals& totals) {
+        totals.total_memory += allocation.size;
+        totals.n_allocations += allocation.n_allocations;
+        auto& tids = totals.thread_ids;
+        if (std::find(tids.begin(), tids.end(), allocation.tid) == tids.end()) {
+            tids.push_back(allocation.tid);
+        }
+    };
+
+    if (frames.empty()) {
+        Totals& totals = totalsFor({&unknown, &unknown});
+        totals.own_memory += allocation.size;
+        add(totals);
+        return;
+    }
+
+    // Like aggregate_allocations(), the entry for the frame that made the
+    // allocation is replaced rather than added to, so that both agree.
+    Totals& top = totalsFor({frames[0].function_name, frames[0].filename});
+    top.own_memory = allocation.size;
+    top.total_memory = 0;
+    top.n_allocations = 0;
+    top.thread_ids.clear();
+    top.epoch = epoch;
+    add(top);
+
+    for (auto it = frames.begin() + 1; it != frames.end(); ++it) {
+        Totals& totals = totalsFor({it->function_name, it->filename});
+        if (totals.epoch == epoch) {
+            continue;
+        }
+        totals.epoch = epoch;
+        add(totals);
+    }
+}
+
+PyObject*
+LocationAggregator::toPythonObject() const
+{
+    PyObject* list = PyList_New(d_totals.size());
+    if (list == nullptr) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < d_totals.size(); ++i) {
+        const Totals& totals = d_totals[i];
+        PyObject* tids = PyTuple_New(totals.thread_ids.size());
+        if (tids == nullptr) {
+            Py_DECREF(list);
+            return nullptr;
+        }
+        for (size_t j = 0; j < totals.thread_ids.size(); ++j) {
+            PyObject* tid = PyLong_FromUnsignedLong(totals.thread_ids[j]);
+            if (tid == nullptr) {
+                Py_DECREF(tids);
+                Py_DECREF(list);
+                return nullptr;
+            }
+            PyTuple_SET_ITEM(tids, j, tid);
+        }
+        PyObject* row = Py_BuildValue(
+                "(s#s#nnnN)",
+                totals.location.first->data(),
+                static_cast<Py_ssize_t>(totals.location.first->size()),
+                totals.location.second->data(),
+                static_cast<Py_ssize_t>(totals.location.second->size()),
+                static_cast<Py_ssize_t>(totals.own_memory),
+                static_cast<Py_ssize_t>(totals.total_memory),
+                static_cast<Py_ssize_t>(totals.n_allocations),
+                tids);
+        if (row == nullptr) {
+            Py_DECREF(list);
+            return nullptr;
+        }
+        PyList_SET_ITEM(list, i, row);
+    }
+    return list;
+}
+
+}  // namespace
+
 void
 BackgroundSocketReader::backgroundThreadWorker()
 {
@@ -20,11 +166,21 @@ BackgroundSocketReader::backgroundThreadWorker()
 
         switch (record_type) {
             case RecordResult::ALLOCATION_RECORD: {
+                const auto& allocation = d_record_reader->getLatestAllocation();
+                std::optional<tracking_api::frame_id_t> python_frame_id;
+                if (d_stats_aggregator) {
+                    python_frame_id = d_record_reader->getLatestPythonFrameId(allocation);
+                }
                 std::lock_guard<std::mutex> lock(d_mutex);
-                d_aggregator.addAllocation(d_record_reader->getLatestAllocation());
+                d_aggregator.addAllocation(allocation);
+                if (d_stats_aggregator) {
+                    d_stats_aggregator->addAllocation(allocation, python_frame_id);
+                }
             } break;
 
             case RecordResult::MEMORY_RECORD: {
+                std::lock_guard<std::mutex> lock(d_mutex);
+                d_latest_memory_record = d_record_reader->getLatestMemoryRecord();
             } break;
 
             case RecordResult::AGGREGATED_ALLOCATION_RECORD: {
@@ -49,12 +205,17 @@ BackgroundSocketReader::backgroundThreadWorker()
     }
 }
 
-BackgroundSocketReader::BackgroundSocketReader(std::shared_ptr<api::RecordReader> reader)
+BackgroundSocketReader::BackgroundSocketReader(
+        std::shared_ptr<api::RecordReader> reader,
+        bool collect_statistics)
 : d_record_reader(reader)
 {
     if (d_record_reader->getHeader().file_format != api::FileFormat::ALL_ALLOCATIONS) {
         throw std::runtime_error("BackgroundSocketReader only supports ALL_ALLOCATIONS");
     }
+    if (collect_statistics) {
+        d_stats_aggregator.emplace();
+    }
 }
 
 void
@@ -67,19 +228,103 @@ BackgroundSocketReader::~BackgroundSocketReader()
 {
     d_record_reader->close();
     d_stop_thread = true;
-    d_thread.join();
+    if (d_thread.joinable()) {
+        d_thread.join();
+    }
 }
 
-PyObject*
-BackgroundSocketReader::Py_GetSnapshotAllocationRecords(bool merge_threads)
+api::IncrementalSnapshotAggregator::Changes
+BackgroundSocketReader::updateSnapshot(bool merge_threads)
 {
-    api::reduced_snapshot_map_t stack_to_allocation;
+    // Changes are collected and applied under d_snapshots_mutex, so that
+    // concurrent updates apply them in the order they were made.
+    std::lock_guard<std::mutex> snapshots_lock(d_snapshots_mutex);
+    api::IncrementalSnapshotAggregator::Changes changes;
     {
         std::lock_guard<std::mutex> lock(d_mutex);
-        stack_to_allocation = d_aggregator.getSnapshotAllocations(merge_threads);
+        changes = d_aggregator.takeChanges(merge_threads);
+    }
+    if (changes.removed.empty() && changes.updated.empty()) {
+        return changes;
+    }
+
+    auto& snapshot = d_snapshots[merge_threads];
+    if (snapshot.use_count() > 1) {
+        snapshot = std::make_shared<api::reduced_snapshot_map_t>(*snapshot);
+    }
+    for (const auto& loc_key : changes.removed) {
+        snapshot->erase(loc_key);
+    }
+    for (const auto& [loc_key, allocation] : changes.updated) {
+        snapshot->insert_or_assign(loc_key, allocation);
+    }
+    return changes;
+}
+
+std::shared_ptr<const api::reduced_snapshot_map_t>
+BackgroundSocketReader::currentSnapshot(bool merge_threads)
+{
+    std::lock_guard<std::mutex> lock(d_snapshots_mutex);
+    return d_snapshots[merge_threads];
+}
+
+tracking_api::MemoryRecord
+BackgroundSocketReader::latestMemoryRecord()
+{
+    std::lock_guard<std::mutex> lock(d_mutex);
+    return d_latest_memory_record;
+}
+
+PyObject*
+BackgroundSocketReader::Py_GetSnapshotLocations(double memory_ratio)
+{
+    const std::shared_ptr<const api::reduced_snapshot_map_t> snapshot_ptr = currentSnapshot(false);
+    const api::reduced_snapshot_map_t& snapshot = *snapshot_ptr;
+    const bool native_traces = d_record_reader->getHeader().native_traces;
+
+    size_t heap_size = 0;
+    for (const auto& [loc_key, allocation] : snapshot) {
+        heap_size += allocation.size;
     }
 
-    return api::Py_ListFromSnapshotAllocationRecords(stack_to_allocation);
+    // Like the TUI, stop once the locations seen so far account for the
+    // requested fraction of the heap: the remaining ones are too small to
+    // matter, and resolving their stacks is the expensive part.
+    const double memory_threshold = memory_ratio * static_cast<double>(heap_size);
+    LocationAggregator aggregator;
+    std::vector<api::RecordReader::StackFrame> frames;
+    size_t current_total = 0;
+    Py_BEGIN_ALLOW_THREADS
+    for (const auto& [loc_key, allocation] : snapshot) {
+        if (static_cast<double>(current_total) >= memory_threshold) {
+            break;
+        }
+        current_total += allocation.size;
+        d_record_reader->getStackFrames(allocation, native_traces, &frames);
+        aggregator.addAllocation(allocation, frames);
+    }
+    Py_END_ALLOW_THREADS
+
+    return aggregator.toPythonObject();
+}
+
+Statistics
+BackgroundSocketReader::currentStatistics(size_t num_largest)
+{
+    if (!d_stats_aggregator) {
+        throw std::runtime_error("This reader does not collect statistics");
+    }
+    std::lock_guard<std::mutex> lock(d_mutex);
+    Statistics stats;
+    stats.total_allocations = d_stats_aggregator->totalAllocations();
+    stats.total_bytes_allocated = d_stats_aggregator->totalBytesAllocated();
+    stats.peak_bytes_allocated = d_stats_aggregator->peakBytesAllocated();
+    stats.current_bytes_allocated = d_stats_aggregator->currentBytesAllocated();
+    stats.allocation_count_by_size = d_stats_aggregator->allocationCountBySize();
+    stats.allocation_count_by_allocator = d_stats_aggregator->allocationCountByAllocator();
+    stats.top_locations_by_size = d_stats_aggregator->topLocationsBySize(num_largest);
+    stats.top_locations_by_count = d_stats_aggregator->topLocationsByCount(num_largest);
+    return stats;
 }
 
 bool
@@ -88,4 +333,10 @@ BackgroundSocketReader::is_active() const
     return !d_stop_thread;
 }
 
+size_t
+BackgroundSocketReader::dropped_allocations() const
+{
+    return d_record_reader->getDroppedAllocationCount();
+}
+
 }  // namespace memray::socket_thread
@@ -3,16 +3,37 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include <array>
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "record_reader.h"
 #include "snapshot.h"
 
 namespace memray::socket_thread {
 
+// The statistics gathered so far, as returned by
+// BackgroundSocketReader::currentStatistics().
+struct Statistics
+{
+    using location_t = std::pair<uint64_t, std::optional<tracking_api::frame_id_t>>;
+
+    uint64_t total_allocations{0};
+    uint64_t total_bytes_allocated{0};
+    uint64_t peak_bytes_allocated{0};
+    uint64_t current_bytes_allocated{0};
+    std::unordered_map<size_t, uint64_t> allocation_count_by_size{};
+    std::unordered_map<int, uint64_t> allocation_count_by_allocator{};
+    std::vector<location_t> top_locations_by_size{};
+    std::vector<location_t> top_locations_by_count{};
+};
+
 class BackgroundSocketReader
 {
   private:
@@ -22,9 +43,22 @@ class BackgroundSocketReader
     std::mutex d_mutex;
     std::shared_ptr<api::RecordReader> d_record_reader;
 
-    api::SnapshotAllocationAggregator d_aggregator;
+    api::IncrementalSnapshotAggregator d_aggregator;
+    std::optional<api::AllocationStatsAggregator> d_stats_aggregator;
     std::thread d_thread;
 
+    // The snapshots as of the last update, indexed by merge_threads. They're
+    // brought up to date with the aggregator's changes by updateSnapshot(),
+    // so that d_mutex is only held for as long as it takes to collect those
+    // changes. Snapshots that were handed out are never modified: one that is
+    // still in use when it needs updating is copied first.
+    std::mutex d_snapshots_mutex;
+    std::array<std::shared_ptr<api::reduced_snapshot_map_t>, 2> d_snapshots{
+            std::make_shared<api::reduced_snapshot_map_t>(),
+            std::make_shared<api::reduced_snapshot_map_t>()};
+
+    tracking_api::MemoryRecord d_latest_memory_record{};
+
     void backgroundThreadWorker();
 
   public:
@@ -33,12 +67,26 @@ class BackgroundSocketReader
     void operator=(const BackgroundSocketReader&) = delete;
     void operator=(BackgroundSocketReader&&) = delete;
 
-    explicit BackgroundSocketReader(std::shared_ptr<api::RecordReader> reader);
+    explicit BackgroundSocketReader(
+            std::shared_ptr<api::RecordReader> reader,
+            bool collect_statistics = false);
     ~BackgroundSocketReader();
 
     void start();
     bool is_active() const;
-    PyObject* Py_GetSnapshotAllocationRecords(bool merge_threads);
+    size_t dropped_allocations() const;
+    // Only available if the reader was created with `collect_statistics`.
+    Statistics currentStatistics(size_t num_largest);
+    // Brings the snapshot up to date, and returns the changes that were made
+    // to it, so that callers can keep views of it up to date in time
+    // proportional to the number of locations that changed.
+    api::IncrementalSnapshotAggregator::Changes updateSnapshot(bool merge_threads);
+    // Returns the snapshot as of the last update, without copying it.
+    std::shared_ptr<const api::reduced_snapshot_map_t> currentSnapshot(bool merge_threads);
+    tracking_api::MemoryRecord latestMemoryRecord();
+    // Returns the memory usage by location of the snapshot as of the last
+    // update of the snapshot that doesn't merge threads.
+    PyObject* Py_GetSnapshotLocations(double memory_ratio);
 };
 
 }  // namespace memray::socket_thread
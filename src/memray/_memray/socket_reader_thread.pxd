@@ -1,13 +1,33 @@
 from _memray.record_reader cimport RecordReader
+from _memray.records cimport optional_frame_id_t
+from _memray.snapshot cimport IncrementalSnapshotAggregatorChanges
+from libc.stdint cimport uint64_t
 from libcpp cimport bool
 from libcpp cimport int
 from libcpp.memory cimport shared_ptr
+from libcpp.unordered_map cimport unordered_map
+from libcpp.utility cimport pair
+from libcpp.vector cimport vector
 
 
 cdef extern from "socket_reader_thread.h" namespace "memray::socket_thread":
+    cdef cppclass Statistics:
+        uint64_t total_allocations
+        uint64_t total_bytes_allocated
+        uint64_t peak_bytes_allocated
+        uint64_t current_bytes_allocated
+        unordered_map[size_t, uint64_t] allocation_count_by_size
+        unordered_map[int, uint64_t] allocation_count_by_allocator
+        vector[pair[uint64_t, optional_frame_id_t]] top_locations_by_size
+        vector[pair[uint64_t, optional_frame_id_t]] top_locations_by_count
+
     cdef cppclass BackgroundSocketReader:
         BackgroundSocketReader(shared_ptr[RecordReader]) except+
+        BackgroundSocketReader(shared_ptr[RecordReader], bool collect_statistics) except+
 
         void start() except+
         bool is_active()
-        object Py_GetSnapshotAllocationRecords(bool merge_threads)
+        size_t dropped_allocations()
+        Statistics currentStatistics(size_t num_largest) except+
+        IncrementalSnapshotAggregatorChanges updateSnapshot(bool merge_threads) except+
+        object Py_GetSnapshotLocations(double memory_ratio)
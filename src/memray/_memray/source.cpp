@@ -1,11 +1,15 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
+#include <fcntl.h>
 #include <iostream>
 #include <netdb.h>
+#include <new>
 #include <stdexcept>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -20,29 +24,54 @@ using namespace memray::exception;
 
 namespace memray::io {
 
-FileSource::FileSource(const std::string& file_name)
+namespace {
+
+// How often a followed file is checked for new data.
+constexpr std::chrono::milliseconds FOLLOW_POLL_INTERVAL{100};
+
+}  // namespace
+
+FileSource::FileSource(const std::string& file_name, bool follow)
 : d_file_name(file_name)
 {
     d_raw_stream = std::make_shared<std::ifstream>(d_file_name, std::ios::binary | std::ios::in);
     if (!(*d_raw_stream)) {
         throw IoError{"Could not open file " + file_name + ": " + std::string(strerror(errno))};
     }
-    char lz4_magic[] = {0x04, 0x22, 0x4D, 0x18};
-    char file_magic[sizeof(lz4_magic)] = {};
-    d_raw_stream->read(file_magic, sizeof(file_magic));
-    d_raw_stream->seekg(0, std::ios::beg);
-
-    if (0 == memcmp(lz4_magic, file_magic, sizeof(lz4_magic))) {
-        d_stream = std::make_shared<lz4_stream::istream>(*d_raw_stream);
-    } else {
-        d_stream = d_raw_stream;
-        findReadableSize();
+    switch (detectCompressionCodec(*d_raw_stream)) {
+        case CompressionCodec::LZ4:
+            if (hasIndependentLz4Frames(*d_raw_stream)) {
+                // This already decompresses ahead of us, on several threads.
+                d_stream = std::make_shared<Lz4BlockInputStream>(*d_raw_stream);
+            } else {
+                d_read_ahead_stream = std::make_shared<ReadAheadInputStream>(
+                        std::make_shared<lz4_stream::istream>(*d_raw_stream));
+                d_stream = d_read_ahead_stream;
+            }
+            break;
+        case CompressionCodec::ZSTD:
+            d_read_ahead_stream = std::make_shared<ReadAheadInputStream>(
+                    std::make_shared<ZstdInputStream>(*d_raw_stream));
+            d_stream = d_read_ahead_stream;
+            break;
+        case CompressionCodec::NONE:
+            d_stream = d_raw_stream;
+            findReadableSize();
+            if (follow) {
+                d_follow = true;
+                d_pending_readable_size = d_readable_size;
+                d_readable_size = 0;
+            }
+            break;
     }
 }
 
 bool
 FileSource::read(char* stream, ssize_t length)
 {
+    if (d_follow && !waitForBytes(length)) {
+        return false;
+    }
     if (d_stream->read(stream, length).fail()) {
         return false;
     }
@@ -56,6 +85,17 @@ FileSource::read(char* stream, ssize_t length)
 bool
 FileSource::getline(std::string& result, char delimiter)
 {
+    if (d_follow) {
+        result.clear();
+        char c;
+        while (read(&c, 1)) {
+            if (c == delimiter) {
+                return true;
+            }
+            result.push_back(c);
+        }
+        return false;
+    }
     std::getline(*d_stream, result, delimiter);
     if (!d_stream) {
         return false;
@@ -70,7 +110,12 @@ FileSource::getline(std::string& result, char delimiter)
 void
 FileSource::close()
 {
-    _close();
+    d_closed = true;
+    // In follow mode another thread may be waiting in read() for the file to
+    // grow. It notices the flag and stops, and the destructor closes the file.
+    if (!d_follow) {
+        _close();
+    }
 }
 
 void
@@ -87,29 +132,73 @@ FileSource::findReadableSize()
     // in order to recover from the file truncation. To ignore these, we count
     // the zeroed bytes at the end of the file, and make calls to read() and
     // getline() fail if they read into those bytes.
-    d_raw_stream->seekg(-1, d_raw_stream->end);
-    while (*d_raw_stream) {
-        char c = d_raw_stream->peek();
-        if (c != 0x00) {
-            d_readable_size = d_raw_stream->tellg() + std::streamoff(1);
+    d_readable_size = findLastNonZeroByte(0);
+    d_raw_stream->clear();
+    d_raw_stream->seekg(0, d_raw_stream->beg);
+}
+
+std::streamoff
+FileSource::findLastNonZeroByte(std::streamoff lower_bound)
+{
+    // Scan backwards a block at a time, since the zero-filled space at the end
+    // of the file can be many megabytes long. Returns the offset just past the
+    // last non-zero byte, or `lower_bound` if there isn't one after it.
+    d_raw_stream->clear();
+    d_raw_stream->seekg(0, d_raw_stream->end);
+    std::streamoff end = d_raw_stream->tellg();
+    char block[MAX_BUF_SIZE];
+    while (end > lower_bound) {
+        std::streamoff start = std::max(lower_bound, end - static_cast<std::streamoff>(sizeof(block)));
+        d_raw_stream->seekg(start);
+        if (!d_raw_stream->read(block, end - start)) {
+            // The file was truncated under us. Try again on the next poll.
             break;
         }
-        // If we're at BOF, this sets failbit and makes the loop break.
-        d_raw_stream->seekg(-1, d_raw_stream->cur);
+        for (std::streamoff i = end - start; i > 0; --i) {
+            if (block[i - 1] != 0x00) {
+                return start + i;
+            }
+        }
+        end = start;
     }
-    d_raw_stream->seekg(0, d_raw_stream->beg);
+    return lower_bound;
+}
+
+bool
+FileSource::waitForBytes(std::streamoff length)
+{
+    // The writer copies records into the file in no particular byte order, so
+    // the data up to the last non-zero byte found by one poll only becomes
+    // readable on the next one, once any copy in progress has finished.
+    while (d_bytes_read + length > d_readable_size) {
+        if (d_closed) {
+            return false;
+        }
+        std::this_thread::sleep_for(FOLLOW_POLL_INTERVAL);
+        d_readable_size = std::max(d_readable_size, d_pending_readable_size);
+        d_pending_readable_size = findLastNonZeroByte(d_pending_readable_size);
+        d_raw_stream->clear();
+        d_raw_stream->seekg(d_bytes_read);
+    }
+    return true;
 }
 
 void
 FileSource::_close()
 {
+    // Stop any thread reading ahead before closing the file under it. Another
+    // thread may still be reading from d_stream, so it's kept until we're
+    // destroyed, and just stops returning data.
+    if (d_read_ahead_stream) {
+        d_read_ahead_stream->close();
+    }
     d_raw_stream->close();
 }
 
 bool
 FileSource::is_open()
 {
-    return d_raw_stream->is_open();
+    return !d_closed && d_raw_stream->is_open();
 }
 
 FileSource::~FileSource()
@@ -236,6 +325,16 @@ SocketSource::SocketSource(int port)
     d_socket_buf = std::make_unique<SocketBuf>(d_sockfd);
 }
 
+std::unique_ptr<SocketSource>
+SocketSource::fromConnectedSocket(int sockfd)
+{
+    std::unique_ptr<SocketSource> source(new SocketSource());
+    source->d_sockfd = sockfd;
+    source->d_is_open = true;
+    source->d_socket_buf = std::make_unique<SocketBuf>(sockfd);
+    return source;
+}
+
 bool
 SocketSource::read(char* result, ssize_t length)
 {
@@ -291,4 +390,243 @@ SocketSource::~SocketSource()
     _close();
 }
 
+#ifdef MEMRAY_HAS_SHARED_MEMORY_RING
+
+namespace {  // unnamed
+
+int
+createAnonymousFile()
+{
+#    ifdef SYS_memfd_create
+    const unsigned int memfd_cloexec = 0x0001U;  // MFD_CLOEXEC
+    int memfd = static_cast<int>(::syscall(SYS_memfd_create, "memray-live", memfd_cloexec));
+    if (memfd != -1 || errno != ENOSYS) {
+        return memfd;
+    }
+#    endif
+    // Kernels without memfd_create: an unlinked file on tmpfs can be reopened
+    // through /proc just the same.
+    char name[] = "/dev/shm/memray-live-XXXXXX";
+    int fd = ::mkostemp(name, O_CLOEXEC);
+    if (fd != -1) {
+        ::unlink(name);
+    }
+    return fd;
+}
+
+}  // unnamed namespace
+
+SharedMemorySource::SharedMemorySource(size_t capacity)
+{
+    d_capacity = 64 * 1024;
+    while (d_capacity < capacity) {
+        d_capacity <<= 1;
+    }
+
+    d_fd = createAnonymousFile();
+    if (d_fd == -1) {
+        throw IoError{"Could not create shared memory ring: " + std::string(strerror(errno))};
+    }
+
+    const size_t page_size = ::sysconf(_SC_PAGESIZE);
+    const size_t data_offset = (sizeof(SharedRingHeader) + page_size - 1) / page_size * page_size;
+    d_mapping_size = data_offset + d_capacity;
+    void* mapping = MAP_FAILED;
+    if (::ftruncate(d_fd, d_mapping_size) == 0) {
+        mapping = ::mmap(nullptr, d_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, d_fd, 0);
+    }
+    if (mapping == MAP_FAILED) {
+        std::string error = strerror(errno);
+        ::close(d_fd);
+        throw IoError{"Could not create shared memory ring: " + error};
+    }
+
+    d_ring = new (mapping) SharedRingHeader{};
+    d_ring->magic = SharedRingHeader::MAGIC;
+    d_ring->version = SharedRingHeader::VERSION;
+    d_ring->reader_pid = static_cast<uint32_t>(::getpid());
+    d_ring->capacity = d_capacity;
+    d_ring->data_offset = data_offset;
+    d_data = static_cast<const char*>(mapping) + data_offset;
+    d_path = "/proc/" + std::to_string(::getpid()) + "/fd/" + std::to_string(d_fd);
+    d_is_open = true;
+}
+
+bool
+SharedMemorySource::waitForWriter()
+{
+    while (d_is_open && d_ring->writer_pid.load() == 0) {
+        uint32_t seq = d_ring->head_seq.load();
+        d_ring->reader_waiting.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (d_ring->writer_pid.load() != 0) {
+            break;
+        }
+        Py_BEGIN_ALLOW_THREADS;
+        futexWait(&d_ring->head_seq, seq, 100 * 1000 * 1000);
+        Py_END_ALLOW_THREADS;
+        // Give a chance to check for signals arriving so we don't block the main thread.
+        if (PyErr_CheckSignals() < 0) {
+            d_ring->reader_waiting.store(0);
+            return false;
+        }
+    }
+    d_ring->reader_waiting.store(0);
+    return d_is_open;
+}
+
+bool
+SharedMemorySource::waitForData()
+{
+    bool has_data = false;
+    while (d_is_open) {
+        uint32_t seq = d_ring->head_seq.load();
+        d_ring->reader_waiting.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // The writer closes the ring after publishing its last record, so
+        // check for that before checking for data.
+        bool writer_closed = d_ring->writer_closed.load();
+        if (d_ring->head.load() != d_ring->tail.load(std::memory_order_relaxed)) {
+            has_data = true;
+            break;
+        }
+        uint32_t writer_pid = d_ring->writer_pid.load();
+        if (writer_closed || (writer_pid != 0 && !processIsAlive(writer_pid))) {
+            break;
+        }
+        futexWait(&d_ring->head_seq, seq, 100 * 1000 * 1000);
+    }
+    d_ring->reader_waiting.store(0);
+    return has_data;
+}
+
+void
+SharedMemorySource::wakeWriter()
+{
+    // Pairs with the fence the writer issues between announcing that it's
+    // going to sleep and checking the tail one last time.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (d_ring->writer_waiting.load(std::memory_order_relaxed)) {
+        futexWakeAll(&d_ring->tail_seq);
+    }
+}
+
+bool
+SharedMemorySource::read(char* result, ssize_t length)
+{
+    size_t needed = length;
+    while (needed) {
+        if (!d_is_open) {
+            return false;
+        }
+
+        uint64_t tail = d_ring->tail.load(std::memory_order_relaxed);
+        size_t available = d_ring->head.load(std::memory_order_acquire) - tail;
+        if (available == 0) {
+            if (!waitForData()) {
+                return false;
+            }
+            continue;
+        }
+
+        size_t offset = tail & (d_capacity - 1);
+        size_t chunk = std::min({needed, available, d_capacity - offset});
+        ::memcpy(result, d_data + offset, chunk);
+        d_ring->tail.store(tail + chunk, std::memory_order_release);
+        result += chunk;
+        needed -= chunk;
+
+        // The writer only ever waits for a full ring, so don't pay for the
+        // fence while the ring is mostly empty.
+        if (available >= d_capacity / 2) {
+            wakeWriter();
+        }
+    }
+    return true;
+}
+
+void
+SharedMemorySource::_close()
+{
+    if (!d_is_open.exchange(false)) {
+        return;
+    }
+    // The mapping stays around until we're destroyed, since the thread
+    // reading records may still be using it.
+    d_ring->reader_closed.store(1);
+    futexWakeAll(&d_ring->head_seq);
+    futexWakeAll(&d_ring->tail_seq);
+}
+
+SharedMemorySource::~SharedMemorySource()
+{
+    _close();
+    if (d_ring) {
+        ::munmap(d_ring, d_mapping_size);
+        ::close(d_fd);
+    }
+}
+
+#else
+
+SharedMemorySource::SharedMemorySource(size_t)
+{
+    throw IoError{"Shared memory rings are only supported on Linux"};
+}
+
+bool
+SharedMemorySource::waitForWriter()
+{
+    return false;
+}
+
+bool
+SharedMemorySource::read(char*, ssize_t)
+{
+    return false;
+}
+
+void
+SharedMemorySource::_close()
+{
+    d_is_open = false;
+}
+
+SharedMemorySource::~SharedMemorySource()
+{
+}
+
+#endif
+
+const std::string&
+SharedMemorySource::path() const
+{
+    return d_path;
+}
+
+void
+SharedMemorySource::close()
+{
+    _close();
+}
+
+bool
+SharedMemorySource::is_open()
+{
+    return d_is_open;
+}
+
+bool
+SharedMemorySource::getline(std::string& result, char delimiter)
+{
+    char buf;
+    while (read(&buf, 1)) {
+        if (buf == delimiter) {
+            return true;
+        }
+        result.push_back(buf);
+    }
+    return false;
+}
+
 }  // namespace memray::io
@@ -6,7 +6,9 @@
 #include <memory>
 #include <string>
 
+#include "compression.h"
 #include "lz4_stream.h"
+#include "shm_ring.h"
 
 namespace memray::io {
 
@@ -30,7 +32,10 @@ class FileSource : public Source
     void operator=(const FileSource&) = delete;
     void operator=(FileSource&&) = delete;
 
-    FileSource(const std::string& file_name);
+    // In follow mode, reads past the data written so far wait for the file to
+    // grow instead of failing, until a call to close(). Compressed files are
+    // only written once tracking ends, so they are read as usual.
+    FileSource(const std::string& file_name, bool follow = false);
     ~FileSource() override;
     void close() override;
     bool is_open() override;
@@ -40,11 +45,17 @@ class FileSource : public Source
   private:
     void _close();
     void findReadableSize();
+    std::streamoff findLastNonZeroByte(std::streamoff lower_bound);
+    bool waitForBytes(std::streamoff length);
     const std::string& d_file_name;
     std::shared_ptr<std::ifstream> d_raw_stream;
+    std::shared_ptr<ReadAheadInputStream> d_read_ahead_stream;
     std::shared_ptr<std::istream> d_stream;
     std::streamoff d_readable_size{};
     std::streamoff d_bytes_read{};
+    bool d_follow{false};
+    std::streamoff d_pending_readable_size{};
+    std::atomic<bool> d_closed{false};
 };
 
 class SocketBuf : public std::streambuf
@@ -71,16 +82,57 @@ class SocketSource : public Source
 
     SocketSource(int port);
     ~SocketSource() override;
+
+    // Read from a socket that a tracked process has already connected to us
+    // through, taking ownership of it.
+    static std::unique_ptr<SocketSource> fromConnectedSocket(int sockfd);
+
     void close() override;
     bool is_open() override;
     bool read(char* result, ssize_t length) override;
     bool getline(std::string& result, char delimiter) override;
 
   private:
+    SocketSource() = default;
     void _close();
     int d_sockfd{-1};
     std::atomic<bool> d_is_open{false};
     std::unique_ptr<SocketBuf> d_socket_buf;
 };
 
+// Reads records from a shared memory ring that a tracked process running on
+// the same host writes to through a SharedMemorySink. The ring is created by
+// the reader, and the writer attaches to it by opening `path()`.
+class SharedMemorySource : public Source
+{
+  public:
+    static constexpr size_t DEFAULT_CAPACITY{16 * 1024 * 1024};  // 16 MiB
+
+    SharedMemorySource(SharedMemorySource& other) = delete;
+    SharedMemorySource(SharedMemorySource&& other) = delete;
+    void operator=(const SharedMemorySource&) = delete;
+    void operator=(SharedMemorySource&&) = delete;
+
+    explicit SharedMemorySource(size_t capacity = DEFAULT_CAPACITY);
+    ~SharedMemorySource() override;
+    const std::string& path() const;
+    bool waitForWriter();
+    void close() override;
+    bool is_open() override;
+    bool read(char* result, ssize_t length) override;
+    bool getline(std::string& result, char delimiter) override;
+
+  private:
+    bool waitForData();
+    void wakeWriter();
+    void _close();
+    int d_fd{-1};
+    std::string d_path;
+    SharedRingHeader* d_ring{nullptr};
+    const char* d_data{nullptr};
+    size_t d_mapping_size{0};
+    size_t d_capacity{0};
+    std::atomic<bool> d_is_open{false};
+};
+
 }  // namespace memray::io
@@ -1,4 +1,5 @@
 from libcpp cimport bool
+from libcpp.memory cimport unique_ptr
 from libcpp.string cimport string
 
 
@@ -8,6 +9,14 @@ cdef extern from "source.h" namespace "memray::io":
 
     cdef cppclass FileSource(Source):
         FileSource(const string& file_name) except+ IOError
+        FileSource(const string& file_name, bool follow) except+ IOError
 
     cdef cppclass SocketSource(Source):
         SocketSource(int port) except+ IOError
+        @staticmethod
+        unique_ptr[SocketSource] fromConnectedSocket(int sockfd)
+
+    cdef cppclass SharedMemorySource(Source):
+        SharedMemorySource(size_t capacity) except+ IOError
+        const string& path()
+        bool waitForWriter()
@@ -132,6 +132,10 @@ class PythonStackTracker
     static std::atomic<unsigned int> s_tracker_generation;
 
     uint32_t d_num_pending_pops{};
+    // The emitted frame that was popped most recently, which is the one
+    // closest to the bottom of the stack among the pending pops. Only
+    // meaningful while d_num_pending_pops is non-zero.
+    RawFrame d_last_popped_frame{};
     uint32_t d_tracker_generation{};
     std::vector<LazilyEmittedFrame>* d_stack{};
     bool d_greenlet_hooks_installed{};
@@ -184,6 +188,7 @@ PythonStackTracker::emitPendingPushesAndPops()
                 // Line number was wrong; emit an artificial pop so we can push
                 // back in with the right line number.
                 d_num_pending_pops++;
+                d_last_popped_frame = it->raw_frame_record;
                 it->state = FrameState::NOT_EMITTED;
                 it->raw_frame_record.lineno = lineno;
             } else {
@@ -197,6 +202,18 @@ PythonStackTracker::emitPendingPushesAndPops()
     }
     auto first_to_emit = it.base();
 
+    // If the first frame to push is identical to the last frame that was
+    // popped, that pop and push cancel each other out. This happens every time
+    // a function is called repeatedly from the same line, and skipping them
+    // keeps consecutive allocations made in a loop free of stack records.
+    if (d_num_pending_pops && first_to_emit != d_stack->end()
+        && first_to_emit->raw_frame_record == d_last_popped_frame)
+    {
+        d_num_pending_pops--;
+        first_to_emit->state = FrameState::EMITTED_AND_LINE_NUMBER_HAS_NOT_CHANGED;
+        ++first_to_emit;
+    }
+
     Tracker* tracker = Tracker::getTracker();
     if (tracker) {
         // Emit pending pops
@@ -313,6 +330,7 @@ PythonStackTracker::popPythonFrame()
     if (d_stack->back().state != FrameState::NOT_EMITTED) {
         d_num_pending_pops += 1;
         assert(d_num_pending_pops != 0);  // Ensure we didn't overflow.
+        d_last_popped_frame = d_stack->back().raw_frame_record;
     }
     d_stack->pop_back();
     invalidateMostRecentFrameLineNumber();
@@ -622,8 +640,9 @@ Tracker::~Tracker()
     }
 
     std::scoped_lock<std::mutex> lock(*s_mutex);
-    d_writer->writeTrailer();
-    d_writer->writeHeader(true);
+    if (!d_writer->writeTrailer() || !d_writer->writeHeader(true)) {
+        std::cerr << "memray: Failed to write output, the capture may be incomplete" << std::endl;
+    }
     d_writer.reset();
 }
 
@@ -20,6 +20,7 @@ from . import attach
 from . import flamegraph
 from . import live
 from . import parse
+from . import report
 from . import run
 from . import stats
 from . import summary
@@ -66,6 +67,7 @@ _COMMANDS: List[Command] = [
     parse.ParseCommand(),
     summary.SummaryCommand(),
     stats.StatsCommand(),
+    report.ReportCommand(),
     transform.TransformCommand(),
     attach.AttachCommand(),
     attach.DetachCommand(),
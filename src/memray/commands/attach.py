@@ -18,6 +18,12 @@ from memray._errors import MemrayCommandError
 
 from .live import LiveCommand
 from .run import _get_free_port
+from .run import add_compression_arguments
+from .run import add_io_backend_argument
+from .run import add_live_backpressure_argument
+from .run import add_live_transport_argument
+from .run import validate_compression_arguments
+from .run import validate_live_transport_argument
 
 try:
     from typing import Literal
@@ -378,7 +384,11 @@ class AttachCommand(_DebuggerCommand):
 
         parser.add_argument(
             "--aggregate",
-            help="Write aggregated stats to the output file instead of all allocations",
+            help=(
+                "Write aggregated stats to the output file instead of all allocations."
+                " Without an output file, send per-location totals to the live"
+                " client periodically instead of every allocation"
+            ),
             action="store_true",
             default=False,
         )
@@ -415,6 +425,10 @@ class AttachCommand(_DebuggerCommand):
             default=False,
             action="store_true",
         )
+        add_compression_arguments(parser)
+        add_io_backend_argument(parser)
+        add_live_backpressure_argument(parser)
+        add_live_transport_argument(parser)
 
         parser.add_argument(
             "--duration", type=int, help="Duration to track for (in seconds)"
@@ -431,22 +445,36 @@ class AttachCommand(_DebuggerCommand):
             mode = "FOR_DURATION"
             duration = args.duration
 
+        validate_compression_arguments(args, parser)
+        if args.output and args.live_backpressure != "block":
+            parser.error("--live-backpressure cannot be used with an output file")
+        if args.output and args.live_transport != "socket":
+            parser.error("--live-transport cannot be used with an output file")
+        validate_live_transport_argument(args, parser)
         args.method = self.resolve_debugger(args.method, verbose=verbose)
 
         destination: memray.Destination
+        reader: memray.SocketReader | None = None
         if args.output:
-            live_port = None
             destination = memray.FileDestination(
                 path=os.path.abspath(args.output),
                 overwrite=args.force,
                 compress_on_exit=not args.no_compress,
+                compression=args.compression,
+                compression_dictionary=args.compression_dictionary,
+                io_backend=args.io_backend,
+            )
+        elif args.live_transport == "shm":
+            reader = memray.SharedMemoryReader()
+            destination = memray.SharedMemoryDestination(
+                path=reader.path, backpressure=args.live_backpressure
             )
         else:
             live_port = _get_free_port()
-            destination = memray.SocketDestination(server_port=live_port)
-
-        if args.aggregate and not args.output:
-            parser.error("Can't use aggregated mode without an output file.")
+            reader = memray.SocketReader(port=live_port)
+            destination = memray.SocketDestination(
+                server_port=live_port, backpressure=args.live_backpressure
+            )
 
         file_format = (
             "file_format=memray.FileFormat.AGGREGATED_ALLOCATIONS"
@@ -472,7 +500,7 @@ class AttachCommand(_DebuggerCommand):
         )
         client.shutdown(socket.SHUT_WR)
 
-        if not live_port:
+        if reader is None:
             err = recvall(client)
             if err:
                 raise MemrayCommandError(
@@ -482,7 +510,8 @@ class AttachCommand(_DebuggerCommand):
             return
 
         # If an error prevents the tracked process from binding a server to
-        # live_port, the TUI will hang forever trying to connect. Handle this
+        # live_port or attaching to the shared memory ring, the TUI will hang
+        # forever waiting for it. Handle this
         # by spawning a background thread that watches for an error report over
         # the side channel and raises a SIGINT to interrupt the TUI if it sees
         # one. This can race, though: in some cases the TUI will also see an
@@ -496,7 +525,7 @@ class AttachCommand(_DebuggerCommand):
         with contextlib.suppress(KeyboardInterrupt):
             try:
                 try:
-                    live.start_live_interface(live_port)
+                    live.run_live_interface(reader)
                 finally:
                     # Note: may get a spurious KeyboardInterrupt!
                     error_reader.join()
@@ -128,11 +128,15 @@ class HighWatermarkCommand:
         inverted: Optional[bool] = None,
         temporal: bool = False,
         max_memory_records: Optional[int] = None,
+        use_index: bool = False,
+        prune_fraction: float = 0.0,
     ) -> None:
         try:
             kwargs = {}
             if max_memory_records is not None:
                 kwargs["max_memory_records"] = max_memory_records
+            if use_index:
+                kwargs["use_index"] = True
             reader = FileReader(os.fspath(result_path), report_progress=True, **kwargs)
             merge_threads = True if merge_threads is None else merge_threads
             inverted = False if inverted is None else inverted
@@ -178,11 +182,15 @@ class HighWatermarkCommand:
                     snapshot = reader.get_high_watermark_allocation_records(
                         merge_threads=merge_threads
                     )
+                reporter_kwargs = {}
+                if prune_fraction:
+                    reporter_kwargs["prune_fraction"] = prune_fraction
                 reporter = self.reporter_factory(
                     snapshot,
                     memory_records=tuple(reader.get_memory_snapshots()),
                     native_traces=reader.metadata.has_native_traces,
                     inverted=inverted,
+                    **reporter_kwargs,
                 )
         except OSError as e:
             raise MemrayCommandError(
@@ -256,12 +264,26 @@ class HighWatermarkCommand:
             dest="temporary_allocation_threshold",
             const=1,
         )
+        parser.add_argument(
+            "--use-index",
+            help=(
+                "Save what is read from the results in an index beside them,"
+                " and read it from there instead if an index is already present"
+            ),
+            action="store_true",
+            default=False,
+        )
         parser.add_argument("results", help="Results of the tracker run")
 
     def run(self, args: argparse.Namespace, parser: argparse.ArgumentParser) -> None:
         temporal = getattr(args, "temporal", False)
         if temporal and args.temporary_allocation_threshold >= 0:
             parser.error("Can't create a temporal flame graph of temporary allocations")
+        prune_threshold = getattr(args, "prune_threshold", 0.0)
+        if not 0 <= prune_threshold < 1:
+            parser.error("The --prune-threshold argument must be in [0, 1)")
+        if temporal and prune_threshold:
+            parser.error("Can't prune a temporal flame graph")
 
         result_path, output_file = self.validate_filenames(
             output=args.output,
@@ -279,6 +301,12 @@ class HighWatermarkCommand:
         if hasattr(args, "max_memory_records"):
             kwargs["max_memory_records"] = args.max_memory_records
 
+        if args.use_index:
+            kwargs["use_index"] = True
+
+        if prune_threshold:
+            kwargs["prune_fraction"] = prune_threshold
+
         self.write_report(
             result_path,
             output_file,
@@ -30,6 +30,18 @@ class FlamegraphCommand(HighWatermarkCommand):
             default=False,
         )
 
+        parser.add_argument(
+            "--prune-threshold",
+            help=(
+                "Fold the frames called by each function that account for less"
+                " than this fraction of the memory, like 0.001, into one node,"
+                " to keep the report small enough for huge captures"
+            ),
+            type=float,
+            default=0.0,
+            metavar="FRACTION",
+        )
+
         parser.add_argument(
             "--max-memory-records",
             help="Maximum number of memory records to display",
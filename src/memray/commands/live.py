@@ -1,7 +1,9 @@
 import argparse
 from contextlib import suppress
 from typing import Optional
+from typing import Union
 
+from memray import ProcessGroupReader
 from memray import SocketReader
 from memray._errors import MemrayCommandError
 from memray.reporters.tui import TUIApp
@@ -27,5 +29,14 @@ class LiveCommand:
     ) -> None:
         if port >= 2**16 or port <= 0:
             raise MemrayCommandError(f"Invalid port: {port}", exit_code=1)
-        with SocketReader(port=port) as reader:
+        self.run_live_interface(
+            SocketReader(port=port), cmdline_override=cmdline_override
+        )
+
+    def run_live_interface(
+        self,
+        reader: Union[SocketReader, ProcessGroupReader],
+        cmdline_override: Optional[str] = None,
+    ) -> None:
+        with reader:
             TUIApp(reader, cmdline_override=cmdline_override).run()
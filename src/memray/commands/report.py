@@ -0,0 +1,177 @@
+import argparse
+import os
+from pathlib import Path
+from typing import Dict
+from typing import List
+from typing import Optional
+from typing import Tuple
+
+from memray import FileReader
+from memray._errors import MemrayCommandError
+from memray.commands.common import ReporterFactory
+from memray.commands.common import warn_if_not_enough_symbols
+from memray.reporters.flamegraph import FlameGraphReporter
+from memray.reporters.stats import StatsReporter
+from memray.reporters.table import TableReporter
+
+HTML_REPORTERS: Dict[str, ReporterFactory] = {
+    "flamegraph": FlameGraphReporter.from_snapshot,
+    "table": TableReporter.from_snapshot,
+}
+REPORTERS = [*HTML_REPORTERS, "stats"]
+
+
+class Report:
+    def __init__(self, spec: str) -> None:
+        name, _, variant = spec.partition(":")
+        if name not in REPORTERS:
+            raise argparse.ArgumentTypeError(
+                f"{name!r} is not a valid reporter (choose from {', '.join(REPORTERS)})"
+            )
+        if variant not in ("", "leaks") or (variant and name not in HTML_REPORTERS):
+            raise argparse.ArgumentTypeError(f"{spec!r} is not a valid report")
+        self.name = name
+        self.show_memory_leaks = variant == "leaks"
+
+    @property
+    def key(self) -> Tuple[str, bool]:
+        return self.name, self.show_memory_leaks
+
+    def output_filename(self, results_file: Path, output_dir: Path) -> Path:
+        if self.name == "stats":
+            output_name = results_file.name + ".json"
+        else:
+            output_name = results_file.with_suffix(".html").name
+        if output_name.startswith("memray-"):
+            output_name = output_name[len("memray-") :]
+        kind = f"{self.name}-leaks" if self.show_memory_leaks else self.name
+        return output_dir / f"memray-{kind}-{output_name}"
+
+
+class ReportCommand:
+    """Generate several reports while reading the results only once"""
+
+    def prepare_parser(self, parser: argparse.ArgumentParser) -> None:
+        parser.add_argument(
+            "-r",
+            "--reporter",
+            help=(
+                "Report to generate, which can be given more than once:"
+                " 'flamegraph' or 'table' for the peak memory usage, the same"
+                " followed by ':leaks' for the memory leaks, or 'stats' for"
+                " the statistics as JSON"
+            ),
+            action="append",
+            dest="reports",
+            type=Report,
+            required=True,
+            metavar="REPORTER[:leaks]",
+        )
+        parser.add_argument(
+            "-d",
+            "--output-dir",
+            help="Directory to write the reports to (default: that of the results)",
+            default=None,
+        )
+        parser.add_argument(
+            "-f",
+            "--force",
+            help="If an output file already exists, overwrite it",
+            action="store_true",
+            default=False,
+        )
+        parser.add_argument(
+            "-n",
+            "--num-largest",
+            help="Number of largest allocating functions in the stats. Default is 5",
+            type=int,
+            default=5,
+        )
+        parser.add_argument(
+            "--use-index",
+            help=(
+                "Save what is read from the results in an index beside them,"
+                " and read it from there instead if an index is already present"
+            ),
+            action="store_true",
+            default=False,
+        )
+        parser.add_argument("results", help="Results of the tracker run")
+
+    def run(self, args: argparse.Namespace, parser: argparse.ArgumentParser) -> None:
+        if args.num_largest <= 0:
+            parser.error("The --num-largest argument must be positive")
+
+        result_path = Path(args.results)
+        if not result_path.exists() or not result_path.is_file():
+            raise MemrayCommandError(f"No such file: {args.results}", exit_code=1)
+        output_dir = (
+            Path(args.output_dir) if args.output_dir is not None else result_path.parent
+        )
+
+        reports: Dict[Tuple[str, bool], Report] = {}
+        for report in args.reports:
+            reports.setdefault(report.key, report)
+        output_files = {
+            key: report.output_filename(result_path, output_dir)
+            for key, report in reports.items()
+        }
+        for output_file in output_files.values():
+            if not args.force and output_file.exists():
+                raise MemrayCommandError(
+                    f"File already exists, will not overwrite: {output_file}",
+                    exit_code=1,
+                )
+
+        try:
+            reader = FileReader(
+                os.fspath(result_path),
+                report_progress=True,
+                collect_statistics=("stats", False) in reports,
+                use_index=args.use_index,
+            )
+        except NotImplementedError as e:
+            raise MemrayCommandError(str(e), exit_code=1)
+        except OSError as e:
+            raise MemrayCommandError(
+                f"Failed to parse allocation records in {result_path}\nReason: {e}",
+                exit_code=1,
+            )
+
+        if reader.metadata.has_native_traces:
+            warn_if_not_enough_symbols()
+
+        written: List[Path] = []
+        for show_memory_leaks in (False, True):
+            names = [
+                report.name
+                for report in reports.values()
+                if report.name in HTML_REPORTERS
+                and report.show_memory_leaks == show_memory_leaks
+            ]
+            if not names:
+                continue
+            reporters = reader.create_reporters(
+                [HTML_REPORTERS[name] for name in names],
+                show_memory_leaks=show_memory_leaks,
+            )
+            for name, reporter in zip(names, reporters):
+                output_file = output_files[name, show_memory_leaks]
+                with open(os.fspath(output_file.expanduser()), "w") as f:
+                    reporter.render(
+                        outfile=f,
+                        metadata=reader.metadata,
+                        show_memory_leaks=show_memory_leaks,
+                        merge_threads=True,
+                        inverted=False,
+                    )
+                written.append(output_file)
+
+        stats_file: Optional[Path] = output_files.get(("stats", False))
+        if stats_file is not None:
+            stats = reader.get_statistics(num_largest=args.num_largest)
+            StatsReporter(stats, args.num_largest).render(json_output_file=stats_file)
+            written.append(stats_file)
+
+        for output_file in written:
+            print(f"Wrote {output_file}")
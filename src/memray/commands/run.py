@@ -8,6 +8,7 @@ import socket
 import subprocess
 import sys
 import textwrap
+import time
 from contextlib import closing
 from contextlib import suppress
 from typing import Any
@@ -18,8 +19,17 @@ from typing import Optional
 from memray import Destination
 from memray import FileDestination
 from memray import FileFormat
+from memray import LiveBroker
+from memray import ProcessGroupReader
+from memray import SharedMemoryDestination
+from memray import SharedMemoryReader
 from memray import SocketDestination
+from memray import SocketReader
 from memray import Tracker
+from memray._destination import BACKPRESSURE_POLICIES
+from memray._destination import IO_BACKENDS
+from memray._destination import LIVE_TRANSPORTS
+from memray._destination import parse_compression
 from memray._errors import MemrayCommandError
 from memray.commands.live import LiveCommand
 
@@ -78,38 +88,76 @@ def _child_process(
     quiet: bool,
     script: str,
     script_args: List[str],
+    backpressure: str = "block",
+    shared_memory_path: Optional[str] = None,
+    aggregate: bool = False,
+    children_port: Optional[int] = None,
 ) -> None:
     args = argparse.Namespace(
         native=native,
         trace_python_allocators=trace_python_allocators,
-        follow_fork=False,
-        aggregate=False,
+        follow_fork=children_port is not None,
+        aggregate=aggregate,
         run_as_module=run_as_module,
         run_as_cmd=run_as_cmd,
         quiet=quiet,
         script=script,
         script_args=script_args,
     )
-    _run_tracker(destination=SocketDestination(server_port=port), args=args)
-
+    destination: Destination
+    if shared_memory_path is not None:
+        destination = SharedMemoryDestination(
+            path=shared_memory_path, backpressure=backpressure
+        )
+    else:
+        destination = SocketDestination(
+            server_port=port, backpressure=backpressure, children_port=children_port
+        )
+    _run_tracker(destination=destination, args=args)
 
-def _run_child_process_and_attach(args: argparse.Namespace) -> None:
-    port = args.live_port
-    if port is None:
-        port = _get_free_port()
-    if not 2**16 > port > 0:
-        raise MemrayCommandError(f"Invalid port: {port}", exit_code=1)
 
+def _tracked_app_command(
+    args: argparse.Namespace,
+    port: int,
+    *,
+    shared_memory_path: Optional[str] = None,
+    children_port: Optional[int] = None,
+) -> List[str]:
     arguments = (
         f"{port},{args.native},{args.trace_python_allocators},"
         f"{args.run_as_module},{args.run_as_cmd},{args.quiet},"
-        f"{args.script!r},{args.script_args}"
+        f"{args.script!r},{args.script_args},{args.live_backpressure!r},"
+        f"{shared_memory_path!r},{args.aggregate},{children_port!r}"
     )
-    tracked_app_cmd = [
+    return [
         sys.executable,
         "-c",
         f"from memray.commands.run import _child_process;_child_process({arguments})",
     ]
+
+
+def _run_child_process_and_attach(args: argparse.Namespace) -> None:
+    reader: Any = None
+    shared_memory_path = None
+    children_port = None
+    if args.live_transport == "shm":
+        port = 0
+        reader = SharedMemoryReader()
+        shared_memory_path = reader.path
+    else:
+        port = args.live_port
+        if port is None:
+            port = _get_free_port()
+        if not 2**16 > port > 0:
+            raise MemrayCommandError(f"Invalid port: {port}", exit_code=1)
+        if args.follow_fork:
+            # Forked processes connect to the TUI through a port of their own.
+            reader = ProcessGroupReader(SocketReader(port=port))
+            children_port = reader.children_port
+
+    tracked_app_cmd = _tracked_app_command(
+        args, port, shared_memory_path=shared_memory_path, children_port=children_port
+    )
     with contextlib.suppress(KeyboardInterrupt):
         with subprocess.Popen(
             tracked_app_cmd,
@@ -118,9 +166,14 @@ def _run_child_process_and_attach(args: argparse.Namespace) -> None:
             text=True,
         ) as process:
             try:
-                LiveCommand().start_live_interface(
-                    port, cmdline_override=" ".join(sys.argv)
-                )
+                if reader is not None:
+                    LiveCommand().run_live_interface(
+                        reader, cmdline_override=" ".join(sys.argv)
+                    )
+                else:
+                    LiveCommand().start_live_interface(
+                        port, cmdline_override=" ".join(sys.argv)
+                    )
             except (Exception, KeyboardInterrupt) as error:
                 process.terminate()
                 raise error from None
@@ -142,7 +195,55 @@ def _run_with_socket_output(args: argparse.Namespace) -> None:
         memray_cli = f"memray{sys.version_info.major}.{sys.version_info.minor}"
         print(f"Run '{memray_cli} live {port}' in another shell to see live results")
     with suppress(KeyboardInterrupt):
-        _run_tracker(destination=SocketDestination(server_port=port), args=args)
+        _run_tracker(
+            destination=SocketDestination(
+                server_port=port, backpressure=args.live_backpressure
+            ),
+            args=args,
+        )
+
+
+def _run_with_live_broker(args: argparse.Namespace) -> None:
+    port = args.live_port if args.live_port is not None else 0
+    if args.live_port is not None and not 2**16 > port > 0:
+        raise MemrayCommandError(f"Invalid port: {port}", exit_code=1)
+
+    reader: SocketReader
+    shared_memory_path = None
+    if args.live_transport == "shm":
+        tracked_port = 0
+        reader = SharedMemoryReader()
+        shared_memory_path = reader.path
+    else:
+        tracked_port = _get_free_port()
+        reader = SocketReader(port=tracked_port)
+
+    tracked_app_cmd = _tracked_app_command(
+        args, tracked_port, shared_memory_path=shared_memory_path
+    )
+    with contextlib.suppress(KeyboardInterrupt):
+        with subprocess.Popen(tracked_app_cmd) as process:
+            try:
+                with LiveBroker(reader, port=port) as broker:
+                    if not args.quiet:
+                        memray_cli = (
+                            f"memray{sys.version_info.major}.{sys.version_info.minor}"
+                        )
+                        print(
+                            f"Run '{memray_cli} live {broker.port}' in other shells"
+                            " to see live results",
+                            flush=True,
+                        )
+                    while broker.is_active:
+                        time.sleep(0.1)
+            except OSError as error:
+                process.terminate()
+                raise MemrayCommandError(str(error), exit_code=1) from None
+            except (Exception, KeyboardInterrupt) as error:
+                process.terminate()
+                raise error from None
+        if process.returncode:
+            raise MemrayCommandError(exit_code=process.returncode)
 
 
 def _run_with_file_output(args: argparse.Namespace) -> None:
@@ -171,7 +272,12 @@ def _run_with_file_output(args: argparse.Namespace) -> None:
     ).strip()
 
     destination = FileDestination(
-        path=filename, overwrite=args.force, compress_on_exit=args.compress_on_exit
+        path=filename,
+        overwrite=args.force,
+        compress_on_exit=args.compress_on_exit,
+        compression=args.compression,
+        compression_dictionary=args.compression_dictionary,
+        io_backend=args.io_backend,
     )
     try:
         _run_tracker(
@@ -183,6 +289,93 @@ def _run_with_file_output(args: argparse.Namespace) -> None:
         raise MemrayCommandError(str(error), exit_code=1)
 
 
+def _compression_spec(value: str) -> str:
+    try:
+        parse_compression(value)
+    except ValueError as e:
+        raise argparse.ArgumentTypeError(str(e))
+    return value
+
+
+def add_compression_arguments(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--compression",
+        help=(
+            "Codec and optional level used to compress the resulting file,"
+            " like 'lz4' or 'zstd:19' (default: lz4)"
+        ),
+        type=_compression_spec,
+        default="lz4",
+        metavar="CODEC[:LEVEL]",
+    )
+    parser.add_argument(
+        "--compression-dictionary",
+        help="Dictionary trained with 'zstd --train' to use when compressing with zstd",
+        default=None,
+        metavar="PATH",
+    )
+
+
+def add_io_backend_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--io-backend",
+        help=(
+            "How to write records to the output file: through a memory mapping"
+            " (mmap), with asynchronous io_uring requests (io_uring), or from a"
+            " background thread (pwrite) (default: mmap)"
+        ),
+        choices=IO_BACKENDS,
+        default="mmap",
+    )
+
+
+def add_live_backpressure_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--live-backpressure",
+        help=(
+            "What to do with allocation records when the live client can't keep"
+            " up: make the tracked process wait (block), drop them (drop), or"
+            " summarize them per location (aggregate) (default: block)"
+        ),
+        choices=BACKPRESSURE_POLICIES,
+        default="block",
+    )
+
+
+def add_live_transport_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--live-transport",
+        help=(
+            "How to send records to the live TUI: over a local TCP connection"
+            " (socket), or through a shared memory ring, which is faster but"
+            " only available on Linux (shm) (default: socket)"
+        ),
+        choices=LIVE_TRANSPORTS,
+        default="socket",
+    )
+
+
+def validate_live_transport_argument(
+    args: argparse.Namespace, parser: argparse.ArgumentParser
+) -> None:
+    if args.live_transport == "shm" and not sys.platform.startswith("linux"):
+        parser.error("--live-transport shm is only supported on Linux")
+
+
+def validate_compression_arguments(
+    args: argparse.Namespace, parser: argparse.ArgumentParser
+) -> None:
+    if args.no_compress and (
+        args.compression != "lz4" or args.compression_dictionary is not None
+    ):
+        parser.error("--no-compress cannot be used with --compression options")
+    if args.compression_dictionary is not None:
+        codec, _ = parse_compression(args.compression)
+        if codec != "zstd":
+            parser.error("--compression-dictionary requires --compression=zstd")
+        args.compression_dictionary = os.path.abspath(args.compression_dictionary)
+
+
 class RunCommand:
     """Run the specified application and track memory usage"""
 
@@ -208,6 +401,16 @@ class RunCommand:
             dest="live_remote_mode",
             default=False,
         )
+        output_group.add_argument(
+            "--live-broker",
+            help=(
+                "Start a live tracking session that any number of clients can"
+                " connect to and disconnect from while it runs"
+            ),
+            action="store_true",
+            dest="live_broker_mode",
+            default=False,
+        )
         parser.add_argument(
             "--live-port",
             "-p",
@@ -215,9 +418,15 @@ class RunCommand:
             default=None,
             type=int,
         )
+        add_live_backpressure_argument(parser)
+        add_live_transport_argument(parser)
         parser.add_argument(
             "--aggregate",
-            help="Write aggregated stats to the output file instead of all allocations",
+            help=(
+                "Write aggregated stats to the output file instead of all allocations."
+                " With --live or --live-remote, send per-location totals to the"
+                " live client periodically instead of every allocation"
+            ),
             action="store_true",
             default=False,
         )
@@ -232,7 +441,10 @@ class RunCommand:
         parser.add_argument(
             "--follow-fork",
             action="store_true",
-            help="Record allocations in child processes forked from the tracked script",
+            help=(
+                "Record allocations in child processes forked from the tracked script."
+                " With --live, each process can be inspected separately"
+            ),
             default=False,
         )
         parser.add_argument(
@@ -267,6 +479,8 @@ class RunCommand:
             default=False,
             action="store_true",
         )
+        add_compression_arguments(parser)
+        add_io_backend_argument(parser)
         parser.add_argument(
             "-c",
             help="Program passed in as string",
@@ -305,15 +519,33 @@ class RunCommand:
             )
 
     def run(self, args: argparse.Namespace, parser: argparse.ArgumentParser) -> None:
+        validate_compression_arguments(args, parser)
         if args.no_compress:
             args.compress_on_exit = False
 
-        if args.live_port is not None and not args.live_remote_mode:
-            parser.error("The --live-port argument requires --live-remote")
-        if args.follow_fork is True and (args.live_mode or args.live_remote_mode):
-            parser.error("--follow-fork cannot be used with the live TUI")
-        if args.aggregate and (args.live_mode or args.live_remote_mode):
-            parser.error("--aggregate cannot be used with the live TUI")
+        if args.live_port is not None and not (
+            args.live_remote_mode or args.live_broker_mode
+        ):
+            parser.error(
+                "The --live-port argument requires --live-remote or --live-broker"
+            )
+        if args.live_backpressure != "block" and not (
+            args.live_mode or args.live_remote_mode or args.live_broker_mode
+        ):
+            parser.error(
+                "--live-backpressure requires --live, --live-remote or --live-broker"
+            )
+        if args.live_transport != "socket" and not (
+            args.live_mode or args.live_broker_mode
+        ):
+            parser.error("--live-transport requires --live or --live-broker")
+        validate_live_transport_argument(args, parser)
+        if args.follow_fork is True and args.live_remote_mode:
+            parser.error("--follow-fork cannot be used with --live-remote")
+        if args.follow_fork is True and args.live_broker_mode:
+            parser.error("--follow-fork cannot be used with --live-broker")
+        if args.follow_fork is True and args.live_transport == "shm":
+            parser.error("--follow-fork cannot be used with --live-transport shm")
         with contextlib.suppress(OSError):
             if args.run_as_cmd and pathlib.Path(args.script).exists():
                 parser.error("remove the option -c to run a file")
@@ -324,5 +556,7 @@ class RunCommand:
             _run_child_process_and_attach(args)
         elif args.live_remote_mode:
             _run_with_socket_output(args)
+        elif args.live_broker_mode:
+            _run_with_live_broker(args)
         else:
             _run_with_file_output(args)
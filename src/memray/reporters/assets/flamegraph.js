@@ -11,6 +11,7 @@ import {
   onResize,
   onInvert,
   getFlamegraph,
+  decodeCompactData,
 } from "./flamegraph_common";
 
 window.resizeMemoryGraph = resizeMemoryGraph;
@@ -64,7 +65,7 @@ function initTrees(packedData) {
 
 // Main entrypoint
 function main() {
-  initTrees(packed_data);
+  initTrees(decodeCompactData(packed_data));
   initMemoryGraph(memory_records);
   initThreadsDropdown(data, merge_threads);
 
@@ -287,3 +287,101 @@ export function drawChart(chart_data) {
   // Rendering the chart can add a scroll bar, so the width may have changed.
   chart.width(getChartWidth());
 }
+
+// Reports embed their nodes and intervals in a compact form, where each
+// column of integers is a base64 string of zigzag varint encoded deltas.
+// These decode it into the packed data that the flame graph scripts expect.
+// Columns of nodes are only decoded the first time they're used.
+
+export function decodeCompactColumn(encoded) {
+  // Arithmetic is used instead of bitwise operators, which would truncate
+  // values to 32 bits.
+  const bytes = atob(encoded);
+  const values = [];
+  let previous = 0;
+  let zigzag = 0;
+  let scale = 1;
+  for (let i = 0; i < bytes.length; i++) {
+    const byte = bytes.charCodeAt(i);
+    zigzag += (byte & 0x7f) * scale;
+    if (byte & 0x80) {
+      scale *= 128;
+      continue;
+    }
+    previous += zigzag % 2 === 0 ? zigzag / 2 : -(zigzag + 1) / 2;
+    values.push(previous);
+    zigzag = 0;
+    scale = 1;
+  }
+  return values;
+}
+
+function defineLazily(object, key, decode) {
+  Object.defineProperty(object, key, {
+    configurable: true,
+    enumerable: true,
+    get() {
+      const value = decode();
+      Object.defineProperty(object, key, {
+        value: value,
+        enumerable: true,
+        writable: true,
+      });
+      return value;
+    },
+  });
+}
+
+function decodeCompactNodes(columns) {
+  const nodes = {};
+  for (const key of Object.keys(columns)) {
+    if (key === "children" || key === "children_count") {
+      continue;
+    }
+    defineLazily(nodes, key, () => decodeCompactColumn(columns[key]));
+  }
+  if ("children_count" in columns) {
+    defineLazily(nodes, "children", () => {
+      const counts = decodeCompactColumn(columns.children_count);
+      const flattened = decodeCompactColumn(columns.children);
+      const children = [];
+      let offset = 0;
+      for (const count of counts) {
+        children.push(flattened.slice(offset, offset + count));
+        offset += count;
+      }
+      return children;
+    });
+  }
+  return nodes;
+}
+
+function decodeCompactIntervals(columns) {
+  const allocated = decodeCompactColumn(columns.allocated_before_snapshot);
+  const deallocated = decodeCompactColumn(columns.deallocated_before_snapshot);
+  const node = decodeCompactColumn(columns.node);
+  const n_allocations = decodeCompactColumn(columns.n_allocations);
+  const n_bytes = decodeCompactColumn(columns.n_bytes);
+  return allocated.map((_, i) => [
+    allocated[i],
+    deallocated[i] === -1 ? null : deallocated[i],
+    node[i],
+    n_allocations[i],
+    n_bytes[i],
+  ]);
+}
+
+export function decodeCompactData(payload) {
+  const data = {};
+  for (const key of Object.keys(payload)) {
+    const value = payload[key];
+    if (key === "nodes" || key === "inverted_no_imports_nodes") {
+      data[key] = decodeCompactNodes(value);
+    } else if (key === "intervals" || key === "no_imports_interval_list") {
+      data[key] = decodeCompactIntervals(value);
+    } else {
+      data[key] = value;
+    }
+  }
+  return data;
+}
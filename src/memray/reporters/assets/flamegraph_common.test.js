@@ -0,0 +1,122 @@
+import { decodeCompactColumn, decodeCompactData } from "./flamegraph_common";
+
+// Browsers provide atob(), but Jest's Node environment may not.
+if (typeof atob === "undefined") {
+  global.atob = (encoded) => Buffer.from(encoded, "base64").toString("binary");
+}
+
+// The encoded strings below were produced by encodeCompactColumn().
+
+describe("Decoding compact columns", () => {
+  test("Empty column", () => {
+    expect(decodeCompactColumn("")).toEqual([]);
+  });
+
+  test("Increasing values", () => {
+    expect(decodeCompactColumn("AgIC")).toEqual([1, 2, 3]);
+  });
+
+  test("Negative deltas and multi-byte varints", () => {
+    expect(decodeCompactColumn("CgMFgICAgIBAjYCAgIBA")).toEqual([
+      5,
+      3,
+      0,
+      2 ** 40,
+      -7,
+    ]);
+  });
+
+  test("Values wider than 32 bits", () => {
+    expect(decodeCompactColumn("gICAgICAgAT/////////A4CAgICAgIAE")).toEqual([
+      2 ** 50,
+      0,
+      2 ** 50,
+    ]);
+  });
+});
+
+describe("Decoding compact payloads", () => {
+  // A tree whose smallest children were pruned into an "<OTHER FRAMES>" node
+  const strings = [
+    "",
+    "<ROOT>",
+    "parent at fun.py:1",
+    "parent",
+    "fun.py",
+    "big at fun.py:10",
+    "big",
+    "<OTHER FRAMES>",
+    "...",
+    "merged thread",
+  ];
+  const compactNodes = {
+    name: "AgIGBA==",
+    function: "AAYGBA==",
+    filename: "AAgACA==",
+    lineno: "AAISEw==",
+    value: "4A8AD78P",
+    children_count: "AgIDAA==",
+    children: "AgIC",
+    n_allocations: "BgADAg==",
+    thread_id: "EgAAAA==",
+    interesting: "AgAAAA==",
+    import_system: "AAAAAA==",
+  };
+  const expectedNodes = {
+    name: [1, 2, 5, 7],
+    function: [0, 3, 6, 8],
+    filename: [0, 4, 4, 8],
+    lineno: [0, 1, 10, 0],
+    value: [1008, 1008, 1000, 8],
+    children: [[1], [2, 3], [], []],
+    n_allocations: [3, 3, 1, 2],
+    thread_id: [9, 9, 9, 9],
+    interesting: [1, 1, 1, 1],
+    import_system: [0, 0, 0, 0],
+  };
+
+  test("Nodes of a pruned tree", () => {
+    const data = decodeCompactData({
+      nodes: compactNodes,
+      inverted_no_imports_nodes: compactNodes,
+      strings: strings,
+      unique_threads: [9],
+    });
+
+    expect({ ...data.nodes }).toEqual(expectedNodes);
+    expect({ ...data.inverted_no_imports_nodes }).toEqual(expectedNodes);
+    expect(data.strings).toBe(strings);
+    expect(data.unique_threads).toEqual([9]);
+    const other = data.nodes.children[1][1];
+    expect(strings[data.nodes.name[other]]).toBe("<OTHER FRAMES>");
+    expect(data.nodes.value[other]).toBe(8);
+  });
+
+  test("Columns are decoded the first time they're used", () => {
+    const data = decodeCompactData({ nodes: compactNodes });
+
+    const descriptor = () =>
+      Object.getOwnPropertyDescriptor(data.nodes, "value");
+    expect(descriptor().get).toBeDefined();
+    expect(data.nodes.value).toEqual(expectedNodes.value);
+    expect(descriptor().get).toBeUndefined();
+    expect(descriptor().value).toBe(data.nodes.value);
+  });
+
+  test("Intervals", () => {
+    const data = decodeCompactData({
+      intervals: {
+        allocated_before_snapshot: "AAI=",
+        deallocated_before_snapshot: "BAU=",
+        node: "AgI=",
+        n_allocations: "AgQ=",
+        n_bytes: "gBCAMA==",
+      },
+    });
+
+    expect(data.intervals).toEqual([
+      [0, 2, 1, 1, 1024],
+      [1, null, 2, 3, 4096],
+    ]);
+  });
+});
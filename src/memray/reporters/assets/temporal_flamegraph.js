@@ -12,14 +12,16 @@ import {
   onInvert,
   getFilteredChart,
   getFlamegraph,
+  decodeCompactData,
 } from "./flamegraph_common";
 
 var active_plot = null;
 var current_dimensions = null;
 
-var parent_index_by_child_index = generateParentIndexes(packed_data.nodes);
+const decoded_data = decodeCompactData(packed_data);
+var parent_index_by_child_index = generateParentIndexes(decoded_data.nodes);
 var inverted_no_imports_parent_index_by_child_index = inverted
-  ? generateParentIndexes(packed_data.inverted_no_imports_nodes)
+  ? generateParentIndexes(decoded_data.inverted_no_imports_nodes)
   : null;
 
 function generateParentIndexes(nodes) {
@@ -344,7 +346,7 @@ function refreshFlamegraph(event) {
   console.log("last possible index is " + memory_records.length);
 
   console.log("constructing tree");
-  packedDataToTree(packed_data, idx0, idx1);
+  packedDataToTree(decoded_data, idx0, idx1);
 
   data = inverted && hideImports ? invertedNoImportsData : flamegraphData;
   intervals =
@@ -399,8 +401,8 @@ function refreshFlamegraphDebounced(event) {
 function main() {
   console.log("main");
 
-  const unique_threads = packed_data.unique_threads.map(
-    (tid) => packed_data.strings[tid],
+  const unique_threads = decoded_data.unique_threads.map(
+    (tid) => decoded_data.strings[tid],
   );
   initThreadsDropdown({ unique_threads: unique_threads }, merge_threads);
 
@@ -9,7 +9,7 @@ from memray import AllocationRecord
 from memray import AllocatorType
 from memray import MemorySnapshot
 from memray import Metadata
-from memray.reporters.templates import render_report
+from memray.reporters.templates import write_report
 
 
 class TableReporter:
@@ -71,7 +71,8 @@ class TableReporter:
             raise NotImplementedError(
                 "TableReporter does not support inverted argument"
             )
-        html_code = render_report(
+        write_report(
+            outfile,
             kind="table",
             data=self.data,
             metadata=metadata,
@@ -80,4 +81,3 @@ class TableReporter:
             merge_threads=merge_threads,
             inverted=inverted,
         )
-        print(html_code, file=outfile)
@@ -1,8 +1,11 @@
 """Templates to render reports in HTML."""
+
 from functools import lru_cache
 from typing import Any
 from typing import Dict
 from typing import Iterable
+from typing import Optional
+from typing import TextIO
 from typing import Union
 
 import jinja2
@@ -41,7 +44,8 @@ def get_report_title(
     return " ".join(parts)
 
 
-def render_report(
+def write_report(
+    outfile: TextIO,
     *,
     kind: str,
     data: Union[Dict[str, Any], Iterable[Dict[str, Any]]],
@@ -50,7 +54,14 @@ def render_report(
     show_memory_leaks: bool,
     merge_threads: bool,
     inverted: bool,
-) -> str:
+    compact_data: Optional[Iterable[str]] = None,
+) -> None:
+    """Render a report, writing it to the file as it's rendered.
+
+    If ``compact_data`` is given, the report embeds the chunks of JSON that it
+    yields instead of ``data``, which the report's scripts must decode with
+    decodeCompactData().
+    """
     env = get_render_environment()
     template = env.get_template(kind + ".html")
 
@@ -60,13 +71,17 @@ def render_report(
         show_memory_leaks=show_memory_leaks,
         inverted=inverted,
     )
-    return template.render(
+    stream = template.stream(
         kind=pretty_kind,
         title=title,
         data=data,
+        compact_data=compact_data,
         metadata=metadata,
         memory_records=memory_records,
         show_memory_leaks=show_memory_leaks,
         merge_threads=merge_threads,
         inverted=inverted,
     )
+    stream.enable_buffering()
+    stream.dump(outfile)
+    outfile.write("\n")
@@ -11,6 +11,7 @@ from memray import AllocationRecord
 from memray import AllocatorType
 from memray import MemorySnapshot
 from memray import Metadata
+from memray._memray import stack_traces
 
 Location = Tuple[str, str]
 
@@ -44,12 +45,10 @@ class TransformReporter:
         location_to_index: Dict[Location, int] = {}
         all_locations: List[Dict[str, str]] = []
         events = []
-        for record in self.allocations:
-            stack_trace = (
-                tuple(record.hybrid_stack_trace())
-                if self.native_traces
-                else record.stack_trace()
-            )
+        allocations = list(self.allocations)
+        for record, stack_trace in zip(
+            allocations, stack_traces(allocations, native_traces=self.native_traces)
+        ):
             call_chain = []
             for func, mod, _ in stack_trace:
                 location = (func, mod)
@@ -105,12 +104,10 @@ class TransformReporter:
                 "stack_trace",
             ]
         )
-        for record in self.allocations:
-            stack_trace = (
-                tuple(record.hybrid_stack_trace())
-                if self.native_traces
-                else record.stack_trace()
-            )
+        allocations = list(self.allocations)
+        for record, stack_trace in zip(
+            allocations, stack_traces(allocations, native_traces=self.native_traces)
+        ):
             writer.writerow(
                 [
                     AllocatorType(record.allocator).name,
@@ -19,6 +19,7 @@ from typing import List
 from typing import Optional
 from typing import Set
 from typing import Tuple
+from typing import Union
 from typing import cast
 
 from rich.markup import escape
@@ -47,6 +48,7 @@ from textual.widgets import Static
 from textual.widgets.data_table import RowKey
 
 from memray import AllocationRecord
+from memray import ProcessGroupReader
 from memray import SocketReader
 from memray._memray import size_fmt
 
@@ -84,6 +86,12 @@ class SnapshotFetched(Message):
         super().__init__()
 
 
+class ProcessSelected(Message):
+    def __init__(self, pid: Optional[int]) -> None:
+        self.pid = pid
+        super().__init__()
+
+
 class MemoryGraph(Widget):
     def __init__(
         self,
@@ -93,18 +101,10 @@ class MemoryGraph(Widget):
         **kwargs: Any,
     ) -> None:
         super().__init__(*args, **kwargs)
-        maxval: float = 1.0
-        minval: float = 0.0
         self._width = max_data_points
-        self._graph: List[Deque[str]] = [
-            deque(maxlen=self._width) for _ in range(height)
-        ]
         self._height = height
-        self._minval = minval
-        self._maxval = maxval
-        self._previous_blocks = [0] * height
-        values = [minval] * (2 * self._width + 1)
-        self._values = deque(values, maxlen=2 * self._width + 1)
+        self._minval: float = 0.0
+        self._clear()
         self._lookup = [
             [" ", "⢀", "⢠", "⢰", "⢸"],
             ["⡀", "⣀", "⣠", "⣰", "⣸"],
@@ -114,6 +114,21 @@ class MemoryGraph(Widget):
         ]
         self.border_title = "Heap Usage"
 
+    def _clear(self) -> None:
+        self._graph: List[Deque[str]] = [
+            deque(maxlen=self._width) for _ in range(self._height)
+        ]
+        self._maxval: float = 1.0
+        self._previous_blocks = [0] * self._height
+        values = [self._minval] * (2 * self._width + 1)
+        self._values = deque(values, maxlen=2 * self._width + 1)
+
+    def reset(self) -> None:
+        """Forget all values added so far."""
+        self._clear()
+        self.border_subtitle = ""
+        self.refresh()
+
     def _value_to_blocks(self, value: float) -> List[int]:
         dots_per_block = 4
         if value < self._minval:
@@ -532,6 +547,8 @@ class TUI(Screen[None]):
         Binding("q,esc", "quit", "Quit"),
         Binding("<,left", "previous_thread", "Previous Thread"),
         Binding(">,right", "next_thread", "Next Thread"),
+        Binding("p", "previous_process", "Previous Process"),
+        Binding("n", "next_process", "Next Process"),
         Binding("t", "sort(1)", "Sort by Total"),
         Binding("o", "sort(3)", "Sort by Own"),
         Binding("a", "sort(5)", "Sort by Allocations"),
@@ -547,6 +564,8 @@ class TUI(Screen[None]):
 
     thread_idx = reactive(0)
     threads = reactive(_DUMMY_THREAD_LIST, always_update=True)
+    process_idx = reactive(0)
+    processes = reactive(cast(List[Optional[int]], []), always_update=True)
     snapshot = reactive(_EMPTY_SNAPSHOT)
     paused = reactive(False)
     disconnected = reactive(False)
@@ -571,6 +590,16 @@ class TUI(Screen[None]):
         """An action to switch to next thread."""
         self.thread_idx = (self.thread_idx + 1) % len(self.threads)
 
+    def action_previous_process(self) -> None:
+        """An action to switch to the previous tracked process."""
+        if self.processes:
+            self.process_idx = (self.process_idx - 1) % len(self.processes)
+
+    def action_next_process(self) -> None:
+        """An action to switch to the next tracked process."""
+        if self.processes:
+            self.process_idx = (self.process_idx + 1) % len(self.processes)
+
     def action_sort(self, col_number: int) -> None:
         """An action to sort the table rows based on a given column attribute."""
         self.update_sort_key(col_number)
@@ -604,6 +633,38 @@ class TUI(Screen[None]):
             f"[b]Thread[/] {self.thread_idx + 1} of {len(threads)}"
         )
 
+    def watch_process_idx(self, process_idx: int) -> None:
+        """Called when the process_idx attribute changes."""
+        if not self.processes:
+            return
+
+        # Threads and heap usage aren't shared between processes.
+        self._seen_threads = set()
+        self.thread_idx = 0
+        self.threads = self._DUMMY_THREAD_LIST
+        self.query_one(MemoryGraph).reset()
+        self.disconnected = False
+        self.update_pid_label()
+        self.post_message(ProcessSelected(self.processes[process_idx]))
+
+    def watch_processes(self, processes: List[Optional[int]]) -> None:
+        """Called when the processes attribute changes."""
+        if len(processes) < 2:
+            return
+        self.update_pid_label()
+        # Show the process switching keys once there's more than one process.
+        self.app.query_one(Footer).highlight_key = "n"
+        self.app.query_one(Footer).highlight_key = None
+
+    def update_pid_label(self) -> None:
+        if len(self.processes) < 2:
+            return
+        pid = self.processes[self.process_idx]
+        self.query_one("#pid", Label).update(
+            f"[b]PID[/]: {pid if pid is not None else '???'}"
+            f" (process {self.process_idx + 1} of {len(self.processes)})"
+        )
+
     def watch_disconnected(self) -> None:
         self.update_label()
         self.app.query_one(Footer).highlight_key = "space"
@@ -681,9 +742,15 @@ class TUI(Screen[None]):
 
 
 class UpdateThread(threading.Thread):
-    def __init__(self, app: App[None], reader: SocketReader) -> None:
+    def __init__(
+        self,
+        app: App[None],
+        reader: SocketReader,
+        processes: Optional[ProcessGroupReader] = None,
+    ) -> None:
         self._app = app
         self._reader = reader
+        self._processes = processes
         self._update_requested = threading.Event()
         self._update_requested.set()
         self._canceled = threading.Event()
@@ -694,26 +761,52 @@ class UpdateThread(threading.Thread):
             if self._canceled.is_set():
                 return
             self._update_requested.clear()
+            reader = self._reader
 
-            records = list(self._reader.get_current_snapshot(merge_threads=False))
-            heap_size = sum(record.size for record in records)
-            records_by_location = aggregate_allocations(
-                records, MAX_MEMORY_RATIO * heap_size, self._reader.has_native_traces
+            # The reader walks the stacks natively, which is much cheaper
+            # than calling aggregate_allocations() on every record.
+            records, locations = reader.get_current_snapshot_by_location(
+                memory_ratio=MAX_MEMORY_RATIO
             )
+            heap_size = sum(record.size for record in records)
+            records_by_location = {
+                Location(function=function, file=file): AllocationEntry(
+                    own_memory=own_memory,
+                    total_memory=total_memory,
+                    n_allocations=n_allocations,
+                    thread_ids=set(thread_ids),
+                )
+                for (
+                    function,
+                    file,
+                    own_memory,
+                    total_memory,
+                    n_allocations,
+                    thread_ids,
+                ) in locations
+            }
             snapshot = Snapshot(
                 heap_size=heap_size,
                 records=records,
                 records_by_location=records_by_location,
             )
 
+            if reader is not self._reader:
+                # Another process was selected while we were fetching this.
+                continue
+
             self._app.post_message(
                 SnapshotFetched(
                     snapshot,
-                    not self._reader.is_active,
+                    not reader.is_active,
                 )
             )
 
-            if not self._reader.is_active:
+            # Other processes may still be running after this one exits.
+            if self._processes is not None:
+                if not self._processes.is_active:
+                    return
+            elif not reader.is_active:
                 return
 
     def cancel(self) -> None:
@@ -723,6 +816,10 @@ class UpdateThread(threading.Thread):
     def schedule_update(self) -> None:
         self._update_requested.set()
 
+    def select_reader(self, reader: SocketReader) -> None:
+        self._reader = reader
+        self.schedule_update()
+
 
 class TUIApp(App[None]):
     """TUI main application class."""
@@ -731,14 +828,18 @@ class TUIApp(App[None]):
 
     def __init__(
         self,
-        reader: SocketReader,
+        reader: Union[SocketReader, ProcessGroupReader],
         cmdline_override: Optional[str] = None,
         poll_interval: float = 1.0,
     ) -> None:
+        self._processes: Optional[ProcessGroupReader] = None
+        if isinstance(reader, ProcessGroupReader):
+            self._processes = reader
+            reader = reader.readers[0]
         self._reader = reader
         self._poll_interval = poll_interval
         self._cmdline_override = cmdline_override
-        self._update_thread = UpdateThread(self, self._reader)
+        self._update_thread = UpdateThread(self, self._reader, self._processes)
         self.tui: Optional[TUI] = None
         super().__init__()
 
@@ -774,10 +875,23 @@ class TUIApp(App[None]):
         """Method called to process each fetched snapshot."""
         assert self.tui is not None
         with self.batch_update():
+            if self._processes is not None:
+                pids = [reader.pid for reader in self._processes.readers]
+                if pids != self.tui.processes:
+                    self.tui.processes = pids
             self.tui.snapshot = message.snapshot
         if message.disconnected:
             self.tui.disconnected = True
 
+    def on_process_selected(self, message: ProcessSelected) -> None:
+        """Method called when a different tracked process is selected."""
+        if self._processes is None:
+            return
+        for reader in self._processes.readers:
+            if reader.pid == message.pid:
+                self._update_thread.select_reader(reader)
+                return
+
     def on_resize(self, event: events.Resize) -> None:
         self.set_class(0 <= event.size.width < 81, "narrow")
 
@@ -799,4 +913,9 @@ class TUIApp(App[None]):
             elif self.tui.disconnected:
                 del bindings["space"]
 
+        if not self.tui or len(self.tui.processes) < 2:
+            for key in ("p", "n"):
+                if key in bindings and bindings[key][1].action.endswith("_process"):
+                    del bindings[key]
+
         return bindings
@@ -1,12 +1,16 @@
 """Tests for exercising the public API."""
 
+from concurrent.futures import ThreadPoolExecutor
+
 import pytest
 
+from memray import AllocatorType
 from memray import FileDestination
-from memray import FileFormat
 from memray import FileReader
 from memray import SocketDestination
 from memray import Tracker
+from memray._memray import compute_statistics
+from memray._memray import stack_traces
 from memray._test import MemoryAllocator
 from tests.utils import filter_relevant_allocations
 
@@ -60,6 +64,359 @@ def test_file_destination_str_path(tmp_path):
         assert len(vallocs_and_their_frees) == 2
 
 
+@pytest.mark.parametrize(
+    "compression, magic",
+    [
+        ("lz4", b"\x04\x22\x4d\x18"),
+        ("lz4:9", b"\x04\x22\x4d\x18"),
+        ("zstd", b"\x28\xb5\x2f\xfd"),
+        ("zstd:19", b"\x28\xb5\x2f\xfd"),
+    ],
+)
+def test_file_destination_compression(tmp_path, compression, magic):
+    # GIVEN
+    allocator = MemoryAllocator()
+    result_file = tmp_path / "test.bin"
+    # WHEN
+    with Tracker(destination=FileDestination(result_file, compression=compression)):
+        allocator.valloc(1234)
+        allocator.free()
+
+    # THEN
+    assert result_file.read_bytes()[: len(magic)] == magic
+    with FileReader(result_file) as reader:
+        all_allocations = reader.get_allocation_records()
+        vallocs_and_their_frees = list(filter_relevant_allocations(all_allocations))
+        assert len(vallocs_and_their_frees) == 2
+
+
+def test_file_destination_lz4_compression_spanning_multiple_frames(tmp_path):
+    # GIVEN
+    allocator = MemoryAllocator()
+    result_file = tmp_path / "test.bin"
+    # Long, unique function names make the capture span several LZ4 frames
+    functions = []
+    for i in range(1500):
+        namespace = {"allocator": allocator}
+        exec(
+            f"def func_{i}_{'x' * 4000}():\n"
+            "    allocator.valloc(1234)\n"
+            "    allocator.free()\n",
+            namespace,
+        )
+        functions.extend(v for k, v in namespace.items() if k.startswith("func_"))
+
+    # WHEN
+    with Tracker(destination=FileDestination(result_file, compression="lz4")):
+        for function in functions:
+            function()
+
+    # THEN
+    assert result_file.read_bytes().count(b"\x04\x22\x4d\x18") > 1
+    with FileReader(result_file) as reader:
+        all_allocations = reader.get_allocation_records()
+        vallocs_and_their_frees = list(filter_relevant_allocations(all_allocations))
+
+    assert len(vallocs_and_their_frees) == 3000
+    vallocs = vallocs_and_their_frees[::2]
+    for i, valloc in enumerate(vallocs):
+        _, (function, *_), *_ = valloc.stack_trace()
+        assert function.startswith(f"func_{i}_")
+
+
+def test_file_destination_zstd_compression_with_very_compressible_tail(tmp_path):
+    # GIVEN
+    allocator = MemoryAllocator()
+    result_file = tmp_path / "test.bin"
+    # A huge function name, recorded last, decompresses to far more than one
+    # output buffer from the last few bytes of the stream.
+    namespace = {"allocator": allocator}
+    exec(
+        f"def func_{'x' * 1_000_000}():\n"
+        "    allocator.valloc(1234)\n"
+        "    allocator.free()\n",
+        namespace,
+    )
+    (function,) = (v for k, v in namespace.items() if k.startswith("func_"))
+
+    # WHEN
+    with Tracker(destination=FileDestination(result_file, compression="zstd")):
+        function()
+
+    # THEN
+    with FileReader(result_file) as reader:
+        all_allocations = reader.get_allocation_records()
+        vallocs_and_their_frees = list(filter_relevant_allocations(all_allocations))
+
+    assert len(vallocs_and_their_frees) == 2
+    _, (function_name, *_), *_ = vallocs_and_their_frees[0].stack_trace()
+    assert function_name == function.__name__
+
+
+def _as_lz4_stream(data):
+    """Wrap ``data`` in a single LZ4 frame that doesn't record its content size.
+
+    This is how captures were compressed before memray wrote independent LZ4
+    frames. The blocks are stored uncompressed, which the format allows, so
+    that no LZ4 library is needed to write the frame.
+    """
+    # Independent blocks of up to 64 KiB, and the checksum of that descriptor
+    frame = bytearray(b"\x04\x22\x4d\x18\x60\x40\x82")
+    block_size = 64 * 1024
+    for start in range(0, len(data), block_size):
+        block = data[start : start + block_size]
+        frame += (len(block) | 0x80000000).to_bytes(4, "little")
+        frame += block
+    frame += bytes(4)  # The end mark
+    return bytes(frame)
+
+
+@pytest.mark.parametrize(
+    "compress_on_exit, compression",
+    [(False, "lz4"), (True, "lz4"), (True, "zstd"), (False, "lz4_stream")],
+)
+def test_file_reader_with_records_spanning_many_batches(
+    tmp_path, compress_on_exit, compression
+):
+    # GIVEN
+    allocator = MemoryAllocator()
+    result_file = tmp_path / "test.bin"
+    # Enough records to be decoded, and decompressed, several batches ahead
+    # of the ones being aggregated
+    n_allocations = 20_000
+
+    # WHEN
+    destination = FileDestination(
+        result_file,
+        compress_on_exit=compress_on_exit,
+        compression="lz4" if compression == "lz4_stream" else compression,
+    )
+    with Tracker(destination=destination):
+        for i in range(n_allocations):
+            allocator.valloc(1 + i)
+            if i % 2:
+                allocator.free()
+    if compression == "lz4_stream":
+        result_file.write_bytes(_as_lz4_stream(result_file.read_bytes()))
+
+    # THEN
+    with FileReader(result_file) as reader:
+        vallocs = [
+            record
+            for record in reader.get_leaked_allocation_records()
+            if record.allocator == AllocatorType.VALLOC
+        ]
+        n_records = reader.metadata.total_allocations
+    stats = compute_statistics(str(result_file))
+
+    (leaked,) = vallocs
+    assert leaked.n_allocations == n_allocations // 2
+    assert leaked.size == sum(range(1, n_allocations + 1, 2))
+    assert n_records >= n_allocations * 3 // 2
+    assert stats.total_num_allocations == n_allocations
+
+
+@pytest.mark.parametrize("native_traces", [False, True])
+def test_stack_traces_of_many_records(tmp_path, native_traces):
+    # GIVEN
+    allocator = MemoryAllocator()
+    result_file = tmp_path / "test.bin"
+
+    def recurse(depth):
+        if depth:
+            recurse(depth - 1)
+        else:
+            allocator.valloc(1024)
+            allocator.valloc(2048)
+
+    with Tracker(result_file, native_traces=native_traces):
+        for depth in range(10):
+            recurse(depth)
+            recurse(depth)
+
+    def vallocs():
+        return [
+            record
+            for record in FileReader(result_file).get_allocation_records()
+            if record.allocator == AllocatorType.VALLOC
+        ]
+
+    # WHEN
+    stacks = stack_traces(vallocs(), native_traces=native_traces)
+
+    # THEN
+    assert len(stacks) == 40
+    assert stacks == [
+        record.hybrid_stack_trace() if native_traces else record.stack_trace()
+        for record in vallocs()
+    ]
+
+
+@pytest.mark.parametrize(
+    "get_stack", ["stack_trace", "native_stack_trace", "hybrid_stack_trace"]
+)
+def test_stack_traces_can_be_read_from_several_threads(tmp_path, get_stack):
+    # GIVEN
+    allocator = MemoryAllocator()
+    result_file = tmp_path / "test.bin"
+
+    def recurse(depth):
+        if depth:
+            recurse(depth - 1)
+        else:
+            allocator.valloc(1024)
+
+    with Tracker(result_file, native_traces=get_stack != "stack_trace"):
+        for depth in range(50):
+            recurse(depth)
+
+    def vallocs():
+        # Once every record was read, the reader's state doesn't change
+        # anymore, and it's read without taking its lock.
+        return [
+            record
+            for record in FileReader(result_file).get_allocation_records()
+            if record.allocator == AllocatorType.VALLOC
+        ]
+
+    expected = [getattr(record, get_stack)() for record in vallocs()]
+
+    # WHEN
+    with ThreadPoolExecutor(max_workers=8) as executor:
+        stacks = list(
+            executor.map(lambda record: getattr(record, get_stack)(), vallocs())
+        )
+
+    # THEN
+    assert stacks == expected
+
+
+@pytest.mark.parametrize(
+    "get_stack", ["stack_trace", "native_stack_trace", "hybrid_stack_trace"]
+)
+def test_records_with_the_same_stack_get_their_own_lists(tmp_path, get_stack):
+    # GIVEN
+    allocator = MemoryAllocator()
+    result_file = tmp_path / "test.bin"
+    with Tracker(result_file, native_traces=get_stack != "stack_trace"):
+        for _ in range(2):
+            allocator.valloc(1024)
+
+    first, second = (
+        record
+        for record in FileReader(result_file).get_allocation_records()
+        if record.allocator == AllocatorType.VALLOC
+    )
+
+    # WHEN
+    first_stack = getattr(first, get_stack)()
+    second_stack = getattr(second, get_stack)()
+    expected = list(second_stack)
+    first_stack.clear()
+
+    # THEN
+    assert first.stack_id == second.stack_id
+    assert second_stack == expected
+    # A native frame may have been resolved to several inlined frames
+    limited = getattr(second, get_stack)(max_stacks=1)
+    assert limited and limited == expected[: len(limited)]
+
+
+@pytest.mark.parametrize("io_backend", ["mmap", "io_uring", "pwrite"])
+@pytest.mark.parametrize("compress_on_exit", [True, False])
+def test_file_destination_io_backend(tmp_path, io_backend, compress_on_exit):
+    # GIVEN
+    allocator = MemoryAllocator()
+    result_file = tmp_path / "test.bin"
+    # Long, unique function names make the capture bigger than the buffers
+    # used by the asynchronous backends
+    functions = []
+    for i in range(2500):
+        namespace = {"allocator": allocator}
+        exec(
+            f"def func_{i}_{'x' * 4000}():\n"
+            "    allocator.valloc(1234)\n"
+            "    allocator.free()\n",
+            namespace,
+        )
+        functions.extend(v for k, v in namespace.items() if k.startswith("func_"))
+    destination = FileDestination(
+        result_file, compress_on_exit=compress_on_exit, io_backend=io_backend
+    )
+
+    # WHEN
+    with Tracker(destination=destination):
+        for function in functions:
+            function()
+
+    # THEN
+    with FileReader(result_file) as reader:
+        all_allocations = reader.get_allocation_records()
+        vallocs_and_their_frees = list(filter_relevant_allocations(all_allocations))
+
+    assert len(vallocs_and_their_frees) == 5000
+    vallocs = vallocs_and_their_frees[::2]
+    for i, valloc in enumerate(vallocs):
+        _, (function, *_), *_ = valloc.stack_trace()
+        assert function.startswith(f"func_{i}_")
+
+
+def test_file_destination_rejects_invalid_io_backend(tmp_path):
+    with pytest.raises(ValueError, match="Unknown I/O backend"):
+        FileDestination(tmp_path / "test.bin", io_backend="aio")
+
+
+def test_file_destination_zstd_compression_with_dictionary(tmp_path):
+    # GIVEN
+    allocator = MemoryAllocator()
+    result_file = tmp_path / "test.bin"
+    dictionary = tmp_path / "memray.dict"
+    dictionary.write_bytes(b"valloc free test_api.py memray " * 64)
+    destination = FileDestination(
+        result_file, compression="zstd", compression_dictionary=dictionary
+    )
+    # WHEN
+    with Tracker(destination=destination):
+        allocator.valloc(1234)
+        allocator.free()
+
+    # THEN
+    assert result_file.read_bytes()[:4] == b"\x5d\x2a\x4d\x18"
+    with FileReader(result_file) as reader:
+        all_allocations = reader.get_allocation_records()
+        vallocs_and_their_frees = list(filter_relevant_allocations(all_allocations))
+        assert len(vallocs_and_their_frees) == 2
+
+
+def test_file_destination_with_missing_compression_dictionary(tmp_path):
+    # GIVEN
+    destination = FileDestination(
+        tmp_path / "test.bin",
+        compression="zstd",
+        compression_dictionary=tmp_path / "missing.dict",
+    )
+
+    # WHEN/THEN
+    with pytest.raises(OSError, match="Could not read compression dictionary"):
+        with Tracker(destination=destination):
+            pass
+
+
+def test_file_destination_rejects_invalid_compression(tmp_path):
+    with pytest.raises(ValueError, match="Unknown compression codec"):
+        FileDestination(tmp_path / "test.bin", compression="gzip")
+
+
+def test_socket_destination_rejects_invalid_backpressure_policy():
+    with pytest.raises(ValueError, match="Unknown backpressure policy"):
+        SocketDestination(server_port=1234, backpressure="spill")
+
+
+def test_socket_destination_rejects_invalid_buffer_size():
+    with pytest.raises(ValueError, match="buffer size must be a positive"):
+        SocketDestination(server_port=1234, buffer_size=0)
+
+
 def test_combine_destination_args():
     """Combining `writer` and `file_name` arguments in the `Tracker` should
     raise an exception."""
@@ -93,15 +450,3 @@ def test_follow_fork_with_socket_destination():
             destination=SocketDestination(server_port=1234), follow_fork=True
         ):  # pragma: no cover
             pass
-
-
-def test_aggregated_capture_with_socket_destination():
-    # GIVEN
-    with pytest.raises(
-        RuntimeError, match="AGGREGATED_ALLOCATIONS requires an output file"
-    ):
-        with Tracker(
-            destination=SocketDestination(server_port=1234),
-            file_format=FileFormat.AGGREGATED_ALLOCATIONS,
-        ):  # pragma: no cover
-            pass
@@ -473,6 +473,7 @@ class TestParseSubcommand:
         record_types = [
             "ALLOCATION",
             "ALLOCATION_WITH_NATIVE",
+            "ALLOCATION_RUN",
             "MEMORY_MAP_START",
             "SEGMENT_HEADER",
             "SEGMENT",
@@ -480,6 +481,7 @@ class TestParseSubcommand:
             "FRAME_PUSH",
             "FRAME_POP",
             "FRAME_ID",
+            "STRING_ID",
             "MEMORY_RECORD",
             "CONTEXT_SWITCH",
             "TRAILER",
@@ -492,8 +494,9 @@ class TestParseSubcommand:
             from memray._test import MemoryAllocator
             print("Allocating some memory!")
             allocator = MemoryAllocator()
-            allocator.valloc(1024)
-            allocator.free()
+            for _ in range(10):
+                allocator.valloc(1024)
+                allocator.free()
             # Give it time to generate some memory records
             time.sleep(0.1)
             """
@@ -761,6 +764,57 @@ class TestFlamegraphSubCommand:
         assert output_file.exists()
         assert str(source_file) in output_file.read_text()
 
+    def test_prune_threshold(self, tmp_path, simple_test_file):
+        # GIVEN
+        results_file, source_file = generate_sample_results(tmp_path, simple_test_file)
+        output_file = tmp_path / "output.html"
+
+        # WHEN
+        subprocess.run(
+            [
+                sys.executable,
+                "-m",
+                "memray",
+                "flamegraph",
+                "--prune-threshold",
+                "0.01",
+                str(results_file),
+                "--output",
+                str(output_file),
+            ],
+            check=True,
+            capture_output=True,
+            text=True,
+        )
+
+        # THEN
+        assert output_file.exists()
+        assert str(source_file) in output_file.read_text()
+
+    @pytest.mark.parametrize("threshold", ["-0.5", "1"])
+    def test_invalid_prune_threshold(self, tmp_path, simple_test_file, threshold):
+        # GIVEN
+        results_file, _ = generate_sample_results(tmp_path, simple_test_file)
+
+        # WHEN
+        proc = subprocess.run(
+            [
+                sys.executable,
+                "-m",
+                "memray",
+                "flamegraph",
+                "--prune-threshold",
+                threshold,
+                str(results_file),
+            ],
+            capture_output=True,
+            text=True,
+        )
+
+        # THEN
+        assert proc.returncode == 2
+        assert "The --prune-threshold argument must be in [0, 1)" in proc.stderr
+
     @pytest.mark.parametrize("trace_python_allocators", [True, False])
     @pytest.mark.parametrize("disable_pymalloc", [True, False])
     def test_leaks_with_pymalloc_warning(
@@ -1118,6 +1172,128 @@ class TestTableSubCommand:
             )
 
 
+class TestReportSubCommand:
+    def test_writes_every_report(self, tmp_path, simple_test_file):
+        # GIVEN
+        results_file, source_file = generate_sample_results(
+            tmp_path, simple_test_file, native=True
+        )
+        subprocess.run(
+            [sys.executable, "-m", "memray", "stats", "--json", str(results_file)],
+            cwd=str(tmp_path),
+            check=True,
+            capture_output=True,
+        )
+        stats_file = tmp_path / "memray-stats-result.bin.json"
+        expected_stats = json.loads(stats_file.read_text())
+        stats_file.unlink()
+
+        # WHEN
+        proc = subprocess.run(
+            [
+                sys.executable,
+                "-m",
+                "memray",
+                "report",
+                "-r",
+                "flamegraph",
+                "-r",
+                "table:leaks",
+                "-r",
+                "stats",
+                str(results_file),
+            ],
+            cwd=str(tmp_path),
+            check=True,
+            capture_output=True,
+            text=True,
+        )
+
+        # THEN
+        flamegraph_file = tmp_path / "memray-flamegraph-result.html"
+        leaks_file = tmp_path / "memray-table-leaks-result.html"
+        assert flamegraph_file.exists()
+        assert str(source_file) in flamegraph_file.read_text()
+        assert leaks_file.exists()
+        assert json.loads(stats_file.read_text()) == expected_stats
+        for output_file in (flamegraph_file, leaks_file, stats_file):
+            assert f"Wrote {output_file}" in proc.stdout
+
+    def test_writes_to_output_dir(self, tmp_path, simple_test_file):
+        # GIVEN
+        results_file, _ = generate_sample_results(tmp_path, simple_test_file)
+        output_dir = tmp_path / "reports"
+        output_dir.mkdir()
+
+        # WHEN
+        subprocess.run(
+            [
+                sys.executable,
+                "-m",
+                "memray",
+                "report",
+                "-r",
+                "table",
+                "-d",
+                str(output_dir),
+                str(results_file),
+            ],
+            cwd=str(tmp_path),
+            check=True,
+            capture_output=True,
+        )
+
+        # THEN
+        assert (output_dir / "memray-table-result.html").exists()
+
+    def test_does_not_overwrite_existing_reports(self, tmp_path, simple_test_file):
+        # GIVEN
+        results_file, _ = generate_sample_results(tmp_path, simple_test_file)
+        existing = tmp_path / "memray-flamegraph-leaks-result.html"
+        existing.write_text("original")
+
+        # WHEN
+        proc = subprocess.run(
+            [
+                sys.executable,
+                "-m",
+                "memray",
+                "report",
+                "-r",
+                "table",
+                "-r",
+                "flamegraph:leaks",
+                str(results_file),
+            ],
+            cwd=str(tmp_path),
+            capture_output=True,
+            text=True,
+        )
+
+        # THEN
+        assert proc.returncode == 1
+        assert "File already exists, will not overwrite" in proc.stderr
+        assert existing.read_text() == "original"
+        assert not (tmp_path / "memray-table-result.html").exists()
+
+    @pytest.mark.parametrize("reporter", ["stats:leaks", "tree", "table:peak"])
+    def test_invalid_reporter(self, tmp_path, simple_test_file, reporter):
+        # GIVEN
+        results_file, _ = generate_sample_results(tmp_path, simple_test_file)
+
+        # WHEN
+        proc = subprocess.run(
+            [sys.executable, "-m", "memray", "report", "-r", reporter, results_file],
+            cwd=str(tmp_path),
+            capture_output=True,
+            text=True,
+        )
+
+        # THEN
+        assert proc.returncode == 2
+        assert "argument -r/--reporter" in proc.stderr
+
+
 class TestReporterSubCommands:
     @pytest.mark.parametrize(
         "report", ["flamegraph", "table", "summary", "tree", "stats"]
@@ -6,6 +6,7 @@ from pathlib import Path
 import pytest
 
 from memray import AllocatorType
+from memray import FileDestination
 from memray import FileReader
 from memray import Tracker
 from memray._test import MemoryAllocator
@@ -75,13 +76,15 @@ def test_allocations_with_multiprocessing(tmpdir):
 
 
 @pytest.mark.no_cover
-def test_allocations_with_multiprocessing_following_fork(tmpdir):
+@pytest.mark.parametrize("io_backend", ["mmap", "io_uring", "pwrite"])
+def test_allocations_with_multiprocessing_following_fork(tmpdir, io_backend):
     # GIVEN
     output = Path(tmpdir) / "test.bin"
+    destination = FileDestination(output, io_backend=io_backend)
     allocator = MemoryAllocator()
 
     # WHEN
-    with Tracker(output, follow_fork=True):
+    with Tracker(destination=destination, follow_fork=True):
         with Pool(3) as p:
             p.map(multiproc_func, [1, 10, 100, 1000, 2000, 3000, 4000, 5000])
 
@@ -1,6 +1,8 @@
 """Tests to exercise socket-based read and write operations in the Tracker."""
 
 import os
+import select
+import socket
 import subprocess
 import sys
 import textwrap
@@ -8,13 +10,27 @@ import time
 from contextlib import contextmanager
 from pathlib import Path
 from typing import Iterator
+from typing import Sequence
 from typing import Set
 from typing import Tuple
+from typing import Union
 
 import pytest
 
 from memray import AllocatorType
+from memray import FileFollower
+from memray import FileReader
+from memray import LiveBroker
+from memray import ProcessGroupReader
+from memray import SharedMemoryDestination
+from memray import SharedMemoryReader
+from memray import SocketDestination
 from memray import SocketReader
+from memray import Tracker
+from memray._memray import compute_statistics
+from memray._test import MemoryAllocator
+from memray.reporters.tui import Location
+from memray.reporters.tui import aggregate_allocations
 from tests.utils import filter_relevant_allocations
 
 TIMEOUT = 5
@@ -84,14 +100,82 @@ ALLOCATE_MANY_THEN_SNAPSHOT_THEN_FREE_MANY = textwrap.dedent(
     """
 )
 
+RECURSIVELY_ALLOCATE_THEN_SNAPSHOT = textwrap.dedent(
+    f"""
+        def recurse(allocators, depth):
+            if depth == 0:
+                for allocator in allocators:
+                    allocator.valloc({ALLOCATION_SIZE})
+                return
+            recurse(allocators, depth - 1)
+
+        allocators = [MemoryAllocator() for _ in range({MULTI_ALLOCATION_COUNT})]
+        destination = SocketDestination(server_port=port)
+        with Tracker(destination=destination, native_traces={{native_traces}}):
+            recurse(allocators, 5)
+            snapshot_point()
+            for allocator in allocators:
+                allocator.free()
+    """
+)
+
+AGGREGATE_ALLOCATE_MANY_FREE_SOME_THEN_SNAPSHOT = textwrap.dedent(
+    f"""
+        import time
+        from memray import FileFormat
+
+        allocators = [MemoryAllocator() for _ in range({MULTI_ALLOCATION_COUNT})]
+        with Tracker(
+            destination=SocketDestination(server_port=port),
+            native_traces={{native_traces}},
+            file_format=FileFormat.AGGREGATED_ALLOCATIONS,
+        ):
+            for allocator in allocators:
+                allocator.valloc({ALLOCATION_SIZE})
+            # Let a delta for the allocations be sent before freeing some.
+            time.sleep(0.1)
+            for allocator in allocators[::2]:
+                allocator.free()
+            snapshot_point()
+            for allocator in allocators[1::2]:
+                allocator.free()
+    """
+)
+
+FORK_THEN_ALLOCATE_IN_BOTH_THEN_SNAPSHOT = textwrap.dedent(
+    f"""
+        import os
+
+        children_port = int(sys.argv[4])
+        allocator = MemoryAllocator()
+
+        with Tracker(
+            destination=SocketDestination(
+                server_port=port, children_port=children_port
+            ),
+            follow_fork=True,
+        ):
+            allocator.valloc({ALLOCATION_SIZE})
+            pid = os.fork()
+            if pid == 0:
+                child_allocator = MemoryAllocator()
+                child_allocator.valloc({ALLOCATION_SIZE * 2})
+                snapshot_point()
+                os._exit(0)
+            assert os.waitpid(pid, 0)[1] == 0
+            allocator.free()
+    """
+)
+
 
 @contextmanager
 def run_till_snapshot_point(
     program: str,
     *,
-    reader: SocketReader,
+    reader: Union[SocketReader, ProcessGroupReader],
     tmp_path: Path,
     free_port: int,
+    extra_args: Sequence[str] = (),
 ) -> Iterator[None]:
     allocations_made = tmp_path / "allocations_made.event"
     snapshot_taken = tmp_path / "snapshot_taken.event"
@@ -110,6 +194,7 @@ def run_till_snapshot_point(
             str(free_port),
             allocations_made,
             snapshot_taken,
+            *extra_args,
         ],
         env=env,
     )
@@ -308,6 +393,83 @@ class TestSocketReaderAccess:
         assert filename.endswith("/_test.py")
         assert 0 < lineno < 200
 
+    @pytest.mark.parametrize("native_traces", [False, True])
+    def test_snapshot_by_location_matches_aggregate_allocations(
+        self, native_traces: bool, free_port: int, tmp_path: Path
+    ) -> None:
+        # GIVEN
+        reader = SocketReader(port=free_port)
+        program = RECURSIVELY_ALLOCATE_THEN_SNAPSHOT.format(native_traces=native_traces)
+
+        # WHEN
+        with run_till_snapshot_point(
+            program,
+            reader=reader,
+            tmp_path=tmp_path,
+            free_port=free_port,
+        ):
+            # Resolving native stacks can make records trail behind the
+            # tracked process, so wait until all of the allocations arrive.
+            deadline = time.monotonic() + TIMEOUT
+            while True:
+                records, locations = reader.get_current_snapshot_by_location()
+                recurse_total = sum(
+                    total
+                    for function, _, _, total, _, _ in locations
+                    if function == "recurse"
+                )
+                expected_total = ALLOCATION_SIZE * MULTI_ALLOCATION_COUNT
+                if recurse_total >= expected_total or time.monotonic() > deadline:
+                    break
+                time.sleep(0.1)
+
+        # THEN
+        by_location = {
+            Location(function=function, file=file): (own, total, count, set(tids))
+            for function, file, own, total, count, tids in locations
+        }
+        assert by_location == {
+            location: (
+                entry.own_memory,
+                entry.total_memory,
+                entry.n_allocations,
+                entry.thread_ids,
+            )
+            for location, entry in aggregate_allocations(
+                records, native_traces=native_traces
+            ).items()
+        }
+
+        (recurse,) = [
+            value for key, value in by_location.items() if key.function == "recurse"
+        ]
+        own, total, count, _ = recurse
+        assert own == 0
+        assert ALLOCATION_SIZE * MULTI_ALLOCATION_COUNT <= total
+        assert total < 2 * ALLOCATION_SIZE * MULTI_ALLOCATION_COUNT
+
+    def test_snapshot_by_location_stops_at_memory_ratio(
+        self, free_port: int, tmp_path: Path
+    ) -> None:
+        # GIVEN
+        reader = SocketReader(port=free_port)
+        program = RECURSIVELY_ALLOCATE_THEN_SNAPSHOT.format(native_traces=False)
+
+        # WHEN
+        with run_till_snapshot_point(
+            program,
+            reader=reader,
+            tmp_path=tmp_path,
+            free_port=free_port,
+        ):
+            records, locations = reader.get_current_snapshot_by_location(
+                memory_ratio=0.0
+            )
+
+        # THEN
+        assert records
+        assert locations == []
+
     @pytest.mark.valgrind
     def test_multiple_context_entries_does_not_crash(
         self, free_port: int, tmp_path: Path
@@ -420,3 +582,595 @@ class TestSocketReaderAccess:
         # THEN
         assert len(traces) >= MAX_TRACES
         proc.returncode == 0
+
+
+_SLOW_CLIENT_SCRIPT = """
+import sys
+from memray import SocketDestination
+from memray import Tracker
+
+port, policy = int(sys.argv[1]), sys.argv[2]
+free = sys.argv[3:] == ["free"]
+
+
+def allocate_strings():
+    return [str(i) for i in range(400_000)]
+
+
+destination = SocketDestination(
+    server_port=port, backpressure=policy, buffer_size=64 * 1024
+)
+with Tracker(destination=destination, trace_python_allocators=True):
+    data = allocate_strings()
+    if free:
+        del data
+    print("done", flush=True)
+    sys.stdin.readline()
+"""
+
+
+def read_from_slow_client(
+    port: int, policy: str, output: Path, free: bool = False
+) -> None:
+    """Run a tracked process whose client doesn't read until it finishes.
+
+    The received stream is stored in ``output`` so it can be read back with
+    a ``FileReader``. If ``free`` is set, the tracked process frees what it
+    allocated before finishing.
+    """
+    extra_args = ["free"] if free else []
+    with subprocess.Popen(
+        [sys.executable, "-c", _SLOW_CLIENT_SCRIPT, str(port), policy, *extra_args],
+        stdin=subprocess.PIPE,
+        stdout=subprocess.PIPE,
+        text=True,
+    ) as proc:
+        client = socket.socket()
+        client.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+        deadline = time.time() + TIMEOUT
+        while True:
+            try:
+                client.connect(("127.0.0.1", port))
+                break
+            except ConnectionRefusedError:
+                if time.time() > deadline:
+                    raise
+                time.sleep(0.1)
+
+        with client:
+            # The tracked process must be able to finish without us reading
+            ready, _, _ = select.select([proc.stdout], [], [], 60)
+            assert ready, "The tracked process blocked on the slow client"
+            assert proc.stdout.readline().strip() == "done"
+            proc.stdin.write("\n")
+            proc.stdin.flush()
+
+            with output.open("wb") as stream:
+                while True:
+                    chunk = client.recv(1 << 20)
+                    if not chunk:
+                        break
+                    stream.write(chunk)
+
+    assert proc.returncode == 0
+
+
+class TestAggregatedLiveStream:
+    @pytest.mark.parametrize("native_traces", [False, True])
+    def test_snapshot_has_net_totals_per_location(
+        self, native_traces: bool, free_port: int, tmp_path: Path
+    ) -> None:
+        # GIVEN
+        reader = SocketReader(port=free_port)
+        program = AGGREGATE_ALLOCATE_MANY_FREE_SOME_THEN_SNAPSHOT.format(
+            native_traces=native_traces
+        )
+        expected_count = MULTI_ALLOCATION_COUNT // 2
+
+        # WHEN
+        with run_till_snapshot_point(
+            program,
+            reader=reader,
+            tmp_path=tmp_path,
+            free_port=free_port,
+        ):
+            # Deltas are sent periodically, so wait for the frees to arrive.
+            deadline = time.monotonic() + TIMEOUT
+            while True:
+                snapshot = list(
+                    filter_relevant_allocations(
+                        reader.get_current_snapshot(merge_threads=False)
+                    )
+                )
+                if (
+                    len(snapshot) == 1
+                    and snapshot[0].n_allocations == expected_count
+                    or time.monotonic() > deadline
+                ):
+                    break
+                time.sleep(0.1)
+
+        # THEN
+        assert len(snapshot) == 1
+        (allocation,) = snapshot
+        assert allocation.address == 0
+        assert allocation.allocator == AllocatorType.VALLOC
+        assert allocation.n_allocations == expected_count
+        assert allocation.size == ALLOCATION_SIZE * expected_count
+
+        symbol, filename, _ = allocation.stack_trace()[0]
+        assert symbol == "valloc"
+        assert filename.endswith("/_test.py")
+        if native_traces:
+            assert any(
+                "valloc" in function for function, *_ in allocation.hybrid_stack_trace()
+            )
+
+
+class TestProcessGroupReader:
+    def test_forked_process_is_read_separately(
+        self, free_port: int, tmp_path: Path
+    ) -> None:
+        # GIVEN
+        reader = ProcessGroupReader(SocketReader(port=free_port))
+
+        # WHEN
+        with run_till_snapshot_point(
+            FORK_THEN_ALLOCATE_IN_BOTH_THEN_SNAPSHOT,
+            reader=reader,
+            tmp_path=tmp_path,
+            free_port=free_port,
+            extra_args=[str(reader.children_port)],
+        ):
+            # The forked process sends its records over its own connection.
+            deadline = time.monotonic() + TIMEOUT
+            while True:
+                readers = reader.readers
+                snapshots = [
+                    list(
+                        filter_relevant_allocations(
+                            process.get_current_snapshot(merge_threads=False)
+                        )
+                    )
+                    for process in readers
+                ]
+                if len(snapshots) == 2 and snapshots[1] or time.monotonic() > deadline:
+                    break
+                time.sleep(0.1)
+            assert reader.is_active
+
+        # THEN
+        assert len(readers) == 2
+        parent, child = readers
+        assert parent.pid is not None
+        assert child.pid is not None
+        assert parent.pid != child.pid
+        assert [record.size for record in snapshots[0]] == [ALLOCATION_SIZE]
+        assert [record.size for record in snapshots[1]] == [ALLOCATION_SIZE * 2]
+
+        symbol, filename, _ = snapshots[1][0].stack_trace()[0]
+        assert symbol == "valloc"
+        assert filename.endswith("/_test.py")
+
+    def test_silent_connection_does_not_block_forked_process(
+        self, free_port: int, tmp_path: Path
+    ) -> None:
+        # GIVEN
+        reader = ProcessGroupReader(SocketReader(port=free_port))
+        silent = socket.create_connection(("127.0.0.1", reader.children_port))
+
+        # WHEN
+        with silent, run_till_snapshot_point(
+            FORK_THEN_ALLOCATE_IN_BOTH_THEN_SNAPSHOT,
+            reader=reader,
+            tmp_path=tmp_path,
+            free_port=free_port,
+            extra_args=[str(reader.children_port)],
+        ):
+            deadline = time.monotonic() + TIMEOUT
+            while len(reader.readers) < 2 and time.monotonic() < deadline:
+                time.sleep(0.1)
+            readers = reader.readers
+
+        # THEN
+        assert len(readers) == 2
+        assert readers[0].pid != readers[1].pid
+
+    def test_children_port_is_required_to_follow_forks(self, free_port: int) -> None:
+        # GIVEN
+        destination = SocketDestination(server_port=free_port)
+
+        # WHEN/THEN
+        with pytest.raises(RuntimeError, match="with a children_port"):
+            Tracker(destination=destination, follow_fork=True)
+
+
+class TestSocketBackpressure:
+    def test_drop_policy_records_gaps(self, free_port: int, tmp_path: Path) -> None:
+        # GIVEN
+        output = tmp_path / "stream.bin"
+
+        # WHEN
+        read_from_slow_client(free_port, "drop", output)
+
+        # THEN
+        records = [
+            record
+            for record in FileReader(output).get_allocation_records()
+            if record.allocator == AllocatorType.PYMALLOC_MALLOC
+        ]
+        assert records
+        assert all(record.address != 0 for record in records)
+
+        parsed = subprocess.run(
+            [sys.executable, "-m", "memray", "parse", str(output)],
+            check=True,
+            capture_output=True,
+            text=True,
+        )
+        dropped = [
+            int(line.rpartition("=")[2])
+            for line in parsed.stdout.splitlines()
+            if line.startswith("ALLOCATION_GAP ")
+        ]
+        assert dropped
+        assert all(count > 0 for count in dropped)
+
+    def test_aggregate_policy_summarizes_by_location(
+        self, free_port: int, tmp_path: Path
+    ) -> None:
+        # GIVEN
+        output = tmp_path / "stream.bin"
+
+        # WHEN
+        read_from_slow_client(free_port, "aggregate", output)
+
+        # THEN
+        summaries = [
+            record
+            for record in FileReader(output).get_allocation_records()
+            if record.address == 0
+        ]
+        assert summaries
+        assert all(record.n_allocations >= 1 for record in summaries)
+        assert any(record.n_allocations > 1 for record in summaries)
+        assert any(
+            frame[0] == "allocate_strings"
+            for record in summaries
+            for frame in record.stack_trace()
+        )
+
+    def test_aggregate_policy_subtracts_freed_summaries(
+        self, free_port: int, tmp_path: Path
+    ) -> None:
+        # GIVEN
+        output = tmp_path / "stream.bin"
+
+        # WHEN
+        read_from_slow_client(free_port, "aggregate", output, free=True)
+
+        # THEN
+        reader = FileReader(output)
+        assert any(record.address == 0 for record in reader.get_allocation_records())
+        remaining = [
+            record
+            for record in reader.get_leaked_allocation_records(merge_threads=False)
+            if record.address == 0
+            and any(frame[0] == "allocate_strings" for frame in record.stack_trace())
+        ]
+        assert remaining == []
+
+
+@pytest.mark.skipif(
+    not sys.platform.startswith("linux"),
+    reason="shared memory rings are only supported on Linux",
+)
+class TestSharedMemoryReader:
+    def test_reads_allocations_from_tracked_process(self, tmp_path: Path) -> None:
+        # GIVEN
+        reader = SharedMemoryReader(buffer_size=64 * 1024)
+        program = textwrap.dedent(
+            f"""
+            from memray import SharedMemoryDestination
+            from memray import Tracker
+            from memray._test import MemoryAllocator
+
+            allocator = MemoryAllocator()
+            with Tracker(destination=SharedMemoryDestination({reader.path!r})):
+                allocator.valloc({ALLOCATION_SIZE})
+                # More records than fit in the ring at once
+                data = [str(i) for i in range(100_000)]
+                del data
+                print("allocated", flush=True)
+                input()
+            """
+        )
+
+        # WHEN
+        with subprocess.Popen(
+            [sys.executable, "-c", program],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            text=True,
+        ) as proc, reader:
+            assert proc.stdout.readline().strip() == "allocated"
+            deadline = time.time() + TIMEOUT
+            snapshot = []
+            while not snapshot and time.time() < deadline:
+                snapshot = [
+                    record
+                    for record in reader.get_current_snapshot(merge_threads=False)
+                    if record.allocator == AllocatorType.VALLOC
+                ]
+                time.sleep(0.1)
+            assert reader.pid == proc.pid
+            proc.stdin.write("\n")
+            proc.stdin.flush()
+
+            while reader.is_active and time.time() < deadline:
+                time.sleep(0.1)
+
+        # THEN
+        assert proc.returncode == 0
+        assert not reader.is_active
+        assert len(snapshot) == 1
+        assert snapshot[0].size == ALLOCATION_SIZE
+
+    def test_ring_cannot_have_two_writers(self) -> None:
+        # GIVEN
+        reader = SharedMemoryReader()
+        program = textwrap.dedent(
+            f"""
+            from memray import SharedMemoryDestination
+            from memray import Tracker
+
+            with Tracker(destination=SharedMemoryDestination({reader.path!r})):
+                try:
+                    Tracker(destination=SharedMemoryDestination({reader.path!r}))
+                except OSError as exc:
+                    print(exc)
+            """
+        )
+
+        # WHEN
+        with subprocess.Popen(
+            [sys.executable, "-c", program], stdout=subprocess.PIPE, text=True
+        ) as proc, reader:
+            output, _ = proc.communicate(timeout=TIMEOUT)
+
+        # THEN
+        assert proc.returncode == 0
+        assert "is already in use" in output
+
+    def test_invalid_ring_path(self, tmp_path: Path) -> None:
+        # GIVEN
+        not_a_ring = tmp_path / "not_a_ring"
+        not_a_ring.write_bytes(b"\0" * 4096)
+
+        # WHEN/THEN
+        with pytest.raises(OSError, match="Invalid shared memory ring"):
+            Tracker(destination=SharedMemoryDestination(str(not_a_ring)))
+
+
+class TestFileFollower:
+    def test_reads_allocations_while_file_is_written(self, tmp_path: Path) -> None:
+        # GIVEN
+        output = tmp_path / "test.bin"
+        program = textwrap.dedent(
+            f"""
+            from memray import Tracker
+            from memray._test import MemoryAllocator
+
+            allocator = MemoryAllocator()
+            with Tracker({str(output)!r}):
+                allocator.valloc({ALLOCATION_SIZE})
+                print("allocated", flush=True)
+                input()
+                allocator.free()
+            """
+        )
+
+        # WHEN
+        with subprocess.Popen(
+            [sys.executable, "-c", program],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            text=True,
+        ) as proc:
+            assert proc.stdout.readline().strip() == "allocated"
+            with FileFollower(output) as follower:
+                deadline = time.time() + TIMEOUT
+                snapshot = []
+                while not snapshot and time.time() < deadline:
+                    snapshot = [
+                        record
+                        for record in follower.get_current_snapshot(merge_threads=False)
+                        if record.allocator == AllocatorType.VALLOC
+                    ]
+                    time.sleep(0.1)
+                stats_while_running = follower.get_current_statistics()
+                was_active = follower.is_active
+
+                proc.stdin.write("\n")
+                proc.stdin.flush()
+                while follower.is_active and time.time() < deadline:
+                    time.sleep(0.1)
+                final_snapshot = [
+                    record
+                    for record in follower.get_current_snapshot(merge_threads=False)
+                    if record.allocator == AllocatorType.VALLOC
+                ]
+                final_stats = follower.get_current_statistics()
+                is_active = follower.is_active
+
+        # THEN
+        assert proc.returncode == 0
+        assert was_active
+        assert len(snapshot) == 1
+        assert snapshot[0].size == ALLOCATION_SIZE
+        assert stats_while_running.peak_memory_allocated >= ALLOCATION_SIZE
+        assert stats_while_running.allocation_count_by_allocator["VALLOC"] == 1
+
+        assert not is_active
+        assert final_snapshot == []
+        assert final_stats.peak_memory_allocated >= ALLOCATION_SIZE
+        assert final_stats.metadata.pid == proc.pid
+
+    def test_complete_file_matches_computed_statistics(self, tmp_path: Path) -> None:
+        # GIVEN
+        output = tmp_path / "test.bin"
+        allocator = MemoryAllocator()
+        with Tracker(output):
+            allocator.valloc(ALLOCATION_SIZE)
+            allocator.valloc(ALLOCATION_SIZE * 2)
+            allocator.free()
+        expected_stats = compute_statistics(str(output))
+
+        # WHEN
+        with FileFollower(output) as follower:
+            deadline = time.time() + TIMEOUT
+            while follower.is_active and time.time() < deadline:
+                time.sleep(0.1)
+            stats = follower.get_current_statistics()
+
+        # THEN
+        assert not follower.is_active
+        assert stats.total_num_allocations == expected_stats.total_num_allocations
+        assert stats.total_memory_allocated == expected_stats.total_memory_allocated
+        assert stats.peak_memory_allocated == expected_stats.peak_memory_allocated
+        assert stats.allocation_count_by_size == expected_stats.allocation_count_by_size
+        assert stats.top_locations_by_size == expected_stats.top_locations_by_size
+
+    def test_missing_file(self, tmp_path: Path) -> None:
+        # WHEN/THEN
+        with pytest.raises(OSError, match="No such file"):
+            FileFollower(tmp_path / "missing.bin")
+
+
+class TestLiveBroker:
+    @staticmethod
+    def _valloc_snapshot(reader: SocketReader) -> list:
+        deadline = time.time() + TIMEOUT
+        snapshot = []
+        while not snapshot and time.time() < deadline:
+            snapshot = [
+                record
+                for record in reader.get_current_snapshot(merge_threads=False)
+                if record.allocator == AllocatorType.VALLOC
+            ]
+            time.sleep(0.1)
+        return snapshot
+
+    @staticmethod
+    def _wait_until_inactive(reader: Union[SocketReader, LiveBroker]) -> None:
+        deadline = time.time() + TIMEOUT
+        while reader.is_active and time.time() < deadline:
+            time.sleep(0.1)
+
+    def test_clients_share_one_tracked_process(
+        self, free_port: int, tmp_path: Path
+    ) -> None:
+        # GIVEN
+        program = textwrap.dedent(
+            f"""
+            from memray import SocketDestination
+            from memray import Tracker
+            from memray._test import MemoryAllocator
+
+            allocator = MemoryAllocator()
+            with Tracker(destination=SocketDestination(server_port={free_port})):
+                allocator.valloc({ALLOCATION_SIZE})
+                print("allocated", flush=True)
+                input()
+                allocator.free()
+            """
+        )
+        broker = LiveBroker(SocketReader(port=free_port))
+
+        # WHEN
+        with subprocess.Popen(
+            [sys.executable, "-c", program],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            text=True,
+        ) as proc, broker:
+            assert proc.stdout.readline().strip() == "allocated"
+            first = SocketReader(port=broker.port)
+            late = SocketReader(port=broker.port)
+            with first:
+                first_snapshot = self._valloc_snapshot(first)
+                with late:
+                    late_snapshot = self._valloc_snapshot(late)
+                    client_count = broker.client_count
+                    pid = late.pid
+
+                    proc.stdin.write("\n")
+                    proc.stdin.flush()
+                    self._wait_until_inactive(broker)
+                    self._wait_until_inactive(first)
+                    self._wait_until_inactive(late)
+                    final_snapshots = [
+                        list(reader.get_current_snapshot(merge_threads=False))
+                        for reader in (first, late)
+                    ]
+                    still_active = [first.is_active, late.is_active]
+
+        # THEN
+        assert proc.returncode == 0
+        assert client_count == 2
+        assert pid == proc.pid
+        for snapshot in (first_snapshot, late_snapshot):
+            assert len(snapshot) == 1
+            assert snapshot[0].size == ALLOCATION_SIZE
+            assert snapshot[0].stack_trace()[0][0] == "valloc"
+        assert not broker.is_active
+        assert still_active == [False, False]
+        assert all(
+            record.allocator != AllocatorType.VALLOC
+            for snapshot in final_snapshots
+            for record in snapshot
+        )
+
+    def test_client_can_reconnect(self, free_port: int, tmp_path: Path) -> None:
+        # GIVEN
+        program = textwrap.dedent(
+            f"""
+            from memray import SocketDestination
+            from memray import Tracker
+            from memray._test import MemoryAllocator
+
+            allocator = MemoryAllocator()
+            with Tracker(destination=SocketDestination(server_port={free_port})):
+                allocator.valloc({ALLOCATION_SIZE})
+                print("allocated", flush=True)
+                input()
+            """
+        )
+        broker = LiveBroker(SocketReader(port=free_port))
+
+        # WHEN
+        with subprocess.Popen(
+            [sys.executable, "-c", program],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            text=True,
+        ) as proc, broker:
+            assert proc.stdout.readline().strip() == "allocated"
+            with SocketReader(port=broker.port) as client:
+                before = self._valloc_snapshot(client)
+            deadline = time.time() + TIMEOUT
+            while broker.client_count and time.time() < deadline:
+                time.sleep(0.1)
+            count_after_disconnect = broker.client_count
+            with SocketReader(port=broker.port) as client:
+                after = self._valloc_snapshot(client)
+            proc.stdin.write("\n")
+            proc.stdin.flush()
+            self._wait_until_inactive(broker)
+
+        # THEN
+        assert proc.returncode == 0
+        assert count_after_disconnect == 0
+        assert [record.size for record in before] == [ALLOCATION_SIZE]
+        assert [record.size for record in after] == [ALLOCATION_SIZE]
+        assert not broker.is_active
@@ -1,7 +1,9 @@
 import collections
 import datetime
 import mmap
+import os
 import signal
+import stat
 import subprocess
 import sys
 import textwrap
@@ -12,6 +14,7 @@ from pathlib import Path
 import pytest
 
 from memray import AllocatorType
+from memray import FileDestination
 from memray import FileFormat
 from memray import FileReader
 from memray import Tracker
@@ -353,6 +356,249 @@ def test_unsupported_operations_on_aggregated_capture(tmpdir):
     ):
         compute_statistics(str(output))
 
+    with pytest.raises(
+        NotImplementedError,
+        match="Can't compute statistics using a pre-aggregated capture file",
+    ):
+        FileReader(output, collect_statistics=True)
+
+
+def test_statistics_collected_while_reading(tmp_path):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    allocator = MemoryAllocator()
+
+    with Tracker(output):
+        allocator.valloc(1234)
+        allocator.valloc(4321)
+        allocator.free()
+        allocator.malloc(100)
+        allocator.free()
+
+    # WHEN
+    reader = FileReader(output, collect_statistics=True)
+    stats = reader.get_statistics()
+
+    # THEN
+    expected = compute_statistics(str(output))
+    assert stats.total_num_allocations == expected.total_num_allocations
+    assert stats.total_memory_allocated == expected.total_memory_allocated
+    assert stats.peak_memory_allocated == expected.peak_memory_allocated
+    assert stats.allocation_count_by_size == expected.allocation_count_by_size
+    assert stats.allocation_count_by_allocator == expected.allocation_count_by_allocator
+    assert stats.top_locations_by_size == expected.top_locations_by_size
+    assert stats.top_locations_by_count == expected.top_locations_by_count
+    assert reader.metadata.peak_memory == expected.peak_memory_allocated
+
+    hwm = filter_relevant_allocations(reader.get_high_watermark_allocation_records())
+    assert sum(record.size for record in hwm) == 1234 + 4321
+
+
+def test_reporters_share_one_snapshot(tmp_path):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    allocator = MemoryAllocator()
+    with Tracker(output):
+        allocator.valloc(1234)
+        allocator.valloc(4321)
+        allocator.free()
+
+    calls = []
+
+    def factory(allocations, **kwargs):
+        calls.append((allocations, kwargs))
+        return len(calls)
+
+    reader = FileReader(output)
+
+    # WHEN
+    reporters = reader.create_reporters([factory, factory], show_memory_leaks=True)
+
+    # THEN
+    assert reporters == [1, 2]
+    (first, first_kwargs), (second, second_kwargs) = calls
+    assert first is second
+    assert first_kwargs == second_kwargs
+    assert first_kwargs["native_traces"] is False
+    assert first_kwargs["inverted"] is False
+    assert first_kwargs["memory_records"] == tuple(reader.get_memory_snapshots())
+    leaks = filter_relevant_allocations(first)
+    assert [record.size for record in leaks] == [1234]
+
+
+def test_statistics_are_only_collected_on_request(tmp_path):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    with Tracker(output):
+        MemoryAllocator().valloc(1234)
+
+    # WHEN
+    reader = FileReader(output)
+
+    # THEN
+    with pytest.raises(ValueError, match="collect_statistics=True"):
+        reader.get_statistics()
+
+
+def _summarize(records):
+    return [
+        (
+            record.allocator,
+            record.size,
+            record.n_allocations,
+            record.stack_trace(),
+            record.native_stack_trace(),
+        )
+        for record in filter_relevant_allocations(records)
+    ]
+
+
+def test_index_gives_the_same_results_as_the_capture(tmp_path):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    allocator = MemoryAllocator()
+    with Tracker(output, native_traces=True):
+        allocator.valloc(1234)
+        allocator.valloc(4321)
+        allocator.free()
+    expected = FileReader(output)
+
+    # WHEN
+    FileReader(output, use_index=True)
+    index = tmp_path / "test.bin.idx"
+    index_stat = index.stat()
+    reader = FileReader(output, use_index=True)
+
+    # THEN
+    # The index was read rather than written again.
+    assert index.stat().st_ino == index_stat.st_ino
+    assert index.stat().st_mtime_ns == index_stat.st_mtime_ns
+    assert _summarize(reader.get_high_watermark_allocation_records()) == _summarize(
+        expected.get_high_watermark_allocation_records()
+    )
+    assert _summarize(reader.get_leaked_allocation_records()) == _summarize(
+        expected.get_leaked_allocation_records()
+    )
+    assert list(reader.get_memory_snapshots()) == list(expected.get_memory_snapshots())
+    assert reader.metadata == expected.metadata
+
+    # The operations that need every allocation still read the capture.
+    temporary = filter_relevant_allocations(reader.get_temporary_allocation_records())
+    assert [record.size for record in temporary] == [4321]
+
+
+def test_index_is_rebuilt_when_the_capture_changes(tmp_path):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    allocator = MemoryAllocator()
+    with Tracker(output):
+        allocator.valloc(1234)
+    FileReader(output, use_index=True)
+    index = tmp_path / "test.bin.idx"
+    index_stat = index.stat()
+
+    # WHEN
+    output.unlink()
+    with Tracker(output):
+        allocator.valloc(4321)
+    reader = FileReader(output, use_index=True)
+
+    # THEN
+    assert index.stat().st_ino != index_stat.st_ino
+    hwm = filter_relevant_allocations(reader.get_high_watermark_allocation_records())
+    assert [record.size for record in hwm] == [4321]
+
+
+def test_index_is_ignored_when_it_is_not_valid(tmp_path):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    with Tracker(output):
+        MemoryAllocator().valloc(1234)
+    index = tmp_path / "test.bin.idx"
+    index.write_bytes(b"not an index")
+
+    # WHEN
+    reader = FileReader(output, use_index=True)
+
+    # THEN
+    hwm = filter_relevant_allocations(reader.get_high_watermark_allocation_records())
+    assert [record.size for record in hwm] == [1234]
+    # A file that isn't a memray index is never overwritten.
+    assert index.read_bytes() == b"not an index"
+
+
+def test_index_that_is_out_of_date_is_replaced(tmp_path):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    with Tracker(output):
+        MemoryAllocator().valloc(1234)
+    index = tmp_path / "test.bin.idx"
+    with Tracker(destination=FileDestination(index, compress_on_exit=False)):
+        MemoryAllocator().valloc(4321)
+
+    # WHEN
+    FileReader(output, use_index=True)
+
+    # THEN
+    index_reader = FileReader(index)
+    hwm = filter_relevant_allocations(
+        index_reader.get_high_watermark_allocation_records()
+    )
+    assert [record.size for record in hwm] == [1234]
+
+
+def test_index_is_written_through_a_temporary_file_of_its_own(tmp_path):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    with Tracker(output):
+        MemoryAllocator().valloc(1234)
+    unrelated = tmp_path / "test.bin.idx.tmp"
+    unrelated.write_bytes(b"not ours")
+
+    # WHEN
+    FileReader(output, use_index=True)
+
+    # THEN
+    assert (tmp_path / "test.bin.idx").exists()
+    assert unrelated.read_bytes() == b"not ours"
+    assert sorted(path.name for path in tmp_path.iterdir()) == [
+        "test.bin",
+        "test.bin.idx",
+        "test.bin.idx.tmp",
+    ]
+
+
+def test_index_gets_the_permissions_of_a_new_file(tmp_path):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    with Tracker(output):
+        MemoryAllocator().valloc(1234)
+    umask = os.umask(0o022)
+
+    # WHEN
+    try:
+        FileReader(output, use_index=True)
+    finally:
+        os.umask(umask)
+
+    # THEN
+    index = tmp_path / "test.bin.idx"
+    assert stat.S_IMODE(index.stat().st_mode) == 0o644
+
+
+def test_index_is_only_used_on_request(tmp_path):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    with Tracker(output):
+        MemoryAllocator().valloc(1234)
+
+    # WHEN
+    FileReader(output)
+    FileReader(output, use_index=True, collect_statistics=True)
+
+    # THEN
+    assert not (tmp_path / "test.bin.idx").exists()
+
 
 @pytest.mark.parametrize(
     "file_format",
@@ -1324,6 +1570,34 @@ class TestTemporaryAllocations:
         (allocation,) = temporary_allocations
         assert allocation.n_allocations == buffer_size
 
+    @pytest.mark.parametrize("buffer_size", [1, 2, 5, 10])
+    def test_temporary_allocations_freed_oldest_first_are_detected(
+        self, tmp_path, buffer_size
+    ):
+        # GIVEN
+        allocators = [MemoryAllocator() for _ in range(buffer_size)]
+        output = tmp_path / "test.bin"
+
+        # WHEN
+        with Tracker(output):
+            for _ in range(3):
+                for allocator in allocators:
+                    allocator.valloc(1024)
+                for allocator in allocators:
+                    allocator.free()
+
+        # THEN
+        temporary_allocations = list(
+            filter_relevant_allocations(
+                FileReader(output).get_temporary_allocation_records(
+                    threshold=buffer_size - 1
+                )
+            )
+        )
+        assert sum(record.n_allocations for record in temporary_allocations) == (
+            3 * buffer_size
+        )
+
     def test_temporary_allocations_that_happen_in_different_lines(self, tmp_path):
         # GIVEN
         allocator1 = MemoryAllocator()
@@ -1378,6 +1652,36 @@ class TestTemporaryAllocations:
         assert allocation.size == 1024 * 10
         assert allocation.n_allocations == 10
 
+    def test_repeated_temporary_allocations_are_expanded_from_runs(self, tmp_path):
+        # GIVEN
+        allocator = MemoryAllocator()
+        output = tmp_path / "test.bin"
+
+        # WHEN
+        with Tracker(output):
+            for _ in range(100):
+                allocator.valloc(1024)
+                allocator.free()
+
+        # THEN
+        reader = FileReader(output)
+        all_allocations = list(
+            filter_relevant_allocations(reader.get_allocation_records())
+        )
+        assert [record.allocator for record in all_allocations] == [
+            AllocatorType.VALLOC,
+            AllocatorType.FREE,
+        ] * 100
+        assert all(record.size == 1024 for record in all_allocations[::2])
+
+        temporary_allocations = list(
+            filter_relevant_allocations(reader.get_temporary_allocation_records())
+        )
+        assert len(temporary_allocations) == 1
+        (allocation,) = temporary_allocations
+        assert allocation.size == 1024 * 100
+        assert allocation.n_allocations == 100
+
     def test_unmatched_allocations_are_not_reported(self, tmp_path):
         # GIVEN
         allocator = MemoryAllocator()
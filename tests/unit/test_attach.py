@@ -1,3 +1,4 @@
+from unittest.mock import MagicMock
 from unittest.mock import patch
 
 import pytest
@@ -7,7 +8,7 @@ from memray.commands import main
 
 @patch("memray.commands.attach.debugger_available")
 class TestAttachSubCommand:
-    def test_memray_attach_aggregated_without_output_file(
+    def test_memray_attach_shared_memory_transport_with_output_file(
         self, is_debugger_available_mock, capsys
     ):
         # GIVEN
@@ -15,8 +16,33 @@ class TestAttachSubCommand:
 
         # WHEN
         with pytest.raises(SystemExit):
-            main(["attach", "--aggregate", "1234"])
+            main(["attach", "--live-transport", "shm", "-o", "out.bin", "1234"])
 
         captured = capsys.readouterr()
-        print("Error", captured.err)
-        assert "Can't use aggregated mode without an output file." in captured.err
+        assert "--live-transport cannot be used with an output file" in captured.err
+
+
+@patch("memray.commands.attach.inject")
+@patch("memray.commands.attach.debugger_available")
+class TestDetachSubCommand:
+    def test_memray_detach_deactivates_the_tracker(
+        self, is_debugger_available_mock, inject_mock
+    ):
+        # GIVEN
+        is_debugger_available_mock.return_value = True
+        inject_mock.return_value = None
+        client = MagicMock()
+        client.recv.return_value = b""
+
+        # WHEN
+        with patch("socket.socket") as socket_mock:
+            socket_mock.return_value.getsockname.return_value = ("localhost", 1234)
+            socket_mock.return_value.accept.return_value = (client, None)
+            ret = main(["detach", "--method", "gdb", "1234"])
+
+        # THEN
+        assert ret == 0
+        inject_mock.assert_called_once_with("gdb", 1234, 1234, verbose=False)
+        (payload,), _ = client.sendall.call_args
+        assert b"DEACTIVATE" in payload
+        client.shutdown.assert_called_once()
@@ -6,10 +6,12 @@ from unittest.mock import patch
 import pytest
 
 from memray import FileDestination
+from memray import FileFormat
 from memray import SocketDestination
 from memray.commands import main
 from memray.commands.flamegraph import FlamegraphCommand
 from memray.commands.run import RunCommand
+from memray.commands.run import _child_process
 from memray.commands.stats import StatsCommand
 from memray.commands.summary import SummaryCommand
 from memray.commands.table import TableCommand
@@ -169,7 +171,7 @@ class TestRunSubCommand:
                 "-c",
                 "from memray.commands.run import _child_process;"
                 "_child_process(1234,False,False,False,False,False,"
-                "'./directory/foobar.py',['arg1', 'arg2'])",
+                "'./directory/foobar.py',['arg1', 'arg2'],'block',None,False,None)",
             ],
             stderr=-1,
             stdout=-3,
@@ -210,7 +212,7 @@ class TestRunSubCommand:
                 "-c",
                 "from memray.commands.run import _child_process;"
                 "_child_process(1234,False,True,False,False,False,"
-                "'./directory/foobar.py',['arg1', 'arg2'])",
+                "'./directory/foobar.py',['arg1', 'arg2'],'block',None,False,None)",
             ],
             stderr=-1,
             stdout=-3,
@@ -221,6 +223,86 @@ class TestRunSubCommand:
             cmdline_override="./directory/foobar.py arg1 arg2",
         )
 
+    @patch("memray.commands.run.subprocess.Popen")
+    @patch("memray.commands.run.LiveCommand")
+    def test_run_with_live_and_aggregate(
+        self,
+        live_command_mock,
+        popen_mock,
+        getpid_mock,
+        runpy_mock,
+        tracker_mock,
+        validate_mock,
+    ):
+        getpid_mock.return_value = 0
+        popen_mock().__enter__().returncode = 0
+        with patch("memray.commands.run._get_free_port", return_value=1234):
+            assert 0 == main(["run", "--live", "--aggregate", "./directory/foobar.py"])
+        popen_mock.assert_called_with(
+            [
+                sys.executable,
+                "-c",
+                "from memray.commands.run import _child_process;"
+                "_child_process(1234,False,False,False,False,False,"
+                "'./directory/foobar.py',[],'block',None,True,None)",
+            ],
+            stderr=-1,
+            stdout=-3,
+            text=True,
+        )
+
+    @patch("memray.commands.run.subprocess.Popen")
+    @patch("memray.commands.run.LiveCommand")
+    @patch("memray.commands.run.SharedMemoryReader")
+    def test_run_with_live_and_shared_memory_transport(
+        self,
+        reader_mock,
+        live_command_mock,
+        popen_mock,
+        getpid_mock,
+        runpy_mock,
+        tracker_mock,
+        validate_mock,
+    ):
+        getpid_mock.return_value = 0
+        popen_mock().__enter__().returncode = 0
+        reader_mock.return_value.path = "/proc/1/fd/3"
+        assert 0 == main(
+            ["run", "--live", "--live-transport=shm", "./directory/foobar.py"]
+        )
+        popen_mock.assert_called_with(
+            [
+                sys.executable,
+                "-c",
+                "from memray.commands.run import _child_process;"
+                "_child_process(0,False,False,False,False,False,"
+                "'./directory/foobar.py',[],'block','/proc/1/fd/3',False,None)",
+            ],
+            stderr=-1,
+            stdout=-3,
+            text=True,
+        )
+        live_command_mock().run_live_interface.assert_called_with(
+            reader_mock.return_value,
+            cmdline_override=" ".join(sys.argv),
+        )
+
+    def test_run_with_live_remote_and_shared_memory_transport(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock, capsys
+    ):
+        with pytest.raises(SystemExit):
+            main(
+                [
+                    "run",
+                    "--live-remote",
+                    "--live-transport=shm",
+                    "./directory/foobar.py",
+                ]
+            )
+
+        captured = capsys.readouterr()
+        assert "--live-transport requires --live" in captured.err
+
     def test_run_with_live_remote(
         self, getpid_mock, runpy_mock, tracker_mock, validate_mock
     ):
@@ -238,6 +320,20 @@ class TestRunSubCommand:
             native_traces=False,
         )
 
+    def test_run_with_live_remote_and_aggregate(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock
+    ):
+        getpid_mock.return_value = 0
+        with patch("memray.commands.run._get_free_port", return_value=1234):
+            assert 0 == main(
+                ["run", "--live-remote", "--aggregate", "./directory/foobar.py"]
+            )
+        tracker_mock.assert_called_with(
+            destination=SocketDestination(server_port=1234, address="127.0.0.1"),
+            native_traces=False,
+            file_format=FileFormat.AGGREGATED_ALLOCATIONS,
+        )
+
     def test_run_with_live_remote_and_live_port(
         self, getpid_mock, runpy_mock, tracker_mock, validate_mock
     ):
@@ -261,6 +357,38 @@ class TestRunSubCommand:
             native_traces=False,
         )
 
+    def test_run_with_live_remote_and_live_backpressure(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock
+    ):
+        getpid_mock.return_value = 0
+        with patch("memray.commands.run._get_free_port", return_value=1234):
+            assert 0 == main(
+                [
+                    "run",
+                    "--live-remote",
+                    "--live-backpressure=drop",
+                    "./directory/foobar.py",
+                ]
+            )
+        tracker_mock.assert_called_with(
+            destination=SocketDestination(
+                server_port=1234, address="127.0.0.1", backpressure="drop"
+            ),
+            native_traces=False,
+        )
+
+    def test_run_with_live_backpressure_but_not_live(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock, capsys
+    ):
+        with pytest.raises(SystemExit):
+            main(["run", "--live-backpressure", "drop", "./directory/foobar.py"])
+
+        captured = capsys.readouterr()
+        assert (
+            "--live-backpressure requires --live, --live-remote or --live-broker"
+            in captured.err
+        )
+
     def test_run_with_live_port_but_not_live_remote(
         self, getpid_mock, runpy_mock, tracker_mock, validate_mock, capsys
     ):
@@ -288,14 +416,84 @@ class TestRunSubCommand:
             follow_fork=True,
         )
 
+    @patch("memray.commands.run.subprocess.Popen")
+    @patch("memray.commands.run.LiveCommand")
+    @patch("memray.commands.run.SocketReader")
+    @patch("memray.commands.run.ProcessGroupReader")
     def test_run_with_follow_fork_and_live_mode(
+        self,
+        group_reader_mock,
+        socket_reader_mock,
+        live_command_mock,
+        popen_mock,
+        getpid_mock,
+        runpy_mock,
+        tracker_mock,
+        validate_mock,
+    ):
+        getpid_mock.return_value = 0
+        popen_mock().__enter__().returncode = 0
+        group_reader_mock.return_value.children_port = 4321
+        with patch("memray.commands.run._get_free_port", return_value=1234):
+            assert 0 == main(
+                ["run", "--live", "--follow-fork", "./directory/foobar.py"]
+            )
+        socket_reader_mock.assert_called_with(port=1234)
+        group_reader_mock.assert_called_with(socket_reader_mock.return_value)
+        popen_mock.assert_called_with(
+            [
+                sys.executable,
+                "-c",
+                "from memray.commands.run import _child_process;"
+                "_child_process(1234,False,False,False,False,False,"
+                "'./directory/foobar.py',[],'block',None,False,4321)",
+            ],
+            stderr=-1,
+            stdout=-3,
+            text=True,
+        )
+        live_command_mock().run_live_interface.assert_called_with(
+            group_reader_mock.return_value,
+            cmdline_override=" ".join(sys.argv),
+        )
+
+    def test_live_child_process_with_children_port_follows_forks(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock
+    ):
+        getpid_mock.return_value = 0
+        _child_process(
+            1234,
+            False,
+            False,
+            False,
+            False,
+            True,
+            "./directory/foobar.py",
+            [],
+            children_port=4321,
+        )
+        tracker_mock.assert_called_with(
+            destination=SocketDestination(server_port=1234, children_port=4321),
+            native_traces=False,
+            follow_fork=True,
+        )
+
+    def test_run_with_follow_fork_and_live_shared_memory_transport(
         self, getpid_mock, runpy_mock, tracker_mock, validate_mock, capsys
     ):
         with pytest.raises(SystemExit):
-            main(["run", "--live", "--follow-fork", "./directory/foobar.py"])
+            main(
+                [
+                    "run",
+                    "--live",
+                    "--live-transport=shm",
+                    "--follow-fork",
+                    "./directory/foobar.py",
+                ]
+            )
 
         captured = capsys.readouterr()
-        assert "--follow-fork cannot be used with" in captured.err
+        assert "--follow-fork cannot be used with --live-transport shm" in captured.err
 
     def test_run_with_follow_fork_and_live_remote_mode(
         self, getpid_mock, runpy_mock, tracker_mock, validate_mock, capsys
@@ -306,6 +504,72 @@ class TestRunSubCommand:
         captured = capsys.readouterr()
         assert "--follow-fork cannot be used with" in captured.err
 
+    @patch("memray.commands.run.subprocess.Popen")
+    @patch("memray.commands.run.LiveBroker")
+    @patch("memray.commands.run.SocketReader")
+    def test_run_with_live_broker(
+        self,
+        reader_mock,
+        broker_mock,
+        popen_mock,
+        getpid_mock,
+        runpy_mock,
+        tracker_mock,
+        validate_mock,
+        capsys,
+    ):
+        getpid_mock.return_value = 0
+        popen_mock().__enter__().returncode = 0
+        broker_mock().__enter__().port = 4321
+        broker_mock().__enter__().is_active = False
+        with patch("memray.commands.run._get_free_port", return_value=1234):
+            assert 0 == main(
+                ["run", "--live-broker", "./directory/foobar.py", "arg1", "arg2"]
+            )
+        popen_mock.assert_called_with(
+            [
+                sys.executable,
+                "-c",
+                "from memray.commands.run import _child_process;"
+                "_child_process(1234,False,False,False,False,False,"
+                "'./directory/foobar.py',['arg1', 'arg2'],'block',None,False,None)",
+            ]
+        )
+        reader_mock.assert_called_with(port=1234)
+        broker_mock.assert_called_with(reader_mock.return_value, port=0)
+        assert "live 4321'" in capsys.readouterr().out
+
+    @patch("memray.commands.run.subprocess.Popen")
+    @patch("memray.commands.run.LiveBroker")
+    @patch("memray.commands.run.SocketReader")
+    def test_run_with_live_broker_and_live_port(
+        self,
+        reader_mock,
+        broker_mock,
+        popen_mock,
+        getpid_mock,
+        runpy_mock,
+        tracker_mock,
+        validate_mock,
+    ):
+        getpid_mock.return_value = 0
+        popen_mock().__enter__().returncode = 0
+        broker_mock().__enter__().is_active = False
+        with patch("memray.commands.run._get_free_port", return_value=1234):
+            assert 0 == main(
+                ["run", "--live-broker", "--live-port=1111", "./directory/foobar.py"]
+            )
+        broker_mock.assert_called_with(reader_mock.return_value, port=1111)
+
+    def test_run_with_follow_fork_and_live_broker_mode(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock, capsys
+    ):
+        with pytest.raises(SystemExit):
+            main(["run", "--live-broker", "--follow-fork", "./directory/foobar.py"])
+
+        captured = capsys.readouterr()
+        assert "--follow-fork cannot be used with --live-broker" in captured.err
+
     def test_run_with_trace_python_allocators_and_live_remote_mode(
         self, getpid_mock, runpy_mock, tracker_mock, validate_mock, capsys
     ):
@@ -331,6 +595,107 @@ class TestRunSubCommand:
             trace_python_allocators=True,
         )
 
+    def test_run_with_zstd_compression(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock
+    ):
+        getpid_mock.return_value = 0
+        assert 0 == main(["run", "--compression=zstd:3", "-m", "foobar"])
+        tracker_mock.assert_called_with(
+            destination=FileDestination(
+                "memray-foobar.0.bin", overwrite=False, compression="zstd:3"
+            ),
+            native_traces=False,
+        )
+
+    def test_run_with_compression_dictionary(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock
+    ):
+        getpid_mock.return_value = 0
+        assert 0 == main(
+            [
+                "run",
+                "--compression=zstd",
+                "--compression-dictionary",
+                "memray.dict",
+                "-m",
+                "foobar",
+            ]
+        )
+        tracker_mock.assert_called_with(
+            destination=FileDestination(
+                "memray-foobar.0.bin",
+                overwrite=False,
+                compression="zstd",
+                compression_dictionary=str(Path("memray.dict").resolve()),
+            ),
+            native_traces=False,
+        )
+
+    @pytest.mark.parametrize("io_backend", ["mmap", "io_uring", "pwrite"])
+    def test_run_with_io_backend(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock, io_backend
+    ):
+        getpid_mock.return_value = 0
+        assert 0 == main(["run", "--io-backend", io_backend, "-m", "foobar"])
+        tracker_mock.assert_called_with(
+            destination=FileDestination(
+                "memray-foobar.0.bin", overwrite=False, io_backend=io_backend
+            ),
+            native_traces=False,
+        )
+
+    def test_run_with_invalid_io_backend(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock, capsys
+    ):
+        with pytest.raises(SystemExit):
+            main(["run", "--io-backend", "aio", "-m", "foobar"])
+
+        captured = capsys.readouterr()
+        assert "argument --io-backend: invalid choice: 'aio'" in captured.err
+
+    @pytest.mark.parametrize(
+        "spec, message",
+        [
+            ("gzip", "Unknown compression codec 'gzip'"),
+            ("zstd:fast", "Invalid compression level 'fast'"),
+            ("zstd:23", "must be between 1 and 22"),
+            ("lz4:13", "must be between 0 and 12"),
+        ],
+    )
+    def test_run_with_invalid_compression(
+        self,
+        getpid_mock,
+        runpy_mock,
+        tracker_mock,
+        validate_mock,
+        capsys,
+        spec,
+        message,
+    ):
+        with pytest.raises(SystemExit):
+            main(["run", f"--compression={spec}", "-m", "foobar"])
+
+        captured = capsys.readouterr()
+        assert message in captured.err
+
+    def test_run_with_compression_dictionary_and_lz4(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock, capsys
+    ):
+        with pytest.raises(SystemExit):
+            main(["run", "--compression-dictionary", "memray.dict", "-m", "foobar"])
+
+        captured = capsys.readouterr()
+        assert "--compression-dictionary requires --compression=zstd" in captured.err
+
+    def test_run_with_compression_and_no_compress(
+        self, getpid_mock, runpy_mock, tracker_mock, validate_mock, capsys
+    ):
+        with pytest.raises(SystemExit):
+            main(["run", "--no-compress", "--compression=zstd", "-m", "foobar"])
+
+        captured = capsys.readouterr()
+        assert "--no-compress cannot be used with --compression" in captured.err
+
 
 class TestFlamegraphSubCommand:
     @staticmethod
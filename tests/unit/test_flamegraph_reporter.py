@@ -1,11 +1,19 @@
+import base64
+import json
 import sys
 
+import pytest
+
 from memray import AllocatorType
 from memray import FileReader
 from memray import Tracker
+from memray._memray import build_flame_graph_data
+from memray._memray import encode_compact_column
 from memray._test import MemoryAllocator
 from memray.reporters.flamegraph import MAX_STACKS
 from memray.reporters.flamegraph import FlameGraphReporter
+from memray.reporters.flamegraph import compact_payload
+from memray.reporters.flamegraph import describe_frame
 from tests.utils import MockAllocationRecord
 from tests.utils import filter_relevant_allocations
 
@@ -47,6 +55,21 @@ def packed_data_to_tree(packed_data):
     return root
 
 
+def decode_compact_column(encoded):
+    """Python implementation of decodeCompactColumn in flamegraph_common.js"""
+    values = []
+    value = shift = delta = 0
+    for byte in base64.b64decode(encoded):
+        delta |= (byte & 0x7F) << shift
+        shift += 7
+        if byte & 0x80:
+            continue
+        value += (delta >> 1) ^ -(delta & 1)
+        values.append(value)
+        shift = delta = 0
+    return values
+
+
 def get_packed_trees(packed_data):
     strings, nodes, inverted_no_imports_nodes, unique_threads = (
         packed_data["strings"],
@@ -539,6 +562,161 @@ class TestFlameGraphReporter:
         assert len(child["children"]) == 1
         assert child["children"][0]["name"] == "            allocator.valloc(4096)\n"
 
+    @pytest.mark.parametrize("native_traces", [False, True])
+    @pytest.mark.parametrize("inverted", [False, True])
+    def test_real_allocations_give_the_same_trees_as_their_stacks(
+        self, tmp_path, native_traces, inverted
+    ):
+        # GIVEN
+        allocator = MemoryAllocator()
+        output = tmp_path / "test.bin"
+
+        def recurse(depth):
+            if depth:
+                recurse(depth - 1)
+            else:
+                allocator.valloc(1024)
+
+        with Tracker(output, native_traces=native_traces):
+            for depth in range(5):
+                recurse(depth)
+            allocator.valloc(4096)
+
+        records = list(FileReader(output).get_high_watermark_allocation_records())
+        mock_records = [
+            MockAllocationRecord(
+                tid=record.tid,
+                address=record.address,
+                size=record.size,
+                allocator=record.allocator,
+                stack_id=record.stack_id,
+                n_allocations=record.n_allocations,
+                _stack=record.stack_trace(),
+                _hybrid_stack=(record.hybrid_stack_trace() if native_traces else None),
+            )
+            for record in records
+        ]
+
+        # WHEN
+        reporter = FlameGraphReporter.from_snapshot(
+            records, memory_records=[], native_traces=native_traces, inverted=inverted
+        )
+        mock_reporter = FlameGraphReporter.from_snapshot(
+            mock_records,
+            memory_records=[],
+            native_traces=native_traces,
+            inverted=inverted,
+        )
+
+        # THEN
+        assert get_packed_trees(reporter.data) == get_packed_trees(mock_reporter.data)
+
+    def test_pruning_folds_small_children_into_other_frames(self):
+        # GIVEN
+        peak_allocations = [
+            MockAllocationRecord(
+                tid=1,
+                address=0x1000000,
+                size=size,
+                allocator=AllocatorType.MALLOC,
+                stack_id=1,
+                n_allocations=1,
+                _stack=[(function, "fun.py", lineno), ("parent", "fun.py", 1)],
+            )
+            for function, lineno, size in [
+                ("big", 10, 1000),
+                ("small", 20, 5),
+                ("tiny", 30, 3),
+            ]
+        ]
+
+        # WHEN
+        reporter = FlameGraphReporter.from_snapshot(
+            peak_allocations,
+            memory_records=[],
+            native_traces=False,
+            prune_fraction=0.01,
+        )
+        tree, _ = get_packed_trees(reporter.data)
+
+        # THEN
+        assert tree["value"] == 1008
+        (parent,) = tree["children"]
+        assert parent["value"] == 1008
+        assert [
+            (child["name"], child["location"], child["value"], child["n_allocations"])
+            for child in parent["children"]
+        ] == [
+            ("big at fun.py:10", ["big", "fun.py", 10], 1000, 1),
+            ("<OTHER FRAMES>", ["...", "...", 0], 8, 2),
+        ]
+
+    def test_pruning_is_not_supported_for_temporal_flame_graphs(self):
+        with pytest.raises(ValueError, match="Temporal flame graphs can't be pruned"):
+            build_flame_graph_data(
+                [],
+                native_traces=False,
+                temporal=True,
+                inverted=False,
+                max_stacks=MAX_STACKS,
+                describe_frame=describe_frame,
+                prune_fraction=0.01,
+            )
+
+    @pytest.mark.parametrize(
+        "values",
+        [
+            [],
+            [0],
+            [1, 2, 3],
+            [5, 3, 0, 2**40, -7],
+            [2**50, 0, 2**50],
+            list(range(1000, 0, -3)),
+        ],
+    )
+    def test_compact_columns_round_trip(self, values):
+        encoded = encode_compact_column(values)
+        assert decode_compact_column(encoded) == values
+
+    def test_compact_payload_holds_the_same_data(self):
+        # GIVEN
+        peak_allocations = [
+            MockAllocationRecord(
+                tid=tid,
+                address=0x1000000,
+                size=1024,
+                allocator=AllocatorType.MALLOC,
+                stack_id=1,
+                n_allocations=1,
+                _stack=[("me", "fun.py", 12), ("parent", "fun.py", 8)],
+            )
+            for tid in (1, 2)
+        ]
+        reporter = FlameGraphReporter.from_snapshot(
+            peak_allocations, memory_records=[], native_traces=False, inverted=True
+        )
+
+        # WHEN
+        payload = json.loads("".join(compact_payload(reporter.data)))
+
+        # THEN
+        for key in ("nodes", "inverted_no_imports_nodes"):
+            nodes = {
+                column: decode_compact_column(encoded)
+                for column, encoded in payload.pop(key).items()
+            }
+            children = iter(nodes.pop("children"))
+            nodes["children"] = [
+                [next(children) for _ in range(count)]
+                for count in nodes.pop("children_count")
+            ]
+            assert nodes == reporter.data[key]
+        assert payload == {
+            key: json.loads(json.dumps(value))
+            for key, value in reporter.data.items()
+            if key not in ("nodes", "inverted_no_imports_nodes")
+        }
+
     def test_works_with_multiple_stacks_from_same_caller_two_frames_above(self):
         # GIVEN
         peak_allocations = [
@@ -0,0 +1,198 @@
+import random
+
+import pytest
+
+from memray import AllocatorType
+from memray._memray import IncrementalSnapshotAggregatorTestHarness
+
+MALLOC = AllocatorType.MALLOC
+FREE = AllocatorType.FREE
+MMAP = AllocatorType.MMAP
+MUNMAP = AllocatorType.MUNMAP
+
+
+def totals(records, merge_threads=False):
+    """Map each location in a list of snapshot records to its (size, count)."""
+    return {
+        (
+            0 if merge_threads else record[0],
+            record[4],
+            record[6],
+        ): (record[2], record[5])
+        for record in records
+    }
+
+
+def test_no_allocations_at_start():
+    # GIVEN
+    tester = IncrementalSnapshotAggregatorTestHarness()
+
+    # WHEN
+    # THEN
+    assert tester.get_snapshot(merge_threads=False) == []
+    assert tester.take_changes(merge_threads=False) == ([], [])
+
+
+def test_totals_follow_allocations_and_frees():
+    # GIVEN
+    tester = IncrementalSnapshotAggregatorTestHarness()
+
+    # WHEN
+    tester.add_allocation(1, 4096, 100, MALLOC, 0, 5)
+    tester.add_allocation(1, 8192, 200, MALLOC, 0, 5)
+    tester.add_allocation(1, 12288, 300, MALLOC, 0, 6)
+    tester.add_allocation(1, 4096, 0, FREE, 0, 0)
+
+    # THEN
+    assert totals(tester.get_snapshot(merge_threads=False)) == {
+        (1, 5, 0): (200, 1),
+        (1, 6, 0): (300, 1),
+    }
+
+
+def test_location_without_allocations_is_removed():
+    # GIVEN
+    tester = IncrementalSnapshotAggregatorTestHarness()
+    tester.add_allocation(1, 4096, 100, MALLOC, 0, 5)
+    tester.take_changes(merge_threads=False)
+
+    # WHEN
+    tester.add_allocation(1, 4096, 0, FREE, 0, 0)
+
+    # THEN
+    assert tester.get_snapshot(merge_threads=False) == []
+    assert tester.take_changes(merge_threads=False) == ([], [(1, 5, 0)])
+
+
+def test_changes_only_include_locations_changed_since_last_call():
+    # GIVEN
+    tester = IncrementalSnapshotAggregatorTestHarness()
+    for frame_index in range(100):
+        tester.add_allocation(1, 4096 * (frame_index + 1), 10, MALLOC, 0, frame_index)
+    updated, removed = tester.take_changes(merge_threads=False)
+    assert len(updated) == 100
+    assert removed == []
+
+    # WHEN
+    tester.add_allocation(1, 4096 * 1000, 20, MALLOC, 0, 42)
+    tester.add_allocation(1, 4096, 0, FREE, 0, 0)
+
+    # THEN
+    updated, removed = tester.take_changes(merge_threads=False)
+    assert totals(updated) == {(1, 42, 0): (30, 2)}
+    assert removed == [(1, 0, 0)]
+    assert tester.take_changes(merge_threads=False) == ([], [])
+
+
+def test_changes_are_tracked_separately_for_each_view():
+    # GIVEN
+    tester = IncrementalSnapshotAggregatorTestHarness()
+    tester.add_allocation(1, 4096, 100, MALLOC, 0, 5)
+    tester.add_allocation(2, 8192, 100, MALLOC, 0, 5)
+
+    # WHEN
+    per_thread, _ = tester.take_changes(merge_threads=False)
+    merged, _ = tester.take_changes(merge_threads=True)
+
+    # THEN
+    assert totals(per_thread) == {(1, 5, 0): (100, 1), (2, 5, 0): (100, 1)}
+    assert totals(merged, merge_threads=True) == {(0, 5, 0): (200, 2)}
+
+
+def test_reallocated_address_replaces_previous_allocation():
+    # GIVEN
+    tester = IncrementalSnapshotAggregatorTestHarness()
+
+    # WHEN
+    tester.add_allocation(1, 4096, 100, MALLOC, 0, 5)
+    tester.add_allocation(1, 4096, 300, MALLOC, 0, 6)
+
+    # THEN
+    assert totals(tester.get_snapshot(merge_threads=False)) == {(1, 6, 0): (300, 1)}
+
+
+def test_summarized_allocations_are_counted():
+    # GIVEN
+    tester = IncrementalSnapshotAggregatorTestHarness()
+
+    # WHEN
+    tester.add_allocation(1, 0, 1000, MALLOC, 0, 5, n_allocations=10)
+    tester.add_allocation(1, 0, 500, MALLOC, 0, 5, n_allocations=5)
+
+    # THEN
+    assert totals(tester.get_snapshot(merge_threads=False)) == {(1, 5, 0): (1500, 15)}
+
+
+def test_negative_summarized_deltas_free_summarized_allocations():
+    # GIVEN
+    tester = IncrementalSnapshotAggregatorTestHarness()
+    tester.add_allocation(1, 0, 1000, MALLOC, 0, 5, n_allocations=10)
+
+    # WHEN
+    # Readers report negative deltas wrapped around.
+    tester.add_allocation(1, 0, 2**64 - 1000, MALLOC, 0, 5, n_allocations=2**64 - 10)
+
+    # THEN
+    assert tester.get_snapshot(merge_threads=False) == []
+    assert tester.get_reference_snapshot(merge_threads=False) == []
+
+
+def test_partially_unmapped_ranges():
+    # GIVEN
+    tester = IncrementalSnapshotAggregatorTestHarness()
+    tester.add_allocation(1, 4096, 4096 * 4, MMAP, 0, 5)
+
+    # WHEN
+    tester.add_allocation(1, 4096 * 2, 4096, MUNMAP, 0, 0)
+
+    # THEN
+    assert totals(tester.get_snapshot(merge_threads=False)) == {
+        (1, 5, 0): (4096 * 3, 2)
+    }
+
+    # WHEN
+    tester.add_allocation(1, 4096, 4096 * 4, MUNMAP, 0, 0)
+
+    # THEN
+    assert tester.get_snapshot(merge_threads=False) == []
+
+
+@pytest.mark.parametrize("merge_threads", [False, True])
+@pytest.mark.parametrize("seed", range(5))
+def test_matches_snapshot_computed_from_scratch(merge_threads, seed):
+    # GIVEN
+    rng = random.Random(seed)
+    tester = IncrementalSnapshotAggregatorTestHarness()
+    live = []
+    mapped = []
+
+    # WHEN
+    for _ in range(2000):
+        action = rng.random()
+        tid = rng.randint(1, 3)
+        frame_index = rng.randint(1, 20)
+        native_frame_id = rng.randint(0, 3)
+        if action < 0.45 or not live:
+            address = rng.randrange(1, 500) * 16
+            tester.add_allocation(
+                tid, address, rng.randint(1, 100), MALLOC, native_frame_id, frame_index
+            )
+            live.append(address)
+        elif action < 0.8:
+            address = live.pop(rng.randrange(len(live)))
+            tester.add_allocation(tid, address, 0, FREE, 0, 0)
+        elif action < 0.9 or not mapped:
+            start = rng.randrange(1, 100) * 4096
+            pages = rng.randint(1, 8)
+            tester.add_allocation(
+                tid, start, pages * 4096, MMAP, native_frame_id, frame_index
+            )
+            mapped.append(start)
+        else:
+            start = rng.choice(mapped) + rng.randint(0, 4) * 4096
+            tester.add_allocation(tid, start, rng.randint(1, 4) * 4096, MUNMAP, 0, 0)
+
+    # THEN
+    assert totals(tester.get_snapshot(merge_threads), merge_threads) == totals(
+        tester.get_reference_snapshot(merge_threads), merge_threads
+    )
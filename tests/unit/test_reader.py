@@ -1,11 +1,14 @@
 import os
+import sys
 
 import pytest
 
 from memray import FileDestination
+from memray import FileFormat
 from memray import FileReader
 from memray import Tracker
 from memray._test import MemoryAllocator
+from tests.utils import filter_relevant_allocations
 
 
 def test_rejects_different_header_magic(tmp_path):
@@ -79,3 +82,32 @@ def test_read_pid(tmp_path):
 
     # THEN
     assert FileReader(output).metadata.pid == os.getpid()
+
+
+@pytest.mark.parametrize("frame_id", [2**64 - 1, 2**40])
+def test_rejects_frame_ids_far_past_the_ones_seen(tmp_path, frame_id):
+    # GIVEN
+    output = tmp_path / "test.bin"
+    allocator = MemoryAllocator()
+
+    def function_with_a_corrupted_frame():
+        allocator.valloc(1024)
+
+    destination = FileDestination(output, compress_on_exit=False)
+    with Tracker(
+        destination=destination, file_format=FileFormat.AGGREGATED_ALLOCATIONS
+    ):
+        function_with_a_corrupted_frame()
+
+    # WHEN
+    # A frame's id is written just before the name of its function
+    data = output.read_bytes()
+    offset = data.index(b"function_with_a_corrupted_frame\0")
+    output.write_bytes(
+        data[: offset - 8] + frame_id.to_bytes(8, sys.byteorder) + data[offset:]
+    )
+
+    # THEN
+    # Reading stops at the corrupted frame, which comes before any allocation
+    records = FileReader(output).get_high_watermark_allocation_records()
+    assert list(filter_relevant_allocations(records)) == []
@@ -23,6 +23,7 @@ from textual.widgets import Label
 import memray.reporters.tui
 from memray import AllocationRecord
 from memray import AllocatorType
+from memray import ProcessGroupReader
 from memray.reporters.tui import Location
 from memray.reporters.tui import MemoryGraph
 from memray.reporters.tui import Snapshot
@@ -112,6 +113,37 @@ class MockReader:
         self.is_active = self._next_snapshot < len(self._snapshots)
         return snapshot
 
+    def get_current_snapshot_by_location(self, *, memory_ratio: float = 1.0):
+        records = list(self.get_current_snapshot(merge_threads=False))
+        heap_size = sum(record.size for record in records)
+        locations = [
+            (
+                location.function,
+                location.file,
+                entry.own_memory,
+                entry.total_memory,
+                entry.n_allocations,
+                tuple(entry.thread_ids),
+            )
+            for location, entry in aggregate_allocations(
+                records, memory_ratio * heap_size, self.has_native_traces
+            ).items()
+        ]
+        return records, locations
+
+
+class MockProcessGroupReader(ProcessGroupReader):
+    def __init__(self, readers: List[MockReader]):
+        self._mock_readers = readers
+
+    @property
+    def readers(self):
+        return list(self._mock_readers)
+
+    @property
+    def is_active(self):
+        return any(reader.is_active for reader in self._mock_readers)
+
 
 @pytest.fixture
 def compare(monkeypatch, tmp_path, snap_compare):
@@ -680,6 +712,37 @@ def test_switching_threads():
     assert threads == [f"Thread {i+1} of 3" for i in order]
 
 
+def test_switching_processes():
+    """Test that we can switch which process is displayed"""
+    # GIVEN
+    processes = MockProcessGroupReader(
+        [MockReader([], pid=100), MockReader([], pid=200), MockReader([], pid=300)]
+    )
+    snapshot = [mock_allocation(tid=1, stack=[("a", "a.py", 1)])]
+    app = MockApp(processes)
+    pids = []
+    selected = []
+
+    # WHEN
+    async def run_test():
+        async with app.run_test() as pilot:
+            app.add_mock_snapshot(snapshot)
+            await pilot.pause()
+
+            for key in ("", "n", "n", "n", "p"):
+                await pilot.press(key)
+                await pilot.pause()
+                pids.append(" ".join(extract_label_text(app)["pid"].split()))
+                selected.append(app._update_thread._reader.pid)
+
+    async_run(run_test())
+
+    # THEN
+    order = [0, 1, 2, 0, 2]
+    assert pids == [f"PID: {(i + 1) * 100} (process {i + 1} of 3)" for i in order]
+    assert selected == [(i + 1) * 100 for i in order]
+
+
 @pytest.mark.parametrize(
     "terminal_size, press, snapshots",
     [